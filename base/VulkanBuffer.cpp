@@ -22,6 +22,16 @@ namespace vks
 	*/
 	VkResult Buffer::map(VkDeviceSize size, VkDeviceSize offset)
 	{
+		// Sub-allocated host visible memory stays mapped by the allocator
+		if (allocation.block)
+		{
+			if (!allocation.mapped)
+			{
+				return VK_ERROR_MEMORY_MAP_FAILED;
+			}
+			mapped = static_cast<char*>(allocation.mapped) + offset;
+			return VK_SUCCESS;
+		}
 		return vkMapMemory(device, memory, offset, size, 0, &mapped);
 	}
 
@@ -34,7 +44,10 @@ namespace vks
 	{
 		if (mapped)
 		{
-			vkUnmapMemory(device, memory);
+			if (!allocation.block)
+			{
+				vkUnmapMemory(device, memory);
+			}
 			mapped = nullptr;
 		}
 	}
@@ -48,7 +61,7 @@ namespace vks
 	*/
 	VkResult Buffer::bind(VkDeviceSize offset)
 	{
-		return vkBindBufferMemory(device, buffer, memory, offset);
+		return vkBindBufferMemory(device, buffer, memory, allocation.offset + offset);
 	}
 
 	/**
@@ -95,6 +108,10 @@ namespace vks
 		mappedRange.memory = memory;
 		mappedRange.offset = offset;
 		mappedRange.size = size;
+		if (allocation.block)
+		{
+			mappedRange = allocation.allocator->getMappedRange(allocation, size, offset);
+		}
 		return vkFlushMappedMemoryRanges(device, 1, &mappedRange);
 	}
 
@@ -115,6 +132,10 @@ namespace vks
 		mappedRange.memory = memory;
 		mappedRange.offset = offset;
 		mappedRange.size = size;
+		if (allocation.block)
+		{
+			mappedRange = allocation.allocator->getMappedRange(allocation, size, offset);
+		}
 		return vkInvalidateMappedMemoryRanges(device, 1, &mappedRange);
 	}
 
@@ -127,7 +148,11 @@ namespace vks
 		{
 			vkDestroyBuffer(device, buffer, nullptr);
 		}
-		if (memory)
+		if (allocation.block)
+		{
+			allocation.allocator->free(&allocation);
+		}
+		else if (memory)
 		{
 			vkFreeMemory(device, memory, nullptr);
 		}
@@ -13,6 +13,7 @@
 #include <vector>
 
 #include "vulkan/vulkan.h"
+#include "VulkanMemoryAllocator.h"
 #include "VulkanTools.h"
 
 namespace vks
@@ -34,6 +35,8 @@ namespace vks
 		VkBufferUsageFlags usageFlags;
 		/** @brief Memory property flags to be filled by external source at buffer creation (to query at some later point) */
 		VkMemoryPropertyFlags memoryPropertyFlags;
+		/** @brief Range of a shared memory block if the buffer was created through the device's allocator, memory then is the block and bind, map and flush offset into it */
+		MemoryAllocation allocation;
 		VkResult map(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
 		void unmap();
 		VkResult bind(VkDeviceSize offset = 0);
@@ -10,6 +10,7 @@
 
 #include <VulkanDevice.h>
 #include <unordered_set>
+#include "trace.h"
 
 namespace vks
 {	
@@ -64,6 +65,7 @@ namespace vks
 		{
 			vkDestroyCommandPool(logicalDevice, commandPool, nullptr);
 		}
+		delete memoryAllocator;
 		if (logicalDevice)
 		{
 			vkDestroyDevice(logicalDevice, nullptr);
@@ -286,12 +288,38 @@ namespace vks
 
 		this->enabledFeatures = enabledFeatures;
 
+		// Check if the application enabled timeline semaphores, e.g. for the upload manager
+		// The feature structures are only valid if the device supports Vulkan 1.2, or for the extension's structure if the extension is enabled
+		const bool vulkan12 = properties.apiVersion >= VK_API_VERSION_1_2;
+		bool timelineExtension = false;
+		for (const char* enabledExtension : deviceExtensions)
+		{
+			if ((strcmp(enabledExtension, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) == 0) && extensionSupported(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME))
+			{
+				timelineExtension = true;
+			}
+		}
+		timelineSemaphores = false;
+		for (const VkBaseInStructure* next = static_cast<const VkBaseInStructure*>(pNextChain); next != nullptr; next = next->pNext)
+		{
+			if ((next->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR) && (timelineExtension || vulkan12))
+			{
+				timelineSemaphores = reinterpret_cast<const VkPhysicalDeviceTimelineSemaphoreFeaturesKHR*>(next)->timelineSemaphore == VK_TRUE;
+			}
+			if ((next->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES) && vulkan12)
+			{
+				timelineSemaphores = reinterpret_cast<const VkPhysicalDeviceVulkan12Features*>(next)->timelineSemaphore == VK_TRUE;
+			}
+		}
+
 		VkResult result = vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, &logicalDevice);
 		if (result != VK_SUCCESS) 
 		{
 			return result;
 		}
 
+		memoryAllocator = new vks::MemoryAllocator(logicalDevice, memoryProperties, properties.limits);
+
 		// Create a default command pool for graphics command buffers
 		commandPool = createCommandPool(queueFamilyIndices.graphics);
 
@@ -376,21 +404,12 @@ namespace vks
 		VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo(usageFlags, size);
 		VK_CHECK_RESULT(vkCreateBuffer(logicalDevice, &bufferCreateInfo, nullptr, &buffer->buffer));
 
-		// Create the memory backing up the buffer handle
+		// Sub-allocate the memory backing up the buffer handle from one of the allocator's blocks
+		// The allocator also takes care of VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT for buffers with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
 		VkMemoryRequirements memReqs;
-		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
 		vkGetBufferMemoryRequirements(logicalDevice, buffer->buffer, &memReqs);
-		memAlloc.allocationSize = memReqs.size;
-		// Find a memory type index that fits the properties of the buffer
-		memAlloc.memoryTypeIndex = getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
-		// If the buffer has VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT set we also need to enable the appropriate flag during allocation
-		VkMemoryAllocateFlagsInfoKHR allocFlagsInfo{};
-		if (usageFlags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
-			allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR;
-			allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
-			memAlloc.pNext = &allocFlagsInfo;
-		}
-		VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &buffer->memory));
+		VK_CHECK_RESULT(memoryAllocator->allocate(memReqs, memoryPropertyFlags, (usageFlags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) ? MEMORY_RESOURCE_DEVICE_ADDRESS : MEMORY_RESOURCE_LINEAR, &buffer->allocation));
+		buffer->memory = buffer->allocation.memory;
 
 		buffer->alignment = memReqs.alignment;
 		buffer->size = size;
@@ -514,6 +533,7 @@ namespace vks
 
 		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
 
+		VKS_TRACE_SCOPE_CATEGORY("Flush command buffer", "queue");
 		VkSubmitInfo submitInfo = vks::initializers::submitInfo();
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &commandBuffer;
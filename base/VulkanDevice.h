@@ -11,6 +11,7 @@
 #pragma once
 
 #include "VulkanBuffer.h"
+#include "VulkanMemoryAllocator.h"
 #include "VulkanTools.h"
 #include "vulkan/vulkan.h"
 #include <algorithm>
@@ -37,10 +38,14 @@ struct VulkanDevice
 	std::vector<VkQueueFamilyProperties> queueFamilyProperties;
 	/** @brief List of extensions supported by the device */
 	std::vector<std::string> supportedExtensions;
+	/** @brief Sub-allocator for buffer and image memory, created along with the logical device */
+	vks::MemoryAllocator *memoryAllocator = nullptr;
 	/** @brief Default command pool for the graphics queue family index */
 	VkCommandPool commandPool = VK_NULL_HANDLE;
 	/** @brief Set to true when the debug marker extension is detected */
 	bool enableDebugMarkers = false;
+	/** @brief Set to true if the timeline semaphore feature has been enabled via the pNext chain of the device creation */
+	bool timelineSemaphores = false;
 	/** @brief Contains queue family indices */
 	struct
 	{
@@ -0,0 +1,219 @@
+/*
+* GPU profiler based on timestamp queries
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanGpuProfiler.h"
+
+#include <iostream>
+
+#include "VulkanTools.h"
+#include "trace.h"
+
+namespace vks
+{
+	static const uint32_t invalidScope = ~0u;
+
+	GpuProfiler::Scope::Scope(GpuProfiler& profiler, VkCommandBuffer commandBuffer, const std::string& name, uint32_t slot) : profiler(profiler), commandBuffer(commandBuffer)
+	{
+		scope = profiler.begin(commandBuffer, name, slot);
+	}
+
+	GpuProfiler::Scope::~Scope()
+	{
+		profiler.end(commandBuffer, scope);
+	}
+
+	void GpuProfiler::create(VkDevice device, const VkPhysicalDeviceProperties& properties, uint32_t timestampValidBits, VkQueue queue, VkCommandPool commandPool)
+	{
+		if ((timestampValidBits == 0) || (properties.limits.timestampPeriod == 0.0f)) {
+			return;
+		}
+		this->device = device;
+		timestampPeriod = properties.limits.timestampPeriod;
+		timestampMask = timestampValidBits >= 64 ? ~0ull : ((1ull << timestampValidBits) - 1);
+
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		// One additional query for the calibration
+		queryPoolInfo.queryCount = maxScopes * 2 + 1;
+		VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &queryPool));
+
+		// Queries start out in an undefined state and must not be read before they have been reset once
+		// Resetting the whole pool up front lets resolve read any scope, even one whose command buffer has been recorded but not submitted yet
+		VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+		VkCommandBuffer commandBuffer;
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &commandBuffer));
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
+		vkCmdResetQueryPool(commandBuffer, queryPool, 0, queryPoolInfo.queryCount);
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+		VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo(VK_FLAGS_NONE);
+		VkFence fence;
+		VK_CHECK_RESULT(vkCreateFence(device, &fenceInfo, nullptr, &fence));
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
+		VK_CHECK_RESULT(vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX));
+		vkDestroyFence(device, fence, nullptr);
+		vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+	}
+
+	void GpuProfiler::destroy()
+	{
+		if (queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, queryPool, nullptr);
+			queryPool = VK_NULL_HANDLE;
+		}
+		scopes.clear();
+		timings.clear();
+		calibrated = false;
+	}
+
+	void GpuProfiler::calibrate(VkQueue queue, VkCommandPool commandPool)
+	{
+		if (!isActive()) {
+			return;
+		}
+		const uint32_t query = maxScopes * 2;
+		VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+		VkCommandBuffer commandBuffer;
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &commandBuffer));
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
+		vkCmdResetQueryPool(commandBuffer, queryPool, query, 1);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, query);
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+
+		VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo(VK_FLAGS_NONE);
+		VkFence fence;
+		VK_CHECK_RESULT(vkCreateFence(device, &fenceInfo, nullptr, &fence));
+		const uint64_t submitTime = trace::now();
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
+		VK_CHECK_RESULT(vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX));
+		const uint64_t completeTime = trace::now();
+		vkDestroyFence(device, fence, nullptr);
+		vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+
+		VK_CHECK_RESULT(vkGetQueryPoolResults(device, queryPool, query, 1, sizeof(uint64_t), &calibrationTimestamp, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+		calibrationTimestamp &= timestampMask;
+		// The timestamp was written somewhere between the submission and the fence wait returning
+		calibrationTime = submitTime + (completeTime - submitTime) / 2;
+		calibrated = true;
+	}
+
+	bool GpuProfiler::isActive() const
+	{
+		return queryPool != VK_NULL_HANDLE;
+	}
+
+	uint32_t GpuProfiler::begin(VkCommandBuffer commandBuffer, const std::string& name, uint32_t slot)
+	{
+		if (!isActive()) {
+			return invalidScope;
+		}
+		uint32_t scope = invalidScope;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			uint32_t timing = 0;
+			while ((timing < timings.size()) && (timings[timing].name != name)) {
+				timing++;
+			}
+			for (uint32_t i = 0; i < scopes.size(); i++) {
+				if ((scopes[i].timing == timing) && (scopes[i].slot == slot)) {
+					scope = i;
+					break;
+				}
+			}
+			if (scope == invalidScope) {
+				if (scopes.size() == maxScopes) {
+					std::cerr << "GPU profiler is out of queries, scope \"" << name << "\" is not measured\n";
+					return invalidScope;
+				}
+				if (timing == timings.size()) {
+					timings.push_back(Timing());
+					timings.back().name = name;
+				}
+				ScopeQueries queries;
+				queries.timing = timing;
+				queries.slot = slot;
+				scopes.push_back(queries);
+				scope = static_cast<uint32_t>(scopes.size() - 1);
+			}
+		}
+		// Resetting the queries inside the command buffer makes them unavailable until this recording executes again,
+		// so resolve never mixes timestamps of two executions
+		vkCmdResetQueryPool(commandBuffer, queryPool, scope * 2, 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, scope * 2);
+		return scope;
+	}
+
+	void GpuProfiler::end(VkCommandBuffer commandBuffer, uint32_t scope)
+	{
+		if (scope == invalidScope) {
+			return;
+		}
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, scope * 2 + 1);
+	}
+
+	bool GpuProfiler::resolve()
+	{
+		if (!isActive()) {
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		if (scopes.empty()) {
+			return false;
+		}
+		// Value and availability for every query of the registered scopes. All of them have been reset by create(), and afterwards
+		// they're only reset and written by submitted command buffers, so each one is either unavailable or holds a complete result
+		std::vector<uint64_t> results(scopes.size() * 4);
+		VkResult result = vkGetQueryPoolResults(device, queryPool, 0, static_cast<uint32_t>(scopes.size() * 2), results.size() * sizeof(uint64_t), results.data(), 2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+		// Not ready only means that some of the queries are still pending
+		if ((result != VK_SUCCESS) && (result != VK_NOT_READY)) {
+			VK_CHECK_RESULT(result);
+		}
+		bool updated = false;
+		for (uint32_t i = 0; i < scopes.size(); i++) {
+			const uint64_t* query = &results[i * 4];
+			if ((query[1] == 0) || (query[3] == 0)) {
+				continue;
+			}
+			ScopeQueries& scope = scopes[i];
+			const uint64_t begin = query[0] & timestampMask;
+			const uint64_t end = query[2] & timestampMask;
+			if ((begin == scope.lastBegin) && (end == scope.lastEnd)) {
+				continue;
+			}
+			scope.lastBegin = begin;
+			scope.lastEnd = end;
+			const double milliseconds = (double)((end - begin) & timestampMask) * timestampPeriod / 1000000.0;
+			Timing& timing = timings[scope.timing];
+			timing.last = milliseconds;
+			timing.average = (timing.samples == 0) ? milliseconds : timing.average * 0.95 + milliseconds * 0.05;
+			timing.samples++;
+			if (onSample) {
+				onSample(timing.name, milliseconds);
+			}
+			if (calibrated && trace::isEnabled()) {
+				const uint64_t beginTime = calibrationTime + (uint64_t)((double)((begin - calibrationTimestamp) & timestampMask) * timestampPeriod);
+				trace::addGpuEvent(timing.name, beginTime, beginTime + (uint64_t)(milliseconds * 1000000.0));
+			}
+			updated = true;
+		}
+		return updated;
+	}
+
+	const std::vector<GpuProfiler::Timing>& GpuProfiler::getTimings() const
+	{
+		return timings;
+	}
+}
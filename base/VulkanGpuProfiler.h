@@ -0,0 +1,130 @@
+/*
+* GPU profiler based on timestamp queries
+*
+* Measures the GPU time of named scopes (e.g. render passes) recorded into command buffers
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+#if defined(__ANDROID__)
+#include "VulkanAndroid.h"
+#endif
+
+namespace vks
+{
+	/**
+	* @brief Timestamp query based GPU profiler
+	* @note Every scope owns a pair of queries per slot. Slots form a ring for command buffers that exist more than once, e.g. one per swap chain image
+	* or frame in flight, so re-recording or re-submitting one slot never touches the queries of another one that may still be executing
+	* @note Results are read without waiting for the GPU, queries that aren't available yet are picked up by a later call to resolve
+	*/
+	class GpuProfiler
+	{
+	public:
+		/** @brief Maximum number of distinct scope and slot combinations */
+		static const uint32_t maxScopes = 64;
+
+		/** @brief GPU time of a named scope in milliseconds */
+		struct Timing
+		{
+			std::string name;
+			/** @brief Time of the most recent execution */
+			double last = 0.0;
+			/** @brief Exponential moving average, stable enough to be displayed */
+			double average = 0.0;
+			uint64_t samples = 0;
+		};
+
+		/**
+		* @brief Writes the begin timestamp of a scope on construction and the end timestamp on destruction
+		* @note The scope resets its queries when it begins, so it has to begin outside of a render pass
+		*/
+		class Scope
+		{
+		public:
+			Scope(GpuProfiler& profiler, VkCommandBuffer commandBuffer, const std::string& name, uint32_t slot = 0);
+			~Scope();
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+		private:
+			GpuProfiler& profiler;
+			VkCommandBuffer commandBuffer;
+			uint32_t scope;
+		};
+
+		/** @brief Called for every new measurement found by resolve, e.g. to collect samples for the benchmark */
+		std::function<void(const std::string& name, double milliseconds)> onSample;
+
+		/**
+		* Create the query pool and reset all of its queries, the profiler stays inactive if the queue family doesn't support timestamps
+		*
+		* @param device Logical device
+		* @param properties Properties of the physical device
+		* @param timestampValidBits Valid timestamp bits of the queue family the profiled command buffers are submitted to
+		* @param queue Queue the initial reset is submitted to, waits for it to finish
+		* @param commandPool Command pool for the queue's family
+		*/
+		void create(VkDevice device, const VkPhysicalDeviceProperties& properties, uint32_t timestampValidBits, VkQueue queue, VkCommandPool commandPool);
+		void destroy();
+		bool isActive() const;
+		/**
+		* Relate GPU timestamps to the CPU clock of vks::trace, so resolved scopes are added to the trace's GPU timeline
+		*
+		* @param queue Queue the profiled command buffers are submitted to
+		* @param commandPool Command pool for the queue's family
+		*
+		* @note Waits for a timestamp written by a single submission, the result is accurate to about half the submission's round trip
+		*/
+		void calibrate(VkQueue queue, VkCommandPool commandPool);
+
+		/**
+		* Record the begin timestamp of a scope
+		*
+		* @param commandBuffer Command buffer to record to, must not be inside of a render pass
+		* @param name Name of the scope, scopes with the same name in different slots are reported as one timing
+		* @param slot Slot of the ring the command buffer belongs to
+		*
+		* @return Handle to be passed to end
+		*/
+		uint32_t begin(VkCommandBuffer commandBuffer, const std::string& name, uint32_t slot = 0);
+		void end(VkCommandBuffer commandBuffer, uint32_t scope);
+
+		/** @brief Read back all measurements that became available since the last call without waiting for the GPU, returns true if there were any */
+		bool resolve();
+		const std::vector<Timing>& getTimings() const;
+
+	private:
+		struct ScopeQueries
+		{
+			uint32_t timing;
+			uint32_t slot;
+			// Timestamps read by the last resolve, to tell a new execution from the one that has already been reported
+			uint64_t lastBegin = 0;
+			uint64_t lastEnd = 0;
+		};
+
+		VkDevice device = VK_NULL_HANDLE;
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		double timestampPeriod = 1.0;
+		uint64_t timestampMask = ~0ull;
+		// GPU timestamp and trace clock time of the calibration
+		bool calibrated = false;
+		uint64_t calibrationTimestamp = 0;
+		uint64_t calibrationTime = 0;
+		std::vector<ScopeQueries> scopes;
+		std::vector<Timing> timings;
+		// Command buffers may be recorded on multiple threads
+		std::mutex mutex;
+	};
+}
@@ -250,10 +250,8 @@ namespace vks
 
 			device->flushCommandBuffer(copyCmd, copyQueue, true);
 
-			vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
-			vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
-			vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
-			vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
+			vertexStaging.destroy();
+			indexStaging.destroy();
 		}
 	};
 }
@@ -0,0 +1,428 @@
+/*
+* Vulkan device memory allocator
+*
+* Sub-allocates buffers and images from large per memory type blocks to stay clear of maxMemoryAllocationCount
+* and the cost of a vkAllocateMemory call per resource
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanMemoryAllocator.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+namespace vks
+{
+	/** @brief A device memory object and the free ranges inside of it */
+	struct MemoryBlock
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		void* mapped = nullptr;
+		uint32_t memoryTypeIndex = 0;
+		MemoryResourceKind kind = MEMORY_RESOURCE_LINEAR;
+		/** @brief Dedicated blocks hold exactly one allocation and are released with it */
+		bool dedicated = false;
+		uint32_t allocationCount = 0;
+		VkDeviceSize usedBytes = 0;
+		/** @brief Free ranges by offset, used for coalescing neighbours */
+		std::map<VkDeviceSize, VkDeviceSize> freeByOffset;
+		/** @brief Free ranges by size (size, offset), used for best fit lookups */
+		std::multimap<VkDeviceSize, VkDeviceSize> freeBySize;
+
+		void insertFreeRange(VkDeviceSize offset, VkDeviceSize rangeSize)
+		{
+			freeByOffset[offset] = rangeSize;
+			freeBySize.insert(std::make_pair(rangeSize, offset));
+		}
+
+		void eraseFreeRange(VkDeviceSize offset, VkDeviceSize rangeSize)
+		{
+			freeByOffset.erase(offset);
+			auto range = freeBySize.equal_range(rangeSize);
+			for (auto it = range.first; it != range.second; ++it) {
+				if (it->second == offset) {
+					freeBySize.erase(it);
+					break;
+				}
+			}
+		}
+
+		/** @brief Take the smallest free range that fits the aligned request, the alignment padding in front stays free */
+		bool allocateRange(VkDeviceSize requestSize, VkDeviceSize alignment, VkDeviceSize* offset)
+		{
+			for (auto it = freeBySize.lower_bound(requestSize); it != freeBySize.end(); ++it) {
+				const VkDeviceSize rangeSize = it->first;
+				const VkDeviceSize rangeOffset = it->second;
+				const VkDeviceSize alignedOffset = (rangeOffset + alignment - 1) / alignment * alignment;
+				const VkDeviceSize padding = alignedOffset - rangeOffset;
+				if (padding + requestSize > rangeSize) {
+					continue;
+				}
+				eraseFreeRange(rangeOffset, rangeSize);
+				if (padding > 0) {
+					insertFreeRange(rangeOffset, padding);
+				}
+				if (rangeSize - padding - requestSize > 0) {
+					insertFreeRange(alignedOffset + requestSize, rangeSize - padding - requestSize);
+				}
+				*offset = alignedOffset;
+				allocationCount++;
+				usedBytes += requestSize;
+				return true;
+			}
+			return false;
+		}
+
+		/** @brief Return a range and merge it with free neighbours */
+		void freeRange(VkDeviceSize offset, VkDeviceSize rangeSize)
+		{
+			auto next = freeByOffset.lower_bound(offset);
+			if (next != freeByOffset.end() && next->first == offset + rangeSize) {
+				const VkDeviceSize nextOffset = next->first;
+				const VkDeviceSize nextSize = next->second;
+				eraseFreeRange(nextOffset, nextSize);
+				rangeSize += nextSize;
+			}
+			next = freeByOffset.lower_bound(offset);
+			if (next != freeByOffset.begin()) {
+				auto prev = std::prev(next);
+				if (prev->first + prev->second == offset) {
+					const VkDeviceSize prevOffset = prev->first;
+					const VkDeviceSize prevSize = prev->second;
+					eraseFreeRange(prevOffset, prevSize);
+					offset = prevOffset;
+					rangeSize += prevSize;
+				}
+			}
+			insertFreeRange(offset, rangeSize);
+		}
+	};
+
+	/**
+	* Create an allocator for a logical device
+	*
+	* @param device Logical device to allocate from
+	* @param memoryProperties Memory types and heaps of the physical device
+	* @param limits Limits of the physical device, used for bufferImageGranularity and nonCoherentAtomSize
+	* @param blockSize (Optional) Size of the blocks that are sub-allocated from
+	*/
+	MemoryAllocator::MemoryAllocator(VkDevice device, const VkPhysicalDeviceMemoryProperties& memoryProperties, const VkPhysicalDeviceLimits& limits, VkDeviceSize blockSize)
+	{
+		this->device = device;
+		this->memoryProperties = memoryProperties;
+		this->blockSize = blockSize;
+		bufferImageGranularity = limits.bufferImageGranularity;
+		nonCoherentAtomSize = std::max<VkDeviceSize>(limits.nonCoherentAtomSize, 1);
+	}
+
+	/**
+	* Release all blocks
+	*
+	* @note Resources still bound to allocations must have been destroyed before
+	*/
+	MemoryAllocator::~MemoryAllocator()
+	{
+		for (auto block : blocks) {
+			if (block->mapped) {
+				vkUnmapMemory(device, block->memory);
+			}
+			vkFreeMemory(device, block->memory, nullptr);
+			delete block;
+		}
+	}
+
+	uint32_t MemoryAllocator::findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags memoryPropertyFlags) const
+	{
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+			if ((typeBits & (1u << i)) && ((memoryProperties.memoryTypes[i].propertyFlags & memoryPropertyFlags) == memoryPropertyFlags)) {
+				return i;
+			}
+		}
+		throw std::runtime_error("Could not find a matching memory type");
+	}
+
+	VkResult MemoryAllocator::createBlock(uint32_t memoryTypeIndex, MemoryResourceKind kind, VkDeviceSize size, bool dedicated, MemoryBlock** block)
+	{
+		VkMemoryAllocateInfo memAlloc{};
+		memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		memAlloc.allocationSize = size;
+		memAlloc.memoryTypeIndex = memoryTypeIndex;
+		VkMemoryAllocateFlagsInfoKHR allocFlagsInfo{};
+		if (kind == MEMORY_RESOURCE_DEVICE_ADDRESS) {
+			allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR;
+			allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
+			memAlloc.pNext = &allocFlagsInfo;
+		}
+		VkDeviceMemory memory;
+		VkResult result = vkAllocateMemory(device, &memAlloc, nullptr, &memory);
+		if (result != VK_SUCCESS) {
+			return result;
+		}
+
+		MemoryBlock* newBlock = new MemoryBlock();
+		newBlock->memory = memory;
+		newBlock->size = size;
+		newBlock->memoryTypeIndex = memoryTypeIndex;
+		newBlock->kind = kind;
+		newBlock->dedicated = dedicated;
+		// Host visible blocks are mapped once, memory can't be mapped a second time while one of its allocations is mapped
+		if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+			result = vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &newBlock->mapped);
+			if (result != VK_SUCCESS) {
+				vkFreeMemory(device, memory, nullptr);
+				delete newBlock;
+				return result;
+			}
+		}
+		newBlock->insertFreeRange(0, size);
+		blocks.push_back(newBlock);
+		*block = newBlock;
+		return VK_SUCCESS;
+	}
+
+	void MemoryAllocator::destroyBlock(MemoryBlock* block)
+	{
+		if (block->mapped) {
+			vkUnmapMemory(device, block->memory);
+		}
+		vkFreeMemory(device, block->memory, nullptr);
+		blocks.erase(std::find(blocks.begin(), blocks.end(), block));
+		delete block;
+	}
+
+	/**
+	* Allocate a memory range for a resource
+	*
+	* @param memoryRequirements Requirements of the resource as returned by vkGet*MemoryRequirements
+	* @param memoryPropertyFlags Memory properties the memory type has to support
+	* @param kind Kind of resource that will be bound to the range
+	* @param allocation Pointer to the allocation that is filled on success
+	*
+	* @return VK_SUCCESS or the error of the failing vkAllocateMemory call
+	*/
+	VkResult MemoryAllocator::allocate(const VkMemoryRequirements& memoryRequirements, VkMemoryPropertyFlags memoryPropertyFlags, MemoryResourceKind kind, MemoryAllocation* allocation)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		const uint32_t memoryTypeIndex = findMemoryType(memoryRequirements.memoryTypeBits, memoryPropertyFlags);
+		const VkMemoryPropertyFlags typeFlags = memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+
+		VkDeviceSize alignment = std::max<VkDeviceSize>(memoryRequirements.alignment, 1);
+		VkDeviceSize size = memoryRequirements.size;
+		// Flushes and invalidates of non-coherent memory work on whole atoms, so ranges must not share an atom with a neighbour
+		if ((typeFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(typeFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+			alignment = std::max(alignment, nonCoherentAtomSize);
+			size = (size + nonCoherentAtomSize - 1) / nonCoherentAtomSize * nonCoherentAtomSize;
+		}
+		// Without a granularity restriction linear and optimal resources can live side by side
+		if ((kind == MEMORY_RESOURCE_OPTIMAL) && (bufferImageGranularity <= 1)) {
+			kind = MEMORY_RESOURCE_LINEAR;
+		}
+
+		// Keep blocks small compared to their heap so small heaps (e.g. host visible device local memory) aren't exhausted by a single block
+		const VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+		const VkDeviceSize typeBlockSize = std::min(blockSize, std::max<VkDeviceSize>(heapSize / 8, 1));
+
+		MemoryBlock* block = nullptr;
+		VkDeviceSize offset = 0;
+		if (size > typeBlockSize / 2) {
+			VkResult result = createBlock(memoryTypeIndex, kind, size, true, &block);
+			if (result != VK_SUCCESS) {
+				return result;
+			}
+			block->allocateRange(size, 1, &offset);
+		}
+		else {
+			for (auto candidate : blocks) {
+				if (!candidate->dedicated && (candidate->memoryTypeIndex == memoryTypeIndex) && (candidate->kind == kind) && candidate->allocateRange(size, alignment, &offset)) {
+					block = candidate;
+					break;
+				}
+			}
+			if (!block) {
+				VkResult result = createBlock(memoryTypeIndex, kind, typeBlockSize, false, &block);
+				if (result != VK_SUCCESS) {
+					return result;
+				}
+				block->allocateRange(size, alignment, &offset);
+			}
+		}
+
+		allocation->allocator = this;
+		allocation->memory = block->memory;
+		allocation->offset = offset;
+		allocation->size = size;
+		allocation->mapped = block->mapped ? static_cast<char*>(block->mapped) + offset : nullptr;
+		allocation->memoryTypeIndex = memoryTypeIndex;
+		allocation->block = block;
+		return VK_SUCCESS;
+	}
+
+	/**
+	* Allocate and bind memory for a buffer
+	*
+	* @param buffer Buffer to allocate for
+	* @param usageFlags Usage flags the buffer was created with
+	* @param memoryPropertyFlags Memory properties the memory type has to support
+	* @param allocation Pointer to the allocation that is filled on success
+	*
+	* @return VkResult of the allocation or the bind call
+	*/
+	VkResult MemoryAllocator::allocateForBuffer(VkBuffer buffer, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, MemoryAllocation* allocation)
+	{
+		VkMemoryRequirements memReqs;
+		vkGetBufferMemoryRequirements(device, buffer, &memReqs);
+		const MemoryResourceKind kind = (usageFlags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) ? MEMORY_RESOURCE_DEVICE_ADDRESS : MEMORY_RESOURCE_LINEAR;
+		VkResult result = allocate(memReqs, memoryPropertyFlags, kind, allocation);
+		if (result != VK_SUCCESS) {
+			return result;
+		}
+		return vkBindBufferMemory(device, buffer, allocation->memory, allocation->offset);
+	}
+
+	/**
+	* Allocate and bind memory for an image
+	*
+	* @param image Image to allocate for
+	* @param tiling Tiling the image was created with
+	* @param memoryPropertyFlags Memory properties the memory type has to support
+	* @param allocation Pointer to the allocation that is filled on success
+	*
+	* @return VkResult of the allocation or the bind call
+	*/
+	VkResult MemoryAllocator::allocateForImage(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags memoryPropertyFlags, MemoryAllocation* allocation)
+	{
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(device, image, &memReqs);
+		const MemoryResourceKind kind = (tiling == VK_IMAGE_TILING_LINEAR) ? MEMORY_RESOURCE_LINEAR : MEMORY_RESOURCE_OPTIMAL;
+		VkResult result = allocate(memReqs, memoryPropertyFlags, kind, allocation);
+		if (result != VK_SUCCESS) {
+			return result;
+		}
+		return vkBindImageMemory(device, image, allocation->memory, allocation->offset);
+	}
+
+	/**
+	* Return an allocation to its block
+	*
+	* @note Empty blocks are released as long as another block of the same memory type and kind is left, so alternating allocations and frees don't cause a vkAllocateMemory each
+	*/
+	void MemoryAllocator::free(MemoryAllocation* allocation)
+	{
+		if (!allocation->block) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+
+		MemoryBlock* block = allocation->block;
+		block->freeRange(allocation->offset, allocation->size);
+		block->allocationCount--;
+		block->usedBytes -= allocation->size;
+		if (block->dedicated) {
+			destroyBlock(block);
+		}
+		else if (block->allocationCount == 0) {
+			for (auto other : blocks) {
+				if ((other != block) && !other->dedicated && (other->memoryTypeIndex == block->memoryTypeIndex) && (other->kind == block->kind)) {
+					destroyBlock(block);
+					break;
+				}
+			}
+		}
+		*allocation = MemoryAllocation();
+	}
+
+	/**
+	* Get the memory range to flush or invalidate for a range of an allocation
+	*
+	* @param allocation Allocation the range belongs to
+	* @param size (Optional) Size of the range, VK_WHOLE_SIZE for the rest of the allocation
+	* @param offset (Optional) Byte offset of the range from the beginning of the allocation
+	*
+	* @note The range is widened to whole non-coherent atoms, which stays inside the allocation as allocations of non-coherent memory are aligned to them
+	*/
+	VkMappedMemoryRange MemoryAllocator::getMappedRange(const MemoryAllocation& allocation, VkDeviceSize size, VkDeviceSize offset) const
+	{
+		const VkDeviceSize end = (size == VK_WHOLE_SIZE) ? allocation.size : std::min(offset + size, allocation.size);
+		const VkDeviceSize begin = offset / nonCoherentAtomSize * nonCoherentAtomSize;
+		const VkDeviceSize alignedEnd = std::min((end + nonCoherentAtomSize - 1) / nonCoherentAtomSize * nonCoherentAtomSize, allocation.size);
+		VkMappedMemoryRange mappedRange{};
+		mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		mappedRange.memory = allocation.memory;
+		mappedRange.offset = allocation.offset + begin;
+		mappedRange.size = alignedEnd - begin;
+		return mappedRange;
+	}
+
+	void MemoryAllocator::collectStatistics(const MemoryBlock* block, MemoryStatistics& statistics) const
+	{
+		statistics.allocationCount += block->allocationCount;
+		statistics.allocatedBytes += block->size;
+		statistics.usedBytes += block->usedBytes;
+		if (block->dedicated) {
+			statistics.dedicatedAllocationCount++;
+			return;
+		}
+		statistics.blockCount++;
+		for (auto& range : block->freeByOffset) {
+			statistics.freeBytes += range.second;
+			statistics.freeRangeCount++;
+			statistics.largestFreeRange = std::max(statistics.largestFreeRange, range.second);
+		}
+	}
+
+	/** @brief Statistics over all memory types */
+	MemoryStatistics MemoryAllocator::getStatistics() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		MemoryStatistics statistics;
+		for (auto block : blocks) {
+			collectStatistics(block, statistics);
+		}
+		return statistics;
+	}
+
+	/** @brief Statistics of a single memory type */
+	MemoryStatistics MemoryAllocator::getStatistics(uint32_t memoryTypeIndex) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		MemoryStatistics statistics;
+		for (auto block : blocks) {
+			if (block->memoryTypeIndex == memoryTypeIndex) {
+				collectStatistics(block, statistics);
+			}
+		}
+		return statistics;
+	}
+
+	/** @brief Print the statistics of every memory type in use and the totals to stdout */
+	void MemoryAllocator::printStatistics() const
+	{
+		auto print = [](const std::string& name, const MemoryStatistics& statistics) {
+			std::cout << std::setw(8) << name
+				<< " allocations: " << statistics.allocationCount
+				<< " blocks: " << statistics.blockCount
+				<< " dedicated: " << statistics.dedicatedAllocationCount
+				<< " used: " << statistics.usedBytes / 1024 << " / " << statistics.allocatedBytes / 1024 << " KB"
+				<< " free ranges: " << statistics.freeRangeCount
+				<< " largest free: " << statistics.largestFreeRange / 1024 << " KB"
+				<< " fragmentation: " << std::fixed << std::setprecision(1) << statistics.fragmentation() * 100.0f << "%\n";
+		};
+		std::cout << "Device memory allocator statistics:\n";
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+			MemoryStatistics statistics = getStatistics(i);
+			if (statistics.allocatedBytes > 0) {
+				print("type " + std::to_string(i), statistics);
+			}
+		}
+		print("total", getStatistics());
+	}
+}
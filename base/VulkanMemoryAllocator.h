@@ -0,0 +1,121 @@
+/*
+* Vulkan device memory allocator
+*
+* Sub-allocates buffers and images from large per memory type blocks to stay clear of maxMemoryAllocationCount
+* and the cost of a vkAllocateMemory call per resource
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+#if defined(__ANDROID__)
+#include "VulkanAndroid.h"
+#endif
+
+namespace vks
+{
+	struct MemoryBlock;
+	class MemoryAllocator;
+
+	/**
+	* @brief Kind of resource an allocation is made for
+	* @note Linear and optimal resources never share a block if bufferImageGranularity is larger than one, so allocations don't need to be padded to the granularity
+	*/
+	enum MemoryResourceKind
+	{
+		/** @brief Buffers and linear tiled images */
+		MEMORY_RESOURCE_LINEAR = 0,
+		/** @brief Optimal tiled images */
+		MEMORY_RESOURCE_OPTIMAL = 1,
+		/** @brief Buffers with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, their memory needs to be allocated with VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT */
+		MEMORY_RESOURCE_DEVICE_ADDRESS = 2,
+	};
+
+	/** @brief A range of device memory handed out by the MemoryAllocator */
+	struct MemoryAllocation
+	{
+		MemoryAllocator* allocator = nullptr;
+		/** @brief Memory object the range lives in, shared with other allocations unless the allocation is dedicated */
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		/** @brief Byte offset of the range inside memory, to be passed to vkBind*Memory */
+		VkDeviceSize offset = 0;
+		VkDeviceSize size = 0;
+		/** @brief Host address of the range for host visible memory (blocks stay mapped for their whole lifetime), nullptr otherwise */
+		void* mapped = nullptr;
+		uint32_t memoryTypeIndex = 0;
+		MemoryBlock* block = nullptr;
+	};
+
+	/** @brief Allocation statistics of one memory type or the whole allocator */
+	struct MemoryStatistics
+	{
+		/** @brief Number of blocks that are sub-allocated from */
+		uint32_t blockCount = 0;
+		/** @brief Number of allocations that got a memory object of their own due to their size */
+		uint32_t dedicatedAllocationCount = 0;
+		/** @brief Number of live allocations, including dedicated ones */
+		uint32_t allocationCount = 0;
+		/** @brief Bytes allocated from the device, blocks and dedicated allocations */
+		VkDeviceSize allocatedBytes = 0;
+		/** @brief Bytes handed out to resources */
+		VkDeviceSize usedBytes = 0;
+		/** @brief Bytes in the free ranges of the blocks */
+		VkDeviceSize freeBytes = 0;
+		uint32_t freeRangeCount = 0;
+		VkDeviceSize largestFreeRange = 0;
+		/** @brief 0 if all free memory is one contiguous range, approaches 1 the more it is split into small ranges */
+		float fragmentation() const
+		{
+			return freeBytes > 0 ? 1.0f - (float)largestFreeRange / (float)freeBytes : 0.0f;
+		}
+	};
+
+	/**
+	* @brief Block based device memory allocator
+	* @note Free ranges of a block are kept ordered by size for best fit lookups in O(log n) and ordered by offset for coalescing on free, requests larger than half a block get a dedicated allocation
+	* @note Allocation and free are thread safe
+	*/
+	class MemoryAllocator
+	{
+	public:
+		/** @brief Default size of a block, smaller for heaps that are less than 512 MB */
+		static const VkDeviceSize defaultBlockSize = 64 * 1024 * 1024;
+
+		MemoryAllocator(VkDevice device, const VkPhysicalDeviceMemoryProperties& memoryProperties, const VkPhysicalDeviceLimits& limits, VkDeviceSize blockSize = defaultBlockSize);
+		~MemoryAllocator();
+		MemoryAllocator(const MemoryAllocator&) = delete;
+		MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+
+		VkResult allocate(const VkMemoryRequirements& memoryRequirements, VkMemoryPropertyFlags memoryPropertyFlags, MemoryResourceKind kind, MemoryAllocation* allocation);
+		VkResult allocateForBuffer(VkBuffer buffer, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, MemoryAllocation* allocation);
+		VkResult allocateForImage(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags memoryPropertyFlags, MemoryAllocation* allocation);
+		void free(MemoryAllocation* allocation);
+		VkMappedMemoryRange getMappedRange(const MemoryAllocation& allocation, VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0) const;
+		MemoryStatistics getStatistics() const;
+		MemoryStatistics getStatistics(uint32_t memoryTypeIndex) const;
+		void printStatistics() const;
+
+	private:
+		VkDevice device;
+		VkPhysicalDeviceMemoryProperties memoryProperties;
+		VkDeviceSize bufferImageGranularity;
+		VkDeviceSize nonCoherentAtomSize;
+		VkDeviceSize blockSize;
+		std::vector<MemoryBlock*> blocks;
+		mutable std::mutex mutex;
+
+		uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags memoryPropertyFlags) const;
+		VkResult createBlock(uint32_t memoryTypeIndex, MemoryResourceKind kind, VkDeviceSize size, bool dedicated, MemoryBlock** block);
+		void destroyBlock(MemoryBlock* block);
+		void collectStatistics(const MemoryBlock* block, MemoryStatistics& statistics) const;
+	};
+}
@@ -0,0 +1,246 @@
+/*
+* Persistent pipeline cache
+*
+* Stores the contents of a VkPipelineCache on disk so pipelines don't have to be compiled from scratch on every start
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanPipelineCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace vks
+{
+	namespace pipelinecache
+	{
+		/*
+			File layout: FileHeader followed by the data returned by vkGetPipelineCacheData
+			The header repeats the device identification so a cache of another device or driver is never handed to the implementation,
+			some drivers don't cope well with foreign data even though the Vulkan header inside the data should catch it
+		*/
+		struct FileHeader
+		{
+			char magic[8];
+			uint32_t version;
+			uint32_t vendorID;
+			uint32_t deviceID;
+			uint32_t driverVersion;
+			uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+			uint64_t dataSize;
+			uint64_t checksum;
+		};
+
+		static const char fileMagic[8] = { 'V', 'K', 'S', 'P', 'C', 'A', 'C', 'H' };
+		static const uint32_t fileVersion = 1;
+
+		// FNV-1a, only guards against truncated or corrupted files
+		static uint64_t checksum(const uint8_t* data, size_t size)
+		{
+			uint64_t hash = 14695981039346656037ull;
+			for (size_t i = 0; i < size; i++) {
+				hash = (hash ^ data[i]) * 1099511628211ull;
+			}
+			return hash;
+		}
+
+		static FileHeader makeHeader(const VkPhysicalDeviceProperties& properties)
+		{
+			FileHeader header{};
+			memcpy(header.magic, fileMagic, sizeof(fileMagic));
+			header.version = fileVersion;
+			header.vendorID = properties.vendorID;
+			header.deviceID = properties.deviceID;
+			header.driverVersion = properties.driverVersion;
+			memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+			return header;
+		}
+
+		static bool headerMatches(const FileHeader& header, const VkPhysicalDeviceProperties& properties)
+		{
+			const FileHeader expected = makeHeader(properties);
+			return (memcmp(header.magic, expected.magic, sizeof(header.magic)) == 0)
+				&& (header.version == expected.version)
+				&& (header.vendorID == expected.vendorID)
+				&& (header.deviceID == expected.deviceID)
+				&& (header.driverVersion == expected.driverVersion)
+				&& (memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) == 0);
+		}
+
+		// Checks the header Vulkan puts in front of the cache data (VkPipelineCacheHeaderVersionOne)
+		static bool vulkanHeaderMatches(const std::vector<uint8_t>& data, const VkPhysicalDeviceProperties& properties)
+		{
+			const size_t vulkanHeaderSize = 16 + VK_UUID_SIZE;
+			if (data.size() < vulkanHeaderSize) {
+				return false;
+			}
+			uint32_t headerSize, headerVersion, vendorID, deviceID;
+			memcpy(&headerSize, &data[0], 4);
+			memcpy(&headerVersion, &data[4], 4);
+			memcpy(&vendorID, &data[8], 4);
+			memcpy(&deviceID, &data[12], 4);
+			return (headerSize >= vulkanHeaderSize) && (headerSize <= data.size())
+				&& (headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+				&& (vendorID == properties.vendorID)
+				&& (deviceID == properties.deviceID)
+				&& (memcmp(&data[16], properties.pipelineCacheUUID, VK_UUID_SIZE) == 0);
+		}
+
+		// Reads and validates a cache file, returns false if it's missing or doesn't belong to the device
+		static bool readFile(const std::string& fileName, const VkPhysicalDeviceProperties& properties, FileHeader& header, std::vector<uint8_t>* data)
+		{
+			FILE* file = fopen(fileName.c_str(), "rb");
+			if (!file) {
+				return false;
+			}
+			bool valid = (fread(&header, sizeof(header), 1, file) == 1) && headerMatches(header, properties);
+			if (valid && data) {
+				// The data has to fill the rest of the file, a corrupted size must not turn into a huge allocation
+				const long dataStart = ftell(file);
+				valid = (dataStart >= 0) && (fseek(file, 0, SEEK_END) == 0);
+				const long fileEnd = valid ? ftell(file) : -1;
+				valid = valid && (fileEnd >= dataStart) && (header.dataSize == static_cast<uint64_t>(fileEnd - dataStart)) && (fseek(file, dataStart, SEEK_SET) == 0);
+			}
+			if (valid && data) {
+				data->resize(header.dataSize);
+				valid = (header.dataSize > 0) && (fread(data->data(), 1, data->size(), file) == data->size()) && (fgetc(file) == EOF)
+					&& (checksum(data->data(), data->size()) == header.checksum) && vulkanHeaderMatches(*data, properties);
+			}
+			fclose(file);
+			return valid;
+		}
+
+		/**
+		* Get the file name of the pipeline cache for a physical device
+		*
+		* @param properties Properties of the physical device
+		* @param directory Directory the cache is stored in, an empty string for the current directory
+		* @param prefix Prefix of the file name, e.g. the name of the application
+		*
+		* @return File name of the form <directory>/<prefix>_<vendorID>_<deviceID>_<driverVersion>_<pipelineCacheUUID>.pipelinecache
+		*/
+		std::string getFileName(const VkPhysicalDeviceProperties& properties, const std::string& directory, const std::string& prefix)
+		{
+			std::stringstream name;
+			if (!directory.empty()) {
+				name << directory;
+				if ((directory.back() != '/') && (directory.back() != '\\')) {
+					name << "/";
+				}
+			}
+			name << prefix << std::hex << std::setfill('0')
+				<< "_" << std::setw(4) << properties.vendorID
+				<< "_" << std::setw(4) << properties.deviceID
+				<< "_" << std::setw(8) << properties.driverVersion << "_";
+			for (uint32_t i = 0; i < VK_UUID_SIZE; i++) {
+				name << std::setw(2) << (uint32_t)properties.pipelineCacheUUID[i];
+			}
+			name << ".pipelinecache";
+			return name.str();
+		}
+
+		/**
+		* Create a pipeline cache, initialized from disk if possible
+		*
+		* @param device Logical device to create the cache for
+		* @param properties Properties of the device's physical device, used to validate the file
+		* @param fileName File to load the initial cache data from
+		* @param pipelineCache Pointer to the created pipeline cache
+		*
+		* @return VkResult of the vkCreatePipelineCache call
+		*/
+		VkResult create(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& fileName, VkPipelineCache* pipelineCache)
+		{
+			FileHeader header;
+			std::vector<uint8_t> data;
+			VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
+			pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+			if (readFile(fileName, properties, header, &data)) {
+				pipelineCacheCreateInfo.initialDataSize = data.size();
+				pipelineCacheCreateInfo.pInitialData = data.data();
+			}
+			VkResult result = vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, pipelineCache);
+			if ((result != VK_SUCCESS) && (pipelineCacheCreateInfo.initialDataSize > 0)) {
+				// The implementation rejected the data, start over with an empty cache
+				pipelineCacheCreateInfo.initialDataSize = 0;
+				pipelineCacheCreateInfo.pInitialData = nullptr;
+				result = vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, pipelineCache);
+			}
+			return result;
+		}
+
+		/**
+		* Save the contents of a pipeline cache to disk
+		*
+		* @param device Logical device the cache belongs to
+		* @param properties Properties of the device's physical device, stored in the file header
+		* @param pipelineCache Pipeline cache to save
+		* @param fileName File to write, an existing file is only replaced if its contents differ
+		*
+		* @return True if the cache is on disk afterwards
+		*
+		* @note The data is written to a temporary file next to the target that is then renamed over it, so a process that is killed while saving leaves the previous cache intact
+		*/
+		bool save(VkDevice device, const VkPhysicalDeviceProperties& properties, VkPipelineCache pipelineCache, const std::string& fileName)
+		{
+			size_t dataSize = 0;
+			if ((vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr) != VK_SUCCESS) || (dataSize == 0)) {
+				return false;
+			}
+			std::vector<uint8_t> data(dataSize);
+			if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data()) != VK_SUCCESS) {
+				return false;
+			}
+			data.resize(dataSize);
+
+			FileHeader header = makeHeader(properties);
+			header.dataSize = dataSize;
+			header.checksum = checksum(data.data(), data.size());
+
+			// Nothing to do if no new pipelines were added since the cache was loaded
+			FileHeader existing;
+			if (readFile(fileName, properties, existing, nullptr) && (existing.dataSize == header.dataSize) && (existing.checksum == header.checksum)) {
+				return true;
+			}
+
+#if defined(_WIN32)
+			const std::string tempFileName = fileName + ".tmp" + std::to_string(GetCurrentProcessId());
+#else
+			const std::string tempFileName = fileName + ".tmp" + std::to_string(getpid());
+#endif
+			FILE* file = fopen(tempFileName.c_str(), "wb");
+			if (!file) {
+				std::cerr << "Could not write pipeline cache \"" << tempFileName << "\"\n";
+				return false;
+			}
+			bool written = (fwrite(&header, sizeof(header), 1, file) == 1) && (fwrite(data.data(), 1, data.size(), file) == data.size()) && (fflush(file) == 0);
+#if !defined(_WIN32)
+			written = written && (fsync(fileno(file)) == 0);
+#endif
+			written = (fclose(file) == 0) && written;
+#if defined(_WIN32)
+			written = written && MoveFileExA(tempFileName.c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+			written = written && (rename(tempFileName.c_str(), fileName.c_str()) == 0);
+#endif
+			if (!written) {
+				std::cerr << "Could not write pipeline cache \"" << fileName << "\"\n";
+				remove(tempFileName.c_str());
+			}
+			return written;
+		}
+	}
+}
@@ -0,0 +1,32 @@
+/*
+* Persistent pipeline cache
+*
+* Stores the contents of a VkPipelineCache on disk so pipelines don't have to be compiled from scratch on every start
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+
+#include "vulkan/vulkan.h"
+
+#if defined(__ANDROID__)
+#include "VulkanAndroid.h"
+#endif
+
+namespace vks
+{
+	namespace pipelinecache
+	{
+		/** @brief File name of the cache for a physical device, keyed by vendor, device, driver version and pipeline cache UUID so a driver update starts with a fresh file */
+		std::string getFileName(const VkPhysicalDeviceProperties& properties, const std::string& directory, const std::string& prefix);
+		/** @brief Create a pipeline cache that is filled with the data of the given file if it exists and matches the device, an empty cache otherwise */
+		VkResult create(VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& fileName, VkPipelineCache* pipelineCache);
+		/** @brief Write the contents of the pipeline cache to the given file, the file is replaced atomically so concurrent readers never see a partial cache */
+		bool save(VkDevice device, const VkPhysicalDeviceProperties& properties, VkPipelineCache pipelineCache, const std::string& fileName);
+	}
+}
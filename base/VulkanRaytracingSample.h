@@ -33,6 +33,7 @@ public:
 
 	// Available features and properties
 	VkPhysicalDeviceRayTracingPipelinePropertiesKHR  rayTracingPipelineProperties{};
+	VkPhysicalDeviceAccelerationStructurePropertiesKHR accelerationStructureProperties{};
 	VkPhysicalDeviceAccelerationStructureFeaturesKHR accelerationStructureFeatures{};
 
 	// Enabled features and properties
@@ -45,20 +46,20 @@ public:
 	{
 		uint64_t deviceAddress = 0;
 		VkBuffer handle = VK_NULL_HANDLE;
-		VkDeviceMemory memory = VK_NULL_HANDLE;
+		vks::MemoryAllocation memory;
 	};
 
 	// Holds information for a ray tracing acceleration structure
 	struct AccelerationStructure {
 		VkAccelerationStructureKHR handle;
 		uint64_t deviceAddress = 0;
-		VkDeviceMemory memory;
+		vks::MemoryAllocation memory;
 		VkBuffer buffer;
 	};
 
 	// Holds information for a storage image that the ray tracing shaders output to
 	struct StorageImage {
-		VkDeviceMemory memory = VK_NULL_HANDLE;
+		vks::MemoryAllocation memory;
 		VkImage image = VK_NULL_HANDLE;
 		VkImageView view = VK_NULL_HANDLE;
 		VkFormat format;
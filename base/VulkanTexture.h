@@ -21,6 +21,7 @@
 #include "VulkanBuffer.h"
 #include "VulkanDevice.h"
 #include "VulkanTools.h"
+#include "VulkanUploadManager.h"
 
 #if defined(__ANDROID__)
 #	include <android/asset_manager.h>
@@ -35,6 +36,8 @@ class Texture
 	VkImage               image;
 	VkImageLayout         imageLayout;
 	VkDeviceMemory        deviceMemory;
+	/** @brief Range of deviceMemory the image is bound to if it was sub-allocated by the device's allocator */
+	MemoryAllocation      allocation;
 	VkImageView           view;
 	uint32_t              width, height;
 	uint32_t              mipLevels;
@@ -69,6 +72,28 @@ class Texture2D : public Texture
 	    VkFilter           filter          = VK_FILTER_LINEAR,
 	    VkImageUsageFlags  imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
 	    VkImageLayout      imageLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	vks::UploadHandle loadFromFile(
+	    std::string         filename,
+	    VkFormat            format,
+	    vks::VulkanDevice * device,
+	    vks::UploadManager &uploadManager,
+	    VkImageUsageFlags   imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
+	    VkImageLayout       imageLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	vks::UploadHandle fromBuffer(
+	    void *              buffer,
+	    VkDeviceSize        bufferSize,
+	    VkFormat            format,
+	    uint32_t            texWidth,
+	    uint32_t            texHeight,
+	    vks::VulkanDevice * device,
+	    vks::UploadManager &uploadManager,
+	    VkFilter            filter          = VK_FILTER_LINEAR,
+	    VkImageUsageFlags   imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
+	    VkImageLayout       imageLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+  private:
+	void createImage(VkFormat format, VkImageUsageFlags imageUsageFlags);
+	void createSamplerAndView(VkFormat format, VkFilter filter);
 };
 
 class Texture2DArray : public Texture
@@ -52,7 +52,7 @@ namespace vks
 		VkPipelineLayout pipelineLayout;
 		VkPipeline pipeline;
 
-		VkDeviceMemory fontMemory = VK_NULL_HANDLE;
+		vks::MemoryAllocation fontMemory;
 		VkImage fontImage = VK_NULL_HANDLE;
 		VkImageView fontView = VK_NULL_HANDLE;
 		VkSampler sampler;
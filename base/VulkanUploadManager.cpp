@@ -0,0 +1,400 @@
+/*
+* Asynchronous uploads on the transfer queue
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanUploadManager.h"
+
+#include <cstring>
+
+#include "trace.h"
+
+namespace vks
+{
+	void UploadManager::create(vks::VulkanDevice* device, VkQueue graphicsQueue, VkDeviceSize stagingSize)
+	{
+		this->device = device;
+		this->graphicsQueue = graphicsQueue;
+		graphicsFamily = device->queueFamilyIndices.graphics;
+		transferFamily = device->queueFamilyIndices.transfer;
+		if (transferFamily == graphicsFamily) {
+			transferQueue = graphicsQueue;
+		}
+		else {
+			vkGetDeviceQueue(device->logicalDevice, transferFamily, 0, &transferQueue);
+			graphicsCommandPool = device->createCommandPool(graphicsFamily);
+		}
+		transferCommandPool = device->createCommandPool(transferFamily);
+
+		// Keep every allocation suitably aligned for buffer to image copies of all formats
+		stagingAlignment = std::max<VkDeviceSize>(16, device->properties.limits.optimalBufferCopyOffsetAlignment);
+		this->stagingSize = (stagingSize + stagingAlignment - 1) & ~(stagingAlignment - 1);
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, this->stagingSize, &stagingBuffer, &stagingMemory));
+		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, VK_WHOLE_SIZE, 0, (void**)&stagingData));
+
+		if (device->timelineSemaphores) {
+			// Core entry points are used if the device was created with Vulkan 1.2 features instead of the extension
+			getSemaphoreCounterValue = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(vkGetDeviceProcAddr(device->logicalDevice, "vkGetSemaphoreCounterValueKHR"));
+			waitSemaphores = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(vkGetDeviceProcAddr(device->logicalDevice, "vkWaitSemaphoresKHR"));
+			if (!getSemaphoreCounterValue || !waitSemaphores) {
+				getSemaphoreCounterValue = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(vkGetDeviceProcAddr(device->logicalDevice, "vkGetSemaphoreCounterValue"));
+				waitSemaphores = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(vkGetDeviceProcAddr(device->logicalDevice, "vkWaitSemaphores"));
+			}
+		}
+		if (getSemaphoreCounterValue && waitSemaphores) {
+			VkSemaphoreTypeCreateInfoKHR semaphoreTypeCI{};
+			semaphoreTypeCI.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+			semaphoreTypeCI.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+			semaphoreTypeCI.initialValue = 0;
+			VkSemaphoreCreateInfo semaphoreCI = vks::initializers::semaphoreCreateInfo();
+			semaphoreCI.pNext = &semaphoreTypeCI;
+			VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphoreCI, nullptr, &timelineSemaphore));
+		}
+		else {
+			getSemaphoreCounterValue = nullptr;
+			waitSemaphores = nullptr;
+		}
+	}
+
+	void UploadManager::destroy()
+	{
+		if (!device) {
+			return;
+		}
+		flush();
+		while (!pendingBatches.empty()) {
+			waitForBatch(pendingBatches.front());
+			retireBatches();
+		}
+		for (Batch* batch : batches) {
+			if (batch->transferComplete != VK_NULL_HANDLE) {
+				vkDestroySemaphore(device->logicalDevice, batch->transferComplete, nullptr);
+			}
+			if (batch->fence != VK_NULL_HANDLE) {
+				vkDestroyFence(device->logicalDevice, batch->fence, nullptr);
+			}
+			delete batch;
+		}
+		batches.clear();
+		freeBatches.clear();
+		currentBatch = nullptr;
+		if (timelineSemaphore != VK_NULL_HANDLE) {
+			vkDestroySemaphore(device->logicalDevice, timelineSemaphore, nullptr);
+			timelineSemaphore = VK_NULL_HANDLE;
+		}
+		// Destroying the pools frees their command buffers
+		vkDestroyCommandPool(device->logicalDevice, transferCommandPool, nullptr);
+		if (graphicsCommandPool != VK_NULL_HANDLE) {
+			vkDestroyCommandPool(device->logicalDevice, graphicsCommandPool, nullptr);
+			graphicsCommandPool = VK_NULL_HANDLE;
+		}
+		vkUnmapMemory(device->logicalDevice, stagingMemory);
+		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
+		device = nullptr;
+	}
+
+	bool UploadManager::isActive() const
+	{
+		return device != nullptr;
+	}
+
+	UploadHandle UploadManager::uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size, VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask)
+	{
+		assert(isActive());
+		UploadHandle handle;
+		// Data larger than the staging buffer is split up into several copies
+		const uint8_t* source = static_cast<const uint8_t*>(data);
+		VkDeviceSize copied = 0;
+		while (copied < size) {
+			const VkDeviceSize chunkSize = std::min(size - copied, stagingSize);
+			const VkDeviceSize stagingOffset = allocateStaging(chunkSize);
+			memcpy(stagingData + stagingOffset, source + copied, chunkSize);
+
+			Batch* batch = getCurrentBatch();
+			VkBufferCopy copyRegion{};
+			copyRegion.srcOffset = stagingOffset;
+			copyRegion.dstOffset = offset + copied;
+			copyRegion.size = chunkSize;
+			vkCmdCopyBuffer(batch->transferCommandBuffer, stagingBuffer, buffer, 1, &copyRegion);
+
+			VkBufferMemoryBarrier barrier = vks::initializers::bufferMemoryBarrier();
+			barrier.buffer = buffer;
+			barrier.offset = offset + copied;
+			barrier.size = chunkSize;
+			if (transfersOwnership()) {
+				// Release on the transfer queue, the matching acquire is recorded on the graphics queue when the batch is submitted
+				barrier.srcQueueFamilyIndex = transferFamily;
+				barrier.dstQueueFamilyIndex = graphicsFamily;
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = 0;
+				vkCmdPipelineBarrier(batch->transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+				barrier.srcAccessMask = 0;
+				barrier.dstAccessMask = dstAccessMask;
+				batch->bufferAcquires.push_back(barrier);
+				batch->acquireStages |= dstStageMask;
+			}
+			else {
+				barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				barrier.dstAccessMask = dstAccessMask;
+				vkCmdPipelineBarrier(batch->transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStageMask, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+			}
+			batch->empty = false;
+			batch->stagingEnd = stagingHead;
+			handle.value = batch->value;
+			copied += chunkSize;
+		}
+		return handle;
+	}
+
+	UploadHandle UploadManager::uploadImage(VkImage image, const VkImageSubresourceRange& subresourceRange, const std::vector<VkBufferImageCopy>& regions, const void* data, VkDeviceSize size, VkImageLayout finalLayout, VkPipelineStageFlags dstStageMask, VkAccessFlags dstAccessMask)
+	{
+		assert(isActive());
+		if (size > stagingSize) {
+			vks::tools::exitFatal("Image upload of " + std::to_string(size) + " bytes does not fit into the staging buffer of " + std::to_string(stagingSize) + " bytes", -1);
+		}
+		const VkDeviceSize stagingOffset = allocateStaging(size);
+		memcpy(stagingData + stagingOffset, data, size);
+
+		Batch* batch = getCurrentBatch();
+		std::vector<VkBufferImageCopy> stagingRegions(regions);
+		for (VkBufferImageCopy& region : stagingRegions) {
+			region.bufferOffset += stagingOffset;
+		}
+
+		VkImageMemoryBarrier barrier = vks::initializers::imageMemoryBarrier();
+		barrier.image = image;
+		barrier.subresourceRange = subresourceRange;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(batch->transferCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		vkCmdCopyBufferToImage(batch->transferCommandBuffer, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(stagingRegions.size()), stagingRegions.data());
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = finalLayout;
+		if (transfersOwnership()) {
+			// The layout transition is part of both the release and the acquire, so both have to use the same layouts
+			barrier.srcQueueFamilyIndex = transferFamily;
+			barrier.dstQueueFamilyIndex = graphicsFamily;
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = 0;
+			vkCmdPipelineBarrier(batch->transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = dstAccessMask;
+			batch->imageAcquires.push_back(barrier);
+			batch->acquireStages |= dstStageMask;
+		}
+		else {
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = dstAccessMask;
+			vkCmdPipelineBarrier(batch->transferCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStageMask, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		}
+		batch->empty = false;
+		batch->stagingEnd = stagingHead;
+
+		UploadHandle handle;
+		handle.value = batch->value;
+		return handle;
+	}
+
+	void UploadManager::flush()
+	{
+		if (!currentBatch || currentBatch->empty) {
+			return;
+		}
+		VKS_TRACE_SCOPE_CATEGORY("Submit uploads", "sync");
+		Batch* batch = currentBatch;
+		currentBatch = nullptr;
+		VK_CHECK_RESULT(vkEndCommandBuffer(batch->transferCommandBuffer));
+
+		// The last submission of a batch signals its value on the timeline (or its fence)
+		VkTimelineSemaphoreSubmitInfoKHR timelineSubmitInfo{};
+		timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+		timelineSubmitInfo.signalSemaphoreValueCount = 1;
+		timelineSubmitInfo.pSignalSemaphoreValues = &batch->value;
+		VkSubmitInfo completeSubmitInfo = vks::initializers::submitInfo();
+		if (timelineSemaphore != VK_NULL_HANDLE) {
+			completeSubmitInfo.pNext = &timelineSubmitInfo;
+			completeSubmitInfo.signalSemaphoreCount = 1;
+			completeSubmitInfo.pSignalSemaphores = &timelineSemaphore;
+		}
+		const VkFence fence = batch->fence;
+		if (fence != VK_NULL_HANDLE) {
+			VK_CHECK_RESULT(vkResetFences(device->logicalDevice, 1, &fence));
+		}
+
+		if (transfersOwnership()) {
+			VkSubmitInfo transferSubmitInfo = vks::initializers::submitInfo();
+			transferSubmitInfo.commandBufferCount = 1;
+			transferSubmitInfo.pCommandBuffers = &batch->transferCommandBuffer;
+			transferSubmitInfo.signalSemaphoreCount = 1;
+			transferSubmitInfo.pSignalSemaphores = &batch->transferComplete;
+			VK_CHECK_RESULT(vkQueueSubmit(transferQueue, 1, &transferSubmitInfo, VK_NULL_HANDLE));
+
+			VkCommandBufferBeginInfo beginInfo = vks::initializers::commandBufferBeginInfo();
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+			VK_CHECK_RESULT(vkBeginCommandBuffer(batch->acquireCommandBuffer, &beginInfo));
+			vkCmdPipelineBarrier(batch->acquireCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, batch->acquireStages, 0, 0, nullptr, static_cast<uint32_t>(batch->bufferAcquires.size()), batch->bufferAcquires.data(), static_cast<uint32_t>(batch->imageAcquires.size()), batch->imageAcquires.data());
+			VK_CHECK_RESULT(vkEndCommandBuffer(batch->acquireCommandBuffer));
+
+			const VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+			completeSubmitInfo.waitSemaphoreCount = 1;
+			completeSubmitInfo.pWaitSemaphores = &batch->transferComplete;
+			completeSubmitInfo.pWaitDstStageMask = &waitStageMask;
+			completeSubmitInfo.commandBufferCount = 1;
+			completeSubmitInfo.pCommandBuffers = &batch->acquireCommandBuffer;
+			VK_CHECK_RESULT(vkQueueSubmit(graphicsQueue, 1, &completeSubmitInfo, fence));
+		}
+		else {
+			completeSubmitInfo.commandBufferCount = 1;
+			completeSubmitInfo.pCommandBuffers = &batch->transferCommandBuffer;
+			VK_CHECK_RESULT(vkQueueSubmit(transferQueue, 1, &completeSubmitInfo, fence));
+		}
+		pendingBatches.push_back(batch);
+	}
+
+	bool UploadManager::isComplete(UploadHandle handle)
+	{
+		if (handle.value <= completedValue) {
+			return true;
+		}
+		retireBatches();
+		return handle.value <= completedValue;
+	}
+
+	void UploadManager::wait(UploadHandle handle)
+	{
+		if (isComplete(handle)) {
+			return;
+		}
+		if (currentBatch && (currentBatch->value == handle.value)) {
+			flush();
+		}
+		VKS_TRACE_SCOPE_CATEGORY("Wait for upload", "sync");
+		while (!pendingBatches.empty() && (pendingBatches.front()->value <= handle.value)) {
+			waitForBatch(pendingBatches.front());
+			retireBatches();
+		}
+	}
+
+	VkSemaphore UploadManager::getTimelineSemaphore() const
+	{
+		return timelineSemaphore;
+	}
+
+	bool UploadManager::transfersOwnership() const
+	{
+		return transferFamily != graphicsFamily;
+	}
+
+	UploadManager::Batch* UploadManager::getCurrentBatch()
+	{
+		if (currentBatch) {
+			return currentBatch;
+		}
+		if (freeBatches.empty()) {
+			Batch* batch = new Batch();
+			batch->transferCommandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, transferCommandPool, false);
+			if (transfersOwnership()) {
+				batch->acquireCommandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, graphicsCommandPool, false);
+				VkSemaphoreCreateInfo semaphoreCI = vks::initializers::semaphoreCreateInfo();
+				VK_CHECK_RESULT(vkCreateSemaphore(device->logicalDevice, &semaphoreCI, nullptr, &batch->transferComplete));
+			}
+			if (timelineSemaphore == VK_NULL_HANDLE) {
+				VkFenceCreateInfo fenceCI = vks::initializers::fenceCreateInfo();
+				VK_CHECK_RESULT(vkCreateFence(device->logicalDevice, &fenceCI, nullptr, &batch->fence));
+			}
+			batches.push_back(batch);
+			freeBatches.push_back(batch);
+		}
+		currentBatch = freeBatches.back();
+		freeBatches.pop_back();
+		currentBatch->value = nextValue++;
+		currentBatch->empty = true;
+		currentBatch->stagingEnd = stagingHead;
+		currentBatch->bufferAcquires.clear();
+		currentBatch->imageAcquires.clear();
+		currentBatch->acquireStages = 0;
+		// The pool allows resetting single command buffers, so beginning one resets it
+		VkCommandBufferBeginInfo beginInfo = vks::initializers::commandBufferBeginInfo();
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		VK_CHECK_RESULT(vkBeginCommandBuffer(currentBatch->transferCommandBuffer, &beginInfo));
+		return currentBatch;
+	}
+
+	VkDeviceSize UploadManager::allocateStaging(VkDeviceSize size)
+	{
+		assert(size <= stagingSize);
+		while (true) {
+			VkDeviceSize position = (stagingHead + stagingAlignment - 1) & ~(stagingAlignment - 1);
+			// Allocations don't wrap around the end of the ring
+			if ((position % stagingSize) + size > stagingSize) {
+				position += stagingSize - (position % stagingSize);
+			}
+			if (position + size - stagingTail <= stagingSize) {
+				stagingHead = position + size;
+				return position % stagingSize;
+			}
+			// The ring is full, reclaim the space of finished batches and wait for the oldest one if that's not enough
+			retireBatches();
+			if (pendingBatches.empty() && !(currentBatch && !currentBatch->empty)) {
+				// Nothing is using the ring anymore
+				stagingHead = stagingTail = 0;
+				continue;
+			}
+			if (position + size - stagingTail <= stagingSize) {
+				continue;
+			}
+			if (pendingBatches.empty()) {
+				// Only the batch that is being recorded uses the staging buffer
+				flush();
+			}
+			VKS_TRACE_SCOPE_CATEGORY("Wait for staging memory", "sync");
+			waitForBatch(pendingBatches.front());
+			retireBatches();
+		}
+	}
+
+	bool UploadManager::isBatchComplete(const Batch* batch) const
+	{
+		if (timelineSemaphore != VK_NULL_HANDLE) {
+			uint64_t value = 0;
+			VK_CHECK_RESULT(getSemaphoreCounterValue(device->logicalDevice, timelineSemaphore, &value));
+			return value >= batch->value;
+		}
+		return vkWaitForFences(device->logicalDevice, 1, &batch->fence, VK_TRUE, 0) == VK_SUCCESS;
+	}
+
+	void UploadManager::waitForBatch(const Batch* batch)
+	{
+		if (timelineSemaphore != VK_NULL_HANDLE) {
+			VkSemaphoreWaitInfoKHR waitInfo{};
+			waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+			waitInfo.semaphoreCount = 1;
+			waitInfo.pSemaphores = &timelineSemaphore;
+			waitInfo.pValues = &batch->value;
+			VK_CHECK_RESULT(waitSemaphores(device->logicalDevice, &waitInfo, UINT64_MAX));
+		}
+		else {
+			VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &batch->fence, VK_TRUE, UINT64_MAX));
+		}
+	}
+
+	void UploadManager::retireBatches()
+	{
+		// Batches finish in submission order
+		while (!pendingBatches.empty() && isBatchComplete(pendingBatches.front())) {
+			Batch* batch = pendingBatches.front();
+			pendingBatches.pop_front();
+			completedValue = batch->value;
+			stagingTail = batch->stagingEnd;
+			freeBatches.push_back(batch);
+		}
+	}
+}
@@ -0,0 +1,140 @@
+/*
+* Asynchronous uploads on the transfer queue
+*
+* Copies data through a ring staging buffer on the device's transfer queue family, so content can be streamed in
+* while the frame loop keeps running instead of stalling on a fence for every upload
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanDevice.h"
+
+namespace vks
+{
+	/** @brief Identifies an upload, it has finished once the manager's timeline has reached its value */
+	struct UploadHandle
+	{
+		uint64_t value = 0;
+		bool valid() const { return value != 0; }
+	};
+
+	/**
+	* @brief Records uploads into batches that are submitted to the transfer queue without waiting for them
+	* @note If the transfer queue belongs to another family than the graphics queue, the ownership of all resources is transferred
+	* to the graphics queue family by a second submission on the graphics queue, so work submitted to that queue after flush can use them
+	* @note Timeline semaphores are used if they have been enabled on the device (VK_KHR_timeline_semaphore), fences otherwise
+	* @note Not thread safe, use it from the thread that submits to the graphics queue
+	*/
+	class UploadManager
+	{
+	public:
+		static const VkDeviceSize defaultStagingSize = 32 * 1024 * 1024;
+
+		/**
+		* Create the staging ring buffer, command pools and synchronization objects
+		*
+		* @param device Device to upload to, the transfer queue of its transfer queue family is used
+		* @param graphicsQueue Queue the uploaded resources are used on, ownership is transferred to its family
+		* @param stagingSize (Optional) Size of the staging ring buffer, a single upload may not be larger (buffers are split)
+		*/
+		void create(vks::VulkanDevice* device, VkQueue graphicsQueue, VkDeviceSize stagingSize = defaultStagingSize);
+		/** @brief Wait for all uploads and destroy all Vulkan objects */
+		void destroy();
+		bool isActive() const;
+
+		/**
+		* Copy data to a buffer
+		*
+		* @param buffer Destination buffer, it must have been created with VK_BUFFER_USAGE_TRANSFER_DST_BIT
+		* @param offset Offset into the destination buffer
+		* @param data Data to copy, it's copied into the staging buffer before the function returns
+		* @param size Size of the data
+		* @param dstStageMask (Optional) Stages the buffer is used in afterwards
+		* @param dstAccessMask (Optional) Accesses to the buffer afterwards
+		*/
+		UploadHandle uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size, VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VkAccessFlags dstAccessMask = VK_ACCESS_MEMORY_READ_BIT);
+		/**
+		* Copy data to the subresources of an image and transition it to its final layout, the previous content of the image is discarded
+		*
+		* @param image Destination image, it must have been created with VK_IMAGE_USAGE_TRANSFER_DST_BIT
+		* @param subresourceRange Subresources that are written
+		* @param regions Copy regions with buffer offsets relative to the start of data, only whole mip levels may be copied to support transfer queues with a coarse image granularity
+		* @param data Data to copy, it's copied into the staging buffer before the function returns
+		* @param size Size of the data
+		* @param finalLayout (Optional) Layout the image is used in afterwards
+		* @param dstStageMask (Optional) Stages the image is used in afterwards
+		* @param dstAccessMask (Optional) Accesses to the image afterwards
+		*/
+		UploadHandle uploadImage(VkImage image, const VkImageSubresourceRange& subresourceRange, const std::vector<VkBufferImageCopy>& regions, const void* data, VkDeviceSize size, VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VkAccessFlags dstAccessMask = VK_ACCESS_SHADER_READ_BIT);
+		/** @brief Submit all uploads recorded since the last flush, does not wait for them */
+		void flush();
+		/** @brief Returns true once the upload has finished on the GPU */
+		bool isComplete(UploadHandle handle);
+		/** @brief Block until the upload has finished, flushes it first if required */
+		void wait(UploadHandle handle);
+		/** @brief Timeline semaphore that reaches the value of an upload's handle once it has finished, VK_NULL_HANDLE if timeline semaphores aren't enabled */
+		VkSemaphore getTimelineSemaphore() const;
+		/** @brief Returns true if uploads run on a queue family other than the graphics one */
+		bool transfersOwnership() const;
+
+	private:
+		struct Batch
+		{
+			VkCommandBuffer transferCommandBuffer = VK_NULL_HANDLE;
+			// Acquires the ownership on the graphics queue, only used if the queue families differ
+			VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE;
+			VkSemaphore transferComplete = VK_NULL_HANDLE;
+			// Only used without timeline semaphores
+			VkFence fence = VK_NULL_HANDLE;
+			uint64_t value = 0;
+			// Position of the staging ring's head once the batch has been recorded
+			VkDeviceSize stagingEnd = 0;
+			bool empty = true;
+			std::vector<VkBufferMemoryBarrier> bufferAcquires;
+			std::vector<VkImageMemoryBarrier> imageAcquires;
+			VkPipelineStageFlags acquireStages = 0;
+		};
+
+		vks::VulkanDevice* device = nullptr;
+		VkQueue graphicsQueue = VK_NULL_HANDLE;
+		VkQueue transferQueue = VK_NULL_HANDLE;
+		uint32_t graphicsFamily = 0;
+		uint32_t transferFamily = 0;
+		VkCommandPool transferCommandPool = VK_NULL_HANDLE;
+		VkCommandPool graphicsCommandPool = VK_NULL_HANDLE;
+
+		VkBuffer stagingBuffer = VK_NULL_HANDLE;
+		VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+		uint8_t* stagingData = nullptr;
+		VkDeviceSize stagingSize = 0;
+		VkDeviceSize stagingAlignment = 16;
+		// Positions grow monotonically, the offset in the staging buffer is the position modulo its size
+		VkDeviceSize stagingHead = 0;
+		VkDeviceSize stagingTail = 0;
+
+		VkSemaphore timelineSemaphore = VK_NULL_HANDLE;
+		PFN_vkGetSemaphoreCounterValueKHR getSemaphoreCounterValue = nullptr;
+		PFN_vkWaitSemaphoresKHR waitSemaphores = nullptr;
+
+		std::vector<Batch*> batches;
+		std::vector<Batch*> freeBatches;
+		std::deque<Batch*> pendingBatches;
+		Batch* currentBatch = nullptr;
+		uint64_t nextValue = 1;
+		uint64_t completedValue = 0;
+
+		Batch* getCurrentBatch();
+		VkDeviceSize allocateStaging(VkDeviceSize size);
+		bool isBatchComplete(const Batch* batch) const;
+		void waitForBatch(const Batch* batch);
+		void retireBatches();
+	};
+}
@@ -12,6 +12,8 @@
 #define TINYGLTF_NO_STB_IMAGE_WRITE
 
 #include "VulkanglTFModel.h"
+#include "trace.h"
+#include "frustum.hpp"
 
 VkDescriptorSetLayout vkglTF::descriptorSetLayoutImage = VK_NULL_HANDLE;
 VkDescriptorSetLayout vkglTF::descriptorSetLayoutUbo = VK_NULL_HANDLE;
@@ -30,7 +32,10 @@ bool loadImageDataFunc(tinygltf::Image* image, const int imageIndex, std::string
 		}
 	}
 
-	return tinygltf::LoadImageData(image, imageIndex, error, warning, req_width, req_height, bytes, size, userData);
+	// Only keep the encoded data, decoding is deferred to loadImages so all images can be decoded in parallel
+	image->image.assign(bytes, bytes + size);
+	image->as_is = true;
+	return true;
 }
 
 bool loadImageDataFuncEmpty(tinygltf::Image* image, const int imageIndex, std::string* error, std::string* warning, int req_width, int req_height, const unsigned char* bytes, int size, void* userData) 
@@ -57,7 +62,14 @@ void vkglTF::Texture::destroy()
 	{
 		vkDestroyImageView(device->logicalDevice, view, nullptr);
 		vkDestroyImage(device->logicalDevice, image, nullptr);
-		vkFreeMemory(device->logicalDevice, deviceMemory, nullptr);
+		if (allocation.block)
+		{
+			device->memoryAllocator->free(&allocation);
+		}
+		else
+		{
+			vkFreeMemory(device->logicalDevice, deviceMemory, nullptr);
+		}
 		vkDestroySampler(device->logicalDevice, sampler, nullptr);
 	}
 }
@@ -82,7 +94,19 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		unsigned char* buffer = nullptr;
 		VkDeviceSize bufferSize = 0;
 		bool deleteBuffer = false;
-		if (gltfimage.component == 3) {
+		if (gltfimage.as_is) {
+			// Image still holds the encoded data kept by our image loader
+			int imageWidth, imageHeight, imageComponents;
+			buffer = stbi_load_from_memory(gltfimage.image.data(), static_cast<int>(gltfimage.image.size()), &imageWidth, &imageHeight, &imageComponents, STBI_rgb_alpha);
+			if (!buffer) {
+				vks::tools::exitFatal("Could not decode image \"" + gltfimage.uri + "\": " + stbi_failure_reason(), -1);
+			}
+			gltfimage.width = imageWidth;
+			gltfimage.height = imageHeight;
+			bufferSize = gltfimage.width * gltfimage.height * 4;
+			deleteBuffer = true;
+		}
+		else if (gltfimage.component == 3) {
 			// Most devices don't support RGB only on Vulkan so convert if necessary
 			// TODO: Check actual format support and transform only if required
 			bufferSize = gltfimage.width * gltfimage.height * 4;
@@ -138,6 +162,15 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void**)&data));
 		memcpy(data, buffer, bufferSize);
 		vkUnmapMemory(device->logicalDevice, stagingMemory);
+		if (deleteBuffer) {
+			// Data has either been decoded by stb_image or converted to RGBA above
+			if (gltfimage.as_is) {
+				stbi_image_free(buffer);
+			}
+			else {
+				delete[] buffer;
+			}
+		}
 
 		VkImageCreateInfo imageCreateInfo{};
 		imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -153,11 +186,8 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		imageCreateInfo.extent = { width, height, 1 };
 		imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
-		vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+		VK_CHECK_RESULT(device->memoryAllocator->allocateForImage(image, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &allocation));
+		deviceMemory = allocation.memory;
 
 		VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
 
@@ -372,11 +402,8 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
 
-		vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+		VK_CHECK_RESULT(device->memoryAllocator->allocateForImage(image, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &allocation));
+		deviceMemory = allocation.memory;
 
 		VkImageSubresourceRange subresourceRange = {};
 		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -396,6 +423,11 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		ktxTexture_Destroy(ktxTexture);
 	}
 
+	createSamplerAndView(format);
+}
+
+void vkglTF::Texture::createSamplerAndView(VkFormat format)
+{
 	VkSamplerCreateInfo samplerInfo{};
 	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
 	samplerInfo.magFilter = VK_FILTER_LINEAR;
@@ -502,47 +534,197 @@ vkglTF::Mesh::~Mesh() {
 }
 
 /*
-	glTF node
+	glTF animation
 */
-glm::mat4 vkglTF::Node::localMatrix() {
-	return glm::translate(glm::mat4(1.0f), translation) * glm::mat4(rotation) * glm::scale(glm::mat4(1.0f), scale) * matrix;
+bool vkglTF::AnimationSampler::valid() const
+{
+	const size_t outputsPerKey = (interpolation == InterpolationType::CUBICSPLINE) ? 3 : 1;
+	return !inputs.empty() && (outputsVec4.size() >= inputs.size() * outputsPerKey);
 }
 
-glm::mat4 vkglTF::Node::getMatrix() {
-	glm::mat4 m = localMatrix();
-	vkglTF::Node *p = parent;
-	while (p) {
-		m = p->localMatrix() * m;
-		p = p->parent;
+uint32_t vkglTF::AnimationSampler::findKeyframe(float time)
+{
+	assert(inputs.size() > 1);
+	const uint32_t lastInterval = static_cast<uint32_t>(inputs.size()) - 2;
+	const uint32_t current = std::min(cursor, lastInterval);
+	// Playback mostly stays in the cached interval or moves on to the next one
+	if (time >= inputs[current]) {
+		if (time <= inputs[current + 1]) {
+			return cursor = current;
+		}
+		if ((current < lastInterval) && (time <= inputs[current + 2])) {
+			return cursor = current + 1;
+		}
 	}
-	return m;
+	// Seeking, looping or skipped frames fall back to a binary search
+	const size_t upper = std::upper_bound(inputs.begin(), inputs.end(), time) - inputs.begin();
+	cursor = upper > 0 ? std::min(static_cast<uint32_t>(upper - 1), lastInterval) : 0;
+	return cursor;
 }
 
-void vkglTF::Node::update() {
-	if (mesh) {
-		glm::mat4 m = getMatrix();
-		if (skin) {
-			mesh->uniformBlock.matrix = m;
-			// Update join matrices
-			glm::mat4 inverseTransform = glm::inverse(m);
-			for (size_t i = 0; i < skin->joints.size(); i++) {
-				vkglTF::Node *jointNode = skin->joints[i];
-				glm::mat4 jointMat = jointNode->getMatrix() * skin->inverseBindMatrices[i];
-				jointMat = inverseTransform * jointMat;
-				mesh->uniformBlock.jointMatrix[i] = jointMat;
-			}
-			mesh->uniformBlock.jointcount = (float)skin->joints.size();
-			memcpy(mesh->uniformBuffer.mapped, &mesh->uniformBlock, sizeof(mesh->uniformBlock));
-		} else {
-			memcpy(mesh->uniformBuffer.mapped, &m, sizeof(glm::mat4));
+void vkglTF::Animation::InterpolationBatch::add(uint32_t channel, const glm::vec4& from, const glm::vec4& to, float factor)
+{
+	channels.push_back(channel);
+	this->from.push_back(from);
+	this->to.push_back(to);
+	factors.push_back(factor);
+}
+
+void vkglTF::Animation::InterpolationBatch::clear()
+{
+	channels.clear();
+	from.clear();
+	to.clear();
+	factors.clear();
+}
+
+void vkglTF::Animation::evaluate(float time)
+{
+	channelValues.resize(channels.size());
+	channelValid.assign(channels.size(), 0);
+	lerpBatch.clear();
+	slerpBatch.clear();
+
+	// Locate the keyframes of all channels, step and cubic spline channels are evaluated right away
+	for (uint32_t i = 0; i < static_cast<uint32_t>(channels.size()); i++) {
+		const AnimationChannel& channel = channels[i];
+		AnimationSampler& sampler = samplers[channel.samplerIndex];
+		if (!sampler.valid()) {
+			continue;
+		}
+		channelValid[i] = 1;
+		const bool cubicSpline = sampler.interpolation == AnimationSampler::InterpolationType::CUBICSPLINE;
+		if (sampler.inputs.size() == 1) {
+			channelValues[i] = sampler.outputsVec4[cubicSpline ? 1 : 0];
+			continue;
+		}
+		const uint32_t key = sampler.findKeyframe(time);
+		const float delta = sampler.inputs[key + 1] - sampler.inputs[key];
+		const float u = (delta > 0.0f) ? std::min(std::max((time - sampler.inputs[key]) / delta, 0.0f), 1.0f) : 0.0f;
+		switch (sampler.interpolation) {
+		case AnimationSampler::InterpolationType::STEP:
+			channelValues[i] = sampler.outputsVec4[(u >= 1.0f) ? key + 1 : key];
+			break;
+		case AnimationSampler::InterpolationType::CUBICSPLINE: {
+			// Hermite spline between the values of both keyframes using the out-tangent of the first and the in-tangent of the second one
+			const glm::vec4& v0 = sampler.outputsVec4[key * 3 + 1];
+			const glm::vec4& b0 = sampler.outputsVec4[key * 3 + 2];
+			const glm::vec4& a1 = sampler.outputsVec4[(key + 1) * 3];
+			const glm::vec4& v1 = sampler.outputsVec4[(key + 1) * 3 + 1];
+			const float u2 = u * u;
+			const float u3 = u2 * u;
+			glm::vec4 value = v0 * (2.0f * u3 - 3.0f * u2 + 1.0f) + b0 * (delta * (u3 - 2.0f * u2 + u)) + v1 * (-2.0f * u3 + 3.0f * u2) + a1 * (delta * (u3 - u2));
+			if (channel.path == AnimationChannel::PathType::ROTATION) {
+				value = glm::normalize(value);
+			}
+			channelValues[i] = value;
+			break;
+		}
+		default:
+			if (channel.path == AnimationChannel::PathType::ROTATION) {
+				slerpBatch.add(i, sampler.outputsVec4[key], sampler.outputsVec4[key + 1], u);
+			} else {
+				lerpBatch.add(i, sampler.outputsVec4[key], sampler.outputsVec4[key + 1], u);
+			}
+			break;
 		}
 	}
 
-	for (auto& child : children) {
-		child->update();
+	// Translations and scales are interpolated in one loop over contiguous arrays, which the compiler can vectorize
+	const size_t lerpCount = lerpBatch.channels.size();
+	for (size_t i = 0; i < lerpCount; i++) {
+		lerpBatch.from[i] += (lerpBatch.to[i] - lerpBatch.from[i]) * lerpBatch.factors[i];
+	}
+	for (size_t i = 0; i < lerpCount; i++) {
+		channelValues[lerpBatch.channels[i]] = lerpBatch.from[i];
+	}
+
+	const size_t slerpCount = slerpBatch.channels.size();
+	for (size_t i = 0; i < slerpCount; i++) {
+		const glm::vec4& from = slerpBatch.from[i];
+		const glm::vec4& to = slerpBatch.to[i];
+		glm::quat q1;
+		q1.x = from.x;
+		q1.y = from.y;
+		q1.z = from.z;
+		q1.w = from.w;
+		glm::quat q2;
+		q2.x = to.x;
+		q2.y = to.y;
+		q2.z = to.z;
+		q2.w = to.w;
+		const glm::quat q = glm::normalize(glm::slerp(q1, q2, slerpBatch.factors[i]));
+		channelValues[slerpBatch.channels[i]] = glm::vec4(q.x, q.y, q.z, q.w);
+	}
+}
+
+/*
+	glTF node transform hierarchy
+*/
+uint32_t vkglTF::NodeTransforms::add(int32_t parent, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale, const glm::mat4& matrix)
+{
+	assert(parent < static_cast<int32_t>(parents.size()));
+	parents.push_back(parent);
+	translations.push_back(translation);
+	rotations.push_back(rotation);
+	scales.push_back(scale);
+	matrices.push_back(matrix);
+	worldMatrices.push_back(glm::mat4(1.0f));
+	dirty.push_back(1);
+	return static_cast<uint32_t>(parents.size() - 1);
+}
+
+void vkglTF::NodeTransforms::setTranslation(uint32_t index, const glm::vec3& translation)
+{
+	translations[index] = translation;
+	dirty[index] = 1;
+}
+
+void vkglTF::NodeTransforms::setRotation(uint32_t index, const glm::quat& rotation)
+{
+	rotations[index] = rotation;
+	dirty[index] = 1;
+}
+
+void vkglTF::NodeTransforms::setScale(uint32_t index, const glm::vec3& scale)
+{
+	scales[index] = scale;
+	dirty[index] = 1;
+}
+
+glm::mat4 vkglTF::NodeTransforms::localMatrix(uint32_t index) const
+{
+	return glm::translate(glm::mat4(1.0f), translations[index]) * glm::mat4(rotations[index]) * glm::scale(glm::mat4(1.0f), scales[index]) * matrices[index];
+}
+
+bool vkglTF::NodeTransforms::update()
+{
+	bool changed = false;
+	const size_t count = parents.size();
+	for (size_t i = 0; i < count; i++) {
+		const int32_t parent = parents[i];
+		// Parents are processed first, so their flag already covers changes further up the hierarchy
+		if (parent > -1 && dirty[parent]) {
+			dirty[i] = 1;
+		}
+		if (!dirty[i]) {
+			continue;
+		}
+		const glm::mat4 local = localMatrix(static_cast<uint32_t>(i));
+		worldMatrices[i] = (parent > -1) ? worldMatrices[parent] * local : local;
+		changed = true;
 	}
+	return changed;
+}
+
+void vkglTF::NodeTransforms::clearDirty()
+{
+	std::fill(dirty.begin(), dirty.end(), static_cast<uint8_t>(0));
 }
 
+/*
+	glTF node
+*/
 vkglTF::Node::~Node() {
 	if (mesh) {
 		delete mesh;
@@ -607,6 +789,16 @@ VkPipelineVertexInputStateCreateInfo* vkglTF::Vertex::getPipelineVertexInputStat
 	return &pipelineVertexInputStateCreateInfo;
 }
 
+const vkglTF::VertexLayout::Attribute* vkglTF::VertexLayout::find(VertexComponent component) const
+{
+	for (const Attribute& attribute : attributes) {
+		if (attribute.component == component) {
+			return &attribute;
+		}
+	}
+	return nullptr;
+}
+
 vkglTF::Texture* vkglTF::Model::getTexture(uint32_t index)
 {
 
@@ -672,11 +864,8 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 	imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 	VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &emptyTexture.image));
 
-	vkGetImageMemoryRequirements(device->logicalDevice, emptyTexture.image, &memReqs);
-	memAllocInfo.allocationSize = memReqs.size;
-	memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &emptyTexture.deviceMemory));
-	VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, emptyTexture.image, emptyTexture.deviceMemory, 0));
+	VK_CHECK_RESULT(device->memoryAllocator->allocateForImage(emptyTexture.image, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &emptyTexture.allocation));
+	emptyTexture.deviceMemory = emptyTexture.allocation.memory;
 
 	VkImageSubresourceRange subresourceRange{};
 	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -745,195 +934,220 @@ vkglTF::Model::~Model()
 	}
 	vkDestroyDescriptorPool(device->logicalDevice, descriptorPool, nullptr);
 	emptyTexture.destroy();
+	if (indirect.prepared) {
+		indirect.commands.destroy();
+		indirect.drawData.destroy();
+		indirect.materials.destroy();
+		indirect.matrices.destroy();
+		vkDestroyDescriptorSetLayout(device->logicalDevice, indirect.descriptorSetLayout, nullptr);
+		vkDestroyDescriptorPool(device->logicalDevice, indirect.descriptorPool, nullptr);
+	}
+	if (culling.prepared) {
+		destroyDepthPyramid();
+		culling.uniformBuffer.destroy();
+		culling.bounds.destroy();
+		culling.commands.destroy();
+		culling.drawCounts.destroy();
+		vkDestroySampler(device->logicalDevice, culling.sampler, nullptr);
+		vkDestroyPipeline(device->logicalDevice, culling.pipeline, nullptr);
+		vkDestroyPipelineLayout(device->logicalDevice, culling.pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(device->logicalDevice, culling.descriptorSetLayout, nullptr);
+		vkDestroyPipeline(device->logicalDevice, culling.reducePipeline, nullptr);
+		vkDestroyPipelineLayout(device->logicalDevice, culling.reducePipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(device->logicalDevice, culling.reduceDescriptorSetLayout, nullptr);
+		vkDestroyDescriptorPool(device->logicalDevice, culling.descriptorPool, nullptr);
+	}
+}
+
+namespace
+{
+	template<typename T>
+	void copyIndices(const unsigned char* source, size_t count, uint32_t vertexStart, uint32_t* destination)
+	{
+		const T* buf = reinterpret_cast<const T*>(source);
+		for (size_t index = 0; index < count; index++) {
+			destination[index] = buf[index] + vertexStart;
+		}
+	}
+
+	/*
+		Unpack the vertices and indices of a primitive into its reserved ranges of the model's buffers
+		Primitives don't share any data, so they can be unpacked in parallel
+	*/
+	void unpackPrimitive(const tinygltf::Model& model, const tinygltf::Primitive& primitive, vkglTF::Vertex* vertices, uint32_t* indices, uint32_t vertexStart)
+	{
+		// Vertices
+		{
+			const float *bufferPos = nullptr;
+			const float *bufferNormals = nullptr;
+			const float *bufferTexCoords = nullptr;
+			const float* bufferColors = nullptr;
+			const float *bufferTangents = nullptr;
+			uint32_t numColorComponents;
+			const uint16_t *bufferJoints = nullptr;
+			const float *bufferWeights = nullptr;
+
+			const tinygltf::Accessor &posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
+			const tinygltf::BufferView &posView = model.bufferViews[posAccessor.bufferView];
+			bufferPos = reinterpret_cast<const float *>(&(model.buffers[posView.buffer].data[posAccessor.byteOffset + posView.byteOffset]));
+
+			if (primitive.attributes.find("NORMAL") != primitive.attributes.end()) {
+				const tinygltf::Accessor &normAccessor = model.accessors[primitive.attributes.find("NORMAL")->second];
+				const tinygltf::BufferView &normView = model.bufferViews[normAccessor.bufferView];
+				bufferNormals = reinterpret_cast<const float *>(&(model.buffers[normView.buffer].data[normAccessor.byteOffset + normView.byteOffset]));
+			}
+
+			if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
+				const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find("TEXCOORD_0")->second];
+				const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
+				bufferTexCoords = reinterpret_cast<const float *>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
+			}
+
+			if (primitive.attributes.find("COLOR_0") != primitive.attributes.end())
+			{
+				const tinygltf::Accessor& colorAccessor = model.accessors[primitive.attributes.find("COLOR_0")->second];
+				const tinygltf::BufferView& colorView = model.bufferViews[colorAccessor.bufferView];
+				// Color buffer are either of type vec3 or vec4
+				numColorComponents = colorAccessor.type == TINYGLTF_PARAMETER_TYPE_FLOAT_VEC3 ? 3 : 4;
+				bufferColors = reinterpret_cast<const float*>(&(model.buffers[colorView.buffer].data[colorAccessor.byteOffset + colorView.byteOffset]));
+			}
+
+			if (primitive.attributes.find("TANGENT") != primitive.attributes.end())
+			{
+				const tinygltf::Accessor &tangentAccessor = model.accessors[primitive.attributes.find("TANGENT")->second];
+				const tinygltf::BufferView &tangentView = model.bufferViews[tangentAccessor.bufferView];
+				bufferTangents = reinterpret_cast<const float *>(&(model.buffers[tangentView.buffer].data[tangentAccessor.byteOffset + tangentView.byteOffset]));
+			}
+
+			// Skinning
+			// Joints
+			if (primitive.attributes.find("JOINTS_0") != primitive.attributes.end()) {
+				const tinygltf::Accessor &jointAccessor = model.accessors[primitive.attributes.find("JOINTS_0")->second];
+				const tinygltf::BufferView &jointView = model.bufferViews[jointAccessor.bufferView];
+				bufferJoints = reinterpret_cast<const uint16_t *>(&(model.buffers[jointView.buffer].data[jointAccessor.byteOffset + jointView.byteOffset]));
+			}
+
+			if (primitive.attributes.find("WEIGHTS_0") != primitive.attributes.end()) {
+				const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find("WEIGHTS_0")->second];
+				const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
+				bufferWeights = reinterpret_cast<const float *>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
+			}
+
+			const bool hasSkin = (bufferJoints && bufferWeights);
+
+			for (size_t v = 0; v < posAccessor.count; v++) {
+				vkglTF::Vertex& vert = vertices[v];
+				vert.pos = glm::vec4(glm::make_vec3(&bufferPos[v * 3]), 1.0f);
+				vert.normal = glm::normalize(glm::vec3(bufferNormals ? glm::make_vec3(&bufferNormals[v * 3]) : glm::vec3(0.0f)));
+				vert.uv = bufferTexCoords ? glm::make_vec2(&bufferTexCoords[v * 2]) : glm::vec3(0.0f);
+				if (bufferColors) {
+					switch (numColorComponents) {
+						case 3:
+							vert.color = glm::vec4(glm::make_vec3(&bufferColors[v * 3]), 1.0f);
+							break;
+						case 4:
+							vert.color = glm::make_vec4(&bufferColors[v * 4]);
+							break;
+					}
+				}
+				else {
+					vert.color = glm::vec4(1.0f);
+				}
+				vert.tangent = bufferTangents ? glm::vec4(glm::make_vec4(&bufferTangents[v * 4])) : glm::vec4(0.0f);
+				vert.joint0 = hasSkin ? glm::vec4(glm::make_vec4(&bufferJoints[v * 4])) : glm::vec4(0.0f);
+				vert.weight0 = hasSkin ? glm::make_vec4(&bufferWeights[v * 4]) : glm::vec4(0.0f);
+			}
+		}
+		// Indices (the component type has already been checked by loadNode)
+		{
+			const tinygltf::Accessor &accessor = model.accessors[primitive.indices];
+			const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
+			const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
+			const unsigned char* data = &buffer.data[accessor.byteOffset + bufferView.byteOffset];
+
+			switch (accessor.componentType) {
+			case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT:
+				copyIndices<uint32_t>(data, accessor.count, vertexStart, indices);
+				break;
+			case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT:
+				copyIndices<uint16_t>(data, accessor.count, vertexStart, indices);
+				break;
+			case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE:
+				copyIndices<uint8_t>(data, accessor.count, vertexStart, indices);
+				break;
+			}
+		}
+	}
 }
 
-void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, uint32_t nodeIndex, const tinygltf::Model &model, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer, float globalscale)
+void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, uint32_t nodeIndex, const tinygltf::Model &model, std::vector<PrimitiveRange>& primitives, uint32_t& vertexCount, uint32_t& indexCount, float globalscale)
 {
 	vkglTF::Node *newNode = new Node{};
 	newNode->index = nodeIndex;
 	newNode->parent = parent;
 	newNode->name = node.name;
 	newNode->skinIndex = node.skin;
-	newNode->matrix = glm::mat4(1.0f);
 
-	// Generate local node matrix
+	// Generate local node transform
 	glm::vec3 translation = glm::vec3(0.0f);
 	if (node.translation.size() == 3) {
 		translation = glm::make_vec3(node.translation.data());
-		newNode->translation = translation;
 	}
-	glm::mat4 rotation = glm::mat4(1.0f);
+	glm::quat rotation = glm::quat();
 	if (node.rotation.size() == 4) {
-		glm::quat q = glm::make_quat(node.rotation.data());
-		newNode->rotation = glm::mat4(q);
+		rotation = glm::make_quat(node.rotation.data());
 	}
 	glm::vec3 scale = glm::vec3(1.0f);
 	if (node.scale.size() == 3) {
 		scale = glm::make_vec3(node.scale.data());
-		newNode->scale = scale;
 	}
+	glm::mat4 matrix = glm::mat4(1.0f);
 	if (node.matrix.size() == 16) {
-		newNode->matrix = glm::make_mat4x4(node.matrix.data());
+		matrix = glm::make_mat4x4(node.matrix.data());
 		if (globalscale != 1.0f) {
-			//newNode->matrix = glm::scale(newNode->matrix, glm::vec3(globalscale));
+			//matrix = glm::scale(matrix, glm::vec3(globalscale));
 		}
 	};
+	// Nodes are added before their children, which keeps the transform hierarchy sorted
+	newNode->transformIndex = transforms.add(parent ? static_cast<int32_t>(parent->transformIndex) : -1, translation, rotation, scale, matrix);
 
 	// Node with children
 	if (node.children.size() > 0) {
 		for (auto i = 0; i < node.children.size(); i++) {
-			loadNode(newNode, model.nodes[node.children[i]], node.children[i], model, indexBuffer, vertexBuffer, globalscale);
+			loadNode(newNode, model.nodes[node.children[i]], node.children[i], model, primitives, vertexCount, indexCount, globalscale);
 		}
 	}
 
 	// Node contains mesh data
+	// Only the ranges of the primitives are reserved here, their data is unpacked in parallel by loadFromFile
 	if (node.mesh > -1) {
-		const tinygltf::Mesh mesh = model.meshes[node.mesh];
-		Mesh *newMesh = new Mesh(device, newNode->matrix);
+		const tinygltf::Mesh &mesh = model.meshes[node.mesh];
+		Mesh *newMesh = new Mesh(device, matrix);
 		newMesh->name = mesh.name;
 		for (size_t j = 0; j < mesh.primitives.size(); j++) {
 			const tinygltf::Primitive &primitive = mesh.primitives[j];
 			if (primitive.indices < 0) {
 				continue;
 			}
-			uint32_t indexStart = static_cast<uint32_t>(indexBuffer.size());
-			uint32_t vertexStart = static_cast<uint32_t>(vertexBuffer.size());
-			uint32_t indexCount = 0;
-			uint32_t vertexCount = 0;
-			glm::vec3 posMin{};
-			glm::vec3 posMax{};
-			bool hasSkin = false;
-			// Vertices
-			{
-				const float *bufferPos = nullptr;
-				const float *bufferNormals = nullptr;
-				const float *bufferTexCoords = nullptr;
-				const float* bufferColors = nullptr;
-				const float *bufferTangents = nullptr;
-				uint32_t numColorComponents;
-				const uint16_t *bufferJoints = nullptr;
-				const float *bufferWeights = nullptr;
-
-				// Position attribute is required
-				assert(primitive.attributes.find("POSITION") != primitive.attributes.end());
-
-				const tinygltf::Accessor &posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
-				const tinygltf::BufferView &posView = model.bufferViews[posAccessor.bufferView];
-				bufferPos = reinterpret_cast<const float *>(&(model.buffers[posView.buffer].data[posAccessor.byteOffset + posView.byteOffset]));
-				posMin = glm::vec3(posAccessor.minValues[0], posAccessor.minValues[1], posAccessor.minValues[2]);
-				posMax = glm::vec3(posAccessor.maxValues[0], posAccessor.maxValues[1], posAccessor.maxValues[2]);
-
-				if (primitive.attributes.find("NORMAL") != primitive.attributes.end()) {
-					const tinygltf::Accessor &normAccessor = model.accessors[primitive.attributes.find("NORMAL")->second];
-					const tinygltf::BufferView &normView = model.bufferViews[normAccessor.bufferView];
-					bufferNormals = reinterpret_cast<const float *>(&(model.buffers[normView.buffer].data[normAccessor.byteOffset + normView.byteOffset]));
-				}
-
-				if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
-					const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find("TEXCOORD_0")->second];
-					const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
-					bufferTexCoords = reinterpret_cast<const float *>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
-				}
-
-				if (primitive.attributes.find("COLOR_0") != primitive.attributes.end())
-				{
-					const tinygltf::Accessor& colorAccessor = model.accessors[primitive.attributes.find("COLOR_0")->second];
-					const tinygltf::BufferView& colorView = model.bufferViews[colorAccessor.bufferView];
-					// Color buffer are either of type vec3 or vec4
-					numColorComponents = colorAccessor.type == TINYGLTF_PARAMETER_TYPE_FLOAT_VEC3 ? 3 : 4;
-					bufferColors = reinterpret_cast<const float*>(&(model.buffers[colorView.buffer].data[colorAccessor.byteOffset + colorView.byteOffset]));
-				}
-
-				if (primitive.attributes.find("TANGENT") != primitive.attributes.end())
-				{
-					const tinygltf::Accessor &tangentAccessor = model.accessors[primitive.attributes.find("TANGENT")->second];
-					const tinygltf::BufferView &tangentView = model.bufferViews[tangentAccessor.bufferView];
-					bufferTangents = reinterpret_cast<const float *>(&(model.buffers[tangentView.buffer].data[tangentAccessor.byteOffset + tangentView.byteOffset]));
-				}
-
-				// Skinning
-				// Joints
-				if (primitive.attributes.find("JOINTS_0") != primitive.attributes.end()) {
-					const tinygltf::Accessor &jointAccessor = model.accessors[primitive.attributes.find("JOINTS_0")->second];
-					const tinygltf::BufferView &jointView = model.bufferViews[jointAccessor.bufferView];
-					bufferJoints = reinterpret_cast<const uint16_t *>(&(model.buffers[jointView.buffer].data[jointAccessor.byteOffset + jointView.byteOffset]));
-				}
-
-				if (primitive.attributes.find("WEIGHTS_0") != primitive.attributes.end()) {
-					const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find("WEIGHTS_0")->second];
-					const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
-					bufferWeights = reinterpret_cast<const float *>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
-				}
+			// Position attribute is required
+			assert(primitive.attributes.find("POSITION") != primitive.attributes.end());
 
-				hasSkin = (bufferJoints && bufferWeights);
-
-				vertexCount = static_cast<uint32_t>(posAccessor.count);
-
-				for (size_t v = 0; v < posAccessor.count; v++) {
-					Vertex vert{};
-					vert.pos = glm::vec4(glm::make_vec3(&bufferPos[v * 3]), 1.0f);
-					vert.normal = glm::normalize(glm::vec3(bufferNormals ? glm::make_vec3(&bufferNormals[v * 3]) : glm::vec3(0.0f)));
-					vert.uv = bufferTexCoords ? glm::make_vec2(&bufferTexCoords[v * 2]) : glm::vec3(0.0f);
-					if (bufferColors) {
-						switch (numColorComponents) {
-							case 3: 
-								vert.color = glm::vec4(glm::make_vec3(&bufferColors[v * 3]), 1.0f);
-							case 4:
-								vert.color = glm::make_vec4(&bufferColors[v * 4]);
-						}
-					}
-					else {
-						vert.color = glm::vec4(1.0f);
-					}
-					vert.tangent = bufferTangents ? glm::vec4(glm::make_vec4(&bufferTangents[v * 4])) : glm::vec4(0.0f);
-					vert.joint0 = hasSkin ? glm::vec4(glm::make_vec4(&bufferJoints[v * 4])) : glm::vec4(0.0f);
-					vert.weight0 = hasSkin ? glm::make_vec4(&bufferWeights[v * 4]) : glm::vec4(0.0f);
-					vertexBuffer.push_back(vert);
-				}
+			const tinygltf::Accessor &posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
+			const tinygltf::Accessor &indexAccessor = model.accessors[primitive.indices];
+			if ((indexAccessor.componentType != TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT) && (indexAccessor.componentType != TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT) && (indexAccessor.componentType != TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE)) {
+				std::cerr << "Index component type " << indexAccessor.componentType << " not supported!" << std::endl;
+				continue;
 			}
-			// Indices
-			{
-				const tinygltf::Accessor &accessor = model.accessors[primitive.indices];
-				const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
-				const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
-
-				indexCount = static_cast<uint32_t>(accessor.count);
 
-				switch (accessor.componentType) {
-				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
-					uint32_t *buf = new uint32_t[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint32_t));
-					for (size_t index = 0; index < accessor.count; index++) {
-						indexBuffer.push_back(buf[index] + vertexStart);
-					}
-					break;
-				}
-				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
-					uint16_t *buf = new uint16_t[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint16_t));
-					for (size_t index = 0; index < accessor.count; index++) {
-						indexBuffer.push_back(buf[index] + vertexStart);
-					}
-					break;
-				}
-				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
-					uint8_t *buf = new uint8_t[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint8_t));
-					for (size_t index = 0; index < accessor.count; index++) {
-						indexBuffer.push_back(buf[index] + vertexStart);
-					}
-					break;
-				}
-				default:
-					std::cerr << "Index component type " << accessor.componentType << " not supported!" << std::endl;
-					return;
-				}
-			}
-			Primitive *newPrimitive = new Primitive(indexStart, indexCount, primitive.material > -1 ? materials[primitive.material] : materials.back());
-			newPrimitive->firstVertex = vertexStart;
-			newPrimitive->vertexCount = vertexCount;
-			newPrimitive->setDimensions(posMin, posMax);
+			Primitive *newPrimitive = new Primitive(indexCount, static_cast<uint32_t>(indexAccessor.count), primitive.material > -1 ? materials[primitive.material] : materials.back());
+			newPrimitive->firstVertex = vertexCount;
+			newPrimitive->vertexCount = static_cast<uint32_t>(posAccessor.count);
+			newPrimitive->setDimensions(glm::vec3(posAccessor.minValues[0], posAccessor.minValues[1], posAccessor.minValues[2]), glm::vec3(posAccessor.maxValues[0], posAccessor.maxValues[1], posAccessor.maxValues[2]));
 			newMesh->primitives.push_back(newPrimitive);
+
+			primitives.push_back({ &primitive, vertexCount, indexCount });
+			vertexCount += newPrimitive->vertexCount;
+			indexCount += newPrimitive->indexCount;
 		}
 		newNode->mesh = newMesh;
 	}
@@ -960,7 +1174,8 @@ void vkglTF::Model::loadSkins(tinygltf::Model &gltfModel)
 		for (int jointIndex : source.joints) {
 			Node* node = nodeFromIndex(jointIndex);
 			if (node) {
-				newSkin->joints.push_back(nodeFromIndex(jointIndex));
+				newSkin->joints.push_back(node);
+				newSkin->jointTransforms.push_back(node->transformIndex);
 			}
 		}
 
@@ -977,105 +1192,450 @@ void vkglTF::Model::loadSkins(tinygltf::Model &gltfModel)
 	}
 }
 
-void vkglTF::Model::loadImages(tinygltf::Model &gltfModel, vks::VulkanDevice *device, VkQueue transferQueue)
-{
-	for (tinygltf::Image &image : gltfModel.images) {
-		vkglTF::Texture texture;
-		texture.fromglTfImage(image, path, device, transferQueue);
-		textures.push_back(texture);
-	}
-	// Create an empty texture to be used for empty material images
-	createEmptyTexture(transferQueue);
-}
-
-void vkglTF::Model::loadMaterials(tinygltf::Model &gltfModel)
+namespace
 {
-	for (tinygltf::Material &mat : gltfModel.materials) {
-		vkglTF::Material material(device);
-		if (mat.values.find("baseColorTexture") != mat.values.end()) {
-			material.baseColorTexture = getTexture(gltfModel.textures[mat.values["baseColorTexture"].TextureIndex()].source);
-		}
-		// Metallic roughness workflow
-		if (mat.values.find("metallicRoughnessTexture") != mat.values.end()) {
-			material.metallicRoughnessTexture = getTexture(gltfModel.textures[mat.values["metallicRoughnessTexture"].TextureIndex()].source);
-		}
-		if (mat.values.find("roughnessFactor") != mat.values.end()) {
-			material.roughnessFactor = static_cast<float>(mat.values["roughnessFactor"].Factor());
-		}
-		if (mat.values.find("metallicFactor") != mat.values.end()) {
-			material.metallicFactor = static_cast<float>(mat.values["metallicFactor"].Factor());
-		}
-		if (mat.values.find("baseColorFactor") != mat.values.end()) {
-			material.baseColorFactor = glm::make_vec4(mat.values["baseColorFactor"].ColorFactor().data());
-		}				
-		if (mat.additionalValues.find("normalTexture") != mat.additionalValues.end()) {
-			material.normalTexture = getTexture(gltfModel.textures[mat.additionalValues["normalTexture"].TextureIndex()].source);
-		} else {
-			material.normalTexture = &emptyTexture;
-		}
-		if (mat.additionalValues.find("emissiveTexture") != mat.additionalValues.end()) {
-			material.emissiveTexture = getTexture(gltfModel.textures[mat.additionalValues["emissiveTexture"].TextureIndex()].source);
+	/*
+		Pixels of a glTF image, either decoded to 8-bit RGBA by stb_image or a ktx texture containing all mip levels
+	*/
+	struct ImageData
+	{
+		stbi_uc* pixels = nullptr;
+		ktxTexture* ktx = nullptr;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t mipLevels = 1;
+		VkDeviceSize size = 0;
+		std::string error;
+
+		ImageData() {};
+		ImageData(const ImageData&) = delete;
+		ImageData& operator=(const ImageData&) = delete;
+		~ImageData()
+		{
+			release();
 		}
-		if (mat.additionalValues.find("occlusionTexture") != mat.additionalValues.end()) {
-			material.occlusionTexture = getTexture(gltfModel.textures[mat.additionalValues["occlusionTexture"].TextureIndex()].source);
+		const uint8_t* data() const
+		{
+			return ktx ? ktxTexture_GetData(ktx) : pixels;
 		}
-		if (mat.additionalValues.find("alphaMode") != mat.additionalValues.end()) {
-			tinygltf::Parameter param = mat.additionalValues["alphaMode"];
-			if (param.string_value == "BLEND") {
-				material.alphaMode = Material::ALPHAMODE_BLEND;
+		void release()
+		{
+			if (pixels) {
+				stbi_image_free(pixels);
+				pixels = nullptr;
 			}
-			if (param.string_value == "MASK") {
-				material.alphaMode = Material::ALPHAMODE_MASK;
+			if (ktx) {
+				ktxTexture_Destroy(ktx);
+				ktx = nullptr;
 			}
 		}
-		if (mat.additionalValues.find("alphaCutoff") != mat.additionalValues.end()) {
-			material.alphaCutoff = static_cast<float>(mat.additionalValues["alphaCutoff"].Factor());
-		}
+	};
 
-		materials.push_back(material);
+	bool isKtxFile(const std::string& uri)
+	{
+		return (uri.find_last_of(".") != std::string::npos) && (uri.substr(uri.find_last_of(".") + 1) == "ktx");
 	}
-	// Push a default material at the end of the list for meshes with no material assigned
-	materials.push_back(Material(device));
-}
-
-void vkglTF::Model::loadAnimations(tinygltf::Model &gltfModel)
-{
-	for (tinygltf::Animation &anim : gltfModel.animations) {
-		vkglTF::Animation animation{};
-		animation.name = anim.name;
-		if (anim.name.empty()) {
-			animation.name = std::to_string(animations.size());
-		}
-
-		// Samplers
-		for (auto &samp : anim.samplers) {
-			vkglTF::AnimationSampler sampler{};
 
-			if (samp.interpolation == "LINEAR") {
-				sampler.interpolation = AnimationSampler::InterpolationType::LINEAR;
+	/*
+		Decode a single image, called from the job system's threads so errors are returned instead of reported
+	*/
+	void decodeImage(tinygltf::Image& gltfimage, const std::string& path, ImageData& imageData)
+	{
+		vks::trace::Scope traceScope("Decode image", "assets", gltfimage.uri);
+		if (isKtxFile(gltfimage.uri)) {
+			// Texture is stored in an external ktx file
+			std::string filename = path + "/" + gltfimage.uri;
+			ktxResult result = KTX_SUCCESS;
+#if defined(__ANDROID__)
+			AAsset* asset = AAssetManager_open(androidApp->activity->assetManager, filename.c_str(), AASSET_MODE_STREAMING);
+			if (!asset) {
+				imageData.error = "Could not load texture from " + filename + "\n\nThe file may be part of the additional asset pack.\n\nRun \"download_assets.py\" in the repository root to download the latest version.";
+				return;
 			}
-			if (samp.interpolation == "STEP") {
-				sampler.interpolation = AnimationSampler::InterpolationType::STEP;
+			size_t size = AAsset_getLength(asset);
+			assert(size > 0);
+			std::vector<ktx_uint8_t> textureData(size);
+			AAsset_read(asset, textureData.data(), size);
+			AAsset_close(asset);
+			result = ktxTexture_CreateFromMemory(textureData.data(), size, KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &imageData.ktx);
+#else
+			if (!vks::tools::fileExists(filename)) {
+				imageData.error = "Could not load texture from " + filename + "\n\nThe file may be part of the additional asset pack.\n\nRun \"download_assets.py\" in the repository root to download the latest version.";
+				return;
 			}
-			if (samp.interpolation == "CUBICSPLINE") {
-				sampler.interpolation = AnimationSampler::InterpolationType::CUBICSPLINE;
+			result = ktxTexture_CreateFromNamedFile(filename.c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &imageData.ktx);
+#endif
+			if (result != KTX_SUCCESS) {
+				imageData.ktx = nullptr;
+				imageData.error = "Could not load texture from " + filename;
+				return;
 			}
+			imageData.width = imageData.ktx->baseWidth;
+			imageData.height = imageData.ktx->baseHeight;
+			imageData.mipLevels = imageData.ktx->numLevels;
+			imageData.size = ktxTexture_GetSize(imageData.ktx);
+		}
+		else {
+			// Most devices don't support RGB only on Vulkan, so stb_image expands all images to RGBA while decoding
+			int width, height, components;
+			imageData.pixels = stbi_load_from_memory(gltfimage.image.data(), static_cast<int>(gltfimage.image.size()), &width, &height, &components, STBI_rgb_alpha);
+			if (!imageData.pixels) {
+				imageData.error = "Could not decode image \"" + gltfimage.uri + "\": " + stbi_failure_reason();
+				return;
+			}
+			// The encoded data is no longer required
+			std::vector<unsigned char>().swap(gltfimage.image);
+			imageData.width = static_cast<uint32_t>(width);
+			imageData.height = static_cast<uint32_t>(height);
+			imageData.mipLevels = static_cast<uint32_t>(floor(log2(std::max(imageData.width, imageData.height))) + 1.0);
+			imageData.size = static_cast<VkDeviceSize>(width) * height * 4;
+		}
+	}
 
-			// Read sampler input time values
-			{
-				const tinygltf::Accessor &accessor = gltfModel.accessors[samp.input];
-				const tinygltf::BufferView &bufferView = gltfModel.bufferViews[accessor.bufferView];
-				const tinygltf::Buffer &buffer = gltfModel.buffers[bufferView.buffer];
-
-				assert(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
-
-				float *buf = new float[accessor.count];
-				memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(float));
-				for (size_t index = 0; index < accessor.count; index++) {
-					sampler.inputs.push_back(buf[index]);
-				}
+	/*
+		Record the copy of an image from the staging buffer and the generation of its mip chain (glTF uses jpg and png, so we need to create this manually)
+	*/
+	void recordImageUpload(VkCommandBuffer commandBuffer, VkBuffer stagingBuffer, VkDeviceSize stagingOffset, const ImageData& imageData, vkglTF::Texture& texture)
+	{
+		VkImageSubresourceRange subresourceRange = {};
+		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		subresourceRange.levelCount = imageData.ktx ? texture.mipLevels : 1;
+		subresourceRange.layerCount = 1;
 
-				for (auto input : sampler.inputs) {
+		{
+			VkImageMemoryBarrier imageMemoryBarrier{};
+			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			imageMemoryBarrier.srcAccessMask = 0;
+			imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			imageMemoryBarrier.image = texture.image;
+			imageMemoryBarrier.subresourceRange = subresourceRange;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+		}
+
+		if (imageData.ktx) {
+			// Ktx files contain all mip levels
+			std::vector<VkBufferImageCopy> bufferCopyRegions;
+			for (uint32_t i = 0; i < texture.mipLevels; i++) {
+				ktx_size_t offset;
+				KTX_error_code result = ktxTexture_GetImageOffset(imageData.ktx, i, 0, 0, &offset);
+				assert(result == KTX_SUCCESS);
+				VkBufferImageCopy bufferCopyRegion = {};
+				bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				bufferCopyRegion.imageSubresource.mipLevel = i;
+				bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
+				bufferCopyRegion.imageSubresource.layerCount = 1;
+				bufferCopyRegion.imageExtent.width = std::max(1u, texture.width >> i);
+				bufferCopyRegion.imageExtent.height = std::max(1u, texture.height >> i);
+				bufferCopyRegion.imageExtent.depth = 1;
+				bufferCopyRegion.bufferOffset = stagingOffset + offset;
+				bufferCopyRegions.push_back(bufferCopyRegion);
+			}
+			vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(bufferCopyRegions.size()), bufferCopyRegions.data());
+			vks::tools::setImageLayout(commandBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
+			return;
+		}
+
+		VkBufferImageCopy bufferCopyRegion = {};
+		bufferCopyRegion.bufferOffset = stagingOffset;
+		bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		bufferCopyRegion.imageSubresource.mipLevel = 0;
+		bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
+		bufferCopyRegion.imageSubresource.layerCount = 1;
+		bufferCopyRegion.imageExtent.width = texture.width;
+		bufferCopyRegion.imageExtent.height = texture.height;
+		bufferCopyRegion.imageExtent.depth = 1;
+		vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
+
+		{
+			VkImageMemoryBarrier imageMemoryBarrier{};
+			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			imageMemoryBarrier.image = texture.image;
+			imageMemoryBarrier.subresourceRange = subresourceRange;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+		}
+
+		for (uint32_t i = 1; i < texture.mipLevels; i++) {
+			VkImageBlit imageBlit{};
+
+			imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			imageBlit.srcSubresource.layerCount = 1;
+			imageBlit.srcSubresource.mipLevel = i - 1;
+			imageBlit.srcOffsets[1].x = std::max(1, int32_t(texture.width >> (i - 1)));
+			imageBlit.srcOffsets[1].y = std::max(1, int32_t(texture.height >> (i - 1)));
+			imageBlit.srcOffsets[1].z = 1;
+
+			imageBlit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			imageBlit.dstSubresource.layerCount = 1;
+			imageBlit.dstSubresource.mipLevel = i;
+			imageBlit.dstOffsets[1].x = std::max(1, int32_t(texture.width >> i));
+			imageBlit.dstOffsets[1].y = std::max(1, int32_t(texture.height >> i));
+			imageBlit.dstOffsets[1].z = 1;
+
+			VkImageSubresourceRange mipSubRange = {};
+			mipSubRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			mipSubRange.baseMipLevel = i;
+			mipSubRange.levelCount = 1;
+			mipSubRange.layerCount = 1;
+
+			{
+				VkImageMemoryBarrier imageMemoryBarrier{};
+				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				imageMemoryBarrier.srcAccessMask = 0;
+				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				imageMemoryBarrier.image = texture.image;
+				imageMemoryBarrier.subresourceRange = mipSubRange;
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+			}
+
+			vkCmdBlitImage(commandBuffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
+
+			{
+				VkImageMemoryBarrier imageMemoryBarrier{};
+				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+				imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+				imageMemoryBarrier.image = texture.image;
+				imageMemoryBarrier.subresourceRange = mipSubRange;
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+			}
+		}
+
+		subresourceRange.levelCount = texture.mipLevels;
+		{
+			VkImageMemoryBarrier imageMemoryBarrier{};
+			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			imageMemoryBarrier.image = texture.image;
+			imageMemoryBarrier.subresourceRange = subresourceRange;
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+		}
+	}
+}
+
+void vkglTF::Model::loadImages(tinygltf::Model &gltfModel, vks::VulkanDevice *device, VkQueue transferQueue, vks::JobSystem& jobSystem)
+{
+	VKS_TRACE_SCOPE_CATEGORY("Upload glTF images", "assets");
+	// Upper limit for the staging memory, larger image sets are uploaded in several batches
+	const VkDeviceSize stagingBudget = 64 * 1024 * 1024;
+
+	const uint32_t imageCount = static_cast<uint32_t>(gltfModel.images.size());
+	std::vector<ImageData> imageData(imageCount);
+
+	// Decode all images in parallel
+	jobSystem.parallelFor(imageCount, 1, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			decodeImage(gltfModel.images[i], path, imageData[i]);
+		}
+	});
+
+	const VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(device->physicalDevice, format, &formatProperties);
+	assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT);
+	assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT);
+
+	// Create the images, the upload is batched afterwards
+	VkDeviceSize stagingSize = 0;
+	textures.resize(imageCount);
+	for (uint32_t i = 0; i < imageCount; i++) {
+		if (!imageData[i].error.empty()) {
+			vks::tools::exitFatal(imageData[i].error, -1);
+		}
+		vkglTF::Texture& texture = textures[i];
+		texture.device = device;
+		texture.width = imageData[i].width;
+		texture.height = imageData[i].height;
+		texture.mipLevels = imageData[i].mipLevels;
+		texture.layerCount = 1;
+
+		VkImageCreateInfo imageCreateInfo = vks::initializers::imageCreateInfo();
+		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageCreateInfo.format = format;
+		imageCreateInfo.mipLevels = texture.mipLevels;
+		imageCreateInfo.arrayLayers = 1;
+		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageCreateInfo.extent = { texture.width, texture.height, 1 };
+		// Mip levels are generated by blitting from the previous level unless they're stored in the file
+		imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		if (!imageData[i].ktx) {
+			imageCreateInfo.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		}
+		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &texture.image));
+		VK_CHECK_RESULT(device->memoryAllocator->allocateForImage(texture.image, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &texture.allocation));
+		texture.deviceMemory = texture.allocation.memory;
+		texture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		stagingSize = std::max(stagingSize, imageData[i].size);
+	}
+
+	if (imageCount > 0) {
+		// Images are placed at offsets that are suitable for buffer to image copies
+		const VkDeviceSize alignment = std::max<VkDeviceSize>(16, device->properties.limits.optimalBufferCopyOffsetAlignment);
+		VkDeviceSize totalSize = 0;
+		for (const ImageData& image : imageData) {
+			totalSize += (image.size + alignment - 1) & ~(alignment - 1);
+		}
+		// A single image may exceed the budget
+		stagingSize = std::max(stagingSize, std::min(totalSize, stagingBudget));
+
+		VkBuffer stagingBuffer;
+		VkDeviceMemory stagingMemory;
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingSize, &stagingBuffer, &stagingMemory));
+		uint8_t* stagingData;
+		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, VK_WHOLE_SIZE, 0, (void**)&stagingData));
+
+		std::vector<VkDeviceSize> offsets(imageCount);
+		uint32_t first = 0;
+		while (first < imageCount) {
+			// Fill the staging buffer with as many images as fit and upload them with a single submission
+			uint32_t last = first;
+			VkDeviceSize batchSize = 0;
+			while (last < imageCount) {
+				const VkDeviceSize offset = (batchSize + alignment - 1) & ~(alignment - 1);
+				if ((last > first) && (offset + imageData[last].size > stagingSize)) {
+					break;
+				}
+				offsets[last] = offset;
+				batchSize = offset + imageData[last].size;
+				last++;
+			}
+
+			// Copy the pixels into the staging buffer while the commands are recorded, the pixels aren't needed afterwards
+			vks::JobCounter copies;
+			jobSystem.parallelFor(last - first, 1, [&, first](uint32_t begin, uint32_t end) {
+				for (uint32_t i = first + begin; i < first + end; i++) {
+					memcpy(stagingData + offsets[i], imageData[i].data(), imageData[i].size);
+				}
+			}, &copies);
+
+			VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+			for (uint32_t i = first; i < last; i++) {
+				recordImageUpload(copyCmd, stagingBuffer, offsets[i], imageData[i], textures[i]);
+			}
+			jobSystem.wait(copies);
+			for (uint32_t i = first; i < last; i++) {
+				imageData[i].release();
+			}
+			device->flushCommandBuffer(copyCmd, transferQueue, true);
+			first = last;
+		}
+
+		vkUnmapMemory(device->logicalDevice, stagingMemory);
+		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
+		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
+	}
+
+	for (vkglTF::Texture& texture : textures) {
+		texture.createSamplerAndView(format);
+	}
+
+	// Create an empty texture to be used for empty material images
+	createEmptyTexture(transferQueue);
+}
+
+void vkglTF::Model::loadMaterials(tinygltf::Model &gltfModel)
+{
+	for (tinygltf::Material &mat : gltfModel.materials) {
+		vkglTF::Material material(device);
+		if (mat.values.find("baseColorTexture") != mat.values.end()) {
+			material.baseColorTexture = getTexture(gltfModel.textures[mat.values["baseColorTexture"].TextureIndex()].source);
+		}
+		// Metallic roughness workflow
+		if (mat.values.find("metallicRoughnessTexture") != mat.values.end()) {
+			material.metallicRoughnessTexture = getTexture(gltfModel.textures[mat.values["metallicRoughnessTexture"].TextureIndex()].source);
+		}
+		if (mat.values.find("roughnessFactor") != mat.values.end()) {
+			material.roughnessFactor = static_cast<float>(mat.values["roughnessFactor"].Factor());
+		}
+		if (mat.values.find("metallicFactor") != mat.values.end()) {
+			material.metallicFactor = static_cast<float>(mat.values["metallicFactor"].Factor());
+		}
+		if (mat.values.find("baseColorFactor") != mat.values.end()) {
+			material.baseColorFactor = glm::make_vec4(mat.values["baseColorFactor"].ColorFactor().data());
+		}				
+		if (mat.additionalValues.find("normalTexture") != mat.additionalValues.end()) {
+			material.normalTexture = getTexture(gltfModel.textures[mat.additionalValues["normalTexture"].TextureIndex()].source);
+		} else {
+			material.normalTexture = &emptyTexture;
+		}
+		if (mat.additionalValues.find("emissiveTexture") != mat.additionalValues.end()) {
+			material.emissiveTexture = getTexture(gltfModel.textures[mat.additionalValues["emissiveTexture"].TextureIndex()].source);
+		}
+		if (mat.additionalValues.find("occlusionTexture") != mat.additionalValues.end()) {
+			material.occlusionTexture = getTexture(gltfModel.textures[mat.additionalValues["occlusionTexture"].TextureIndex()].source);
+		}
+		if (mat.additionalValues.find("alphaMode") != mat.additionalValues.end()) {
+			tinygltf::Parameter param = mat.additionalValues["alphaMode"];
+			if (param.string_value == "BLEND") {
+				material.alphaMode = Material::ALPHAMODE_BLEND;
+			}
+			if (param.string_value == "MASK") {
+				material.alphaMode = Material::ALPHAMODE_MASK;
+			}
+		}
+		if (mat.additionalValues.find("alphaCutoff") != mat.additionalValues.end()) {
+			material.alphaCutoff = static_cast<float>(mat.additionalValues["alphaCutoff"].Factor());
+		}
+
+		materials.push_back(material);
+	}
+	// Push a default material at the end of the list for meshes with no material assigned
+	materials.push_back(Material(device));
+}
+
+void vkglTF::Model::loadAnimations(tinygltf::Model &gltfModel)
+{
+	for (tinygltf::Animation &anim : gltfModel.animations) {
+		vkglTF::Animation animation{};
+		animation.name = anim.name;
+		if (anim.name.empty()) {
+			animation.name = std::to_string(animations.size());
+		}
+
+		// Samplers
+		for (auto &samp : anim.samplers) {
+			vkglTF::AnimationSampler sampler{};
+
+			if (samp.interpolation == "LINEAR") {
+				sampler.interpolation = AnimationSampler::InterpolationType::LINEAR;
+			}
+			if (samp.interpolation == "STEP") {
+				sampler.interpolation = AnimationSampler::InterpolationType::STEP;
+			}
+			if (samp.interpolation == "CUBICSPLINE") {
+				sampler.interpolation = AnimationSampler::InterpolationType::CUBICSPLINE;
+			}
+
+			// Read sampler input time values
+			{
+				const tinygltf::Accessor &accessor = gltfModel.accessors[samp.input];
+				const tinygltf::BufferView &bufferView = gltfModel.bufferViews[accessor.bufferView];
+				const tinygltf::Buffer &buffer = gltfModel.buffers[bufferView.buffer];
+
+				assert(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
+
+				float *buf = new float[accessor.count];
+				memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(float));
+				for (size_t index = 0; index < accessor.count; index++) {
+					sampler.inputs.push_back(buf[index]);
+				}
+
+				for (auto input : sampler.inputs) {
 					if (input < animation.start) {
 						animation.start = input;
 					};
@@ -1150,8 +1710,261 @@ void vkglTF::Model::loadAnimations(tinygltf::Model &gltfModel)
 	}
 }
 
+namespace
+{
+	const vkglTF::VertexComponent allVertexComponents[] = {
+		vkglTF::VertexComponent::Position, vkglTF::VertexComponent::Normal, vkglTF::VertexComponent::UV, vkglTF::VertexComponent::Color,
+		vkglTF::VertexComponent::Tangent, vkglTF::VertexComponent::Joint0, vkglTF::VertexComponent::Weight0
+	};
+
+	uint32_t formatSize(VkFormat format)
+	{
+		switch (format) {
+			case VK_FORMAT_R8G8B8A8_UNORM:
+			case VK_FORMAT_R16G16_SNORM:
+			case VK_FORMAT_R16G16_SFLOAT:
+				return 4;
+			case VK_FORMAT_R16G16B16A16_SNORM:
+			case VK_FORMAT_R16G16B16A16_SFLOAT:
+			case VK_FORMAT_R32G32_SFLOAT:
+				return 8;
+			case VK_FORMAT_R32G32B32_SFLOAT:
+				return 12;
+			default:
+				return 16;
+		}
+	}
+
+	/** @brief Format a component is stored in with a compact layout */
+	VkFormat compactFormat(vkglTF::VertexComponent component, uint32_t fileLoadingFlags)
+	{
+		const bool quantize = fileLoadingFlags & vkglTF::FileLoadingFlags::QuantizeVertices;
+		switch (component) {
+			case vkglTF::VertexComponent::Position:
+				return (fileLoadingFlags & vkglTF::FileLoadingFlags::QuantizePositions) ? VK_FORMAT_R16G16B16A16_SNORM : VK_FORMAT_R32G32B32_SFLOAT;
+			case vkglTF::VertexComponent::Normal:
+				if (fileLoadingFlags & vkglTF::FileLoadingFlags::OctahedralNormals) {
+					return VK_FORMAT_R16G16_SNORM;
+				}
+				return quantize ? VK_FORMAT_R16G16B16A16_SNORM : VK_FORMAT_R32G32B32_SFLOAT;
+			case vkglTF::VertexComponent::UV:
+				return quantize ? VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_R32G32_SFLOAT;
+			case vkglTF::VertexComponent::Color:
+				return quantize ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R32G32B32A32_SFLOAT;
+			case vkglTF::VertexComponent::Tangent:
+				return quantize ? VK_FORMAT_R16G16B16A16_SNORM : VK_FORMAT_R32G32B32A32_SFLOAT;
+			case vkglTF::VertexComponent::Joint0:
+				// Half floats represent joint indices up to 2048 exactly and are read as floats like the full layout
+				return quantize ? VK_FORMAT_R16G16B16A16_SFLOAT : VK_FORMAT_R32G32B32A32_SFLOAT;
+			case vkglTF::VertexComponent::Weight0:
+				return quantize ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R32G32B32A32_SFLOAT;
+			default:
+				return VK_FORMAT_R32G32B32A32_SFLOAT;
+		}
+	}
+
+	uint16_t packHalf(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		const uint32_t sign = (bits >> 16) & 0x8000;
+		const int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xff);
+		uint32_t mantissa = bits & 0x7fffff;
+		// Infinity and NaN
+		if (exponent == 0xff) {
+			return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+		}
+		const int32_t halfExponent = exponent - 127 + 15;
+		if (halfExponent >= 31) {
+			return static_cast<uint16_t>(sign | 0x7c00);
+		}
+		if (halfExponent <= 0) {
+			// Denormalized half or zero
+			if (halfExponent < -10) {
+				return static_cast<uint16_t>(sign);
+			}
+			mantissa |= 0x800000;
+			const uint32_t shift = static_cast<uint32_t>(14 - halfExponent);
+			uint32_t half = mantissa >> shift;
+			if ((mantissa >> (shift - 1)) & 1) {
+				half++;
+			}
+			return static_cast<uint16_t>(sign | half);
+		}
+		uint32_t half = (static_cast<uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+		// Round to nearest, a carry correctly moves into the exponent
+		if (mantissa & 0x1000) {
+			half++;
+		}
+		return static_cast<uint16_t>(sign | half);
+	}
+
+	int16_t packSnorm16(float value)
+	{
+		return static_cast<int16_t>(std::lround(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f));
+	}
+
+	uint8_t packUnorm8(float value)
+	{
+		return static_cast<uint8_t>(std::lround(std::min(std::max(value, 0.0f), 1.0f) * 255.0f));
+	}
+
+	/** @brief Map a direction onto the octahedron and unfold it into [-1, 1]^2, zero length directions are mapped to the origin */
+	glm::vec2 octahedralEncode(const glm::vec3& direction)
+	{
+		const float sum = std::fabs(direction.x) + std::fabs(direction.y) + std::fabs(direction.z);
+		if (!(sum > 0.0f)) {
+			return glm::vec2(0.0f);
+		}
+		glm::vec2 p(direction.x / sum, direction.y / sum);
+		if (direction.z < 0.0f) {
+			p = glm::vec2((1.0f - std::fabs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f), (1.0f - std::fabs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+		}
+		return p;
+	}
+
+	/** @brief Convert the first components of value to the attribute format and write them to target */
+	void storeAttribute(VkFormat format, const glm::vec4& value, uint8_t* target)
+	{
+		switch (format) {
+			case VK_FORMAT_R16G16_SFLOAT:
+			case VK_FORMAT_R16G16B16A16_SFLOAT: {
+				uint16_t halfs[4];
+				for (uint32_t i = 0; i < 4; i++) {
+					halfs[i] = packHalf(value[i]);
+				}
+				memcpy(target, halfs, formatSize(format));
+				break;
+			}
+			case VK_FORMAT_R16G16_SNORM:
+			case VK_FORMAT_R16G16B16A16_SNORM: {
+				int16_t snorms[4];
+				for (uint32_t i = 0; i < 4; i++) {
+					snorms[i] = packSnorm16(value[i]);
+				}
+				memcpy(target, snorms, formatSize(format));
+				break;
+			}
+			case VK_FORMAT_R8G8B8A8_UNORM: {
+				uint8_t unorms[4];
+				for (uint32_t i = 0; i < 4; i++) {
+					unorms[i] = packUnorm8(value[i]);
+				}
+				memcpy(target, unorms, sizeof(unorms));
+				break;
+			}
+			default: {
+				const float floats[4] = { value.x, value.y, value.z, value.w };
+				memcpy(target, floats, formatSize(format));
+				break;
+			}
+		}
+	}
+
+	void packVertex(const vkglTF::Vertex& vertex, const vkglTF::VertexLayout& layout, uint8_t* destination)
+	{
+		for (const vkglTF::VertexLayout::Attribute& attribute : layout.attributes) {
+			uint8_t* target = destination + attribute.offset;
+			switch (attribute.component) {
+				case vkglTF::VertexComponent::Position:
+					if (attribute.format == VK_FORMAT_R16G16B16A16_SNORM) {
+						storeAttribute(attribute.format, glm::vec4((vertex.pos - layout.positionOffset) / layout.positionScale, 0.0f), target);
+					} else {
+						storeAttribute(attribute.format, glm::vec4(vertex.pos, 0.0f), target);
+					}
+					break;
+				case vkglTF::VertexComponent::Normal:
+					if (attribute.format == VK_FORMAT_R16G16_SNORM) {
+						const glm::vec2 encoded = octahedralEncode(vertex.normal);
+						storeAttribute(attribute.format, glm::vec4(encoded.x, encoded.y, 0.0f, 0.0f), target);
+					} else {
+						storeAttribute(attribute.format, glm::vec4(vertex.normal, 0.0f), target);
+					}
+					break;
+				case vkglTF::VertexComponent::UV:
+					storeAttribute(attribute.format, glm::vec4(vertex.uv.x, vertex.uv.y, 0.0f, 0.0f), target);
+					break;
+				case vkglTF::VertexComponent::Color:
+					storeAttribute(attribute.format, vertex.color, target);
+					break;
+				case vkglTF::VertexComponent::Tangent:
+					storeAttribute(attribute.format, vertex.tangent, target);
+					break;
+				case vkglTF::VertexComponent::Joint0:
+					storeAttribute(attribute.format, vertex.joint0, target);
+					break;
+				case vkglTF::VertexComponent::Weight0:
+					storeAttribute(attribute.format, vertex.weight0, target);
+					if (attribute.format == VK_FORMAT_R8G8B8A8_UNORM) {
+						// Keep the quantized weights summing up to one by moving the rounding error to the largest weight
+						uint32_t sum = target[0] + target[1] + target[2] + target[3];
+						if (sum > 0) {
+							uint32_t largest = 0;
+							for (uint32_t i = 1; i < 4; i++) {
+								if (target[i] > target[largest]) {
+									largest = i;
+								}
+							}
+							target[largest] = static_cast<uint8_t>(static_cast<int32_t>(target[largest]) + 255 - static_cast<int32_t>(sum));
+						}
+					}
+					break;
+			}
+		}
+	}
+
+	bool compactVerticesRequested(uint32_t fileLoadingFlags)
+	{
+		return fileLoadingFlags & (vkglTF::FileLoadingFlags::CompactVertices | vkglTF::FileLoadingFlags::QuantizeVertices | vkglTF::FileLoadingFlags::QuantizePositions | vkglTF::FileLoadingFlags::OctahedralNormals);
+	}
+
+	/** @brief Layout of the vertex buffer for the file loading flags, the vertices are used for the bounding box of quantized positions */
+	vkglTF::VertexLayout buildVertexLayout(const std::vector<vkglTF::VertexComponent>& components, uint32_t fileLoadingFlags, const std::vector<vkglTF::Vertex>& vertices)
+	{
+		vkglTF::VertexLayout layout;
+		if (!compactVerticesRequested(fileLoadingFlags)) {
+			// Full vertex structure
+			for (vkglTF::VertexComponent component : allVertexComponents) {
+				const VkVertexInputAttributeDescription description = vkglTF::Vertex::inputAttributeDescription(0, 0, component);
+				layout.attributes.push_back({ component, description.format, description.offset });
+			}
+			layout.stride = sizeof(vkglTF::Vertex);
+			return layout;
+		}
+		uint32_t offset = 0;
+		for (vkglTF::VertexComponent component : components) {
+			if (layout.find(component)) {
+				continue;
+			}
+			const VkFormat format = compactFormat(component, fileLoadingFlags);
+			layout.attributes.push_back({ component, format, offset });
+			// All formats are multiples of four bytes, so every attribute stays aligned
+			offset += formatSize(format);
+		}
+		layout.stride = offset;
+		if ((fileLoadingFlags & vkglTF::FileLoadingFlags::QuantizePositions) && !vertices.empty()) {
+			glm::vec3 min = vertices[0].pos;
+			glm::vec3 max = vertices[0].pos;
+			for (const vkglTF::Vertex& vertex : vertices) {
+				min = glm::min(min, vertex.pos);
+				max = glm::max(max, vertex.pos);
+			}
+			glm::vec3 extent = (max - min) * 0.5f;
+			for (uint32_t i = 0; i < 3; i++) {
+				if (extent[i] <= 0.0f) {
+					extent[i] = 1.0f;
+				}
+			}
+			layout.positionScale = extent;
+			layout.positionOffset = (min + max) * 0.5f;
+		}
+		return layout;
+	}
+}
+
 void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device, VkQueue transferQueue, uint32_t fileLoadingFlags, float scale)
 {
+	vks::trace::Scope traceScope("Load glTF model", "assets", filename);
 	tinygltf::Model gltfModel;
 	tinygltf::TinyGLTF gltfContext;
 	if (fileLoadingFlags & FileLoadingFlags::DontLoadImages) {
@@ -1170,26 +1983,49 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 	std::string error, warning;
 
 	this->device = device;
+	loadingFlags = fileLoadingFlags;
 
 #if defined(__ANDROID__)
 	// On Android all assets are packed with the apk in a compressed form, so we need to open them using the asset manager
 	// We let tinygltf handle this, by passing the asset manager of our app
 	tinygltf::asset_manager = androidApp->activity->assetManager;
 #endif
-	bool fileLoaded = gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning, filename);
+	bool fileLoaded;
+	{
+		// Images are only read here, they're decoded in parallel by loadImages
+		VKS_TRACE_SCOPE_CATEGORY("Parse glTF file", "assets");
+		fileLoaded = gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning, filename);
+	}
 
 	std::vector<uint32_t> indexBuffer;
 	std::vector<Vertex> vertexBuffer;
 
+	// Image decoding, vertex unpacking and pre-transformations are spread across all cores
+	vks::JobSystem jobSystem;
+
 	if (fileLoaded) {
 		if (!(fileLoadingFlags & FileLoadingFlags::DontLoadImages)) {
-			loadImages(gltfModel, device, transferQueue);
+			loadImages(gltfModel, device, transferQueue, jobSystem);
 		}
 		loadMaterials(gltfModel);
 		const tinygltf::Scene &scene = gltfModel.scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
-		for (size_t i = 0; i < scene.nodes.size(); i++) {
-			const tinygltf::Node node = gltfModel.nodes[scene.nodes[i]];
-			loadNode(nullptr, node, scene.nodes[i], gltfModel, indexBuffer, vertexBuffer, scale);
+		{
+			VKS_TRACE_SCOPE_CATEGORY("Load glTF nodes", "assets");
+			std::vector<PrimitiveRange> primitives;
+			uint32_t vertexCount = 0;
+			uint32_t indexCount = 0;
+			for (size_t i = 0; i < scene.nodes.size(); i++) {
+				const tinygltf::Node &node = gltfModel.nodes[scene.nodes[i]];
+				loadNode(nullptr, node, scene.nodes[i], gltfModel, primitives, vertexCount, indexCount, scale);
+			}
+			vertexBuffer.resize(vertexCount);
+			indexBuffer.resize(indexCount);
+			jobSystem.parallelFor(static_cast<uint32_t>(primitives.size()), 1, [&](uint32_t begin, uint32_t end) {
+				for (uint32_t i = begin; i < end; i++) {
+					const PrimitiveRange& range = primitives[i];
+					unpackPrimitive(gltfModel, *range.source, &vertexBuffer[range.firstVertex], &indexBuffer[range.firstIndex], range.firstVertex);
+				}
+			});
 		}
 		if (gltfModel.animations.size() > 0) {
 			loadAnimations(gltfModel);
@@ -1201,11 +2037,9 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 			if (node->skinIndex > -1) {
 				node->skin = skins[node->skinIndex];
 			}
-			// Initial pose
-			if (node->mesh) {
-				node->update();
-			}
 		}
+		// Initial pose
+		updateTransforms();
 	}
 	else {
 		// TODO: throw
@@ -1218,9 +2052,14 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 		const bool preTransform = fileLoadingFlags & FileLoadingFlags::PreTransformVertices;
 		const bool preMultiplyColor = fileLoadingFlags & FileLoadingFlags::PreMultiplyVertexColors;
 		const bool flipY = fileLoadingFlags & FileLoadingFlags::FlipY;
-		for (Node* node : linearNodes) {
-			if (node->mesh) {
-				const glm::mat4 localMatrix = node->getMatrix();
+		// Every primitive belongs to a single node, so nodes can be processed in parallel
+		jobSystem.parallelFor(static_cast<uint32_t>(linearNodes.size()), 1, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t n = begin; n < end; n++) {
+				Node* node = linearNodes[n];
+				if (!node->mesh) {
+					continue;
+				}
+				const glm::mat4 localMatrix = getNodeMatrix(node);
 				for (Primitive* primitive : node->mesh->primitives) {
 					for (uint32_t i = 0; i < primitive->vertexCount; i++) {
 						Vertex& vertex = vertexBuffer[primitive->firstVertex + i];
@@ -1241,7 +2080,7 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 					}
 				}
 			}
-		}
+		});
 	}
 
 	for (auto extension : gltfModel.extensionsUsed) {
@@ -1251,7 +2090,22 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 		}
 	}
 
+	// Pack the vertices into a compact layout if requested, otherwise the vertex structure is uploaded as is
+	vertexLayout = buildVertexLayout(vertexComponents, fileLoadingFlags, vertexBuffer);
+	std::vector<uint8_t> packedVertices;
+	void* vertexData = vertexBuffer.data();
 	size_t vertexBufferSize = vertexBuffer.size() * sizeof(Vertex);
+	if (compactVerticesRequested(fileLoadingFlags)) {
+		VKS_TRACE_SCOPE_CATEGORY("Pack glTF vertices", "assets");
+		packedVertices.resize(vertexBuffer.size() * vertexLayout.stride);
+		jobSystem.parallelFor(static_cast<uint32_t>(vertexBuffer.size()), 4096, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; i++) {
+				packVertex(vertexBuffer[i], vertexLayout, &packedVertices[static_cast<size_t>(i) * vertexLayout.stride]);
+			}
+		});
+		vertexData = packedVertices.data();
+		vertexBufferSize = packedVertices.size();
+	}
 	size_t indexBufferSize = indexBuffer.size() * sizeof(uint32_t);
 	indices.count = static_cast<uint32_t>(indexBuffer.size());
 	vertices.count = static_cast<uint32_t>(vertexBuffer.size());
@@ -1271,7 +2125,7 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 		vertexBufferSize,
 		&vertexStaging.buffer,
 		&vertexStaging.memory,
-		vertexBuffer.data()));
+		vertexData));
 	// Index data
 	VK_CHECK_RESULT(device->createBuffer(
 		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
@@ -1443,8 +2297,9 @@ void vkglTF::Model::getNodeDimensions(Node *node, glm::vec3 &min, glm::vec3 &max
 {
 	if (node->mesh) {
 		for (Primitive *primitive : node->mesh->primitives) {
-			glm::vec4 locMin = glm::vec4(primitive->dimensions.min, 1.0f) * node->getMatrix();
-			glm::vec4 locMax = glm::vec4(primitive->dimensions.max, 1.0f) * node->getMatrix();
+			const glm::mat4& nodeMatrix = getNodeMatrix(node);
+			glm::vec4 locMin = glm::vec4(primitive->dimensions.min, 1.0f) * nodeMatrix;
+			glm::vec4 locMax = glm::vec4(primitive->dimensions.max, 1.0f) * nodeMatrix;
 			if (locMin.x < min.x) { min.x = locMin.x; }
 			if (locMin.y < min.y) { min.y = locMin.y; }
 			if (locMin.z < min.z) { min.z = locMin.z; }
@@ -1477,54 +2332,81 @@ void vkglTF::Model::updateAnimation(uint32_t index, float time)
 		return;
 	}
 	Animation &animation = animations[index];
+	animation.evaluate(time);
 
 	bool updated = false;
-	for (auto& channel : animation.channels) {
-		vkglTF::AnimationSampler &sampler = animation.samplers[channel.samplerIndex];
-		if (sampler.inputs.size() > sampler.outputsVec4.size()) {
+	for (size_t i = 0; i < animation.channels.size(); i++) {
+		if (!animation.channelValid[i]) {
 			continue;
 		}
-
-		for (auto i = 0; i < sampler.inputs.size() - 1; i++) {
-			if ((time >= sampler.inputs[i]) && (time <= sampler.inputs[i + 1])) {
-				float u = std::max(0.0f, time - sampler.inputs[i]) / (sampler.inputs[i + 1] - sampler.inputs[i]);
-				if (u <= 1.0f) {
-					switch (channel.path) {
-					case vkglTF::AnimationChannel::PathType::TRANSLATION: {
-						glm::vec4 trans = glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], u);
-						channel.node->translation = glm::vec3(trans);
-						break;
-					}
-					case vkglTF::AnimationChannel::PathType::SCALE: {
-						glm::vec4 trans = glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], u);
-						channel.node->scale = glm::vec3(trans);
-						break;
-					}
-					case vkglTF::AnimationChannel::PathType::ROTATION: {
-						glm::quat q1;
-						q1.x = sampler.outputsVec4[i].x;
-						q1.y = sampler.outputsVec4[i].y;
-						q1.z = sampler.outputsVec4[i].z;
-						q1.w = sampler.outputsVec4[i].w;
-						glm::quat q2;
-						q2.x = sampler.outputsVec4[i + 1].x;
-						q2.y = sampler.outputsVec4[i + 1].y;
-						q2.z = sampler.outputsVec4[i + 1].z;
-						q2.w = sampler.outputsVec4[i + 1].w;
-						channel.node->rotation = glm::normalize(glm::slerp(q1, q2, u));
-						break;
-					}
-					}
-					updated = true;
-				}
-			}
+		const vkglTF::AnimationChannel& channel = animation.channels[i];
+		const glm::vec4& value = animation.channelValues[i];
+		switch (channel.path) {
+		case vkglTF::AnimationChannel::PathType::TRANSLATION:
+			transforms.setTranslation(channel.node->transformIndex, glm::vec3(value));
+			break;
+		case vkglTF::AnimationChannel::PathType::SCALE:
+			transforms.setScale(channel.node->transformIndex, glm::vec3(value));
+			break;
+		case vkglTF::AnimationChannel::PathType::ROTATION: {
+			glm::quat q;
+			q.x = value.x;
+			q.y = value.y;
+			q.z = value.z;
+			q.w = value.w;
+			transforms.setRotation(channel.node->transformIndex, q);
+			break;
+		}
 		}
+		updated = true;
 	}
 	if (updated) {
-		for (auto &node : nodes) {
-			node->update();
+		updateTransforms();
+	}
+}
+
+const glm::mat4& vkglTF::Model::getNodeMatrix(const Node* node) const
+{
+	return transforms.worldMatrices[node->transformIndex];
+}
+
+void vkglTF::Model::updateTransforms()
+{
+	if (!transforms.update()) {
+		return;
+	}
+	if (indirect.prepared) {
+		memcpy(indirect.matrices.mapped, transforms.worldMatrices.data(), transforms.worldMatrices.size() * sizeof(glm::mat4));
+	}
+	// Dirty flags have been propagated to all descendants, so only meshes whose node or joints moved are updated
+	for (Node* node : linearNodes) {
+		Mesh* mesh = node->mesh;
+		if (!mesh) {
+			continue;
+		}
+		const glm::mat4& m = transforms.worldMatrices[node->transformIndex];
+		if (node->skin) {
+			const Skin* skin = node->skin;
+			bool changed = transforms.dirty[node->transformIndex] != 0;
+			for (size_t i = 0; i < skin->jointTransforms.size() && !changed; i++) {
+				changed = transforms.dirty[skin->jointTransforms[i]] != 0;
+			}
+			if (!changed) {
+				continue;
+			}
+			mesh->uniformBlock.matrix = m;
+			// Update joint matrices from the cached world matrices
+			const glm::mat4 inverseTransform = glm::inverse(m);
+			for (size_t i = 0; i < skin->jointTransforms.size(); i++) {
+				mesh->uniformBlock.jointMatrix[i] = inverseTransform * transforms.worldMatrices[skin->jointTransforms[i]] * skin->inverseBindMatrices[i];
+			}
+			mesh->uniformBlock.jointcount = (float)skin->jointTransforms.size();
+			memcpy(mesh->uniformBuffer.mapped, &mesh->uniformBlock, sizeof(mesh->uniformBlock));
+		} else if (transforms.dirty[node->transformIndex]) {
+			memcpy(mesh->uniformBuffer.mapped, &m, sizeof(glm::mat4));
 		}
 	}
+	transforms.clearDirty();
 }
 
 /*
@@ -1578,3 +2460,565 @@ void vkglTF::Model::prepareNodeDescriptor(vkglTF::Node* node, VkDescriptorSetLay
 		prepareNodeDescriptor(child, descriptorSetLayout);
 	}
 }
+
+VkPipelineVertexInputStateCreateInfo* vkglTF::Model::getPipelineVertexInputState(const std::vector<VertexComponent> components)
+{
+	vertexInputBindingDescription = { 0, vertexLayout.stride, VK_VERTEX_INPUT_RATE_VERTEX };
+	vertexInputAttributeDescriptions.clear();
+	uint32_t location = 0;
+	for (VertexComponent component : components) {
+		const VertexLayout::Attribute* attribute = vertexLayout.find(component);
+		if (!attribute) {
+			vks::tools::exitFatal("Vertex component " + std::to_string(static_cast<uint32_t>(component)) + " is not stored in the vertex buffer of the glTF model", -1);
+			continue;
+		}
+		vertexInputAttributeDescriptions.push_back({ location, 0, attribute->format, attribute->offset });
+		location++;
+	}
+	pipelineVertexInputStateCreateInfo = {};
+	pipelineVertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	pipelineVertexInputStateCreateInfo.vertexBindingDescriptionCount = 1;
+	pipelineVertexInputStateCreateInfo.pVertexBindingDescriptions = &vertexInputBindingDescription;
+	pipelineVertexInputStateCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexInputAttributeDescriptions.size());
+	pipelineVertexInputStateCreateInfo.pVertexAttributeDescriptions = vertexInputAttributeDescriptions.data();
+	return &pipelineVertexInputStateCreateInfo;
+}
+
+void vkglTF::Model::prepareIndirectDraws(VkQueue transferQueue)
+{
+	// Flatten the primitives of all nodes into draws grouped by the alpha mode of their material
+	std::vector<VkDrawIndexedIndirectCommand> modeCommands[3];
+	std::vector<IndirectDraws::DrawData> modeDrawData[3];
+	std::vector<IndirectDraws::Bounds> modeBounds[3];
+	for (Node* node : linearNodes) {
+		if (!node->mesh) {
+			continue;
+		}
+		const glm::mat4& nodeMatrix = getNodeMatrix(node);
+		for (Primitive* primitive : node->mesh->primitives) {
+			const uint32_t mode = static_cast<uint32_t>(primitive->material.alphaMode);
+			VkDrawIndexedIndirectCommand command{};
+			command.indexCount = primitive->indexCount;
+			command.instanceCount = 1;
+			command.firstIndex = primitive->firstIndex;
+			// Indices already address the model's whole vertex buffer
+			command.vertexOffset = 0;
+			modeCommands[mode].push_back(command);
+			IndirectDraws::DrawData drawData{};
+			drawData.matrixIndex = node->transformIndex;
+			drawData.materialIndex = static_cast<uint32_t>(&primitive->material - materials.data());
+			modeDrawData[mode].push_back(drawData);
+			// Bounds are stored in the space of the vertex buffer, so they follow the pre-calculations done while loading
+			glm::vec3 boundsMin = primitive->dimensions.min;
+			glm::vec3 boundsMax = primitive->dimensions.max;
+			if (loadingFlags & FileLoadingFlags::PreTransformVertices) {
+				const glm::vec3 center = glm::vec3(nodeMatrix * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+				const glm::vec3 halfSize = (boundsMax - boundsMin) * 0.5f;
+				const glm::vec3 extent = glm::abs(glm::vec3(nodeMatrix[0])) * halfSize.x + glm::abs(glm::vec3(nodeMatrix[1])) * halfSize.y + glm::abs(glm::vec3(nodeMatrix[2])) * halfSize.z;
+				boundsMin = center - extent;
+				boundsMax = center + extent;
+			}
+			if (loadingFlags & FileLoadingFlags::FlipY) {
+				const float minY = boundsMin.y;
+				boundsMin.y = -boundsMax.y;
+				boundsMax.y = -minY;
+			}
+			IndirectDraws::Bounds bounds;
+			bounds.min = glm::vec4(boundsMin, 0.0f);
+			// Skinned vertices can leave the bounds of the bind pose
+			bounds.max = glm::vec4(boundsMax, node->skinIndex > -1 ? 1.0f : 0.0f);
+			modeBounds[mode].push_back(bounds);
+		}
+	}
+	std::vector<IndirectDraws::DrawData> drawData;
+	indirect.drawCommands.clear();
+	indirect.bounds.clear();
+	for (uint32_t mode = 0; mode < 3; mode++) {
+		indirect.ranges[mode].first = static_cast<uint32_t>(indirect.drawCommands.size());
+		indirect.ranges[mode].count = static_cast<uint32_t>(modeCommands[mode].size());
+		indirect.drawCommands.insert(indirect.drawCommands.end(), modeCommands[mode].begin(), modeCommands[mode].end());
+		drawData.insert(drawData.end(), modeDrawData[mode].begin(), modeDrawData[mode].end());
+		indirect.bounds.insert(indirect.bounds.end(), modeBounds[mode].begin(), modeBounds[mode].end());
+	}
+	if (indirect.drawCommands.empty()) {
+		return;
+	}
+	// The draw index is passed as the first instance so shaders can fetch their draw data
+	for (uint32_t i = 0; i < static_cast<uint32_t>(indirect.drawCommands.size()); i++) {
+		indirect.drawCommands[i].firstInstance = i;
+	}
+
+	auto textureIndex = [&](const Texture* texture) -> int32_t {
+		if (!texture || texture < textures.data() || texture >= textures.data() + textures.size()) {
+			return -1;
+		}
+		return static_cast<int32_t>(texture - textures.data());
+	};
+	std::vector<IndirectDraws::MaterialData> materialData;
+	for (const Material& material : materials) {
+		IndirectDraws::MaterialData data{};
+		data.baseColorFactor = material.baseColorFactor;
+		data.baseColorTexture = textureIndex(material.baseColorTexture);
+		data.metallicRoughnessTexture = textureIndex(material.metallicRoughnessTexture);
+		data.normalTexture = textureIndex(material.normalTexture);
+		data.alphaMode = static_cast<int32_t>(material.alphaMode);
+		data.alphaCutoff = material.alphaCutoff;
+		data.metallicFactor = material.metallicFactor;
+		data.roughnessFactor = material.roughnessFactor;
+		materialData.push_back(data);
+	}
+
+	// Static data is uploaded to device local memory
+	auto createDeviceLocalBuffer = [&](vks::Buffer& buffer, VkBufferUsageFlags usageFlags, const void* data, VkDeviceSize size) {
+		vks::Buffer staging;
+		VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging, size, const_cast<void*>(data)));
+		VK_CHECK_RESULT(device->createBuffer(usageFlags | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &buffer, size));
+		device->copyBuffer(&staging, &buffer, transferQueue);
+		staging.destroy();
+	};
+	// Commands can also be read by compute shaders, e.g. for culling
+	createDeviceLocalBuffer(indirect.commands, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, indirect.drawCommands.data(), indirect.drawCommands.size() * sizeof(VkDrawIndexedIndirectCommand));
+	createDeviceLocalBuffer(indirect.drawData, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, drawData.data(), drawData.size() * sizeof(IndirectDraws::DrawData));
+	createDeviceLocalBuffer(indirect.materials, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, materialData.data(), materialData.size() * sizeof(IndirectDraws::MaterialData));
+	// Matrices change with animations, so they stay host visible
+	VK_CHECK_RESULT(device->createBuffer(
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&indirect.matrices,
+		transforms.worldMatrices.size() * sizeof(glm::mat4),
+		transforms.worldMatrices.data()));
+	VK_CHECK_RESULT(indirect.matrices.map());
+
+	// Descriptors
+	const uint32_t textureCount = static_cast<uint32_t>(textures.size());
+	std::vector<VkDescriptorPoolSize> poolSizes = {
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3),
+	};
+	if (textureCount > 0) {
+		poolSizes.push_back(vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, textureCount));
+	}
+	VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, 1);
+	VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, nullptr, &indirect.descriptorPool));
+
+	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT, 0),
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT, 1),
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 2),
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 3, textureCount),
+	};
+	// The texture array is declared unsized in the shaders
+	std::vector<VkDescriptorBindingFlagsEXT> bindingFlags = { 0, 0, 0, VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT };
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT setLayoutBindingFlags{};
+	setLayoutBindingFlags.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	setLayoutBindingFlags.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+	setLayoutBindingFlags.pBindingFlags = bindingFlags.data();
+	VkDescriptorSetLayoutCreateInfo descriptorLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+	descriptorLayoutCI.pNext = &setLayoutBindingFlags;
+	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayoutCI, nullptr, &indirect.descriptorSetLayout));
+
+	VkDescriptorSetVariableDescriptorCountAllocateInfoEXT variableDescriptorCountAllocInfo{};
+	variableDescriptorCountAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT;
+	variableDescriptorCountAllocInfo.descriptorSetCount = 1;
+	variableDescriptorCountAllocInfo.pDescriptorCounts = &textureCount;
+	VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(indirect.descriptorPool, &indirect.descriptorSetLayout, 1);
+	allocInfo.pNext = &variableDescriptorCountAllocInfo;
+	VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &indirect.descriptorSet));
+
+	std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+		vks::initializers::writeDescriptorSet(indirect.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0, &indirect.matrices.descriptor),
+		vks::initializers::writeDescriptorSet(indirect.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &indirect.drawData.descriptor),
+		vks::initializers::writeDescriptorSet(indirect.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &indirect.materials.descriptor),
+	};
+	std::vector<VkDescriptorImageInfo> textureDescriptors;
+	for (const Texture& texture : textures) {
+		textureDescriptors.push_back(texture.descriptor);
+	}
+	if (textureCount > 0) {
+		writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(indirect.descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, textureDescriptors.data(), textureCount));
+	}
+	vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+	indirect.prepared = true;
+}
+
+void vkglTF::Model::drawIndirect(VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindSet)
+{
+	if (!indirect.prepared) {
+		return;
+	}
+	if (!buffersBound) {
+		const VkDeviceSize offsets[1] = {0};
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+	}
+	if (pipelineLayout != VK_NULL_HANDLE) {
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindSet, 1, &indirect.descriptorSet, 0, nullptr);
+	}
+	const uint32_t modeFlags[3] = { RenderFlags::RenderOpaqueNodes, RenderFlags::RenderAlphaMaskedNodes, RenderFlags::RenderAlphaBlendedNodes };
+	const bool allModes = (renderFlags & (RenderFlags::RenderOpaqueNodes | RenderFlags::RenderAlphaMaskedNodes | RenderFlags::RenderAlphaBlendedNodes)) == 0;
+	const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+	// Culled draws are read from the output of the culling pass, which only runs if the draw index can be passed as the first instance
+	const bool culled = (renderFlags & RenderFlags::CulledDraws) && culling.prepared && device->enabledFeatures.drawIndirectFirstInstance;
+	const VkBuffer drawBuffer = culled ? culling.commands.buffer : indirect.commands.buffer;
+	for (uint32_t mode = 0; mode < 3; mode++) {
+		const IndirectDraws::Range& range = indirect.ranges[mode];
+		if ((range.count == 0) || (!allModes && !(renderFlags & modeFlags[mode]))) {
+			continue;
+		}
+		if (culled && (culling.uniformData.flags & Culling::CompactDraws)) {
+			culling.drawIndexedIndirectCount(commandBuffer, drawBuffer, range.first * stride, culling.drawCounts.buffer, mode * sizeof(uint32_t), range.count, stride);
+		} else if (!device->enabledFeatures.drawIndirectFirstInstance) {
+			// The draw index can't be passed through indirect commands, so they are issued directly
+			for (uint32_t i = range.first; i < range.first + range.count; i++) {
+				const VkDrawIndexedIndirectCommand& command = indirect.drawCommands[i];
+				vkCmdDrawIndexed(commandBuffer, command.indexCount, command.instanceCount, command.firstIndex, command.vertexOffset, command.firstInstance);
+			}
+		} else if (device->enabledFeatures.multiDrawIndirect) {
+			vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, range.first * stride, range.count, stride);
+		} else {
+			for (uint32_t i = range.first; i < range.first + range.count; i++) {
+				vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, i * stride, 1, stride);
+			}
+		}
+	}
+}
+
+void vkglTF::Model::prepareCulling(const VkPipelineShaderStageCreateInfo& cullStage, const VkPipelineShaderStageCreateInfo& depthReduceStage, VkQueue queue, VkPipelineCache pipelineCache)
+{
+	if (!indirect.prepared) {
+		return;
+	}
+	culling.queue = queue;
+	const uint32_t drawCount = static_cast<uint32_t>(indirect.drawCommands.size());
+
+	// Compacted draws are only possible with a draw count read by the GPU (Vulkan 1.2 or VK_KHR_draw_indirect_count), which returns no function if it hasn't been enabled
+	culling.drawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(vkGetDeviceProcAddr(device->logicalDevice, "vkCmdDrawIndexedIndirectCountKHR"));
+	if (!culling.drawIndexedIndirectCount) {
+		culling.drawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(vkGetDeviceProcAddr(device->logicalDevice, "vkCmdDrawIndexedIndirectCount"));
+	}
+	culling.uniformData = {};
+	for (uint32_t mode = 0; mode < 3; mode++) {
+		culling.uniformData.rangeFirst[mode] = indirect.ranges[mode].first;
+	}
+	culling.uniformData.drawCount = drawCount;
+	if (!(loadingFlags & FileLoadingFlags::PreTransformVertices)) {
+		culling.uniformData.flags |= Culling::ApplyNodeMatrices;
+	}
+	if (culling.drawIndexedIndirectCount && device->enabledFeatures.multiDrawIndirect) {
+		culling.uniformData.flags |= Culling::CompactDraws;
+	}
+
+	// Buffers
+	VK_CHECK_RESULT(device->createBuffer(
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&culling.uniformBuffer,
+		sizeof(Culling::UniformData)));
+	VK_CHECK_RESULT(culling.uniformBuffer.map());
+	vks::Buffer staging;
+	const VkDeviceSize boundsSize = indirect.bounds.size() * sizeof(IndirectDraws::Bounds);
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging, boundsSize, indirect.bounds.data()));
+	VK_CHECK_RESULT(device->createBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &culling.bounds, boundsSize));
+	device->copyBuffer(&staging, &culling.bounds, queue);
+	staging.destroy();
+	VK_CHECK_RESULT(device->createBuffer(
+		VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		&culling.commands,
+		drawCount * sizeof(VkDrawIndexedIndirectCommand)));
+	VK_CHECK_RESULT(device->createBuffer(
+		VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&culling.drawCounts,
+		4 * sizeof(uint32_t)));
+	VK_CHECK_RESULT(culling.drawCounts.map());
+	memset(culling.drawCounts.mapped, 0, 4 * sizeof(uint32_t));
+
+	// Depth values are fetched without filtering
+	VkSamplerCreateInfo samplerCI = vks::initializers::samplerCreateInfo();
+	samplerCI.magFilter = VK_FILTER_NEAREST;
+	samplerCI.minFilter = VK_FILTER_NEAREST;
+	samplerCI.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerCI.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCI.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCI.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCI.maxLod = VK_LOD_CLAMP_NONE;
+	samplerCI.maxAnisotropy = 1.0f;
+	VK_CHECK_RESULT(vkCreateSampler(device->logicalDevice, &samplerCI, nullptr, &culling.sampler));
+
+	// Culling pipeline
+	std::vector<VkDescriptorPoolSize> poolSizes = {
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6),
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1),
+	};
+	VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, 1);
+	VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, nullptr, &culling.descriptorPool));
+
+	std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 5),
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 6),
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 7),
+	};
+	VkDescriptorSetLayoutCreateInfo descriptorLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayoutCI, nullptr, &culling.descriptorSetLayout));
+	VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(culling.descriptorPool, &culling.descriptorSetLayout, 1);
+	VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &culling.descriptorSet));
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&culling.descriptorSetLayout, 1);
+	VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutCI, nullptr, &culling.pipelineLayout));
+	VkComputePipelineCreateInfo pipelineCI = vks::initializers::computePipelineCreateInfo(culling.pipelineLayout);
+	pipelineCI.stage = cullStage;
+	VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &pipelineCI, nullptr, &culling.pipeline));
+
+	// Depth pyramid reduction pipeline, binding 0: input level (or depth buffer), binding 1: output level
+	setLayoutBindings = {
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+		vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+	};
+	descriptorLayoutCI = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings);
+	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayoutCI, nullptr, &culling.reduceDescriptorSetLayout));
+	pipelineLayoutCI = vks::initializers::pipelineLayoutCreateInfo(&culling.reduceDescriptorSetLayout, 1);
+	VK_CHECK_RESULT(vkCreatePipelineLayout(device->logicalDevice, &pipelineLayoutCI, nullptr, &culling.reducePipelineLayout));
+	pipelineCI = vks::initializers::computePipelineCreateInfo(culling.reducePipelineLayout);
+	pipelineCI.stage = depthReduceStage;
+	VK_CHECK_RESULT(vkCreateComputePipelines(device->logicalDevice, pipelineCache, 1, &pipelineCI, nullptr, &culling.reducePipeline));
+
+	// Until a depth buffer is set, a single texel pyramid at the far plane keeps the pyramid binding valid and occludes nothing
+	createDepthPyramid(1, 1);
+	culling.prepared = true;
+}
+
+void vkglTF::Model::createDepthPyramid(uint32_t width, uint32_t height)
+{
+	Culling::DepthPyramid& pyramid = culling.pyramid;
+	pyramid.width = width;
+	pyramid.height = height;
+	pyramid.levels = 1;
+	while ((std::max(width, height) >> pyramid.levels) > 0) {
+		pyramid.levels++;
+	}
+
+	VkImageCreateInfo imageCI = vks::initializers::imageCreateInfo();
+	imageCI.imageType = VK_IMAGE_TYPE_2D;
+	imageCI.format = VK_FORMAT_R32_SFLOAT;
+	imageCI.extent = { width, height, 1 };
+	imageCI.mipLevels = pyramid.levels;
+	imageCI.arrayLayers = 1;
+	imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageCI.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	imageCI.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCI, nullptr, &pyramid.image));
+	VkMemoryRequirements memReqs;
+	vkGetImageMemoryRequirements(device->logicalDevice, pyramid.image, &memReqs);
+	VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
+	memAllocInfo.allocationSize = memReqs.size;
+	memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &pyramid.memory));
+	VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, pyramid.image, pyramid.memory, 0));
+
+	VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+	viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewCI.format = VK_FORMAT_R32_SFLOAT;
+	viewCI.image = pyramid.image;
+	viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, pyramid.levels, 0, 1 };
+	VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &pyramid.view));
+	pyramid.levelViews.resize(pyramid.levels);
+	for (uint32_t level = 0; level < pyramid.levels; level++) {
+		viewCI.subresourceRange.baseMipLevel = level;
+		viewCI.subresourceRange.levelCount = 1;
+		VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &pyramid.levelViews[level]));
+	}
+
+	// The pyramid stays in the general layout, it starts out at the far plane so nothing is occluded before the first reduction
+	VkCommandBuffer commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+	VkImageSubresourceRange subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, pyramid.levels, 0, 1 };
+	VkImageMemoryBarrier imageBarrier = vks::initializers::imageMemoryBarrier();
+	imageBarrier.srcAccessMask = 0;
+	imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	imageBarrier.image = pyramid.image;
+	imageBarrier.subresourceRange = subresourceRange;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+	VkClearColorValue clearColor = { { 1.0f, 1.0f, 1.0f, 1.0f } };
+	vkCmdClearColorImage(commandBuffer, pyramid.image, VK_IMAGE_LAYOUT_GENERAL, &clearColor, 1, &subresourceRange);
+	imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	imageBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+	device->flushCommandBuffer(commandBuffer, culling.queue);
+
+	std::vector<VkDescriptorBufferInfo> bufferInfos = {
+		culling.uniformBuffer.descriptor,
+		indirect.matrices.descriptor,
+		indirect.drawData.descriptor,
+		culling.bounds.descriptor,
+		indirect.commands.descriptor,
+		culling.commands.descriptor,
+		culling.drawCounts.descriptor,
+	};
+	VkDescriptorImageInfo pyramidInfo = vks::initializers::descriptorImageInfo(culling.sampler, pyramid.view, VK_IMAGE_LAYOUT_GENERAL);
+	std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+		vks::initializers::writeDescriptorSet(culling.descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &bufferInfos[0]),
+	};
+	for (uint32_t binding = 1; binding < static_cast<uint32_t>(bufferInfos.size()); binding++) {
+		writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(culling.descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, binding, &bufferInfos[binding]));
+	}
+	writeDescriptorSets.push_back(vks::initializers::writeDescriptorSet(culling.descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 7, &pyramidInfo));
+	vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+
+	culling.uniformData.pyramidSize = glm::vec4(static_cast<float>(width), static_cast<float>(height), static_cast<float>(pyramid.levels), 0.0f);
+}
+
+void vkglTF::Model::destroyDepthPyramid()
+{
+	Culling::DepthPyramid& pyramid = culling.pyramid;
+	for (VkImageView levelView : pyramid.levelViews) {
+		vkDestroyImageView(device->logicalDevice, levelView, nullptr);
+	}
+	pyramid.levelViews.clear();
+	vkDestroyImageView(device->logicalDevice, pyramid.view, nullptr);
+	vkDestroyImage(device->logicalDevice, pyramid.image, nullptr);
+	vkFreeMemory(device->logicalDevice, pyramid.memory, nullptr);
+	if (pyramid.depthView != VK_NULL_HANDLE) {
+		vkDestroyImageView(device->logicalDevice, pyramid.depthView, nullptr);
+		vkDestroyDescriptorPool(device->logicalDevice, pyramid.descriptorPool, nullptr);
+	}
+	pyramid = Culling::DepthPyramid();
+}
+
+void vkglTF::Model::setCullingDepth(VkImage depthImage, VkFormat depthFormat, VkImageLayout depthLayout, uint32_t width, uint32_t height)
+{
+	if (!culling.prepared) {
+		return;
+	}
+	destroyDepthPyramid();
+	// Power of two levels halve exactly, only the first reduction from the depth buffer covers a non-integer footprint
+	uint32_t pyramidWidth = 1;
+	uint32_t pyramidHeight = 1;
+	while (pyramidWidth * 2 <= width) {
+		pyramidWidth *= 2;
+	}
+	while (pyramidHeight * 2 <= height) {
+		pyramidHeight *= 2;
+	}
+	createDepthPyramid(pyramidWidth, pyramidHeight);
+
+	Culling::DepthPyramid& pyramid = culling.pyramid;
+	pyramid.depthLayout = depthLayout;
+	VkImageViewCreateInfo viewCI = vks::initializers::imageViewCreateInfo();
+	viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	viewCI.format = depthFormat;
+	viewCI.image = depthImage;
+	// Only the depth aspect can be sampled
+	viewCI.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+	VK_CHECK_RESULT(vkCreateImageView(device->logicalDevice, &viewCI, nullptr, &pyramid.depthView));
+
+	std::vector<VkDescriptorPoolSize> poolSizes = {
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, pyramid.levels),
+		vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, pyramid.levels),
+	};
+	VkDescriptorPoolCreateInfo descriptorPoolCI = vks::initializers::descriptorPoolCreateInfo(poolSizes, pyramid.levels);
+	VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, nullptr, &pyramid.descriptorPool));
+	pyramid.descriptorSets.resize(pyramid.levels);
+	for (uint32_t level = 0; level < pyramid.levels; level++) {
+		VkDescriptorSetAllocateInfo allocInfo = vks::initializers::descriptorSetAllocateInfo(pyramid.descriptorPool, &culling.reduceDescriptorSetLayout, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &allocInfo, &pyramid.descriptorSets[level]));
+		VkDescriptorImageInfo inputInfo = (level == 0) ?
+			vks::initializers::descriptorImageInfo(culling.sampler, pyramid.depthView, depthLayout) :
+			vks::initializers::descriptorImageInfo(culling.sampler, pyramid.levelViews[level - 1], VK_IMAGE_LAYOUT_GENERAL);
+		VkDescriptorImageInfo outputInfo = vks::initializers::descriptorImageInfo(VK_NULL_HANDLE, pyramid.levelViews[level], VK_IMAGE_LAYOUT_GENERAL);
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(pyramid.descriptorSets[level], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &inputInfo),
+			vks::initializers::writeDescriptorSet(pyramid.descriptorSets[level], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, &outputInfo),
+		};
+		vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+	}
+	culling.uniformData.flags |= Culling::OcclusionCulling;
+	// The new pyramid doesn't contain the depth of the previous frame yet
+	culling.firstUpdate = true;
+}
+
+void vkglTF::Model::updateCulling(const glm::mat4& viewProjection)
+{
+	if (!culling.prepared) {
+		return;
+	}
+	// The depth pyramid was built from the previous frame, so occlusion is tested with the matrix that frame was rendered with
+	culling.uniformData.previousViewProjection = culling.firstUpdate ? viewProjection : culling.uniformData.viewProjection;
+	culling.uniformData.viewProjection = viewProjection;
+	culling.firstUpdate = false;
+	vks::Frustum frustum;
+	frustum.update(viewProjection);
+	for (uint32_t i = 0; i < 6; i++) {
+		culling.uniformData.frustumPlanes[i] = frustum.planes[i];
+	}
+	memcpy(culling.uniformBuffer.mapped, &culling.uniformData, sizeof(Culling::UniformData));
+}
+
+void vkglTF::Model::recordCulling(VkCommandBuffer commandBuffer)
+{
+	if (!culling.prepared || !device->enabledFeatures.drawIndirectFirstInstance) {
+		return;
+	}
+	// Indirect draws of earlier submissions have to finish before their commands and counts are overwritten
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+	vkCmdFillBuffer(commandBuffer, culling.drawCounts.buffer, 0, VK_WHOLE_SIZE, 0);
+	// Covers the cleared counts and the depth pyramid written at the end of the previous frame
+	VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+	memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling.pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling.pipelineLayout, 0, 1, &culling.descriptorSet, 0, nullptr);
+	// Must match the local size of the culling shader
+	const uint32_t workGroupSize = 64;
+	vkCmdDispatch(commandBuffer, (culling.uniformData.drawCount + workGroupSize - 1) / workGroupSize, 1, 1);
+
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+void vkglTF::Model::recordDepthPyramid(VkCommandBuffer commandBuffer)
+{
+	const Culling::DepthPyramid& pyramid = culling.pyramid;
+	if (!culling.prepared || pyramid.depthView == VK_NULL_HANDLE) {
+		return;
+	}
+	// The culling pass has to finish reading the pyramid before it's overwritten
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling.reducePipeline);
+	// Must match the local size of the reduction shader
+	const uint32_t workGroupSize = 8;
+	VkMemoryBarrier memoryBarrier = vks::initializers::memoryBarrier();
+	memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	for (uint32_t level = 0; level < pyramid.levels; level++) {
+		const uint32_t levelWidth = std::max(1u, pyramid.width >> level);
+		const uint32_t levelHeight = std::max(1u, pyramid.height >> level);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling.reducePipelineLayout, 0, 1, &pyramid.descriptorSets[level], 0, nullptr);
+		vkCmdDispatch(commandBuffer, (levelWidth + workGroupSize - 1) / workGroupSize, (levelHeight + workGroupSize - 1) / workGroupSize, 1);
+		// Each level is read by the reduction of the next one
+		if (level < pyramid.levels - 1) {
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+		}
+	}
+}
+
+uint32_t vkglTF::Model::getVisibleDrawCount() const
+{
+	if (!culling.prepared) {
+		return static_cast<uint32_t>(indirect.drawCommands.size());
+	}
+	const uint32_t* drawCounts = static_cast<const uint32_t*>(culling.drawCounts.mapped);
+	return drawCounts[0] + drawCounts[1] + drawCounts[2];
+}
@@ -15,6 +15,7 @@
 
 #include "vulkan/vulkan.h"
 #include "VulkanDevice.h"
+#include "jobsystem.h"
 
 #include <ktx.h>
 #include <ktxvulkan.h>
@@ -57,6 +58,7 @@ namespace vkglTF
 		VkImage image;
 		VkImageLayout imageLayout;
 		VkDeviceMemory deviceMemory;
+		vks::MemoryAllocation allocation;
 		VkImageView view;
 		uint32_t width, height;
 		uint32_t mipLevels;
@@ -66,6 +68,8 @@ namespace vkglTF
 		void updateDescriptor();
 		void destroy();
 		void fromglTfImage(tinygltf::Image& gltfimage, std::string path, vks::VulkanDevice* device, VkQueue copyQueue);
+		/** @brief Create the sampler and view for the uploaded image and update the descriptor */
+		void createSamplerAndView(VkFormat format);
 	};
 
 	/*
@@ -151,6 +155,33 @@ namespace vkglTF
 		Node* skeletonRoot = nullptr;
 		std::vector<glm::mat4> inverseBindMatrices;
 		std::vector<Node*> joints;
+		// Transform indices of the joints, so skinning doesn't have to touch the nodes
+		std::vector<uint32_t> jointTransforms;
+	};
+
+	/*
+		Transforms of all nodes in a flattened hierarchy stored as arrays
+		Nodes are sorted so parents always come before their children, which lets a single forward pass propagate transforms
+	*/
+	struct NodeTransforms {
+		std::vector<int32_t> parents;
+		std::vector<glm::vec3> translations;
+		std::vector<glm::quat> rotations;
+		std::vector<glm::vec3> scales;
+		std::vector<glm::mat4> matrices;
+		std::vector<glm::mat4> worldMatrices;
+		// Set if the local transform changed since the last update
+		std::vector<uint8_t> dirty;
+
+		/** @brief Append a node, its parent has to be added before it */
+		uint32_t add(int32_t parent, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale, const glm::mat4& matrix);
+		void setTranslation(uint32_t index, const glm::vec3& translation);
+		void setRotation(uint32_t index, const glm::quat& rotation);
+		void setScale(uint32_t index, const glm::vec3& scale);
+		glm::mat4 localMatrix(uint32_t index) const;
+		/** @brief Recompute the world matrices of all dirty nodes and their descendants, flags descendants as dirty too and returns true if anything changed */
+		bool update();
+		void clearDirty();
 	};
 
 	/*
@@ -160,17 +191,12 @@ namespace vkglTF
 		Node* parent;
 		uint32_t index;
 		std::vector<Node*> children;
-		glm::mat4 matrix;
 		std::string name;
 		Mesh* mesh;
 		Skin* skin;
 		int32_t skinIndex = -1;
-		glm::vec3 translation{};
-		glm::vec3 scale{ 1.0f };
-		glm::quat rotation{};
-		glm::mat4 localMatrix();
-		glm::mat4 getMatrix();
-		void update();
+		// Index of the node's transform in the model's transform hierarchy
+		uint32_t transformIndex = 0;
 		~Node();
 	};
 
@@ -191,7 +217,14 @@ namespace vkglTF
 		enum InterpolationType { LINEAR, STEP, CUBICSPLINE };
 		InterpolationType interpolation;
 		std::vector<float> inputs;
+		// Cubic spline samplers store an in-tangent, the value and an out-tangent per keyframe
 		std::vector<glm::vec4> outputsVec4;
+		// Keyframe interval found by the last lookup, playback usually stays in it or moves on to the next one
+		uint32_t cursor = 0;
+		/** @brief Returns true if there are enough outputs for the inputs */
+		bool valid() const;
+		/** @brief Returns the index of the keyframe interval containing time, times outside of the inputs are clamped to the first or last interval */
+		uint32_t findKeyframe(float time);
 	};
 
 	/*
@@ -203,6 +236,24 @@ namespace vkglTF
 		std::vector<AnimationChannel> channels;
 		float start = std::numeric_limits<float>::max();
 		float end = std::numeric_limits<float>::min();
+		// Values of all channels as of the last evaluation, rotations are quaternions stored as xyzw
+		std::vector<glm::vec4> channelValues;
+		// Set for channels that have been evaluated, samplers without usable keyframes are skipped
+		std::vector<uint8_t> channelValid;
+		/** @brief Interpolate all channels at the given time, linear and spherical interpolations are batched into tight loops over all channels */
+		void evaluate(float time);
+	private:
+		// Keyframe pairs of the channels that are interpolated together, kept between evaluations to avoid reallocations
+		struct InterpolationBatch {
+			std::vector<uint32_t> channels;
+			std::vector<glm::vec4> from;
+			std::vector<glm::vec4> to;
+			std::vector<float> factors;
+			void add(uint32_t channel, const glm::vec4& from, const glm::vec4& to, float factor);
+			void clear();
+		};
+		InterpolationBatch lerpBatch;
+		InterpolationBatch slerpBatch;
 	};
 
 	/*
@@ -224,7 +275,7 @@ namespace vkglTF
 		static VkVertexInputBindingDescription inputBindingDescription(uint32_t binding);
 		static VkVertexInputAttributeDescription inputAttributeDescription(uint32_t binding, uint32_t location, VertexComponent component);
 		static std::vector<VkVertexInputAttributeDescription> inputAttributeDescriptions(uint32_t binding, const std::vector<VertexComponent> components);
-		/** @brief Returns the default pipeline vertex input state create info structure for the requested vertex components */
+		/** @brief Returns the default pipeline vertex input state create info structure for the requested vertex components, use Model::getPipelineVertexInputState for compact layouts */
 		static VkPipelineVertexInputStateCreateInfo* getPipelineVertexInputState(const std::vector<VertexComponent> components);
 	};
 
@@ -233,14 +284,50 @@ namespace vkglTF
 		PreTransformVertices = 0x00000001,
 		PreMultiplyVertexColors = 0x00000002,
 		FlipY = 0x00000004,
-		DontLoadImages = 0x00000008
+		DontLoadImages = 0x00000008,
+		// Only store the components listed in Model::vertexComponents, tightly packed
+		CompactVertices = 0x00000010,
+		// Implies CompactVertices, stores uv, color, tangent, joint and weight components in smaller formats that shaders read unchanged
+		QuantizeVertices = 0x00000020,
+		// Implies CompactVertices, stores positions as snorm16 relative to the model's bounding box, shaders need to apply VertexLayout::positionScale and positionOffset
+		QuantizePositions = 0x00000040,
+		// Implies CompactVertices, stores normals octahedral encoded as two snorm16 values, shaders need to decode them
+		OctahedralNormals = 0x00000080
+	};
+
+	/*
+		Layout of the vertices in a model's vertex buffer, depends on the file loading flags
+
+		Positions stored with QuantizePositions are reconstructed with:
+			vec3 pos = inPos.xyz * positionScale + positionOffset;
+		Normals stored with OctahedralNormals are decoded with:
+			vec3 octDecode(vec2 e) {
+				vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+				float t = max(-n.z, 0.0);
+				n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+				return normalize(n);
+			}
+	*/
+	struct VertexLayout {
+		struct Attribute {
+			VertexComponent component;
+			VkFormat format;
+			uint32_t offset;
+		};
+		uint32_t stride = sizeof(Vertex);
+		std::vector<Attribute> attributes;
+		glm::vec3 positionScale = glm::vec3(1.0f);
+		glm::vec3 positionOffset = glm::vec3(0.0f);
+		/** @brief Returns the attribute storing the component, nullptr if it's not part of the layout */
+		const Attribute* find(VertexComponent component) const;
 	};
 
 	enum RenderFlags {
 		BindImages = 0x00000001,
 		RenderOpaqueNodes = 0x00000002,
 		RenderAlphaMaskedNodes = 0x00000004,
-		RenderAlphaBlendedNodes = 0x00000008
+		RenderAlphaBlendedNodes = 0x00000008,
+		CulledDraws = 0x00000010
 	};
 
 	/*
@@ -248,9 +335,23 @@ namespace vkglTF
 	*/
 	class Model {
 	private:
+		/** @brief Location of a primitive's vertices and indices in the model's buffers, filled in parallel once all nodes have been loaded */
+		struct PrimitiveRange {
+			const tinygltf::Primitive* source;
+			uint32_t firstVertex;
+			uint32_t firstIndex;
+		};
 		vkglTF::Texture* getTexture(uint32_t index);
 		vkglTF::Texture emptyTexture;
 		void createEmptyTexture(VkQueue transferQueue);
+		// Backing storage for getPipelineVertexInputState
+		VkVertexInputBindingDescription vertexInputBindingDescription;
+		std::vector<VkVertexInputAttributeDescription> vertexInputAttributeDescriptions;
+		VkPipelineVertexInputStateCreateInfo pipelineVertexInputStateCreateInfo;
+		// Flags the model was loaded with, culling bounds have to match pre-transformed and flipped vertices
+		uint32_t loadingFlags = 0;
+		void createDepthPyramid(uint32_t width, uint32_t height);
+		void destroyDepthPyramid();
 	public:
 		vks::VulkanDevice* device;
 		VkDescriptorPool descriptorPool;
@@ -268,6 +369,120 @@ namespace vkglTF
 
 		std::vector<Node*> nodes;
 		std::vector<Node*> linearNodes;
+		NodeTransforms transforms;
+
+		/*
+			GPU driven rendering
+			All primitives are flattened into a list of indirect draws, with per-draw data (world matrix and material index) and all materials
+			stored in storage buffers and all textures in one descriptor indexed array, so the whole model is drawn by a few indirect draw calls
+			The index of a draw is passed as its first instance, shaders look up their draw data with gl_InstanceIndex
+			Requires VK_EXT_descriptor_indexing (runtimeDescriptorArray, descriptorBindingVariableDescriptorCount and
+			shaderSampledImageArrayNonUniformIndexing), without drawIndirectFirstInstance the draws are issued directly from the CPU copy
+		*/
+		struct IndirectDraws {
+			struct DrawData {
+				uint32_t matrixIndex;
+				uint32_t materialIndex;
+				uint32_t padding[2];
+			};
+			// Texture indices are -1 if a material doesn't use that texture
+			struct MaterialData {
+				glm::vec4 baseColorFactor;
+				int32_t baseColorTexture;
+				int32_t metallicRoughnessTexture;
+				int32_t normalTexture;
+				int32_t alphaMode;
+				float alphaCutoff;
+				float metallicFactor;
+				float roughnessFactor;
+				float padding;
+			};
+			// Axis aligned bounding box of a draw in the space of the vertex buffer, max.w is set for draws that are never culled (skinned meshes)
+			struct Bounds {
+				glm::vec4 min;
+				glm::vec4 max;
+			};
+			// Draws are sorted by alpha mode, each mode is a contiguous range of the draw list
+			struct Range {
+				uint32_t first = 0;
+				uint32_t count = 0;
+			} ranges[3];
+			bool prepared = false;
+			std::vector<VkDrawIndexedIndirectCommand> drawCommands;
+			std::vector<Bounds> bounds;
+			vks::Buffer commands;
+			vks::Buffer drawData;
+			vks::Buffer materials;
+			// World matrices of all nodes indexed by their transform index, updated with the transform hierarchy
+			vks::Buffer matrices;
+			VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+			// Binding 0: matrices, binding 1: draw data, binding 2: materials, binding 3: texture array
+			VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+		} indirect;
+
+		/*
+			GPU culling of the indirect draws
+			A compute pass tests the bounds of every draw against the view frustum and a hierarchical depth (Hi-Z) pyramid built from
+			the depth buffer of the previous frame, and writes the visible draws to a compacted command list with one draw count per alpha mode
+			Occlusion is tested with the previous frame's view projection, so draws that become visible are drawn one frame late
+			Without vkCmdDrawIndexedIndirectCount (Vulkan 1.2 or VK_KHR_draw_indirect_count) culled draws keep their slot with an instance count of zero
+			Expects a depth buffer with 1.0 at the far plane
+		*/
+		struct Culling {
+			enum Flags {
+				ApplyNodeMatrices = 0x1,
+				CompactDraws = 0x2,
+				OcclusionCulling = 0x4
+			};
+			struct UniformData {
+				glm::mat4 viewProjection;
+				glm::mat4 previousViewProjection;
+				glm::vec4 frustumPlanes[6];
+				// Width, height and number of mip levels of the depth pyramid
+				glm::vec4 pyramidSize;
+				// First draw of each alpha mode and the total number of draws
+				uint32_t rangeFirst[3];
+				uint32_t drawCount;
+				uint32_t flags;
+				uint32_t padding[3];
+			} uniformData;
+			bool prepared = false;
+			bool firstUpdate = true;
+			VkQueue queue = VK_NULL_HANDLE;
+			PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount = nullptr;
+			vks::Buffer uniformBuffer;
+			vks::Buffer bounds;
+			// Visible draws, compacted per alpha mode into the ranges of the draw list
+			vks::Buffer commands;
+			// Number of visible draws per alpha mode, host visible for statistics
+			vks::Buffer drawCounts;
+			VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+			VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+			VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+			VkPipeline pipeline = VK_NULL_HANDLE;
+			// Depth pyramid, each level stores the farthest depth of the texels it covers
+			struct DepthPyramid {
+				VkImage image = VK_NULL_HANDLE;
+				VkDeviceMemory memory = VK_NULL_HANDLE;
+				VkImageView view = VK_NULL_HANDLE;
+				std::vector<VkImageView> levelViews;
+				uint32_t width = 0;
+				uint32_t height = 0;
+				uint32_t levels = 0;
+				// Depth only view of the depth buffer the pyramid is built from
+				VkImageView depthView = VK_NULL_HANDLE;
+				VkImageLayout depthLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+				VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+				// One set per level, reading the previous level (or the depth buffer) and writing the level
+				std::vector<VkDescriptorSet> descriptorSets;
+			} pyramid;
+			VkSampler sampler = VK_NULL_HANDLE;
+			VkDescriptorSetLayout reduceDescriptorSetLayout = VK_NULL_HANDLE;
+			VkPipelineLayout reducePipelineLayout = VK_NULL_HANDLE;
+			VkPipeline reducePipeline = VK_NULL_HANDLE;
+		} culling;
 
 		std::vector<Skin*> skins;
 
@@ -283,26 +498,82 @@ namespace vkglTF
 			float radius;
 		} dimensions;
 
+		/** @brief Components stored in the vertex buffer if a compact layout is requested, set this before loading the model */
+		std::vector<VertexComponent> vertexComponents = { VertexComponent::Position, VertexComponent::Normal, VertexComponent::UV, VertexComponent::Color, VertexComponent::Tangent, VertexComponent::Joint0, VertexComponent::Weight0 };
+		/** @brief Layout of the vertex buffer, valid once the model has been loaded */
+		VertexLayout vertexLayout;
+
 		bool metallicRoughnessWorkflow = true;
 		bool buffersBound = false;
 		std::string path;
 
 		Model() {};
 		~Model();
-		void loadNode(vkglTF::Node* parent, const tinygltf::Node& node, uint32_t nodeIndex, const tinygltf::Model& model, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer, float globalscale);
+		/**
+		* Create the node hierarchy and reserve the vertex and index ranges of all primitives
+		*
+		* @param primitives Ranges of the primitives whose vertices and indices still have to be unpacked
+		* @param vertexCount Number of vertices reserved so far
+		* @param indexCount Number of indices reserved so far
+		*/
+		void loadNode(vkglTF::Node* parent, const tinygltf::Node& node, uint32_t nodeIndex, const tinygltf::Model& model, std::vector<PrimitiveRange>& primitives, uint32_t& vertexCount, uint32_t& indexCount, float globalscale);
 		void loadSkins(tinygltf::Model& gltfModel);
-		void loadImages(tinygltf::Model& gltfModel, vks::VulkanDevice* device, VkQueue transferQueue);
+		/** @brief Decode all images in parallel and upload them (including their mip chains) in a few batched submissions */
+		void loadImages(tinygltf::Model& gltfModel, vks::VulkanDevice* device, VkQueue transferQueue, vks::JobSystem& jobSystem);
 		void loadMaterials(tinygltf::Model& gltfModel);
 		void loadAnimations(tinygltf::Model& gltfModel);
 		void loadFromFile(std::string filename, vks::VulkanDevice* device, VkQueue transferQueue, uint32_t fileLoadingFlags = vkglTF::FileLoadingFlags::None, float scale = 1.0f);
 		void bindBuffers(VkCommandBuffer commandBuffer);
 		void drawNode(Node* node, VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
 		void draw(VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
+		/** @brief Build the indirect draw list, the storage buffers and the descriptor set for GPU driven rendering */
+		void prepareIndirectDraws(VkQueue transferQueue);
+		/**
+		* Draw the whole model with indirect draws, one per alpha mode selected by the render flags
+		*
+		* @param renderFlags (Optional) RenderOpaqueNodes, RenderAlphaMaskedNodes and RenderAlphaBlendedNodes select the alpha modes to draw, all are drawn if none is set, CulledDraws draws the output of recordCulling
+		* @param pipelineLayout (Optional) Layout used to bind the indirect descriptor set
+		* @param bindSet (Optional) Set index the indirect descriptor set is bound to
+		*/
+		void drawIndirect(VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindSet = 0);
+		/**
+		* Create the culling and depth pyramid pipelines, the indirect draws have to be prepared first
+		*
+		* @param cullStage Compute shader stage of base/culling.comp
+		* @param depthReduceStage Compute shader stage of base/depthreduce.comp
+		* @param queue Queue used to initialize the depth pyramid
+		* @param pipelineCache Pipeline cache used to create the pipelines
+		*/
+		void prepareCulling(const VkPipelineShaderStageCreateInfo& cullStage, const VkPipelineShaderStageCreateInfo& depthReduceStage, VkQueue queue, VkPipelineCache pipelineCache);
+		/**
+		* (Re)create the depth pyramid for a depth buffer and enable occlusion culling, call this again if the depth buffer is recreated
+		*
+		* @param depthImage Depth buffer, it must have been created with VK_IMAGE_USAGE_SAMPLED_BIT
+		* @param depthFormat Format of the depth buffer
+		* @param depthLayout Layout the depth buffer is in when recordDepthPyramid is called
+		* @param width Width of the depth buffer
+		* @param height Height of the depth buffer
+		*/
+		void setCullingDepth(VkImage depthImage, VkFormat depthFormat, VkImageLayout depthLayout, uint32_t width, uint32_t height);
+		/** @brief Update the matrices used for culling, call this once per frame with the matrix that transforms the model to clip space */
+		void updateCulling(const glm::mat4& viewProjection);
+		/** @brief Record the culling pass, call this outside of a render pass before drawing with RenderFlags::CulledDraws */
+		void recordCulling(VkCommandBuffer commandBuffer);
+		/** @brief Record the depth pyramid reduction, call this after the depth buffer has been written and made visible to compute shaders */
+		void recordDepthPyramid(VkCommandBuffer commandBuffer);
+		/** @brief Returns the number of draws that passed culling as of the last finished frame */
+		uint32_t getVisibleDrawCount() const;
+		/** @brief Returns the world matrix of the node as of the last transform update */
+		const glm::mat4& getNodeMatrix(const Node* node) const;
+		/** @brief Propagate changed node transforms through the hierarchy and update the uniform buffers of affected meshes */
+		void updateTransforms();
 		void getNodeDimensions(Node* node, glm::vec3& min, glm::vec3& max);
 		void getSceneDimensions();
 		void updateAnimation(uint32_t index, float time);
 		Node* findNode(Node* parent, uint32_t index);
 		Node* nodeFromIndex(uint32_t index);
 		void prepareNodeDescriptor(vkglTF::Node* node, VkDescriptorSetLayout descriptorSetLayout);
+		/** @brief Returns the pipeline vertex input state for the requested components in the model's vertex layout, locations follow the order of the components */
+		VkPipelineVertexInputStateCreateInfo* getPipelineVertexInputState(const std::vector<VertexComponent> components);
 	};
 }
\ No newline at end of file
@@ -0,0 +1,412 @@
+/*
+* Benchmark class
+*
+* Copyright (C) 2016-2017 by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+#include "VulkanTools.h"
+#include "json.hpp"
+
+namespace vks
+{
+	// Linearly interpolated percentile of sorted samples
+	static double percentile(const std::vector<double>& sorted, double p)
+	{
+		const double rank = p * (double)(sorted.size() - 1);
+		const size_t lower = (size_t)std::floor(rank);
+		const size_t upper = std::min(lower + 1, sorted.size() - 1);
+		return sorted[lower] + (sorted[upper] - sorted[lower]) * (rank - (double)lower);
+	}
+
+	FrameTimeStatistics FrameTimeStatistics::compute(std::vector<double> frameTimes)
+	{
+		FrameTimeStatistics statistics;
+		if (frameTimes.empty()) {
+			return statistics;
+		}
+		std::sort(frameTimes.begin(), frameTimes.end());
+		statistics.samples = (uint32_t)frameTimes.size();
+		statistics.min = frameTimes.front();
+		statistics.max = frameTimes.back();
+		statistics.p50 = percentile(frameTimes, 0.5);
+		statistics.p95 = percentile(frameTimes, 0.95);
+		statistics.p99 = percentile(frameTimes, 0.99);
+		statistics.p999 = percentile(frameTimes, 0.999);
+
+		// Reject outliers by their modified z-score (Iglewicz and Hoaglin), which unlike the standard deviation isn't skewed by the outliers themselves
+		std::vector<double> deviations(frameTimes.size());
+		std::transform(frameTimes.begin(), frameTimes.end(), deviations.begin(), [&statistics](double t) { return std::abs(t - statistics.p50); });
+		std::sort(deviations.begin(), deviations.end());
+		const double mad = percentile(deviations, 0.5);
+		std::vector<double> inliers;
+		inliers.reserve(frameTimes.size());
+		for (double t : frameTimes) {
+			if ((mad == 0.0) || (0.6745 * std::abs(t - statistics.p50) / mad <= 3.5)) {
+				inliers.push_back(t);
+			}
+		}
+		statistics.outliers = statistics.samples - (uint32_t)inliers.size();
+
+		statistics.mean = std::accumulate(inliers.begin(), inliers.end(), 0.0) / (double)inliers.size();
+		if (inliers.size() > 1) {
+			double sum = 0.0;
+			for (double t : inliers) {
+				sum += (t - statistics.mean) * (t - statistics.mean);
+			}
+			statistics.stddev = std::sqrt(sum / (double)(inliers.size() - 1));
+		}
+		return statistics;
+	}
+
+	static nlohmann::json toJson(const FrameTimeStatistics& statistics)
+	{
+		nlohmann::json json;
+		json["samples"] = statistics.samples;
+		json["outliers"] = statistics.outliers;
+		json["min"] = statistics.min;
+		json["max"] = statistics.max;
+		json["mean"] = statistics.mean;
+		json["stddev"] = statistics.stddev;
+		json["p50"] = statistics.p50;
+		json["p95"] = statistics.p95;
+		json["p99"] = statistics.p99;
+		json["p99.9"] = statistics.p999;
+		return json;
+	}
+
+	static void printStatistics(const std::string& label, const FrameTimeStatistics& statistics)
+	{
+		std::cout << label << " frame time (ms)" << "\n";
+		std::cout << "  min/max: " << statistics.min << " / " << statistics.max << "\n";
+		std::cout << "  mean   : " << statistics.mean << " (stddev " << statistics.stddev << ", " << statistics.outliers << " of " << statistics.samples << " samples rejected as outliers)" << "\n";
+		std::cout << "  p50    : " << statistics.p50 << "\n";
+		std::cout << "  p95    : " << statistics.p95 << "\n";
+		std::cout << "  p99    : " << statistics.p99 << "\n";
+		std::cout << "  p99.9  : " << statistics.p999 << "\n";
+	}
+
+	void Benchmark::run(std::function<void()> renderFunc, VkPhysicalDeviceProperties deviceProps)
+	{
+		active = true;
+		this->deviceProps = deviceProps;
+#if defined(_WIN32)
+		AttachConsole(ATTACH_PARENT_PROCESS);
+		freopen_s(&stream, "CONOUT$", "w+", stdout);
+		freopen_s(&stream, "CONOUT$", "w+", stderr);
+#endif
+		std::cout << std::fixed << std::setprecision(3);
+
+		// Warm up phase to get more stable frame rates
+		{
+			double tMeasured = 0.0;
+			while (tMeasured < (warmup * 1000)) {
+				auto tStart = std::chrono::high_resolution_clock::now();
+				renderFunc();
+				auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+				tMeasured += tDiff;
+			};
+		}
+
+		// Benchmark phase
+		{
+			measuring = true;
+			while (runtime < (duration * 1000.0)) {
+				auto tStart = std::chrono::high_resolution_clock::now();
+				renderFunc();
+				auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+				runtime += tDiff;
+				frameTimes.push_back(tDiff);
+				frameCount++;
+				if (outputFrames != -1 && outputFrames == frameCount) break;
+			};
+			measuring = false;
+			resolveGpuFrames();
+			std::cout << "Benchmark finished" << "\n";
+			std::cout << "device : " << deviceProps.deviceName << " (driver version: " << deviceProps.driverVersion << ")" << "\n";
+			std::cout << "runtime: " << (runtime / 1000.0) << "\n";
+			std::cout << "frames : " << frameCount << "\n";
+			std::cout << "fps    : " << frameCount / (runtime / 1000.0) << "\n";
+			printStatistics("CPU", FrameTimeStatistics::compute(frameTimes));
+			if (!gpuFrameTimes.empty()) {
+				printStatistics("GPU", FrameTimeStatistics::compute(gpuFrameTimes));
+			}
+			for (auto& pass : passTimes) {
+				printStatistics("Pass \"" + pass.first + "\" GPU", FrameTimeStatistics::compute(pass.second));
+			}
+		}
+	}
+
+	void Benchmark::saveResults()
+	{
+		std::ofstream result(filename, std::ios::out);
+		if (result.is_open()) {
+			result << std::fixed << std::setprecision(4);
+
+			result << "device,driverversion,duration (ms),frames,fps" << "\n";
+			result << deviceProps.deviceName << "," << deviceProps.driverVersion << "," << runtime << "," << frameCount << "," << frameCount / (runtime / 1000.0) << "\n";
+
+			if (!passTimes.empty()) {
+				result << "\n" << "pass,samples,mean (ms),p50 (ms),p95 (ms),p99 (ms)" << "\n";
+				for (auto& pass : passTimes) {
+					const FrameTimeStatistics statistics = FrameTimeStatistics::compute(pass.second);
+					result << pass.first << "," << statistics.samples << "," << statistics.mean << "," << statistics.p50 << "," << statistics.p95 << "," << statistics.p99 << "\n";
+				}
+			}
+
+			if (outputFrameTimes) {
+				result << "\n" << "frame,ms" << (gpuFrameTimes.empty() ? "" : ",gpu ms") << "\n";
+				for (size_t i = 0; i < frameTimes.size(); i++) {
+					result << i << "," << frameTimes[i];
+					if (i < gpuFrameTimes.size()) {
+						result << "," << gpuFrameTimes[i];
+					}
+					result << "\n";
+				}
+				double tMin = *std::min_element(frameTimes.begin(), frameTimes.end());
+				double tMax = *std::max_element(frameTimes.begin(), frameTimes.end());
+				double tAvg = std::accumulate(frameTimes.begin(), frameTimes.end(), 0.0) / (double)frameTimes.size();
+				std::cout << "best   : " << (1000.0 / tMin) << " fps (" << tMin << " ms)" << "\n";
+				std::cout << "worst  : " << (1000.0 / tMax) << " fps (" << tMax << " ms)" << "\n";
+				std::cout << "avg    : " << (1000.0 / tAvg) << " fps (" << tAvg << " ms)" << "\n";
+				std::cout << "\n";
+			}
+
+			result.flush();
+#if defined(_WIN32)
+			FreeConsole();
+#endif
+		}
+	}
+
+	/*
+		The JSON results are meant to be compared across runs, so besides the statistics they also identify the device,
+		the driver and the settings of the run
+	*/
+	void Benchmark::saveJson()
+	{
+		nlohmann::json json;
+		json["version"] = 1;
+		json["name"] = name;
+		json["device"] = {
+			{ "name", deviceProps.deviceName },
+			{ "vendorID", deviceProps.vendorID },
+			{ "deviceID", deviceProps.deviceID },
+			{ "driverVersion", deviceProps.driverVersion },
+			{ "apiVersion", deviceProps.apiVersion },
+		};
+		json["settings"] = {
+			{ "warmup", warmup },
+			{ "duration", duration },
+			{ "frameLimit", outputFrames },
+		};
+		json["frames"] = frameCount;
+		json["runtime"] = runtime;
+		json["fps"] = frameCount / (runtime / 1000.0);
+		json["cpu"] = toJson(FrameTimeStatistics::compute(frameTimes));
+		if (!gpuFrameTimes.empty()) {
+			json["gpu"] = toJson(FrameTimeStatistics::compute(gpuFrameTimes));
+		}
+		if (!passTimes.empty()) {
+			nlohmann::json passes = nlohmann::json::object();
+			for (auto& pass : passTimes) {
+				passes[pass.first] = toJson(FrameTimeStatistics::compute(pass.second));
+			}
+			json["passes"] = passes;
+		}
+		if (outputFrameTimes) {
+			json["frameTimes"] = { { "cpu", frameTimes }, { "gpu", gpuFrameTimes } };
+		}
+
+		std::ofstream file(jsonFilename, std::ios::out);
+		if (!file.is_open()) {
+			std::cerr << "Could not write benchmark results to \"" << jsonFilename << "\"\n";
+			return;
+		}
+		file << json.dump(4) << "\n";
+	}
+
+	bool Benchmark::compareToBaseline()
+	{
+		std::ifstream file(baselineFilename);
+		if (!file.is_open()) {
+			std::cerr << "Could not open benchmark baseline \"" << baselineFilename << "\"\n";
+			return false;
+		}
+		nlohmann::json baseline;
+		try {
+			file >> baseline;
+		}
+		catch (const std::exception& e) {
+			std::cerr << "Could not parse benchmark baseline \"" << baselineFilename << "\": " << e.what() << "\n";
+			return false;
+		}
+
+		const nlohmann::json& baselineDevice = baseline["device"];
+		if ((baselineDevice.value("deviceID", 0u) != deviceProps.deviceID) || (baselineDevice.value("driverVersion", 0u) != deviceProps.driverVersion)) {
+			std::cout << "Warning: baseline was recorded on \"" << baselineDevice.value("name", std::string("unknown device")) << "\" with driver version " << baselineDevice.value("driverVersion", 0u) << ", results may not be comparable" << "\n";
+		}
+
+		std::cout << "Comparison against " << baselineFilename << " (regression threshold " << regressionThreshold << " %)" << "\n";
+		std::cout << std::left << std::setw(12) << "metric" << std::right << std::setw(12) << "baseline" << std::setw(12) << "current" << std::setw(10) << "change" << "\n";
+		bool passed = true;
+		const char* percentiles[] = { "p50", "p95", "p99", "p99.9" };
+		auto compare = [&](const std::string& timer, const std::vector<double>& samples) {
+			if (!baseline.count(timer) || samples.empty()) {
+				return;
+			}
+			const nlohmann::json current = toJson(FrameTimeStatistics::compute(samples));
+			for (auto p : percentiles) {
+				const double before = baseline[timer].value(p, 0.0);
+				const double after = current[p].get<double>();
+				const double change = before > 0.0 ? (after - before) / before * 100.0 : 0.0;
+				// Only the median is robust enough against noise to fail a run, the tail percentiles are informational
+				const bool regressed = (std::string(p) == "p50") && (change > regressionThreshold);
+				std::cout << std::left << std::setw(12) << (timer + " " + p) << std::right << std::setw(12) << before << std::setw(12) << after << std::setw(9) << std::showpos << change << std::noshowpos << "%" << (regressed ? "  REGRESSION" : "") << "\n";
+				passed = passed && !regressed;
+			}
+		};
+		compare("cpu", frameTimes);
+		compare("gpu", gpuFrameTimes);
+		std::cout << (passed ? "No regressions" : "Frame time regressed") << "\n";
+		return passed;
+	}
+
+	void Benchmark::prepareGpuTimer(VkDevice device, const VkPhysicalDeviceProperties& properties, uint32_t timestampValidBits, VkCommandPool commandPool)
+	{
+		if ((timestampValidBits == 0) || (properties.limits.timestampPeriod == 0.0f)) {
+			std::cout << "Timestamps are not supported by the queue, GPU frame times are not measured" << "\n";
+			return;
+		}
+		gpuTimer.device = device;
+		gpuTimer.commandPool = commandPool;
+		gpuTimer.timestampPeriod = properties.limits.timestampPeriod;
+		gpuTimer.timestampMask = timestampValidBits >= 64 ? ~0ull : ((1ull << timestampValidBits) - 1);
+		gpuTimer.pending.fill(false);
+
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = gpuTimerFrameCount * 2;
+		VK_CHECK_RESULT(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &gpuTimer.queryPool));
+
+		VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, gpuTimerFrameCount);
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, gpuTimer.begin.data()));
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, gpuTimer.end.data()));
+
+		// The command buffers only differ in their queries, so they're recorded once and submitted again whenever their slot comes up
+		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
+		for (uint32_t i = 0; i < gpuTimerFrameCount; i++) {
+			VK_CHECK_RESULT(vkBeginCommandBuffer(gpuTimer.begin[i], &cmdBufInfo));
+			vkCmdResetQueryPool(gpuTimer.begin[i], gpuTimer.queryPool, i * 2, 2);
+			vkCmdWriteTimestamp(gpuTimer.begin[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, gpuTimer.queryPool, i * 2);
+			VK_CHECK_RESULT(vkEndCommandBuffer(gpuTimer.begin[i]));
+			// Timestamps are only written once all previously submitted work has reached the given stage, including that of earlier submissions
+			VK_CHECK_RESULT(vkBeginCommandBuffer(gpuTimer.end[i], &cmdBufInfo));
+			vkCmdWriteTimestamp(gpuTimer.end[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, gpuTimer.queryPool, i * 2 + 1);
+			VK_CHECK_RESULT(vkEndCommandBuffer(gpuTimer.end[i]));
+		}
+	}
+
+	void Benchmark::destroyGpuTimer()
+	{
+		if (gpuTimer.device == VK_NULL_HANDLE) {
+			return;
+		}
+		vkFreeCommandBuffers(gpuTimer.device, gpuTimer.commandPool, gpuTimerFrameCount, gpuTimer.begin.data());
+		vkFreeCommandBuffers(gpuTimer.device, gpuTimer.commandPool, gpuTimerFrameCount, gpuTimer.end.data());
+		vkDestroyQueryPool(gpuTimer.device, gpuTimer.queryPool, nullptr);
+		gpuTimer.device = VK_NULL_HANDLE;
+	}
+
+	void Benchmark::beginGpuFrame(VkQueue queue)
+	{
+		if (!measuring || (gpuTimer.device == VK_NULL_HANDLE)) {
+			return;
+		}
+		const uint32_t slot = gpuTimer.frameIndex % gpuTimerFrameCount;
+		if (gpuTimer.pending[slot]) {
+			// The slot's frame was submitted gpuTimerFrameCount frames ago, so this rarely has to wait
+			resolveGpuFrame(slot);
+		}
+		VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &gpuTimer.begin[slot];
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		gpuTimer.frameStarted = true;
+	}
+
+	void Benchmark::endGpuFrame(VkQueue queue)
+	{
+		if (!gpuTimer.frameStarted) {
+			return;
+		}
+		const uint32_t slot = gpuTimer.frameIndex % gpuTimerFrameCount;
+		VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &gpuTimer.end[slot];
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+		gpuTimer.pending[slot] = true;
+		gpuTimer.frameStarted = false;
+		gpuTimer.frameIndex++;
+	}
+
+	void Benchmark::resolveGpuFrame(uint32_t slot)
+	{
+		uint64_t timestamps[2];
+		VK_CHECK_RESULT(vkGetQueryPoolResults(gpuTimer.device, gpuTimer.queryPool, slot * 2, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+		gpuTimer.pending[slot] = false;
+		const uint64_t end = timestamps[1] & gpuTimer.timestampMask;
+		// With multiple frames in flight the begin timestamp may be written while the previous frame is still executing, so the overlap is not counted
+		uint64_t begin = timestamps[0] & gpuTimer.timestampMask;
+		if ((gpuTimer.lastEnd > begin) && (gpuTimer.lastEnd <= end)) {
+			begin = gpuTimer.lastEnd;
+		}
+		gpuTimer.lastEnd = end;
+		if (end >= begin) {
+			gpuFrameTimes.push_back((double)(end - begin) * gpuTimer.timestampPeriod / 1000000.0);
+		}
+	}
+
+	void Benchmark::resolveGpuFrames()
+	{
+		if (gpuTimer.device == VK_NULL_HANDLE) {
+			return;
+		}
+		// Oldest frames first, so overlaps are removed against the right predecessor
+		for (uint32_t i = 0; i < gpuTimerFrameCount; i++) {
+			const uint32_t slot = (gpuTimer.frameIndex + i) % gpuTimerFrameCount;
+			if (gpuTimer.pending[slot]) {
+				resolveGpuFrame(slot);
+			}
+		}
+	}
+
+	void Benchmark::addPassTime(const std::string& pass, double milliseconds)
+	{
+		if (!measuring) {
+			return;
+		}
+		auto it = std::find_if(passTimes.begin(), passTimes.end(), [&pass](const std::pair<std::string, std::vector<double>>& entry) { return entry.first == pass; });
+		if (it == passTimes.end()) {
+			passTimes.push_back(std::make_pair(pass, std::vector<double>()));
+			it = passTimes.end() - 1;
+		}
+		it->second.push_back(milliseconds);
+	}
+}
@@ -6,20 +6,78 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#pragma once
+
 #include <vector>
 #include <string>
-#include <algorithm>
-#include <limits>
+#include <array>
 #include <functional>
-#include <chrono>
-#include <iomanip>
+#include <utility>
+
+#include "vulkan/vulkan.h"
+
+#if defined(__ANDROID__)
+#include "VulkanAndroid.h"
+#endif
 
 namespace vks
 {
+	/** @brief Summary of a series of frame times in milliseconds */
+	struct FrameTimeStatistics
+	{
+		uint32_t samples = 0;
+		/** @brief Number of samples that were rejected as outliers for the mean and standard deviation */
+		uint32_t outliers = 0;
+		double min = 0.0;
+		double max = 0.0;
+		/** @brief Mean of the samples without outliers */
+		double mean = 0.0;
+		/** @brief Standard deviation of the samples without outliers */
+		double stddev = 0.0;
+		/** @brief Percentiles of all samples, outliers included as they are the stutters a user notices */
+		double p50 = 0.0;
+		double p95 = 0.0;
+		double p99 = 0.0;
+		double p999 = 0.0;
+
+		/**
+		* Compute the statistics of a series of frame times
+		*
+		* @param frameTimes Frame times in milliseconds
+		*
+		* @note Outliers are samples with a modified z-score (based on the median absolute deviation) above 3.5
+		*/
+		static FrameTimeStatistics compute(std::vector<double> frameTimes);
+	};
+
 	class Benchmark {
 	private:
 		FILE *stream;
 		VkPhysicalDeviceProperties deviceProps;
+
+		/*
+			GPU frame times are measured with timestamps written in small command buffers submitted before and after the frame's work
+			Results are read back a few frames later, so measuring doesn't stall the frames in flight
+		*/
+		static const uint32_t gpuTimerFrameCount = 8;
+		struct {
+			VkDevice device = VK_NULL_HANDLE;
+			VkCommandPool commandPool = VK_NULL_HANDLE;
+			VkQueryPool queryPool = VK_NULL_HANDLE;
+			std::array<VkCommandBuffer, gpuTimerFrameCount> begin;
+			std::array<VkCommandBuffer, gpuTimerFrameCount> end;
+			std::array<bool, gpuTimerFrameCount> pending;
+			uint32_t frameIndex = 0;
+			bool frameStarted = false;
+			double timestampPeriod = 1.0;
+			uint64_t timestampMask = ~0ull;
+			uint64_t lastEnd = 0;
+		} gpuTimer;
+		// Only frames of the benchmark phase are measured on the GPU
+		bool measuring = false;
+
+		void resolveGpuFrame(uint32_t slot);
+		void resolveGpuFrames();
 	public:
 		bool active = false;
 		bool outputFrameTimes = false;
@@ -27,78 +85,47 @@ namespace vks
 		uint32_t warmup = 1;
 		uint32_t duration = 10;
 		std::vector<double> frameTimes;
+		/** @brief GPU time of each frame in milliseconds, empty if the queue doesn't support timestamps */
+		std::vector<double> gpuFrameTimes;
+		/** @brief GPU times of named passes in milliseconds, in the order the passes were first measured */
+		std::vector<std::pair<std::string, std::vector<double>>> passTimes;
 		std::string filename = "";
+		/** @brief File the results are written to as JSON, meant to be kept as a baseline for later runs */
+		std::string jsonFilename = "";
+		/** @brief JSON results of an earlier run the results are compared against */
+		std::string baselineFilename = "";
+		/** @brief Increase of the median frame time against the baseline in percent that counts as a regression */
+		double regressionThreshold = 5.0;
+		/** @brief Name of the benchmarked example, stored in the JSON results */
+		std::string name = "";
 
 		double runtime = 0.0;
 		uint32_t frameCount = 0;
 
-		void run(std::function<void()> renderFunc, VkPhysicalDeviceProperties deviceProps) {
-			active = true;
-			this->deviceProps = deviceProps;
-#if defined(_WIN32)
-			AttachConsole(ATTACH_PARENT_PROCESS);
-			freopen_s(&stream, "CONOUT$", "w+", stdout);
-			freopen_s(&stream, "CONOUT$", "w+", stderr);
-#endif
-			std::cout << std::fixed << std::setprecision(3);
-
-			// Warm up phase to get more stable frame rates
-			{
-				double tMeasured = 0.0;
-				while (tMeasured < (warmup * 1000)) {
-					auto tStart = std::chrono::high_resolution_clock::now();
-					renderFunc();
-					auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
-					tMeasured += tDiff;
-				};
-			}
-
-			// Benchmark phase
-			{
-				while (runtime < (duration * 1000.0)) {
-					auto tStart = std::chrono::high_resolution_clock::now();
-					renderFunc();
-					auto tDiff = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
-					runtime += tDiff;
-					frameTimes.push_back(tDiff);
-					frameCount++;
-					if (outputFrames != -1 && outputFrames == frameCount) break;
-				};
-				std::cout << "Benchmark finished" << "\n";
-				std::cout << "device : " << deviceProps.deviceName << " (driver version: " << deviceProps.driverVersion << ")" << "\n";
-				std::cout << "runtime: " << (runtime / 1000.0) << "\n";
-				std::cout << "frames : " << frameCount << "\n";
-				std::cout << "fps    : " << frameCount / (runtime / 1000.0) << "\n";
-			}
-		}
+		void run(std::function<void()> renderFunc, VkPhysicalDeviceProperties deviceProps);
+		void saveResults();
+		void saveJson();
+		/** @brief Compare the results with the baseline, returns false if CPU or GPU median frame time regressed by more than the threshold */
+		bool compareToBaseline();
 
-		void saveResults() {
-			std::ofstream result(filename, std::ios::out);
-			if (result.is_open()) {
-				result << std::fixed << std::setprecision(4);
-
-				result << "device,driverversion,duration (ms),frames,fps" << "\n";
-				result << deviceProps.deviceName << "," << deviceProps.driverVersion << "," << runtime << "," << frameCount << "," << frameCount / (runtime / 1000.0) << "\n";
-
-				if (outputFrameTimes) {
-					result << "\n" << "frame,ms" << "\n";
-					for (size_t i = 0; i < frameTimes.size(); i++) {
-						result << i << "," << frameTimes[i] << "\n";
-					}
-					double tMin = *std::min_element(frameTimes.begin(), frameTimes.end());
-					double tMax = *std::max_element(frameTimes.begin(), frameTimes.end());
-					double tAvg = std::accumulate(frameTimes.begin(), frameTimes.end(), 0.0) / (double)frameTimes.size();
-					std::cout << "best   : " << (1000.0 / tMin) << " fps (" << tMin << " ms)" << "\n";
-					std::cout << "worst  : " << (1000.0 / tMax) << " fps (" << tMax << " ms)" << "\n";
-					std::cout << "avg    : " << (1000.0 / tAvg) << " fps (" << tAvg << " ms)" << "\n";
-					std::cout << "\n";
-				}
-
-				result.flush();
-#if defined(_WIN32)
-				FreeConsole();
-#endif
-			}
-		}
+		/**
+		* Prepare the timestamp queries for measuring GPU frame times
+		*
+		* @param device Logical device
+		* @param properties Properties of the physical device
+		* @param timestampValidBits Valid timestamp bits of the queue family the frames are submitted to, no GPU times are measured if zero
+		* @param commandPool Command pool for the queue family the frames are submitted to
+		*/
+		void prepareGpuTimer(VkDevice device, const VkPhysicalDeviceProperties& properties, uint32_t timestampValidBits, VkCommandPool commandPool);
+		void destroyGpuTimer();
+		/**
+		* @brief Submit the timestamp that marks the start of a frame's GPU work, call after the frame's image has been acquired
+		* @note The timestamp doesn't wait for the acquire semaphore, so GPU frame times include waits for the swap chain image (negligible without v-sync)
+		*/
+		void beginGpuFrame(VkQueue queue);
+		/** @brief Submit the timestamp that marks the end of a frame's GPU work, call after all of the frame's work has been submitted */
+		void endGpuFrame(VkQueue queue);
+		/** @brief Add a GPU time measured for a named pass (e.g. by vks::GpuProfiler), ignored outside of the benchmark phase */
+		void addPassTime(const std::string& pass, double milliseconds);
 	};
-}
\ No newline at end of file
+}
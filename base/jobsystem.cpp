@@ -0,0 +1,312 @@
+/*
+* Work stealing job system
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "jobsystem.h"
+
+#include <cassert>
+#include <memory>
+#include <thread>
+
+#include "trace.h"
+
+namespace vks
+{
+	/*
+		Fixed size Chase-Lev deque (see "Correct and Efficient Work-Stealing for Weak Memory Models", Lê et al.)
+		Only the owning thread calls push and pop, any thread may call steal
+	*/
+	class WorkStealingQueue
+	{
+	public:
+		WorkStealingQueue() : jobs(new std::atomic<Job*>[JobSystem::maxJobsPerThread]) {}
+
+		bool push(Job* job)
+		{
+			const int64_t b = bottom.load(std::memory_order_relaxed);
+			const int64_t t = top.load(std::memory_order_acquire);
+			if (b - t >= (int64_t)JobSystem::maxJobsPerThread) {
+				return false;
+			}
+			jobs[b & mask].store(job, std::memory_order_relaxed);
+			// Publishes the job and its contents to thieves
+			bottom.store(b + 1, std::memory_order_release);
+			return true;
+		}
+
+		Job* pop()
+		{
+			const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+			bottom.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t t = top.load(std::memory_order_relaxed);
+			if (t > b) {
+				// Empty
+				bottom.store(b + 1, std::memory_order_relaxed);
+				return nullptr;
+			}
+			Job* job = jobs[b & mask].load(std::memory_order_relaxed);
+			if (t == b) {
+				// Last job, race against thieves for it
+				if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+					job = nullptr;
+				}
+				bottom.store(b + 1, std::memory_order_relaxed);
+			}
+			return job;
+		}
+
+		Job* steal()
+		{
+			int64_t t = top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			const int64_t b = bottom.load(std::memory_order_acquire);
+			if (t >= b) {
+				return nullptr;
+			}
+			Job* job = jobs[t & mask].load(std::memory_order_acquire);
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+				// Lost against the owner or another thief
+				return nullptr;
+			}
+			return job;
+		}
+
+	private:
+		static const int64_t mask = JobSystem::maxJobsPerThread - 1;
+		static_assert((JobSystem::maxJobsPerThread & (JobSystem::maxJobsPerThread - 1)) == 0, "Queue capacity needs to be a power of two");
+		// Top and bottom are written by different threads, keep them on separate cache lines
+		std::atomic<int64_t> top{ 0 };
+		char padding[64 - sizeof(std::atomic<int64_t>)];
+		std::atomic<int64_t> bottom{ 0 };
+		std::unique_ptr<std::atomic<Job*>[]> jobs;
+	};
+
+	struct JobSystem::Worker
+	{
+		WorkStealingQueue queue;
+		// Pool the thread's jobs are taken from in a round robin fashion, as many as the queue can hold
+		// The queue can still run full when the thread submits continuations that were created by other threads
+		std::unique_ptr<Job[]> jobs{ new Job[JobSystem::maxJobsPerThread] };
+		uint32_t nextJob = 0;
+		uint32_t randomState = 0;
+		std::thread thread;
+	};
+
+	namespace
+	{
+		thread_local const JobSystem* currentSystem = nullptr;
+		thread_local uint32_t currentThreadIndex = 0;
+	}
+
+	JobSystem::JobSystem(uint32_t threadCount)
+	{
+		if (threadCount == 0) {
+			threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+		}
+		workers.resize(threadCount);
+		for (uint32_t i = 0; i < threadCount; i++) {
+			workers[i] = new Worker();
+			workers[i]->randomState = 0x9E3779B9u * (i + 1);
+		}
+		previousSystem = currentSystem;
+		previousThreadIndex = currentThreadIndex;
+		currentSystem = this;
+		currentThreadIndex = 0;
+		// Thread 0 is the creating thread, it runs jobs while it waits for them
+		for (uint32_t i = 1; i < threadCount; i++) {
+			workers[i]->thread = std::thread(&JobSystem::workerLoop, this, i);
+		}
+	}
+
+	JobSystem::~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			stopping.store(true);
+		}
+		wakeCondition.notify_all();
+		for (auto worker : workers) {
+			if (worker->thread.joinable()) {
+				worker->thread.join();
+			}
+		}
+		// Idle workers look into every queue, so none may go away before all threads have stopped
+		for (auto worker : workers) {
+			delete worker;
+		}
+		if (currentSystem == this) {
+			currentSystem = previousSystem;
+			currentThreadIndex = previousThreadIndex;
+		}
+	}
+
+	uint32_t JobSystem::getThreadCount() const
+	{
+		return static_cast<uint32_t>(workers.size());
+	}
+
+	uint32_t JobSystem::getThreadIndex() const
+	{
+		assert(currentSystem == this && "Calling thread is not part of the job system");
+		return currentThreadIndex;
+	}
+
+	Job* JobSystem::allocateJob()
+	{
+		const uint32_t threadIndex = getThreadIndex();
+		Worker* worker = workers[threadIndex];
+		for (;;) {
+			// Skip jobs that haven't finished yet, waiting for a specific one could wait for the job that is allocating
+			for (uint32_t i = 0; i < maxJobsPerThread; i++) {
+				Job* job = &worker->jobs[worker->nextJob++ & (maxJobsPerThread - 1)];
+				if (!job->inUse.load(std::memory_order_acquire)) {
+					job->inUse.store(true, std::memory_order_relaxed);
+					return job;
+				}
+			}
+			// All of the thread's jobs are in flight, help out until one of them has finished
+			Job* pending = findJob(threadIndex);
+			if (pending) {
+				execute(pending);
+			} else {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	void JobSystem::submit(Job* job)
+	{
+		if (!workers[getThreadIndex()]->queue.push(job)) {
+			// Continuations come from the pools of other threads, so they may not fit, spill them instead of dropping them
+			std::lock_guard<std::mutex> lock(overflowMutex);
+			overflowJobs.push_back(job);
+			overflowJobCount.fetch_add(1, std::memory_order_release);
+		}
+		queuedJobs.fetch_add(1);
+		if (sleepingWorkers.load() > 0) {
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			wakeCondition.notify_one();
+		}
+	}
+
+	void JobSystem::addContinuation(JobCounter& dependency, Job* job)
+	{
+		while (dependency.lock.test_and_set(std::memory_order_acquire)) {
+			std::this_thread::yield();
+		}
+		const bool done = dependency.done();
+		if (!done) {
+			dependency.continuations.push_back(job);
+		}
+		dependency.lock.clear(std::memory_order_release);
+		if (done) {
+			submit(job);
+		}
+	}
+
+	void JobSystem::execute(Job* job)
+	{
+		{
+			VKS_TRACE_SCOPE_CATEGORY("Job", "jobs");
+			job->invoke(&job->storage);
+		}
+		job->destroy(&job->storage);
+		JobCounter* counter = job->counter;
+		job->inUse.store(false, std::memory_order_release);
+		if (!counter) {
+			return;
+		}
+		// Decrement under the lock so continuations added concurrently are either submitted here or by addContinuation
+		std::vector<Job*> continuations;
+		while (counter->lock.test_and_set(std::memory_order_acquire)) {
+			std::this_thread::yield();
+		}
+		if (counter->value.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			continuations.swap(counter->continuations);
+		}
+		counter->lock.clear(std::memory_order_release);
+		// The counter may be gone from here on
+		for (auto continuation : continuations) {
+			submit(continuation);
+		}
+	}
+
+	Job* JobSystem::findJob(uint32_t threadIndex)
+	{
+		Worker* worker = workers[threadIndex];
+		Job* job = worker->queue.pop();
+		if (!job && overflowJobCount.load(std::memory_order_acquire) > 0) {
+			std::lock_guard<std::mutex> lock(overflowMutex);
+			if (!overflowJobs.empty()) {
+				job = overflowJobs.front();
+				overflowJobs.pop_front();
+				overflowJobCount.fetch_sub(1, std::memory_order_relaxed);
+			}
+		}
+		if (!job) {
+			// Start stealing at a random victim so idle threads don't all go for the same queue
+			const uint32_t threadCount = getThreadCount();
+			worker->randomState ^= worker->randomState << 13;
+			worker->randomState ^= worker->randomState >> 17;
+			worker->randomState ^= worker->randomState << 5;
+			const uint32_t start = worker->randomState % threadCount;
+			for (uint32_t i = 0; i < threadCount && !job; i++) {
+				const uint32_t victim = (start + i) % threadCount;
+				if (victim != threadIndex) {
+					job = workers[victim]->queue.steal();
+				}
+			}
+		}
+		if (job) {
+			queuedJobs.fetch_sub(1);
+		}
+		return job;
+	}
+
+	void JobSystem::wait(JobCounter& counter)
+	{
+		const uint32_t threadIndex = getThreadIndex();
+		while (!counter.done()) {
+			Job* job = findJob(threadIndex);
+			if (job) {
+				execute(job);
+			} else {
+				std::this_thread::yield();
+			}
+		}
+		// The thread that finished the last job may still hold the lock, the counter must outlive that
+		while (counter.lock.test_and_set(std::memory_order_acquire)) {
+			std::this_thread::yield();
+		}
+		counter.lock.clear(std::memory_order_release);
+	}
+
+	void JobSystem::workerLoop(uint32_t threadIndex)
+	{
+		currentSystem = this;
+		currentThreadIndex = threadIndex;
+		trace::setThreadName("Job worker " + std::to_string(threadIndex));
+		while (!stopping.load()) {
+			Job* job = findJob(threadIndex);
+			// Spin for a bit before going to sleep, new jobs often arrive in quick succession
+			for (uint32_t spin = 0; !job && spin < 64; spin++) {
+				std::this_thread::yield();
+				job = findJob(threadIndex);
+			}
+			if (job) {
+				execute(job);
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			// Announce the sleep before checking for jobs, submit checks in the opposite order so a wake up can't get lost
+			sleepingWorkers.fetch_add(1);
+			wakeCondition.wait(lock, [this] { return queuedJobs.load() > 0 || stopping.load(); });
+			sleepingWorkers.fetch_sub(1);
+		}
+	}
+}
@@ -0,0 +1,209 @@
+/*
+* Work stealing job system
+*
+* Every thread of the system owns a lock-free deque of jobs. It pushes and pops jobs at the bottom of its own deque,
+* idle threads steal jobs from the top of the other threads' deques, so no thread runs dry while others still have work queued
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace vks
+{
+	class JobSystem;
+	class JobCounter;
+
+	/**
+	* @brief A unit of work, the callable is stored in place so creating and running a job never allocates
+	* @note Jobs are owned by the job system, they are taken from a fixed size pool of the thread that creates them
+	*/
+	struct Job
+	{
+		/** @brief Bytes available for the callable and its captures, larger callables are rejected at compile time */
+		static const size_t storageSize = 96;
+
+		void (*invoke)(void* storage) = nullptr;
+		void (*destroy)(void* storage) = nullptr;
+		JobCounter* counter = nullptr;
+		std::atomic<bool> inUse{ false };
+		typename std::aligned_storage<storageSize, alignof(std::max_align_t)>::type storage;
+	};
+
+	/**
+	* @brief Counts the unfinished jobs it has been passed to, used to wait for jobs and to express dependencies between them
+	* @note A counter must not be destroyed before JobSystem::wait returned for it
+	*/
+	class JobCounter
+	{
+	public:
+		JobCounter() = default;
+		JobCounter(const JobCounter&) = delete;
+		JobCounter& operator=(const JobCounter&) = delete;
+
+		/** @brief True if all jobs of the counter have finished */
+		bool done() const
+		{
+			return value.load(std::memory_order_acquire) == 0;
+		}
+
+	private:
+		friend class JobSystem;
+		std::atomic<uint32_t> value{ 0 };
+		// Guards the continuations, a spin lock as it's only held for a few instructions
+		std::atomic_flag lock = ATOMIC_FLAG_INIT;
+		// Jobs that are submitted once the counter reaches zero
+		std::vector<Job*> continuations;
+	};
+
+	/**
+	* @brief Work stealing scheduler
+	* @note The thread that creates the system takes part in it as thread 0, jobs may only be created on that thread and from within jobs
+	* @note Systems may be nested, e.g. a short lived one for loading while another one exists, the creating thread belongs to the newest one until it's destroyed
+	*/
+	class JobSystem
+	{
+	public:
+		/** @brief Number of jobs a single thread can have in flight, creating more jobs makes the thread help out until one of its jobs has finished */
+		static const uint32_t maxJobsPerThread = 4096;
+
+		/** @brief Create the system with threadCount threads including the calling one, 0 uses one thread per hardware thread */
+		explicit JobSystem(uint32_t threadCount = 0);
+		/** @brief Stop all worker threads, all jobs need to have been waited for */
+		~JobSystem();
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+
+		/** @brief Number of threads that run jobs, including the thread that created the system */
+		uint32_t getThreadCount() const;
+		/** @brief Index of the calling thread in [0, getThreadCount()), e.g. to select per thread resources inside of a job */
+		uint32_t getThreadIndex() const;
+
+		/**
+		* Run a callable as a job
+		*
+		* @param function Callable without arguments, it's moved into the job
+		* @param counter (Optional) Counter that is incremented now and decremented once the job has finished
+		*/
+		template<typename F>
+		void run(F&& function, JobCounter* counter = nullptr)
+		{
+			submit(createJob(std::forward<F>(function), counter));
+		}
+
+		/**
+		* Run a callable as a job once all jobs of another counter have finished
+		*
+		* @param dependency Counter the job depends on
+		* @param function Callable without arguments, it's moved into the job
+		* @param counter (Optional) Counter that is incremented now and decremented once the job has finished
+		*/
+		template<typename F>
+		void runAfter(JobCounter& dependency, F&& function, JobCounter* counter = nullptr)
+		{
+			addContinuation(dependency, createJob(std::forward<F>(function), counter));
+		}
+
+		/**
+		* Call a function for all indices of [0, count) in parallel
+		*
+		* @param count Number of indices
+		* @param grainSize Number of indices below which a range is no longer split, should cover enough work to outweigh the cost of a job
+		* @param function Callable taking the begin and end of a range of indices, it's copied for every job the range is split into
+		* @param counter (Optional) Counter the jobs are added to, if no counter is passed the call returns once all indices have been processed
+		*/
+		template<typename F>
+		void parallelFor(uint32_t count, uint32_t grainSize, F&& function, JobCounter* counter = nullptr)
+		{
+			JobCounter localCounter;
+			JobCounter* rangeCounter = counter ? counter : &localCounter;
+			if (count > 0) {
+				// Ranges are split in halves recursively so thieves take large chunks and the owner keeps working on the small ones
+				RangeJob<typename std::decay<F>::type> range = { this, std::forward<F>(function), rangeCounter, 0, count, grainSize > 0 ? grainSize : 1 };
+				run(std::move(range), rangeCounter);
+			}
+			if (!counter) {
+				wait(localCounter);
+			}
+		}
+
+		/** @brief Run jobs on the calling thread until all jobs of the counter have finished */
+		void wait(JobCounter& counter);
+
+	private:
+		struct Worker;
+		std::vector<Worker*> workers;
+		// Jobs sitting in any of the queues, used to put idle workers to sleep
+		std::atomic<uint32_t> queuedJobs{ 0 };
+		std::atomic<uint32_t> sleepingWorkers{ 0 };
+		std::atomic<bool> stopping{ false };
+		std::mutex sleepMutex;
+		std::condition_variable wakeCondition;
+		// Jobs that didn't fit into the submitting thread's deque, any thread may take them
+		std::mutex overflowMutex;
+		std::deque<Job*> overflowJobs;
+		std::atomic<uint32_t> overflowJobCount{ 0 };
+		// System the creating thread belonged to before this one was created, restored on destruction
+		const JobSystem* previousSystem = nullptr;
+		uint32_t previousThreadIndex = 0;
+
+		template<typename F>
+		struct RangeJob
+		{
+			JobSystem* system;
+			F function;
+			JobCounter* counter;
+			uint32_t begin;
+			uint32_t end;
+			uint32_t grainSize;
+
+			void operator()()
+			{
+				while (end - begin > grainSize) {
+					const uint32_t middle = begin + (end - begin) / 2;
+					RangeJob upperHalf = { system, function, counter, middle, end, grainSize };
+					system->run(std::move(upperHalf), counter);
+					end = middle;
+				}
+				function(begin, end);
+			}
+		};
+
+		template<typename F>
+		Job* createJob(F&& function, JobCounter* counter)
+		{
+			typedef typename std::decay<F>::type Function;
+			static_assert(sizeof(Function) <= Job::storageSize, "Callable does not fit into the job's storage, capture large data by reference or pointer");
+			static_assert(alignof(Function) <= alignof(std::max_align_t), "Callable is over-aligned for the job's storage");
+			Job* job = allocateJob();
+			new (&job->storage) Function(std::forward<F>(function));
+			job->invoke = [](void* storage) { (*static_cast<Function*>(storage))(); };
+			job->destroy = [](void* storage) { static_cast<Function*>(storage)->~Function(); };
+			job->counter = counter;
+			if (counter) {
+				counter->value.fetch_add(1, std::memory_order_relaxed);
+			}
+			return job;
+		}
+
+		Job* allocateJob();
+		void submit(Job* job);
+		void addContinuation(JobCounter& dependency, Job* job);
+		void execute(Job* job);
+		Job* findJob(uint32_t threadIndex);
+		void workerLoop(uint32_t threadIndex);
+	};
+}
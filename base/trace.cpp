@@ -0,0 +1,194 @@
+/*
+* CPU and GPU timeline tracing
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "trace.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "json.hpp"
+
+namespace vks
+{
+	namespace trace
+	{
+		namespace detail
+		{
+			std::atomic<bool> enabled{ false };
+		}
+
+		namespace
+		{
+			struct Event
+			{
+				std::string name;
+				const char* category;
+				uint64_t begin;
+				uint64_t end;
+				std::string detail;
+			};
+
+			/*
+				Every thread records into its own buffer, so recording only contends with stop
+				Buffers outlive their threads, events of threads that finished early are still written
+			*/
+			struct ThreadBuffer
+			{
+				uint32_t id;
+				std::string name;
+				std::mutex mutex;
+				std::vector<Event> events;
+			};
+
+			struct Registry
+			{
+				std::mutex mutex;
+				std::vector<std::unique_ptr<ThreadBuffer>> threads;
+				std::map<std::string, std::vector<Event>> gpuTracks;
+				std::string filename;
+				uint64_t startTime = 0;
+			};
+
+			Registry& registry()
+			{
+				static Registry instance;
+				return instance;
+			}
+
+			thread_local ThreadBuffer* threadBuffer = nullptr;
+
+			ThreadBuffer& getThreadBuffer()
+			{
+				if (!threadBuffer) {
+					Registry& reg = registry();
+					std::lock_guard<std::mutex> lock(reg.mutex);
+					reg.threads.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer()));
+					threadBuffer = reg.threads.back().get();
+					threadBuffer->id = static_cast<uint32_t>(reg.threads.size());
+					threadBuffer->name = "Thread " + std::to_string(threadBuffer->id);
+				}
+				return *threadBuffer;
+			}
+
+			void writeEvent(std::ostream& stream, const Event& event, uint32_t pid, uint32_t tid, uint64_t startTime)
+			{
+				// Chrome traces use microseconds
+				const uint64_t begin = (event.begin > startTime) ? event.begin - startTime : 0;
+				const uint64_t duration = (event.end > event.begin) ? event.end - event.begin : 0;
+				stream << ",\n{\"name\":" << nlohmann::json(event.name).dump() << ",\"cat\":\"" << event.category << "\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << tid;
+				stream << ",\"ts\":" << (double)begin / 1000.0 << ",\"dur\":" << (double)duration / 1000.0;
+				if (!event.detail.empty()) {
+					stream << ",\"args\":{\"detail\":" << nlohmann::json(event.detail).dump() << "}";
+				}
+				stream << "}";
+			}
+
+			void writeMetadata(std::ostream& stream, const char* type, uint32_t pid, uint32_t tid, const std::string& name)
+			{
+				stream << ",\n{\"name\":\"" << type << "\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << tid << ",\"args\":{\"name\":" << nlohmann::json(name).dump() << "}}";
+			}
+		}
+
+		void start(const std::string& filename)
+		{
+			Registry& reg = registry();
+			{
+				std::lock_guard<std::mutex> lock(reg.mutex);
+				reg.filename = filename;
+				reg.startTime = now();
+			}
+			detail::enabled.store(true);
+		}
+
+		bool stop()
+		{
+			if (!detail::enabled.exchange(false)) {
+				return false;
+			}
+			Registry& reg = registry();
+			std::lock_guard<std::mutex> lock(reg.mutex);
+			std::ofstream file(reg.filename, std::ios::out);
+			if (!file.is_open()) {
+				std::cerr << "Could not write trace to \"" << reg.filename << "\"\n";
+				return false;
+			}
+			const uint32_t cpuProcess = 1;
+			const uint32_t gpuProcess = 2;
+			file << std::fixed << std::setprecision(3);
+			file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+			file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << cpuProcess << ",\"args\":{\"name\":\"CPU\"}}";
+			writeMetadata(file, "process_name", gpuProcess, 0, "GPU");
+			size_t eventCount = 0;
+			for (auto& thread : reg.threads) {
+				std::vector<Event> events;
+				{
+					std::lock_guard<std::mutex> threadLock(thread->mutex);
+					events.swap(thread->events);
+				}
+				writeMetadata(file, "thread_name", cpuProcess, thread->id, thread->name);
+				for (auto& event : events) {
+					writeEvent(file, event, cpuProcess, thread->id, reg.startTime);
+				}
+				eventCount += events.size();
+			}
+			uint32_t trackId = 1;
+			for (auto& track : reg.gpuTracks) {
+				writeMetadata(file, "thread_name", gpuProcess, trackId, track.first);
+				for (auto& event : track.second) {
+					writeEvent(file, event, gpuProcess, trackId, reg.startTime);
+				}
+				eventCount += track.second.size();
+				trackId++;
+			}
+			reg.gpuTracks.clear();
+			file << "\n]}\n";
+			std::cout << "Trace with " << eventCount << " events written to " << reg.filename << "\n";
+			return eventCount > 0;
+		}
+
+		uint64_t now()
+		{
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+		}
+
+		void setThreadName(const std::string& name)
+		{
+			ThreadBuffer& buffer = getThreadBuffer();
+			std::lock_guard<std::mutex> lock(buffer.mutex);
+			buffer.name = name;
+		}
+
+		void addEvent(const std::string& name, const char* category, uint64_t begin, uint64_t end, const std::string& detail)
+		{
+			if (!isEnabled()) {
+				return;
+			}
+			ThreadBuffer& buffer = getThreadBuffer();
+			Event event{ name, category, begin, end, detail };
+			std::lock_guard<std::mutex> lock(buffer.mutex);
+			buffer.events.push_back(std::move(event));
+		}
+
+		void addGpuEvent(const std::string& name, uint64_t begin, uint64_t end, const std::string& track)
+		{
+			if (!isEnabled()) {
+				return;
+			}
+			Registry& reg = registry();
+			Event event{ name, "gpu", begin, end, "" };
+			std::lock_guard<std::mutex> lock(reg.mutex);
+			reg.gpuTracks[track].push_back(std::move(event));
+		}
+	}
+}
@@ -0,0 +1,100 @@
+/*
+* CPU and GPU timeline tracing
+*
+* Records scopes on all threads and GPU time ranges, and writes them as a Chrome trace (JSON) that can be opened
+* in chrome://tracing or ui.perfetto.dev
+*
+* Copyright (C) by Sascha Willems - www.saschawillems.de
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace vks
+{
+	namespace trace
+	{
+		namespace detail
+		{
+			extern std::atomic<bool> enabled;
+		}
+
+		/** @brief Start recording, events are kept in memory until stop writes them to the given file */
+		void start(const std::string& filename);
+		/** @brief Stop recording and write the trace file, returns false if nothing was recorded or the file could not be written */
+		bool stop();
+		inline bool isEnabled()
+		{
+			return detail::enabled.load(std::memory_order_relaxed);
+		}
+
+		/** @brief Time on the trace's clock in nanoseconds */
+		uint64_t now();
+		/** @brief Name the calling thread's track in the trace */
+		void setThreadName(const std::string& name);
+
+		/**
+		* Add a finished CPU event to the calling thread's track
+		*
+		* @param name Name of the event
+		* @param category Category of the event (used for filtering in the trace viewer), has to be a string literal
+		* @param begin Start time on the trace's clock
+		* @param end End time on the trace's clock
+		* @param detail (Optional) Additional information shown with the event, e.g. a file name
+		*/
+		void addEvent(const std::string& name, const char* category, uint64_t begin, uint64_t end, const std::string& detail = "");
+		/**
+		* Add a GPU time range to a GPU track
+		*
+		* @param name Name of the event
+		* @param begin Start time, already converted to the trace's clock
+		* @param end End time, already converted to the trace's clock
+		* @param track (Optional) Name of the GPU track, e.g. to separate queues
+		*/
+		void addGpuEvent(const std::string& name, uint64_t begin, uint64_t end, const std::string& track = "Graphics queue");
+
+		/** @brief Records the lifetime of the scope as an event on the calling thread's track */
+		class Scope
+		{
+		public:
+			Scope(const char* name, const char* category = "cpu") : name(name), category(category)
+			{
+				if (isEnabled()) {
+					begin = now();
+				}
+			}
+			Scope(const char* name, const char* category, const std::string& detail) : name(name), category(category)
+			{
+				if (isEnabled()) {
+					this->detail = detail;
+					begin = now();
+				}
+			}
+			~Scope()
+			{
+				// Recording may have started while the scope was open
+				if ((begin != 0) && isEnabled()) {
+					addEvent(name, category, begin, now(), detail);
+				}
+			}
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+		private:
+			const char* name;
+			const char* category;
+			std::string detail;
+			uint64_t begin = 0;
+		};
+	}
+}
+
+#define VKS_TRACE_CONCAT_INNER(a, b) a##b
+#define VKS_TRACE_CONCAT(a, b) VKS_TRACE_CONCAT_INNER(a, b)
+/** @brief Trace the enclosing block, the name has to be a string literal */
+#define VKS_TRACE_SCOPE(name) vks::trace::Scope VKS_TRACE_CONCAT(traceScope, __LINE__)(name)
+#define VKS_TRACE_SCOPE_CATEGORY(name, category) vks::trace::Scope VKS_TRACE_CONCAT(traceScope, __LINE__)(name, category)
@@ -171,9 +171,21 @@ std::string VulkanExampleBase::getShadersPath() const
 
 void VulkanExampleBase::createPipelineCache()
 {
-	VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
-	pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-	VK_CHECK_RESULT(vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache));
+	// The cache is stored per example and device, so a restart doesn't have to compile all pipelines again
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+	const std::string directory = androidApp->activity->internalDataPath;
+	std::string prefix = title;
+	std::replace_if(prefix.begin(), prefix.end(), [](char c) { return !isalnum(c); }, '_');
+#else
+	const std::string directory = pipelineCacheDir;
+	std::string prefix = args.empty() ? name : std::string(args[0]);
+	prefix = prefix.substr(prefix.find_last_of("/\\") + 1);
+	if ((prefix.size() > 4) && (prefix.compare(prefix.size() - 4, 4, ".exe") == 0)) {
+		prefix.resize(prefix.size() - 4);
+	}
+#endif
+	pipelineCacheFile = vks::pipelinecache::getFileName(deviceProperties, directory, prefix);
+	VK_CHECK_RESULT(vks::pipelinecache::create(device, deviceProperties, pipelineCacheFile, &pipelineCache));
 }
 
 void VulkanExampleBase::prepare()
@@ -190,6 +202,15 @@ void VulkanExampleBase::prepare()
 	setupRenderPass();
 	createPipelineCache();
 	setupFrameBuffer();
+	const uint32_t timestampValidBits = vulkanDevice->queueFamilyProperties[vulkanDevice->queueFamilyIndices.graphics].timestampValidBits;
+	gpuProfiler.create(device, deviceProperties, timestampValidBits, queue, cmdPool);
+	if (vks::trace::isEnabled()) {
+		gpuProfiler.calibrate(queue, cmdPool);
+	}
+	if (benchmark.active) {
+		benchmark.prepareGpuTimer(device, deviceProperties, timestampValidBits, cmdPool);
+		gpuProfiler.onSample = [this](const std::string& name, double milliseconds) { benchmark.addPassTime(name, milliseconds); };
+	}
 	settings.overlay = settings.overlay && (!benchmark.active);
 	if (settings.overlay) {
 		UIOverlay.device = vulkanDevice;
@@ -221,6 +242,7 @@ VkPipelineShaderStageCreateInfo VulkanExampleBase::loadShader(std::string fileNa
 
 void VulkanExampleBase::nextFrame()
 {
+	VKS_TRACE_SCOPE("Frame");
 	auto tStart = std::chrono::high_resolution_clock::now();
 	if (viewUpdated)
 	{
@@ -266,12 +288,27 @@ void VulkanExampleBase::nextFrame()
 
 void VulkanExampleBase::renderLoop()
 {
+	// All resources of the example have been created at this point
+	if (settings.memoryStatistics) {
+		vulkanDevice->memoryAllocator->printStatistics();
+	}
+
 	if (benchmark.active) {
-		benchmark.run([=] { render(); }, vulkanDevice->properties);
+		benchmark.name = title;
+		benchmark.run([=] {
+			VKS_TRACE_SCOPE("Frame");
+			render();
+		}, vulkanDevice->properties);
 		vkDeviceWaitIdle(device);
 		if (benchmark.filename != "") {
 			benchmark.saveResults();
 		}
+		if (benchmark.jsonFilename != "") {
+			benchmark.saveJson();
+		}
+		if ((benchmark.baselineFilename != "") && !benchmark.compareToBaseline()) {
+			exitCode = 1;
+		}
 		return;
 	}
 
@@ -634,6 +671,8 @@ void VulkanExampleBase::updateOverlay()
 	if (!settings.overlay)
 		return;
 
+	VKS_TRACE_SCOPE("Update UI overlay");
+
 	ImGuiIO& io = ImGui::GetIO();
 
 	io.DisplaySize = ImVec2((float)width, (float)height);
@@ -652,6 +691,13 @@ void VulkanExampleBase::updateOverlay()
 	ImGui::TextUnformatted(title.c_str());
 	ImGui::TextUnformatted(deviceProperties.deviceName);
 	ImGui::Text("%.2f ms/frame (%.1d fps)", (1000.0f / lastFPS), lastFPS);
+	if (!gpuProfiler.getTimings().empty()) {
+		if (UIOverlay.header("GPU timings")) {
+			for (auto& timing : gpuProfiler.getTimings()) {
+				UIOverlay.text("%s: %.3f ms", timing.name.c_str(), timing.average);
+			}
+		}
+	}
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0.0f, 5.0f * UIOverlay.scale));
@@ -668,6 +714,10 @@ void VulkanExampleBase::updateOverlay()
 	ImGui::Render();
 
 	if (UIOverlay.update() || UIOverlay.updated) {
+		if (maxFramesInFlight > 1) {
+			// Command buffers of older frames may still be executing
+			VK_CHECK_RESULT(vkQueueWaitIdle(queue));
+		}
 		buildCommandBuffers();
 		UIOverlay.updated = false;
 	}
@@ -691,10 +741,43 @@ void VulkanExampleBase::drawUI(const VkCommandBuffer commandBuffer)
 	}
 }
 
+vks::UploadManager& VulkanExampleBase::getUploadManager()
+{
+	if (!uploadManager.isActive()) {
+		uploadManager.create(vulkanDevice, queue);
+	}
+	return uploadManager;
+}
+
+void VulkanExampleBase::createFrameUniformBuffers(std::vector<vks::Buffer>& buffers, VkDeviceSize size, const void* data)
+{
+	// Sized by the frames in flight and not the swap chain images, so a resize that changes the image count doesn't affect them
+	buffers.resize(maxFramesInFlight);
+	for (auto& buffer : buffers) {
+		VK_CHECK_RESULT(vulkanDevice->createBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffer, size, const_cast<void*>(data)));
+		VK_CHECK_RESULT(buffer.map());
+	}
+}
+
 void VulkanExampleBase::prepareFrame()
 {
+	// Submit the uploads recorded since the last frame, so they're ordered before this frame's command buffers on the graphics queue
+	if (uploadManager.isActive()) {
+		uploadManager.flush();
+	}
+	if (maxFramesInFlight > 1) {
+		// Wait until the GPU has finished the last frame that used this frame's synchronization objects
+		VKS_TRACE_SCOPE_CATEGORY("Wait for frame in flight", "sync");
+		VK_CHECK_RESULT(vkWaitForFences(device, 1, &frameSync[currentFrame].complete, VK_TRUE, UINT64_MAX));
+		semaphores.presentComplete = frameSync[currentFrame].presentComplete;
+		semaphores.renderComplete = frameSync[currentFrame].renderComplete;
+	}
 	// Acquire the next image from the swap chain
-	VkResult result = swapChain.acquireNextImage(semaphores.presentComplete, &currentBuffer);
+	VkResult result;
+	{
+		VKS_TRACE_SCOPE_CATEGORY("Acquire image", "sync");
+		result = swapChain.acquireNextImage(semaphores.presentComplete, &currentBuffer);
+	}
 	// Recreate the swapchain if it's no longer compatible with the surface (OUT_OF_DATE) or no longer optimal for presentation (SUBOPTIMAL)
 	if ((result == VK_ERROR_OUT_OF_DATE_KHR) || (result == VK_SUBOPTIMAL_KHR)) {
 		windowResize();
@@ -702,11 +785,35 @@ void VulkanExampleBase::prepareFrame()
 	else {
 		VK_CHECK_RESULT(result);
 	}
+	if ((maxFramesInFlight > 1) && (currentBuffer < imageFences.size())) {
+		// The image's command buffer may still be executing for an older frame that acquired the same image
+		if (imageFences[currentBuffer] != VK_NULL_HANDLE) {
+			VKS_TRACE_SCOPE_CATEGORY("Wait for image", "sync");
+			VK_CHECK_RESULT(vkWaitForFences(device, 1, &imageFences[currentBuffer], VK_TRUE, UINT64_MAX));
+		}
+		imageFences[currentBuffer] = frameSync[currentFrame].complete;
+	}
+	if (benchmark.active) {
+		benchmark.beginGpuFrame(queue);
+	}
 }
 
 void VulkanExampleBase::submitFrame()
 {
-	VkResult result = swapChain.queuePresent(queue, currentBuffer, semaphores.renderComplete);
+	if (benchmark.active) {
+		benchmark.endGpuFrame(queue);
+	}
+	if (maxFramesInFlight > 1) {
+		// An empty submission signals the fence once all work submitted to the queue for this frame has completed
+		VK_CHECK_RESULT(vkResetFences(device, 1, &frameSync[currentFrame].complete));
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 0, nullptr, frameSync[currentFrame].complete));
+		currentFrame = (currentFrame + 1) % maxFramesInFlight;
+	}
+	VkResult result;
+	{
+		VKS_TRACE_SCOPE_CATEGORY("Present", "queue");
+		result = swapChain.queuePresent(queue, currentBuffer, semaphores.renderComplete);
+	}
 	if (!((result == VK_SUCCESS) || (result == VK_SUBOPTIMAL_KHR))) {
 		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 			// Swap chain is no longer compatible with the surface and needs to be recreated
@@ -716,7 +823,12 @@ void VulkanExampleBase::submitFrame()
 			VK_CHECK_RESULT(result);
 		}
 	}
-	VK_CHECK_RESULT(vkQueueWaitIdle(queue));
+	if (maxFramesInFlight == 1) {
+		VKS_TRACE_SCOPE_CATEGORY("vkQueueWaitIdle", "sync");
+		VK_CHECK_RESULT(vkQueueWaitIdle(queue));
+	}
+	// Picks up the timings of whichever older frames have finished by now
+	gpuProfiler.resolve();
 }
 
 VulkanExampleBase::VulkanExampleBase(bool enableValidation)
@@ -772,6 +884,15 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 			shaderDir = value;
 		}
 	}
+	if (commandLineParser.isSet("pipelinecachedir")) {
+		pipelineCacheDir = commandLineParser.getValueAsString("pipelinecachedir", pipelineCacheDir);
+	}
+	if (commandLineParser.isSet("memorystatistics")) {
+		settings.memoryStatistics = true;
+	}
+	if (commandLineParser.isSet("framesinflight")) {
+		settings.framesInFlight = std::max(commandLineParser.getValueAsInt("framesinflight", 1), 1);
+	}
 	if (commandLineParser.isSet("benchmark")) {
 		benchmark.active = true;
 		vks::tools::errorModeSilent = true;
@@ -791,6 +912,19 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 	if (commandLineParser.isSet("benchmarkframes")) {
 		benchmark.outputFrames = commandLineParser.getValueAsInt("benchmarkframes", benchmark.outputFrames);
 	}
+	if (commandLineParser.isSet("benchmarkjson")) {
+		benchmark.jsonFilename = commandLineParser.getValueAsString("benchmarkjson", benchmark.jsonFilename);
+	}
+	if (commandLineParser.isSet("benchmarkcompare")) {
+		benchmark.baselineFilename = commandLineParser.getValueAsString("benchmarkcompare", benchmark.baselineFilename);
+	}
+	if (commandLineParser.isSet("benchmarkthreshold")) {
+		benchmark.regressionThreshold = std::stod(commandLineParser.getValueAsString("benchmarkthreshold", "5.0"));
+	}
+	if (commandLineParser.isSet("trace")) {
+		vks::trace::setThreadName("Main thread");
+		vks::trace::start(commandLineParser.getValueAsString("trace", "trace.json"));
+	}
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	// Vulkan library is loaded dynamically on Android
@@ -816,6 +950,7 @@ VulkanExampleBase::VulkanExampleBase(bool enableValidation)
 
 VulkanExampleBase::~VulkanExampleBase()
 {
+	vks::trace::stop();
 	// Clean up Vulkan resources
 	swapChain.cleanup();
 	if (descriptorPool != VK_NULL_HANDLE)
@@ -837,12 +972,26 @@ VulkanExampleBase::~VulkanExampleBase()
 	vkDestroyImage(device, depthStencil.image, nullptr);
 	vkFreeMemory(device, depthStencil.mem, nullptr);
 
-	vkDestroyPipelineCache(device, pipelineCache, nullptr);
+	if (pipelineCache != VK_NULL_HANDLE) {
+		vks::pipelinecache::save(device, deviceProperties, pipelineCache, pipelineCacheFile);
+		vkDestroyPipelineCache(device, pipelineCache, nullptr);
+	}
 
+	benchmark.destroyGpuTimer();
+	gpuProfiler.destroy();
+	uploadManager.destroy();
 	vkDestroyCommandPool(device, cmdPool, nullptr);
 
-	vkDestroySemaphore(device, semaphores.presentComplete, nullptr);
-	vkDestroySemaphore(device, semaphores.renderComplete, nullptr);
+	if (frameSync.empty()) {
+		vkDestroySemaphore(device, semaphores.presentComplete, nullptr);
+		vkDestroySemaphore(device, semaphores.renderComplete, nullptr);
+	}
+	// The first frame in flight owns the semaphores created in initVulkan
+	for (auto& frame : frameSync) {
+		vkDestroySemaphore(device, frame.presentComplete, nullptr);
+		vkDestroySemaphore(device, frame.renderComplete, nullptr);
+		vkDestroyFence(device, frame.complete, nullptr);
+	}
 	for (auto& fence : waitFences) {
 		vkDestroyFence(device, fence, nullptr);
 	}
@@ -978,7 +1127,8 @@ bool VulkanExampleBase::initVulkan()
 	// This is handled by a separate class that gets a logical device representation
 	// and encapsulates functions related to a device
 	vulkanDevice = new vks::VulkanDevice(physicalDevice);
-	VkResult res = vulkanDevice->createLogicalDevice(enabledFeatures, enabledDeviceExtensions, deviceCreatepNextChain);
+	// A dedicated transfer queue (if available) is used by the upload manager
+	VkResult res = vulkanDevice->createLogicalDevice(enabledFeatures, enabledDeviceExtensions, deviceCreatepNextChain, true, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT);
 	if (res != VK_SUCCESS) {
 		vks::tools::exitFatal("Could not create Vulkan device: \n" + vks::tools::errorString(res), res);
 		return false;
@@ -2492,6 +2642,30 @@ void VulkanExampleBase::createSynchronizationPrimitives()
 	for (auto& fence : waitFences) {
 		VK_CHECK_RESULT(vkCreateFence(device, &fenceCreateInfo, nullptr, &fence));
 	}
+
+	// Only examples that keep per frame resources can run with more than one frame in flight, the others share their uniform buffers
+	if (settings.framesInFlight > 0) {
+		if (maxFramesInFlight > 1) {
+			maxFramesInFlight = settings.framesInFlight;
+		} else if (settings.framesInFlight > 1) {
+			std::cout << "This example doesn't support multiple frames in flight, --framesinflight is ignored\n";
+		}
+	}
+	// Frames in flight, the first one reuses the semaphores created in initVulkan
+	maxFramesInFlight = std::max(maxFramesInFlight, 1u);
+	frameSync.resize(maxFramesInFlight);
+	VkSemaphoreCreateInfo semaphoreCreateInfo = vks::initializers::semaphoreCreateInfo();
+	for (uint32_t i = 0; i < maxFramesInFlight; i++) {
+		if (i == 0) {
+			frameSync[i].presentComplete = semaphores.presentComplete;
+			frameSync[i].renderComplete = semaphores.renderComplete;
+		} else {
+			VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &frameSync[i].presentComplete));
+			VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &frameSync[i].renderComplete));
+		}
+		VK_CHECK_RESULT(vkCreateFence(device, &fenceCreateInfo, nullptr, &frameSync[i].complete));
+	}
+	imageFences.assign(drawCmdBuffers.size(), VK_NULL_HANDLE);
 }
 
 void VulkanExampleBase::createCommandPool()
@@ -2646,6 +2820,7 @@ void VulkanExampleBase::getEnabledFeatures() {}
 
 void VulkanExampleBase::windowResize()
 {
+	VKS_TRACE_SCOPE("Resize swap chain");
 	if (!prepared)
 	{
 		return;
@@ -2681,6 +2856,7 @@ void VulkanExampleBase::windowResize()
 	// references to the recreated frame buffer
 	destroyCommandBuffers();
 	createCommandBuffers();
+	imageFences.assign(drawCmdBuffers.size(), VK_NULL_HANDLE);
 	buildCommandBuffers();
 
 	vkDeviceWaitIdle(device);
@@ -2770,12 +2946,19 @@ CommandLineParser::CommandLineParser()
 	add("shaders", { "-s", "--shaders" }, 1, "Select shader type to use (glsl or hlsl)");
 	add("gpuselection", { "-g", "--gpu" }, 1, "Select GPU to run on");
 	add("gpulist", { "-gl", "--listgpus" }, 0, "Display a list of available Vulkan devices");
+	add("pipelinecachedir", { "-pcd", "--pipelinecachedir" }, 1, "Set directory the pipeline cache is stored in");
+	add("memorystatistics", { "-ms", "--memorystats" }, 0, "Print device memory allocator statistics after loading");
+	add("framesinflight", { "-fif", "--framesinflight" }, 1, "Set the number of frames the CPU may submit ahead of the GPU (examples that support it default to 2)");
 	add("benchmark", { "-b", "--benchmark" }, 0, "Run example in benchmark mode");
 	add("benchmarkwarmup", { "-bw", "--benchwarmup" }, 1, "Set warmup time for benchmark mode in seconds");
 	add("benchmarkruntime", { "-br", "--benchruntime" }, 1, "Set duration time for benchmark mode in seconds");
 	add("benchmarkresultfile", { "-bf", "--benchfilename" }, 1, "Set file name for benchmark results");
 	add("benchmarkresultframes", { "-bt", "--benchframetimes" }, 0, "Save frame times to benchmark results file");
 	add("benchmarkframes", { "-bfs", "--benchmarkframes" }, 1, "Only render the given number of frames");
+	add("benchmarkjson", { "-bj", "--benchjson" }, 1, "Save benchmark results including frame time statistics as JSON");
+	add("benchmarkcompare", { "-bc", "--benchcompare" }, 1, "Compare benchmark results against a JSON baseline, exits with an error code on regressions");
+	add("benchmarkthreshold", { "-bth", "--benchthreshold" }, 1, "Increase of the median frame time in percent that counts as a regression (default 5)");
+	add("trace", { "--trace" }, 1, "Record the CPU and GPU timelines and save them as a Chrome trace (JSON) to the given file");
 }
 
 void CommandLineParser::add(std::string name, std::vector<std::string> commands, bool hasValue, std::string help)
@@ -67,6 +67,10 @@
 #include "VulkanBuffer.h"
 #include "VulkanDevice.h"
 #include "VulkanTexture.h"
+#include "VulkanPipelineCache.h"
+#include "VulkanGpuProfiler.h"
+#include "VulkanUploadManager.h"
+#include "trace.h"
 
 #include "VulkanInitializers.hpp"
 #include "camera.hpp"
@@ -112,6 +116,11 @@ private:
 	void createCommandBuffers();
 	void destroyCommandBuffers();
 	std::string shaderDir = "glsl";
+	/** @brief Directory the pipeline cache is stored in (empty for the working directory) and the file it is saved to on exit */
+	std::string pipelineCacheDir;
+	std::string pipelineCacheFile;
+	// Only created by getUploadManager, so examples that don't stream data don't allocate its staging buffer
+	vks::UploadManager uploadManager;
 protected:
 	// Returns the path to the root of the glsl or hlsl shader directory.
 	std::string getShadersPath() const;
@@ -162,8 +171,8 @@ protected:
 	VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
 	// List of shader modules created (stored for cleanup)
 	std::vector<VkShaderModule> shaderModules;
-	// Pipeline cache object
-	VkPipelineCache pipelineCache;
+	// Pipeline cache object, loaded from and saved to disk
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
 	// Wraps the swap chain to present images (framebuffers) to the windowing system
 	VulkanSwapChain swapChain;
 	// Synchronization semaphores
@@ -174,6 +183,26 @@ protected:
 		VkSemaphore renderComplete;
 	} semaphores;
 	std::vector<VkFence> waitFences;
+	/**
+	* @brief Number of frames the CPU may submit ahead of the GPU, set in the derived constructor
+	* With the default of 1 submitFrame() waits for the queue to become idle after every frame
+	* With more frames in flight, per frame resources (see createFrameUniformBuffers) are indexed with currentFrame
+	* and the copy of currentFrame may only be written after prepareFrame() returned
+	* Examples that set this to more than 1 can be run with a different number via --framesinflight
+	*/
+	uint32_t maxFramesInFlight = 1;
+	/** @brief Frame in flight that is currently prepared and submitted, in [0, maxFramesInFlight) */
+	uint32_t currentFrame = 0;
+	// Synchronization objects of each frame in flight, semaphores always holds the pair of currentFrame
+	struct FrameSync {
+		VkSemaphore presentComplete;
+		VkSemaphore renderComplete;
+		// Signaled once all work submitted for the frame has been executed
+		VkFence complete;
+	};
+	std::vector<FrameSync> frameSync;
+	// Fence of the last frame that rendered to each swap chain image (VK_NULL_HANDLE if none)
+	std::vector<VkFence> imageFences;
 public:
 	bool prepared = false;
 	bool resized = false;
@@ -187,6 +216,12 @@ public:
 	float frameTimer = 1.0f;
 
 	vks::Benchmark benchmark;
+	/** @brief Timestamp profiler for named passes, timings are shown in the UI overlay and added to the benchmark results */
+	vks::GpuProfiler gpuProfiler;
+	/** @brief Streams buffer and image data in on the transfer queue, created on first use and pending uploads are submitted at the start of every frame */
+	vks::UploadManager& getUploadManager();
+	/** @brief Exit code of the example's process, non-zero if the benchmark results regressed against a baseline */
+	int exitCode = 0;
 
 	/** @brief Encapsulated physical and logical vulkan device */
 	vks::VulkanDevice *vulkanDevice;
@@ -201,6 +236,10 @@ public:
 		bool vsync = false;
 		/** @brief Enable UI overlay */
 		bool overlay = true;
+		/** @brief Print the statistics of the device memory allocator once the example has been prepared */
+		bool memoryStatistics = false;
+		/** @brief Frames in flight requested via command line, 0 keeps the example's maxFramesInFlight */
+		uint32_t framesInFlight = 0;
 	} settings;
 
 	VkClearColorValue defaultClearColor = { { 0.025f, 0.025f, 0.025f, 1.0f } };
@@ -396,6 +435,15 @@ public:
 	/** @brief Adds the drawing commands for the ImGui overlay to the given command buffer */
 	void drawUI(const VkCommandBuffer commandBuffer);
 
+	/**
+	* Create one host visible and mapped uniform buffer per frame in flight
+	*
+	* @param buffers Receives maxFramesInFlight buffers, buffers[currentFrame] may be written after prepareFrame()
+	* @param size Size of each buffer in bytes
+	* @param data (Optional) Initial data copied into every buffer
+	*/
+	void createFrameUniformBuffers(std::vector<vks::Buffer>& buffers, VkDeviceSize size, const void* data = nullptr);
+
 	/** Prepare the next frame for workload submission by acquiring the next swap chain image */
 	void prepareFrame();
 	/** @brief Presents the current image to the swap chain */
@@ -428,8 +476,9 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int)									\
 	vulkanExample->setupWindow(hInstance, WndProc);													\
 	vulkanExample->prepare();																		\
 	vulkanExample->renderLoop();																	\
+	int exitCode = vulkanExample->exitCode;															\
 	delete(vulkanExample);																			\
-	return 0;																						\
+	return exitCode;																				\
 }
 #elif defined(VK_USE_PLATFORM_ANDROID_KHR)
 // Android entry point
@@ -460,8 +509,9 @@ int main(const int argc, const char *argv[])													    \
 	vulkanExample->initVulkan();																	\
 	vulkanExample->prepare();																		\
 	vulkanExample->renderLoop();																	\
+	int exitCode = vulkanExample->exitCode;															\
 	delete(vulkanExample);																			\
-	return 0;																						\
+	return exitCode;																				\
 }
 #elif defined(VK_USE_PLATFORM_DIRECTFB_EXT)
 #define VULKAN_EXAMPLE_MAIN()																		\
@@ -481,8 +531,9 @@ int main(const int argc, const char *argv[])													    \
 	vulkanExample->setupWindow();					 												\
 	vulkanExample->prepare();																		\
 	vulkanExample->renderLoop();																	\
+	int exitCode = vulkanExample->exitCode;															\
 	delete(vulkanExample);																			\
-	return 0;																						\
+	return exitCode;																				\
 }
 #elif (defined(VK_USE_PLATFORM_WAYLAND_KHR) || defined(VK_USE_PLATFORM_HEADLESS_EXT))
 #define VULKAN_EXAMPLE_MAIN()																		\
@@ -495,8 +546,9 @@ int main(const int argc, const char *argv[])													    \
 	vulkanExample->setupWindow();					 												\
 	vulkanExample->prepare();																		\
 	vulkanExample->renderLoop();																	\
+	int exitCode = vulkanExample->exitCode;															\
 	delete(vulkanExample);																			\
-	return 0;																						\
+	return exitCode;																				\
 }
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
 #define VULKAN_EXAMPLE_MAIN()																		\
@@ -516,8 +568,9 @@ int main(const int argc, const char *argv[])													    \
 	vulkanExample->setupWindow();					 												\
 	vulkanExample->prepare();																		\
 	vulkanExample->renderLoop();																	\
+	int exitCode = vulkanExample->exitCode;															\
 	delete(vulkanExample);																			\
-	return 0;																						\
+	return exitCode;																				\
 }
 #elif (defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK))
 #if defined(VK_EXAMPLE_XCODE_GENERATED)
@@ -525,6 +578,7 @@ int main(const int argc, const char *argv[])													    \
 VulkanExample *vulkanExample;																		\
 int main(const int argc, const char *argv[])														\
 {																									\
+	int exitCode = 0;																				\
 	@autoreleasepool																				\
 	{																								\
 		for (size_t i = 0; i < argc; i++) { VulkanExample::args.push_back(argv[i]); };				\
@@ -533,9 +587,10 @@ int main(const int argc, const char *argv[])														\
 		vulkanExample->setupWindow(nullptr);														\
 		vulkanExample->prepare();																	\
 		vulkanExample->renderLoop();																\
+		exitCode = vulkanExample->exitCode;															\
 		delete(vulkanExample);																		\
 	}																								\
-	return 0;																						\
+	return exitCode;																				\
 }
 #else
 #define VULKAN_EXAMPLE_MAIN()
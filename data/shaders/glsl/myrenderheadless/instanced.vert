@@ -0,0 +1,38 @@
+#version 450
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec3 inColor;
+
+layout (location = 0) out vec3 outColor;
+
+out gl_PerVertex {
+	vec4 gl_Position;   
+};
+
+// model_view only holds the view matrix, the model matrix is fetched per instance
+layout(push_constant) uniform PushConsts {
+	mat4 model_view;
+	mat4 proj;
+	float far_z;
+} constants;
+
+layout (std430, set = 0, binding = 0) readonly buffer Instances {
+	mat4 models[];
+};
+
+// false: same projection as triangle.vert, true: same projection as perspective.vert
+layout (constant_id = 0) const bool PERSPECTIVE = false;
+
+void main() 
+{
+	outColor = inColor;
+	vec4 pView = constants.model_view * models[gl_InstanceIndex] * vec4(inPos.xyz, 1.0);
+	if (PERSPECTIVE) {
+		gl_Position = constants.proj * pView;
+	} else {
+		vec4 pImg = pView / pView.z;
+		pImg = constants.proj * pImg;
+		float ndc_depth = pView.z / constants.far_z;
+		gl_Position = vec4(pImg.x, pImg.y, ndc_depth, 1.0);
+	}
+}
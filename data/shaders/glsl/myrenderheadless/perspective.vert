@@ -0,0 +1,23 @@
+#version 450
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec3 inColor;
+
+layout (location = 0) out vec3 outColor;
+
+out gl_PerVertex {
+	vec4 gl_Position;   
+};
+
+layout(push_constant) uniform PushConsts {
+	mat4 model_view;
+	mat4 proj;
+	float far_z;
+} constants;
+
+void main() 
+{
+	outColor = inColor;
+	// w = view space z, the rasterizer does the perspective divide and interpolates perspective correctly
+	gl_Position = constants.proj * constants.model_view * vec4(inPos.xyz, 1.0);
+}
@@ -0,0 +1,47 @@
+#version 450
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec3 inColor;
+
+layout (location = 0) out vec3 outColor;
+
+out gl_PerVertex {
+	vec4 gl_Position;   
+};
+
+// the only value baked into the recorded command buffer, the camera of the image being rendered
+layout(push_constant) uniform PushConsts {
+	uint camera;
+} constants;
+
+layout (std430, set = 0, binding = 0) readonly buffer Instances {
+	mat4 models[];
+};
+
+struct Camera {
+	mat4 view;
+	mat4 proj;
+	float far_z;
+};
+
+layout (std430, set = 0, binding = 1) readonly buffer Cameras {
+	Camera cameras[];
+};
+
+// false: same projection as triangle.vert, true: same projection as perspective.vert
+layout (constant_id = 0) const bool PERSPECTIVE = false;
+
+void main() 
+{
+	outColor = inColor;
+	Camera camera = cameras[constants.camera];
+	vec4 pView = camera.view * models[gl_InstanceIndex] * vec4(inPos.xyz, 1.0);
+	if (PERSPECTIVE) {
+		gl_Position = camera.proj * pView;
+	} else {
+		vec4 pImg = pView / pView.z;
+		pImg = camera.proj * pImg;
+		float ndc_depth = pView.z / camera.far_z;
+		gl_Position = vec4(pImg.x, pImg.y, ndc_depth, 1.0);
+	}
+}
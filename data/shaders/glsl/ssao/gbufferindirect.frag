@@ -0,0 +1,58 @@
+#version 450
+
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout (location = 0) in vec3 inNormal;
+layout (location = 1) in vec2 inUV;
+layout (location = 2) in vec3 inColor;
+layout (location = 3) in vec3 inPos;
+layout (location = 4) flat in uint inMaterialIndex;
+
+layout (location = 0) out vec4 outPosition;
+layout (location = 1) out vec4 outNormal;
+layout (location = 2) out vec4 outAlbedo;
+
+layout (set = 0, binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 model;
+	mat4 view;
+	float nearPlane;
+	float farPlane;
+} ubo;
+
+struct Material
+{
+	vec4 baseColorFactor;
+	int baseColorTexture;
+	int metallicRoughnessTexture;
+	int normalTexture;
+	int alphaMode;
+	float alphaCutoff;
+	float metallicFactor;
+	float roughnessFactor;
+	float padding;
+};
+
+layout (std430, set = 1, binding = 2) readonly buffer MaterialBuffer
+{
+	Material materials[];
+};
+
+layout (set = 1, binding = 3) uniform sampler2D textures[];
+
+float linearDepth(float depth)
+{
+	float z = depth * 2.0f - 1.0f; 
+	return (2.0f * ubo.nearPlane * ubo.farPlane) / (ubo.farPlane + ubo.nearPlane - z * (ubo.farPlane - ubo.nearPlane));	
+}
+
+void main() 
+{
+	outPosition = vec4(inPos, linearDepth(gl_FragCoord.z));
+	outNormal = vec4(normalize(inNormal) * 0.5 + 0.5, 1.0);
+	// A negative index means the material has no base color texture
+	int textureIndex = materials[inMaterialIndex].baseColorTexture;
+	vec4 color = textureIndex >= 0 ? texture(textures[nonuniformEXT(textureIndex)], inUV) : vec4(1.0);
+	outAlbedo = color * vec4(inColor, 1.0);
+}
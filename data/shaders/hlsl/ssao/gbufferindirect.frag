@@ -0,0 +1,70 @@
+// Copyright 2020 Google LLC
+// Non-uniform access is enabled at compile time via SPV_EXT_descriptor_indexing (see compile.py)
+
+struct VSOutput
+{
+	float4 Pos : SV_POSITION;
+[[vk::location(0)]] float3 Normal : NORMAL0;
+[[vk::location(1)]] float2 UV : TEXCOORD0;
+[[vk::location(2)]] float3 Color : COLOR0;
+[[vk::location(3)]] float3 WorldPos : POSITION0;
+[[vk::location(4)]] nointerpolation uint MaterialIndex : MATERIALINDEX0;
+};
+
+struct UBO
+{
+	float4x4 projection;
+	float4x4 model;
+	float4x4 view;
+	float nearPlane;
+	float farPlane;
+};
+
+cbuffer ubo : register(b0) { UBO ubo; }
+
+struct Material
+{
+	float4 baseColorFactor;
+	int baseColorTexture;
+	int metallicRoughnessTexture;
+	int normalTexture;
+	int alphaMode;
+	float alphaCutoff;
+	float metallicFactor;
+	float roughnessFactor;
+	float padding;
+};
+
+StructuredBuffer<Material> materials : register(t2, space1);
+
+Texture2D textures[] : register(t3, space1);
+SamplerState samplerTextures : register(s3, space1);
+
+struct FSOutput
+{
+	float4 Position : SV_TARGET0;
+	float4 Normal : SV_TARGET1;
+	float4 Albedo : SV_TARGET2;
+};
+
+float linearDepth(float depth)
+{
+	float z = depth * 2.0f - 1.0f;
+	return (2.0f * ubo.nearPlane * ubo.farPlane) / (ubo.farPlane + ubo.nearPlane - z * (ubo.farPlane - ubo.nearPlane));
+}
+
+FSOutput main(VSOutput input)
+{
+	FSOutput output = (FSOutput)0;
+	output.Position = float4(input.WorldPos, linearDepth(input.Pos.z));
+	output.Normal = float4(normalize(input.Normal) * 0.5 + 0.5, 1.0);
+	// A negative index means the material has no base color texture
+	int textureIndex = materials[input.MaterialIndex].baseColorTexture;
+	// The conditional operator evaluates both sides in HLSL, so the texture must only be sampled in a branch
+	float4 color = float4(1.0, 1.0, 1.0, 1.0);
+	if (textureIndex >= 0) {
+		color = textures[NonUniformResourceIndex(textureIndex)].Sample(samplerTextures, input.UV);
+	}
+	output.Albedo = color * float4(input.Color, 1.0);
+	return output;
+}
@@ -0,0 +1,173 @@
+/*
+* Vulkan Example - CPU benchmark for glTF animation evaluation
+*
+* Measures vkglTF::Animation::evaluate for synthetic clips of increasing length against the previous evaluation,
+* which scanned all keyframes of every channel. No Vulkan device is required
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#if defined(_WIN32)
+#pragma comment(linker, "/subsystem:console")
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <iostream>
+#include <iomanip>
+#include <functional>
+
+#include "VulkanglTFModel.h"
+
+// Nodes animated by each clip, every node has a translation, rotation and scale channel
+#define NODE_COUNT 64
+// Frame rate the playback benchmark advances the time with
+#define FRAME_RATE 60.0f
+
+/*
+	Builds a clip with the given number of keyframes per sampler and one second between keyframes
+*/
+vkglTF::Animation createAnimation(uint32_t keyCount, vkglTF::AnimationSampler::InterpolationType interpolation, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+	const uint32_t outputsPerKey = (interpolation == vkglTF::AnimationSampler::InterpolationType::CUBICSPLINE) ? 3 : 1;
+	vkglTF::Animation animation{};
+	animation.start = 0.0f;
+	animation.end = static_cast<float>(keyCount - 1);
+	const vkglTF::AnimationChannel::PathType paths[] = { vkglTF::AnimationChannel::PathType::TRANSLATION, vkglTF::AnimationChannel::PathType::ROTATION, vkglTF::AnimationChannel::PathType::SCALE };
+	for (uint32_t node = 0; node < NODE_COUNT; node++) {
+		for (vkglTF::AnimationChannel::PathType path : paths) {
+			vkglTF::AnimationSampler sampler{};
+			sampler.interpolation = interpolation;
+			sampler.inputs.resize(keyCount);
+			sampler.outputsVec4.resize(keyCount * outputsPerKey);
+			for (uint32_t i = 0; i < keyCount; i++) {
+				sampler.inputs[i] = static_cast<float>(i);
+			}
+			for (glm::vec4& output : sampler.outputsVec4) {
+				output = glm::vec4(value(rng), value(rng), value(rng), value(rng));
+				if (path == vkglTF::AnimationChannel::PathType::ROTATION) {
+					output = glm::normalize(output);
+				}
+			}
+			vkglTF::AnimationChannel channel{};
+			channel.path = path;
+			channel.node = nullptr;
+			channel.samplerIndex = static_cast<uint32_t>(animation.samplers.size());
+			animation.samplers.push_back(sampler);
+			animation.channels.push_back(channel);
+		}
+	}
+	return animation;
+}
+
+/*
+	Evaluation as it was done before keyframe cursors, every interval of every channel is tested and cubic splines are treated as linear
+*/
+void evaluateLinearScan(const vkglTF::Animation& animation, float time, std::vector<glm::vec4>& values)
+{
+	values.resize(animation.channels.size());
+	for (size_t c = 0; c < animation.channels.size(); c++) {
+		const vkglTF::AnimationChannel& channel = animation.channels[c];
+		const vkglTF::AnimationSampler& sampler = animation.samplers[channel.samplerIndex];
+		for (size_t i = 0; i < sampler.inputs.size() - 1; i++) {
+			if ((time >= sampler.inputs[i]) && (time <= sampler.inputs[i + 1])) {
+				float u = std::max(0.0f, time - sampler.inputs[i]) / (sampler.inputs[i + 1] - sampler.inputs[i]);
+				if (channel.path == vkglTF::AnimationChannel::PathType::ROTATION) {
+					glm::quat q1;
+					q1.x = sampler.outputsVec4[i].x;
+					q1.y = sampler.outputsVec4[i].y;
+					q1.z = sampler.outputsVec4[i].z;
+					q1.w = sampler.outputsVec4[i].w;
+					glm::quat q2;
+					q2.x = sampler.outputsVec4[i + 1].x;
+					q2.y = sampler.outputsVec4[i + 1].y;
+					q2.z = sampler.outputsVec4[i + 1].z;
+					q2.w = sampler.outputsVec4[i + 1].w;
+					glm::quat q = glm::normalize(glm::slerp(q1, q2, u));
+					values[c] = glm::vec4(q.x, q.y, q.z, q.w);
+				} else {
+					values[c] = glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], u);
+				}
+			}
+		}
+	}
+}
+
+/** @brief Runs the evaluation for all times and returns the average time per channel in nanoseconds */
+double measure(const std::vector<float>& times, size_t channelCount, const std::function<void(float)>& evaluate)
+{
+	// Warm up caches and the keyframe cursors
+	evaluate(times[0]);
+	const auto tStart = std::chrono::high_resolution_clock::now();
+	for (float time : times) {
+		evaluate(time);
+	}
+	const auto tEnd = std::chrono::high_resolution_clock::now();
+	const double ns = std::chrono::duration<double, std::nano>(tEnd - tStart).count();
+	return ns / (static_cast<double>(times.size()) * static_cast<double>(channelCount));
+}
+
+int main(int argc, char* argv[])
+{
+	uint32_t frameCount = 2000;
+	for (int i = 1; i + 1 < argc; i++) {
+		if (std::string(argv[i]) == "--frames") {
+			frameCount = std::max(1, atoi(argv[i + 1]));
+		}
+	}
+
+	std::mt19937 rng(1234);
+	const uint32_t keyCounts[] = { 8, 64, 512, 4096, 32768 };
+
+	std::cout << "Animation evaluation, " << NODE_COUNT * 3 << " channels, " << frameCount << " evaluations per run, ns per channel\n\n";
+	std::cout << std::setw(8) << "keys" << std::setw(16) << "scan playback" << std::setw(16) << "playback" << std::setw(16) << "scan seeking" << std::setw(16) << "seeking" << std::setw(16) << "cubic playback" << std::setw(14) << "max error" << "\n";
+	std::cout << std::fixed << std::setprecision(1);
+
+	for (uint32_t keyCount : keyCounts) {
+		vkglTF::Animation animation = createAnimation(keyCount, vkglTF::AnimationSampler::InterpolationType::LINEAR, rng);
+		vkglTF::Animation cubicAnimation = createAnimation(keyCount, vkglTF::AnimationSampler::InterpolationType::CUBICSPLINE, rng);
+		const size_t channelCount = animation.channels.size();
+
+		// Playback advances by one frame at a time and loops, seeking jumps to random times
+		std::vector<float> playbackTimes(frameCount);
+		std::vector<float> seekTimes(frameCount);
+		std::uniform_real_distribution<float> seek(animation.start, animation.end);
+		for (uint32_t i = 0; i < frameCount; i++) {
+			playbackTimes[i] = std::fmod(static_cast<float>(i) / FRAME_RATE, animation.end);
+			seekTimes[i] = seek(rng);
+		}
+
+		std::vector<glm::vec4> reference;
+		float sink = 0.0f;
+		auto scan = [&](float time) { evaluateLinearScan(animation, time, reference); sink += reference[0].x; };
+		auto cursor = [&](float time) { animation.evaluate(time); sink += animation.channelValues[0].x; };
+		auto cubic = [&](float time) { cubicAnimation.evaluate(time); sink += cubicAnimation.channelValues[0].x; };
+
+		const double scanPlayback = measure(playbackTimes, channelCount, scan);
+		const double cursorPlayback = measure(playbackTimes, channelCount, cursor);
+		const double scanSeeking = measure(seekTimes, channelCount, scan);
+		const double cursorSeeking = measure(seekTimes, channelCount, cursor);
+		const double cubicPlayback = measure(playbackTimes, channelCount, cubic);
+
+		// Both evaluations have to agree for linear clips
+		float maxError = 0.0f;
+		for (float time : seekTimes) {
+			evaluateLinearScan(animation, time, reference);
+			animation.evaluate(time);
+			for (size_t c = 0; c < channelCount; c++) {
+				const glm::vec4 difference = reference[c] - animation.channelValues[c];
+				maxError = std::max(maxError, std::max(std::max(std::fabs(difference.x), std::fabs(difference.y)), std::max(std::fabs(difference.z), std::fabs(difference.w))));
+			}
+		}
+
+		std::cout << std::setw(8) << keyCount << std::setw(16) << scanPlayback << std::setw(16) << cursorPlayback << std::setw(16) << scanSeeking << std::setw(16) << cursorSeeking << std::setw(16) << cubicPlayback << std::setw(14) << std::scientific << maxError << std::fixed;
+		// Keeps the compiler from dropping the evaluations
+		std::cout << (sink == 12345.0f ? " " : "") << "\n";
+	}
+	return 0;
+}
@@ -28,6 +28,8 @@
 
 #include <vulkan/vulkan.h>
 #include "VulkanTools.h"
+#include "VulkanPipelineCache.h"
+#include "trace.h"
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 android_app* androidapp;
@@ -62,6 +64,7 @@ class VulkanExample
 public:
 	VkInstance instance;
 	VkPhysicalDevice physicalDevice;
+	VkPhysicalDeviceProperties deviceProperties;
 	VkDevice device;
 	uint32_t queueFamilyIndex;
 	VkPipelineCache pipelineCache;
@@ -78,6 +81,15 @@ public:
 
 	VkDebugReportCallbackEXT debugReportCallback{};
 
+	std::string getPipelineCacheFile()
+	{
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+		return vks::pipelinecache::getFileName(deviceProperties, androidapp->activity->internalDataPath, "computeheadless");
+#else
+		return vks::pipelinecache::getFileName(deviceProperties, "", "computeheadless");
+#endif
+	}
+
 	VkResult createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkBuffer *buffer, VkDeviceMemory *memory, VkDeviceSize size, void *data = nullptr)
 	{
 		// Create the buffer handle
@@ -207,7 +219,6 @@ public:
 		VK_CHECK_RESULT(vkEnumeratePhysicalDevices(instance, &deviceCount, physicalDevices.data()));
 		physicalDevice = physicalDevices[0];
 
-		VkPhysicalDeviceProperties deviceProperties;
 		vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
 		LOG("GPU: %s\n", deviceProperties.deviceName);
 
@@ -307,8 +318,11 @@ public:
 			VK_CHECK_RESULT(vkCreateFence(device, &fenceInfo, nullptr, &fence));
 
 			// Submit to the queue
-			VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
-			VK_CHECK_RESULT(vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX));
+			{
+				VKS_TRACE_SCOPE_CATEGORY("Upload input", "queue");
+				VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
+				VK_CHECK_RESULT(vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX));
+			}
 
 			vkDestroyFence(device, fence, nullptr);
 			vkFreeCommandBuffers(device, commandPool, 1, &copyCmd);
@@ -347,9 +361,7 @@ public:
 			};
 			vkUpdateDescriptorSets(device, static_cast<uint32_t>(computeWriteDescriptorSets.size()), computeWriteDescriptorSets.data(), 0, NULL);
 
-			VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
-			pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-			VK_CHECK_RESULT(vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache));
+			VK_CHECK_RESULT(vks::pipelinecache::create(device, deviceProperties, getPipelineCacheFile(), &pipelineCache));
 
 			// Create pipeline
 			VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(pipelineLayout, 0);
@@ -471,8 +483,11 @@ public:
 			computeSubmitInfo.pWaitDstStageMask = &waitStageMask;
 			computeSubmitInfo.commandBufferCount = 1;
 			computeSubmitInfo.pCommandBuffers = &commandBuffer;
-			VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &computeSubmitInfo, fence));
-			VK_CHECK_RESULT(vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX));
+			{
+				VKS_TRACE_SCOPE_CATEGORY("Compute and read back", "queue");
+				VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &computeSubmitInfo, fence));
+				VK_CHECK_RESULT(vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX));
+			}
 
 			// Make device writes visible to the host
 			void *mapped;
@@ -488,7 +503,10 @@ public:
 			vkUnmapMemory(device, hostMemory);
 		}
 
-		vkQueueWaitIdle(queue);
+		{
+			VKS_TRACE_SCOPE_CATEGORY("vkQueueWaitIdle", "sync");
+			vkQueueWaitIdle(queue);
+		}
 
 		// Output buffer contents
 		LOG("Compute input:\n");
@@ -516,6 +534,7 @@ public:
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 		vkDestroyDescriptorPool(device, descriptorPool, nullptr);
 		vkDestroyPipeline(device, pipeline, nullptr);
+		vks::pipelinecache::save(device, deviceProperties, pipelineCache, getPipelineCacheFile());
 		vkDestroyPipelineCache(device, pipelineCache, nullptr);
 		vkDestroyFence(device, fence, nullptr);
 		vkDestroyCommandPool(device, commandPool, nullptr);
@@ -555,8 +574,16 @@ void android_main(android_app* state) {
 	}
 }
 #else
-int main() {
+int main(int argc, char* argv[]) {
+	// computeheadless --trace <file> records a Chrome trace of the run
+	for (int i = 1; i + 1 < argc; i++) {
+		if (std::string(argv[i]) == "--trace") {
+			vks::trace::setThreadName("Main thread");
+			vks::trace::start(argv[i + 1]);
+		}
+	}
 	VulkanExample *vulkanExample = new VulkanExample();
+	vks::trace::stop();
 	std::cout << "Finished. Press enter to terminate...";
 	getchar();
 	delete(vulkanExample);
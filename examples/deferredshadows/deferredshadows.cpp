@@ -344,10 +344,13 @@ public:
 			0.0f,
 			depthBiasSlope);
 
+		// Each pass is timed separately, the queries need to be written outside of the render passes
+		uint32_t gpuScope = gpuProfiler.begin(commandBuffers.deferred, "Shadow");
 		vkCmdBeginRenderPass(commandBuffers.deferred, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 		vkCmdBindPipeline(commandBuffers.deferred, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.shadowpass);
 		renderScene(commandBuffers.deferred, true);
 		vkCmdEndRenderPass(commandBuffers.deferred);
+		gpuProfiler.end(commandBuffers.deferred, gpuScope);
 
 		// Second pass: Deferred calculations
 		// -------------------------------------------------------------------------------------------------------
@@ -365,6 +368,7 @@ public:
 		renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
 		renderPassBeginInfo.pClearValues = clearValues.data();
 
+		gpuScope = gpuProfiler.begin(commandBuffers.deferred, "G-Buffer");
 		vkCmdBeginRenderPass(commandBuffers.deferred, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 		viewport = vks::initializers::viewport((float)frameBuffers.deferred->width, (float)frameBuffers.deferred->height, 0.0f, 1.0f);
@@ -376,6 +380,7 @@ public:
 		vkCmdBindPipeline(commandBuffers.deferred, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.offscreen);
 		renderScene(commandBuffers.deferred, false);
 		vkCmdEndRenderPass(commandBuffers.deferred);
+		gpuProfiler.end(commandBuffers.deferred, gpuScope);
 
 		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffers.deferred));
 	}
@@ -415,6 +420,7 @@ public:
 
 			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
 
+			const uint32_t gpuScope = gpuProfiler.begin(drawCmdBuffers[i], "Composition", i);
 			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
@@ -434,6 +440,7 @@ public:
 			drawUI(drawCmdBuffers[i]);
 
 			vkCmdEndRenderPass(drawCmdBuffers[i]);
+			gpuProfiler.end(drawCmdBuffers[i], gpuScope);
 
 			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
 		}
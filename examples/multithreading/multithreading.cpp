@@ -8,7 +8,7 @@
 
 #include "vulkanexamplebase.h"
 
-#include "threadpool.hpp"
+#include "jobsystem.h"
 #include "frustum.hpp"
 
 #include "VulkanglTFModel.h"
@@ -48,11 +48,9 @@ public:
 
 	// Number of animated objects to be renderer
 	// by using threads and secondary command buffers
-	uint32_t numObjectsPerThread;
-
-	// Multi threaded stuff
-	// Max. number of concurrent threads
-	uint32_t numThreads;
+	const uint32_t numObjects = 512;
+	// Number of objects recorded by a single job, recording one object is only a handful of commands
+	const uint32_t objectsPerJob = 8;
 
 	// Use push constants to update shader
 	// parameters on a per-thread base
@@ -71,20 +69,27 @@ public:
 		float deltaT;
 		float stateT = 0;
 		bool visible = true;
+		// Secondary command buffer the object was recorded to in the current frame
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
 	};
 
+	// Per object information (position, rotation, etc.)
+	std::vector<ObjectData> objectData;
+	// One push constant block per render object
+	std::vector<ThreadPushConstantBlock> pushConstBlock;
+
+	// Objects are picked up by whichever thread of the job system is idle, so command pools
+	// (which must not be used by two threads at once) belong to the threads and not to the objects
 	struct ThreadData {
 		VkCommandPool commandPool;
-		// One command buffer per render object
-		std::vector<VkCommandBuffer> commandBuffer;
-		// One push constant block per render object
-		std::vector<ThreadPushConstantBlock> pushConstBlock;
-		// Per object information (position, rotation, etc.)
-		std::vector<ObjectData> objectData;
+		// Secondary command buffers allocated from the thread's pool
+		std::vector<VkCommandBuffer> commandBuffers;
+		// Number of command buffers recorded in the current frame
+		uint32_t usedCommandBuffers = 0;
 	};
 	std::vector<ThreadData> threadData;
 
-	vks::ThreadPool threadPool;
+	vks::JobSystem jobSystem;
 
 	// Fence to wait for all command buffers to finish before
 	// presenting to the swap chain
@@ -103,16 +108,12 @@ public:
 		camera.setRotation(glm::vec3(0.0f));
 		camera.setRotationSpeed(0.5f);
 		camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 256.0f);
-		// Get number of max. concurrent threads
-		numThreads = std::thread::hardware_concurrency();
-		assert(numThreads > 0);
+		// The job system runs one thread per hardware thread
 #if defined(__ANDROID__)
-		LOGD("numThreads = %d", numThreads);
+		LOGD("numThreads = %d", jobSystem.getThreadCount());
 #else
-		std::cout << "numThreads = " << numThreads << std::endl;
+		std::cout << "numThreads = " << jobSystem.getThreadCount() << std::endl;
 #endif
-		threadPool.setThreadCount(numThreads);
-		numObjectsPerThread = 512 / numThreads;
 		rndEngine.seed(benchmark.active ? 0 : (unsigned)time(nullptr));
 	}
 
@@ -126,7 +127,7 @@ public:
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 
 		for (auto& thread : threadData) {
-			vkFreeCommandBuffers(device, thread.commandPool, thread.commandBuffer.size(), thread.commandBuffer.data());
+			vkFreeCommandBuffers(device, thread.commandPool, thread.commandBuffers.size(), thread.commandBuffers.data());
 			vkDestroyCommandPool(device, thread.commandPool, nullptr);
 		}
 
@@ -157,56 +158,49 @@ public:
 		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &secondaryCommandBuffers.background));
 		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &secondaryCommandBuffers.ui));
 
-		threadData.resize(numThreads);
-
-		float maxX = std::floor(std::sqrt(numThreads * numObjectsPerThread));
-		uint32_t posX = 0;
-		uint32_t posZ = 0;
+		threadData.resize(jobSystem.getThreadCount());
 
-		for (uint32_t i = 0; i < numThreads; i++) {
+		for (uint32_t i = 0; i < threadData.size(); i++) {
 			ThreadData *thread = &threadData[i];
 
 			// Create one command pool for each thread
+			// The pool is reset as a whole at the start of each frame, so single command buffers don't need to be resettable
 			VkCommandPoolCreateInfo cmdPoolInfo = vks::initializers::commandPoolCreateInfo();
 			cmdPoolInfo.queueFamilyIndex = swapChain.queueNodeIndex;
-			cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 			VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &thread->commandPool));
 
-			// One secondary command buffer per object that is updated by this thread
-			thread->commandBuffer.resize(numObjectsPerThread);
-			// Generate secondary command buffers for each thread
+			// Start with an even share of the objects, threads that end up recording more allocate additional command buffers on demand
+			thread->commandBuffers.resize((numObjects + threadData.size() - 1) / threadData.size());
 			VkCommandBufferAllocateInfo secondaryCmdBufAllocateInfo =
 				vks::initializers::commandBufferAllocateInfo(
 					thread->commandPool,
 					VK_COMMAND_BUFFER_LEVEL_SECONDARY,
-					thread->commandBuffer.size());
-			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &secondaryCmdBufAllocateInfo, thread->commandBuffer.data()));
+					thread->commandBuffers.size());
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &secondaryCmdBufAllocateInfo, thread->commandBuffers.data()));
+		}
 
-			thread->pushConstBlock.resize(numObjectsPerThread);
-			thread->objectData.resize(numObjectsPerThread);
+		pushConstBlock.resize(numObjects);
+		objectData.resize(numObjects);
 
-			for (uint32_t j = 0; j < numObjectsPerThread; j++) {
-				float theta = 2.0f * float(M_PI) * rnd(1.0f);
-				float phi = acos(1.0f - 2.0f * rnd(1.0f));
-				thread->objectData[j].pos = glm::vec3(sin(phi) * cos(theta), 0.0f, cos(phi)) * 35.0f;
+		for (uint32_t j = 0; j < numObjects; j++) {
+			float theta = 2.0f * float(M_PI) * rnd(1.0f);
+			float phi = acos(1.0f - 2.0f * rnd(1.0f));
+			objectData[j].pos = glm::vec3(sin(phi) * cos(theta), 0.0f, cos(phi)) * 35.0f;
 
-				thread->objectData[j].rotation = glm::vec3(0.0f, rnd(360.0f), 0.0f);
-				thread->objectData[j].deltaT = rnd(1.0f);
-				thread->objectData[j].rotationDir = (rnd(100.0f) < 50.0f) ? 1.0f : -1.0f;
-				thread->objectData[j].rotationSpeed = (2.0f + rnd(4.0f)) * thread->objectData[j].rotationDir;
-				thread->objectData[j].scale = 0.75f + rnd(0.5f);
+			objectData[j].rotation = glm::vec3(0.0f, rnd(360.0f), 0.0f);
+			objectData[j].deltaT = rnd(1.0f);
+			objectData[j].rotationDir = (rnd(100.0f) < 50.0f) ? 1.0f : -1.0f;
+			objectData[j].rotationSpeed = (2.0f + rnd(4.0f)) * objectData[j].rotationDir;
+			objectData[j].scale = 0.75f + rnd(0.5f);
 
-				thread->pushConstBlock[j].color = glm::vec3(rnd(1.0f), rnd(1.0f), rnd(1.0f));
-			}
+			pushConstBlock[j].color = glm::vec3(rnd(1.0f), rnd(1.0f), rnd(1.0f));
 		}
-
 	}
 
-	// Builds the secondary command buffer for each thread
-	void threadRenderCode(uint32_t threadIndex, uint32_t cmdBufferIndex, VkCommandBufferInheritanceInfo inheritanceInfo)
+	// Builds the secondary command buffer for an object, called from the threads of the job system
+	void threadRenderCode(uint32_t objectIndex, const VkCommandBufferInheritanceInfo& inheritanceInfo)
 	{
-		ThreadData *thread = &threadData[threadIndex];
-		ObjectData *objectData = &thread->objectData[cmdBufferIndex];
+		ObjectData *objectData = &this->objectData[objectIndex];
 
 		// Check visibility against view frustum using a simple sphere check based on the radius of the mesh
 		objectData->visible = frustum.checkSphere(objectData->pos, models.ufo.dimensions.radius * 0.5f);
@@ -216,11 +210,21 @@ public:
 			return;
 		}
 
+		// Take the next command buffer from the pool of the thread that runs this job
+		ThreadData *thread = &threadData[jobSystem.getThreadIndex()];
+		if (thread->usedCommandBuffers == thread->commandBuffers.size()) {
+			VkCommandBufferAllocateInfo secondaryCmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(thread->commandPool, VK_COMMAND_BUFFER_LEVEL_SECONDARY, 1);
+			VkCommandBuffer commandBuffer;
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &secondaryCmdBufAllocateInfo, &commandBuffer));
+			thread->commandBuffers.push_back(commandBuffer);
+		}
+		objectData->commandBuffer = thread->commandBuffers[thread->usedCommandBuffers++];
+
 		VkCommandBufferBeginInfo commandBufferBeginInfo = vks::initializers::commandBufferBeginInfo();
 		commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
 		commandBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
 
-		VkCommandBuffer cmdBuffer = thread->commandBuffer[cmdBufferIndex];
+		VkCommandBuffer cmdBuffer = objectData->commandBuffer;
 
 		VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuffer, &commandBufferBeginInfo));
 
@@ -250,7 +254,7 @@ public:
 		objectData->model = glm::rotate(objectData->model, glm::radians(objectData->deltaT * 360.0f), glm::vec3(0.0f, objectData->rotationDir, 0.0f));
 		objectData->model = glm::scale(objectData->model, glm::vec3(objectData->scale));
 
-		thread->pushConstBlock[cmdBufferIndex].mvp = matrices.projection * matrices.view * objectData->model;
+		pushConstBlock[objectIndex].mvp = matrices.projection * matrices.view * objectData->model;
 
 		// Update shader push constant block
 		// Contains model view matrix
@@ -260,7 +264,7 @@ public:
 			VK_SHADER_STAGE_VERTEX_BIT,
 			0,
 			sizeof(ThreadPushConstantBlock),
-			&thread->pushConstBlock[cmdBufferIndex]);
+			&pushConstBlock[objectIndex]);
 
 		VkDeviceSize offsets[1] = { 0 };
 		vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &models.ufo.vertices.buffer, offsets);
@@ -328,7 +332,7 @@ public:
 		VK_CHECK_RESULT(vkEndCommandBuffer(secondaryCommandBuffers.ui));
 	}
 
-	// Updates the secondary command buffers using a thread pool
+	// Updates the secondary command buffers using the job system
 	// and puts them into the primary command buffer that's
 	// lat submitted to the queue for rendering
 	void updateCommandBuffers(VkFramebuffer frameBuffer)
@@ -373,26 +377,26 @@ public:
 			commandBuffers.push_back(secondaryCommandBuffers.background);
 		}
 
-		// Add a job to the thread's queue for each object to be rendered
-		for (uint32_t t = 0; t < numThreads; t++)
-		{
-			for (uint32_t i = 0; i < numObjectsPerThread; i++)
-			{
-				threadPool.threads[t]->addJob([=] { threadRenderCode(t, i, inheritanceInfo); });
-			}
+		// The render fence has been waited for, so none of the last frame's secondary command buffers are in use anymore
+		for (auto& thread : threadData) {
+			VK_CHECK_RESULT(vkResetCommandPool(device, thread.commandPool, 0));
+			thread.usedCommandBuffers = 0;
 		}
 
-		threadPool.wait();
+		// Record all objects in parallel, idle threads steal ranges of objects from busy ones
+		// The calling thread takes part in recording and the call returns once all objects are done
+		jobSystem.parallelFor(numObjects, objectsPerJob, [this, &inheritanceInfo](uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; i++) {
+				threadRenderCode(i, inheritanceInfo);
+			}
+		});
 
 		// Only submit if object is within the current view frustum
-		for (uint32_t t = 0; t < numThreads; t++)
+		for (auto& object : objectData)
 		{
-			for (uint32_t i = 0; i < numObjectsPerThread; i++)
+			if (object.visible)
 			{
-				if (threadData[t].objectData[i].visible)
-				{
-					commandBuffers.push_back(threadData[t].commandBuffer[i]);
-				}
+				commandBuffers.push_back(object.commandBuffer);
 			}
 		}
 
@@ -530,7 +534,7 @@ public:
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
 	{
 		if (overlay->header("Statistics")) {
-			overlay->text("Active threads: %d", numThreads);
+			overlay->text("Active threads: %d", jobSystem.getThreadCount());
 		}
 		if (overlay->header("Settings")) {
 			overlay->checkBox("Stars", &displayStarSphere);
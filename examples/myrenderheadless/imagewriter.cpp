@@ -0,0 +1,352 @@
+#include "imagewriter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include <trace.h>
+
+namespace {
+
+void append(std::vector<uint8_t> *file, const void *data, size_t size) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  file->insert(file->end(), bytes, bytes + size);
+}
+
+void appendString(std::vector<uint8_t> *file, const std::string &s) {
+  append(file, s.data(), s.size());
+}
+
+// the formats below are written in little endian, PNG in big endian
+template<typename T>
+void appendLE(std::vector<uint8_t> *file, T value) {
+  append(file, &value, sizeof(value));
+}
+
+void appendBE32(std::vector<uint8_t> *file, uint32_t value) {
+  const uint8_t bytes[4] = {(uint8_t)(value >> 24), (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value};
+  append(file, bytes, 4);
+}
+
+uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0) {
+  static uint32_t table[256];
+  static bool initialized = [] {
+    for (uint32_t n = 0; n < 256; ++n) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; ++k) {
+        c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      }
+      table[n] = c;
+    }
+    return true;
+  }();
+  (void)initialized;
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i) {
+    crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+uint32_t adler32(const uint8_t *data, size_t size) {
+  uint32_t a = 1;
+  uint32_t b = 0;
+  while (size > 0) {
+    // largest block before b can overflow
+    const size_t block = std::min<size_t>(size, 5552);
+    for (size_t i = 0; i < block; ++i) {
+      a += data[i];
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+    data += block;
+    size -= block;
+  }
+  return (b << 16) | a;
+}
+
+void appendPngChunk(std::vector<uint8_t> *file, const char type[4], const std::vector<uint8_t> &data) {
+  appendBE32(file, data.size());
+  const size_t start = file->size();
+  append(file, type, 4);
+  append(file, data.data(), data.size());
+  appendBE32(file, crc32(file->data() + start, file->size() - start));
+}
+
+// 16 bit grayscale PNG, the zlib stream uses stored deflate blocks: depth maps barely compress with a fast deflate
+// and skipping compression keeps the encoder a memcpy
+void encodePng16(const float *depth, uint32_t width, uint32_t height, float scale, std::vector<uint8_t> *file) {
+  std::vector<uint8_t> raw;
+  raw.reserve((size_t)height * (1 + width * 2));
+  for (uint32_t y = 0; y < height; ++y) {
+    // filter type none
+    raw.push_back(0);
+    const float *row = depth + (size_t)y * width;
+    for (uint32_t x = 0; x < width; ++x) {
+      const float value = std::min(std::max(std::round(row[x] * scale), 0.0f), 65535.0f);
+      const uint16_t sample = (uint16_t)value;
+      raw.push_back(sample >> 8);
+      raw.push_back(sample & 0xff);
+    }
+  }
+
+  std::vector<uint8_t> idat;
+  idat.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+  // zlib header: deflate, 32K window, no preset dictionary
+  idat.push_back(0x78);
+  idat.push_back(0x01);
+  size_t offset = 0;
+  do {
+    const size_t block = std::min<size_t>(raw.size() - offset, 65535);
+    const bool last = offset + block == raw.size();
+    idat.push_back(last ? 1 : 0);
+    idat.push_back(block & 0xff);
+    idat.push_back(block >> 8);
+    idat.push_back(~block & 0xff);
+    idat.push_back((~block >> 8) & 0xff);
+    idat.insert(idat.end(), raw.begin() + offset, raw.begin() + offset + block);
+    offset += block;
+  } while (offset < raw.size());
+  appendBE32(&idat, adler32(raw.data(), raw.size()));
+
+  const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  append(file, signature, sizeof(signature));
+  std::vector<uint8_t> ihdr;
+  appendBE32(&ihdr, width);
+  appendBE32(&ihdr, height);
+  // bit depth 16, grayscale, deflate, adaptive filtering, no interlace
+  const uint8_t ihdrTail[5] = {16, 0, 0, 0, 0};
+  append(&ihdr, ihdrTail, sizeof(ihdrTail));
+  appendPngChunk(file, "IHDR", ihdr);
+  appendPngChunk(file, "IDAT", idat);
+  appendPngChunk(file, "IEND", std::vector<uint8_t>());
+}
+
+void appendExrAttribute(std::vector<uint8_t> *file, const char *name, const char *type, const std::vector<uint8_t> &value) {
+  append(file, name, strlen(name) + 1);
+  append(file, type, strlen(type) + 1);
+  appendLE<int32_t>(file, value.size());
+  append(file, value.data(), value.size());
+}
+
+// single part scanline OpenEXR without compression, one FLOAT channel "Z"
+void encodeExr(const float *depth, uint32_t width, uint32_t height, std::vector<uint8_t> *file) {
+  appendLE<uint32_t>(file, 20000630);
+  appendLE<uint32_t>(file, 2);
+
+  std::vector<uint8_t> value;
+  append(&value, "Z", 2);
+  // pixel type FLOAT, pLinear and reserved, x and y sampling
+  appendLE<int32_t>(&value, 2);
+  appendLE<uint32_t>(&value, 0);
+  appendLE<int32_t>(&value, 1);
+  appendLE<int32_t>(&value, 1);
+  value.push_back(0);
+  appendExrAttribute(file, "channels", "chlist", value);
+
+  appendExrAttribute(file, "compression", "compression", std::vector<uint8_t>(1, 0));
+
+  value.clear();
+  appendLE<int32_t>(&value, 0);
+  appendLE<int32_t>(&value, 0);
+  appendLE<int32_t>(&value, width - 1);
+  appendLE<int32_t>(&value, height - 1);
+  appendExrAttribute(file, "dataWindow", "box2i", value);
+  appendExrAttribute(file, "displayWindow", "box2i", value);
+
+  // increasing y
+  appendExrAttribute(file, "lineOrder", "lineOrder", std::vector<uint8_t>(1, 0));
+  value.clear();
+  appendLE<float>(&value, 1.0f);
+  appendExrAttribute(file, "pixelAspectRatio", "float", value);
+  appendExrAttribute(file, "screenWindowWidth", "float", value);
+  value.clear();
+  appendLE<float>(&value, 0.0f);
+  appendLE<float>(&value, 0.0f);
+  appendExrAttribute(file, "screenWindowCenter", "v2f", value);
+  file->push_back(0);
+
+  // offset table, then one chunk per scanline: y, byte count, pixels
+  const uint32_t lineSize = width * sizeof(float);
+  const uint64_t firstLine = file->size() + (uint64_t)height * sizeof(uint64_t);
+  for (uint32_t y = 0; y < height; ++y) {
+    appendLE<uint64_t>(file, firstLine + (uint64_t)y * (8 + lineSize));
+  }
+  for (uint32_t y = 0; y < height; ++y) {
+    appendLE<int32_t>(file, y);
+    appendLE<uint32_t>(file, lineSize);
+    append(file, depth + (size_t)y * width, lineSize);
+  }
+}
+
+// numpy .npy version 1.0 of a float32 array with shape (height, width)
+void encodeNpy(const float *depth, uint32_t width, uint32_t height, std::vector<uint8_t> *file) {
+  std::string header = "{'descr': '<f4', 'fortran_order': False, 'shape': (" + std::to_string(height) + ", " + std::to_string(width) + "), }";
+  // magic, version and length take 10 bytes, the header is padded so the data starts 64 byte aligned
+  const size_t total = (10 + header.size() + 1 + 63) & ~(size_t)63;
+  header.append(total - 10 - header.size() - 1, ' ');
+  header.push_back('\n');
+  append(file, "\x93NUMPY", 6);
+  file->push_back(1);
+  file->push_back(0);
+  appendLE<uint16_t>(file, header.size());
+  appendString(file, header);
+  append(file, depth, (size_t)width * height * sizeof(float));
+}
+
+}  // namespace
+
+void encodeImage(ImageFileFormat format, const uint8_t *pixels, uint32_t width, uint32_t height, float png16Scale,
+                 std::vector<uint8_t> *file) {
+  file->clear();
+  const size_t texelCount = (size_t)width * height;
+  switch (format) {
+    case IMAGE_FILE_PPM:
+    case IMAGE_FILE_RAW_RGB: {
+      if (format == IMAGE_FILE_PPM) {
+        appendString(file, "P6\n" + std::to_string(width) + "\n" + std::to_string(height) + "\n255\n");
+      }
+      const size_t headerSize = file->size();
+      file->resize(headerSize + texelCount * 3);
+      uint8_t *dst = file->data() + headerSize;
+      for (size_t i = 0; i < texelCount; ++i) {
+        dst[i * 3] = pixels[i * 4];
+        dst[i * 3 + 1] = pixels[i * 4 + 1];
+        dst[i * 3 + 2] = pixels[i * 4 + 2];
+      }
+      break;
+    }
+    case IMAGE_FILE_PFM: {
+      // rows are stored bottom to top
+      appendString(file, "Pf\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1\n");
+      const float *depth = (const float *)pixels;
+      for (int32_t y = height - 1; y >= 0; y--) {
+        append(file, depth + (size_t)y * width, sizeof(float) * width);
+      }
+      break;
+    }
+    case IMAGE_FILE_EXR:
+      encodeExr((const float *)pixels, width, height, file);
+      break;
+    case IMAGE_FILE_NPY:
+      encodeNpy((const float *)pixels, width, height, file);
+      break;
+    case IMAGE_FILE_PNG16:
+      encodePng16((const float *)pixels, width, height, png16Scale, file);
+      break;
+  }
+}
+
+ImageWriter::ImageWriter(uint32_t workerCount, uint32_t maxQueued) : maxQueued_(std::max(maxQueued, 1u)) {
+  for (uint32_t i = 0; i < std::max(workerCount, 1u); ++i) {
+    workers_.emplace_back(&ImageWriter::workerLoop, this);
+  }
+}
+
+ImageWriter::~ImageWriter() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    jobDone_.wait(lock, [this] { return queue_.empty() && busy_ == 0; });
+    stop_ = true;
+  }
+  jobAvailable_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+void ImageWriter::writeColor(const std::string &path, ImageFileFormat format, const uint8_t *rgba, uint32_t width, uint32_t height) {
+  enqueue(path, format, rgba, (size_t)width * height * 4, width, height, 0.0f);
+}
+
+void ImageWriter::writeDepth(const std::string &path, ImageFileFormat format, const float *depth, uint32_t width, uint32_t height,
+                             float png16Scale) {
+  enqueue(path, format, depth, (size_t)width * height * sizeof(float), width, height, png16Scale);
+}
+
+void ImageWriter::enqueue(const std::string &path, ImageFileFormat format, const void *pixels, size_t size, uint32_t width,
+                          uint32_t height, float png16Scale) {
+  Job job;
+  job.path = path;
+  job.format = format;
+  job.width = width;
+  job.height = height;
+  job.png16Scale = png16Scale;
+  {
+    // backpressure: the render thread waits here instead of queueing unbounded copies of its images
+    VKS_TRACE_SCOPE_CATEGORY("Wait for image writer", "sync");
+    std::unique_lock<std::mutex> lock(mutex_);
+    jobDone_.wait(lock, [this] { return queue_.size() < maxQueued_ || error_; });
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    if (!freeBuffers_.empty()) {
+      job.pixels.swap(freeBuffers_.back());
+      freeBuffers_.pop_back();
+    }
+  }
+  job.pixels.resize(size);
+  memcpy(job.pixels.data(), pixels, size);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(std::move(job));
+  }
+  jobAvailable_.notify_one();
+}
+
+void ImageWriter::wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  jobDone_.wait(lock, [this] { return queue_.empty() && busy_ == 0; });
+  if (error_) {
+    std::exception_ptr error = error_;
+    error_ = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+void ImageWriter::workerLoop() {
+  vks::trace::setThreadName("Image writer");
+  // per worker, so the encoded file's allocation is reused as well
+  std::vector<uint8_t> file;
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      jobAvailable_.wait(lock, [this] { return !queue_.empty() || stop_; });
+      if (queue_.empty()) {
+        break;
+      }
+      job = std::move(queue_.front());
+      queue_.pop_front();
+      busy_++;
+    }
+    // a queue slot is free for the render thread
+    jobDone_.notify_all();
+
+    try {
+      vks::trace::Scope traceScope("Encode and write image", "io", job.path);
+      encodeImage(job.format, job.pixels.data(), job.width, job.height, job.png16Scale, &file);
+      std::ofstream out(job.path, std::ios::out | std::ios::binary | std::ios::trunc);
+      out.write((const char *)file.data(), file.size());
+      if (!out.good()) {
+        throw std::runtime_error("can not write image " + job.path);
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_) {
+        error_ = std::current_exception();
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      freeBuffers_.push_back(std::move(job.pixels));
+      busy_--;
+    }
+    jobDone_.notify_all();
+  }
+}
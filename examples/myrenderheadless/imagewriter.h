@@ -0,0 +1,72 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum ImageFileFormat {
+  // color, 8 bit RGB
+  IMAGE_FILE_PPM,
+  IMAGE_FILE_RAW_RGB,
+  // depth, 32 bit float
+  IMAGE_FILE_PFM,
+  IMAGE_FILE_EXR,
+  IMAGE_FILE_NPY,
+  // depth, 16 bit unsigned integer of depth * png16Scale (millimeters by default)
+  IMAGE_FILE_PNG16,
+};
+
+// encodes images on a pool of worker threads, every file is assembled in memory and written with a single write
+// the caller's pixels are copied into a recycled buffer, so they only need to stay valid during the call
+// write*() blocks while maxQueued images are waiting, which keeps memory bounded when encoding falls behind rendering
+class ImageWriter {
+ public:
+  ImageWriter(uint32_t workerCount, uint32_t maxQueued);
+  // finishes all queued images
+  ~ImageWriter();
+  ImageWriter(const ImageWriter &) = delete;
+  ImageWriter &operator=(const ImageWriter &) = delete;
+
+  // rgba is tightly packed RGBA8, alpha is dropped
+  void writeColor(const std::string &path, ImageFileFormat format, const uint8_t *rgba, uint32_t width, uint32_t height);
+  void writeDepth(const std::string &path, ImageFileFormat format, const float *depth, uint32_t width, uint32_t height,
+                  float png16Scale = 1000.0f);
+
+  // blocks until every queued image is written, rethrows the first error of a worker
+  void wait();
+
+ private:
+  struct Job {
+    std::string path;
+    ImageFileFormat format;
+    uint32_t width;
+    uint32_t height;
+    float png16Scale;
+    std::vector<uint8_t> pixels;
+  };
+
+  void enqueue(const std::string &path, ImageFileFormat format, const void *pixels, size_t size, uint32_t width, uint32_t height,
+               float png16Scale);
+  void workerLoop();
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable jobAvailable_;
+  std::condition_variable jobDone_;
+  std::deque<Job> queue_;
+  // pixel buffers of finished jobs, reused to avoid reallocating an image per frame
+  std::vector<std::vector<uint8_t>> freeBuffers_;
+  uint32_t maxQueued_;
+  uint32_t busy_ = 0;
+  bool stop_ = false;
+  std::exception_ptr error_;
+};
+
+// encode a whole file into memory, exposed for the writer's workers and offline tools
+void encodeImage(ImageFileFormat format, const uint8_t *pixels, uint32_t width, uint32_t height, float png16Scale,
+                 std::vector<uint8_t> *file);
@@ -0,0 +1,178 @@
+#include "meshblob.h"
+#include "meshlibrary.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static uint64_t alignTo4(uint64_t offset) {
+  return (offset + 3) & ~(uint64_t)3;
+}
+
+template <typename T>
+static uint32_t maxIndex(const T *indices, uint32_t count) {
+  uint32_t result = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    result = std::max(result, (uint32_t)indices[i]);
+  }
+  return result;
+}
+
+MeshBlob::MeshBlob(const std::string &path) {
+#if defined(_WIN32)
+  std::ifstream file(path, std::ios::binary | std::ios::in | std::ios::ate);
+  if (!file.is_open()) {
+    throw std::runtime_error("can not open mesh blob " + path);
+  }
+  fallback_.resize((size_t)file.tellg());
+  file.seekg(0, std::ios::beg);
+  file.read((char *)fallback_.data(), fallback_.size());
+  data_ = fallback_.data();
+  size_ = fallback_.size();
+#else
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("can not open mesh blob " + path);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(MeshBlobHeader)) {
+    close(fd);
+    throw std::runtime_error("invalid mesh blob " + path);
+  }
+  void *mapping = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    throw std::runtime_error("can not map mesh blob " + path);
+  }
+  data_ = (const uint8_t *)mapping;
+  size_ = (size_t)st.st_size;
+#endif
+
+  // everything the renderer reads later has to be inside the file
+  const MeshBlobHeader &h = header();
+  const uint64_t indexSize = h.flags & MESH_BLOB_INDEX32_BIT ? sizeof(uint32_t) : sizeof(uint16_t);
+  bool valid = size_ >= sizeof(MeshBlobHeader) &&
+               memcmp(h.magic, MESH_BLOB_MAGIC, sizeof(h.magic)) == 0 &&
+               h.version == MESH_BLOB_VERSION &&
+               h.fileSize == size_ &&
+               h.positionsOffset + (uint64_t)h.vertexCount * 3 * sizeof(float) <= size_ &&
+               h.indicesOffset + (uint64_t)h.indexCount * indexSize <= size_ &&
+               h.indexCount % 3 == 0;
+  if (valid && (h.flags & MESH_BLOB_NORMALS_BIT)) {
+    valid = h.normalsOffset + (uint64_t)h.vertexCount * 3 * sizeof(float) <= size_;
+  }
+  // an index past the vertices would make the gpu fetch outside of the vertex buffer
+  if (valid) {
+    valid = index32() ? maxIndex((const uint32_t *)indices(), h.indexCount) < h.vertexCount
+                      : maxIndex((const uint16_t *)indices(), h.indexCount) < h.vertexCount;
+  }
+  if (!valid) {
+    unmap();
+    throw std::runtime_error("invalid mesh blob " + path);
+  }
+}
+
+MeshBlob::~MeshBlob() {
+  unmap();
+}
+
+void MeshBlob::unmap() {
+#if !defined(_WIN32)
+  if (data_) {
+    munmap(const_cast<uint8_t *>(data_), size_);
+    data_ = nullptr;
+  }
+#endif
+}
+
+void writeMeshBlob(const std::string &path, uint64_t sourceHash, const std::vector<float> &positions, const std::vector<float> &normals,
+                   const std::vector<uint32_t> &indices) {
+  const uint32_t vertexCount = positions.size() / 3;
+  const bool withNormals = !normals.empty();
+  const bool index32 = vertexCount > 65536;
+
+  MeshBlobHeader header{};
+  memcpy(header.magic, MESH_BLOB_MAGIC, sizeof(header.magic));
+  header.version = MESH_BLOB_VERSION;
+  header.flags = (withNormals ? MESH_BLOB_NORMALS_BIT : 0) | (index32 ? MESH_BLOB_INDEX32_BIT : 0);
+  header.vertexCount = vertexCount;
+  header.indexCount = indices.size();
+  header.sourceHash = sourceHash;
+  for (uint32_t i = 0; i < vertexCount; ++i) {
+    for (int c = 0; c < 3; ++c) {
+      const float v = positions[i * 3 + c];
+      header.boundsMin[c] = i == 0 ? v : std::min(header.boundsMin[c], v);
+      header.boundsMax[c] = i == 0 ? v : std::max(header.boundsMax[c], v);
+    }
+  }
+  header.positionsOffset = alignTo4(sizeof(MeshBlobHeader));
+  header.normalsOffset = header.positionsOffset + positions.size() * sizeof(float);
+  header.indicesOffset = header.normalsOffset + (withNormals ? normals.size() * sizeof(float) : 0);
+  header.fileSize = alignTo4(header.indicesOffset + indices.size() * (index32 ? sizeof(uint32_t) : sizeof(uint16_t)));
+
+  // assemble the whole file in memory and write it at once
+  std::vector<uint8_t> content(header.fileSize, 0);
+  memcpy(content.data(), &header, sizeof(header));
+  memcpy(content.data() + header.positionsOffset, positions.data(), positions.size() * sizeof(float));
+  if (withNormals) {
+    memcpy(content.data() + header.normalsOffset, normals.data(), normals.size() * sizeof(float));
+  }
+  if (index32) {
+    memcpy(content.data() + header.indicesOffset, indices.data(), indices.size() * sizeof(uint32_t));
+  } else {
+    uint16_t *dst = (uint16_t *)(content.data() + header.indicesOffset);
+    for (size_t i = 0; i < indices.size(); ++i) {
+      dst[i] = (uint16_t)indices[i];
+    }
+  }
+
+  // write next to the destination and rename, so a worker never maps a half written file
+  const std::string tmpPath = path + ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      throw std::runtime_error("can not write mesh blob " + path);
+    }
+    file.write((const char *)content.data(), content.size());
+    if (!file.good()) {
+      throw std::runtime_error("can not write mesh blob " + path);
+    }
+  }
+#if defined(_WIN32)
+  // rename does not replace existing files on windows
+  const bool renamed = MoveFileExA(tmpPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+  const bool renamed = std::rename(tmpPath.c_str(), path.c_str()) == 0;
+#endif
+  if (!renamed) {
+    throw std::runtime_error("can not write mesh blob " + path);
+  }
+}
+
+void convertToMeshBlob(const std::string &srcPath, const std::string &dstPath, bool withNormals, MeshOptimizeStats *stats) {
+  std::ifstream file(srcPath, std::ios::binary | std::ios::in | std::ios::ate);
+  if (!file.is_open()) {
+    throw std::runtime_error("can not open mesh " + srcPath);
+  }
+  std::vector<char> content((size_t)file.tellg());
+  file.seekg(0, std::ios::beg);
+  file.read(content.data(), content.size());
+  file.close();
+
+  std::vector<float> positions;
+  std::vector<float> normals;
+  std::vector<uint32_t> indices;
+  MeshLibrary::importMesh(srcPath, content.data(), content.size(), &positions, withNormals ? &normals : nullptr, &indices, stats);
+  writeMeshBlob(dstPath, MeshLibrary::hashBytes(content.data(), content.size()), positions, normals, indices);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// preprocessed mesh file (.bmesh) that can be mapped and uploaded without parsing
+// layout: MeshBlobHeader, float positions[3 * vertexCount], float normals[3 * vertexCount] (optional),
+// uint16_t or uint32_t indices[indexCount], every section starts on a 4 byte boundary
+const char MESH_BLOB_MAGIC[4] = {'B', 'M', 'S', 'H'};
+const uint32_t MESH_BLOB_VERSION = 1;
+
+enum MeshBlobFlagBits {
+  MESH_BLOB_NORMALS_BIT = 0x1,
+  MESH_BLOB_INDEX32_BIT = 0x2,
+};
+
+struct MeshBlobHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t flags;
+  uint32_t vertexCount;
+  uint32_t indexCount;
+  uint32_t reserved;
+  // content hash of the source file, lets the mesh library deduplicate blobs without hashing them
+  uint64_t sourceHash;
+  float boundsMin[3];
+  float boundsMax[3];
+  uint64_t positionsOffset;
+  uint64_t normalsOffset;
+  uint64_t indicesOffset;
+  uint64_t fileSize;
+};
+
+// read only view of a .bmesh file, memory mapped where the platform supports it
+class MeshBlob {
+ public:
+  // throws if the file can not be opened or fails validation
+  explicit MeshBlob(const std::string &path);
+  ~MeshBlob();
+  MeshBlob(const MeshBlob &) = delete;
+  MeshBlob &operator=(const MeshBlob &) = delete;
+
+  const MeshBlobHeader &header() const { return *(const MeshBlobHeader *)data_; }
+  const float *positions() const { return (const float *)(data_ + header().positionsOffset); }
+  const float *normals() const { return header().flags & MESH_BLOB_NORMALS_BIT ? (const float *)(data_ + header().normalsOffset) : nullptr; }
+  const void *indices() const { return data_ + header().indicesOffset; }
+  bool index32() const { return (header().flags & MESH_BLOB_INDEX32_BIT) != 0; }
+
+ private:
+  void unmap();
+
+  const uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+  // used instead of a mapping on platforms without mmap
+  std::vector<uint8_t> fallback_;
+};
+
+struct MeshOptimizeStats;
+
+// import a mesh with assimp and write it as .bmesh, indices are uint16_t when all vertices can be addressed with them
+// stats receives the vertex counts and cache miss ratios of the optimization if not null
+void convertToMeshBlob(const std::string &srcPath, const std::string &dstPath, bool withNormals, MeshOptimizeStats *stats = nullptr);
+
+// write already imported data as .bmesh
+void writeMeshBlob(const std::string &path, uint64_t sourceHash, const std::vector<float> &positions, const std::vector<float> &normals,
+                   const std::vector<uint32_t> &indices);
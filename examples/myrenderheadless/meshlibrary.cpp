@@ -0,0 +1,180 @@
+#include "meshlibrary.h"
+#include "meshoptimize.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include <trace.h>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+// 64 bit FNV-1a
+uint64_t MeshLibrary::hashBytes(const void *data, size_t size) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+void MeshLibrary::importMesh(const std::string &path, const void *content, size_t size, std::vector<float> *positions,
+                             std::vector<float> *normals, std::vector<uint32_t> *indices, MeshOptimizeStats *stats) {
+  // assimp picks the importer from the extension hint, so STL, OBJ and PLY all go through here
+  std::string extension;
+  size_t dot = path.find_last_of('.');
+  if (dot != std::string::npos) {
+    extension = path.substr(dot + 1);
+  }
+  Assimp::Importer importer;
+  const aiScene *scene = importer.ReadFileFromMemory(content, size, aiProcess_Triangulate, extension.c_str());
+  if (!scene || scene->mNumMeshes == 0) {
+    throw std::runtime_error("can not import mesh " + path);
+  }
+
+  std::vector<float> ignoredNormals;
+  if (!normals) {
+    normals = &ignoredNormals;
+  }
+  positions->clear();
+  normals->clear();
+  indices->clear();
+  bool hasNormals = normals != &ignoredNormals;
+  for (uint32_t m = 0; m < scene->mNumMeshes; ++m) {
+    hasNormals = hasNormals && scene->mMeshes[m]->HasNormals();
+  }
+  // multi mesh files are merged into one mesh
+  uint32_t baseVertex = 0;
+  for (uint32_t m = 0; m < scene->mNumMeshes; ++m) {
+    const aiMesh *sceneMesh = scene->mMeshes[m];
+    for (uint32_t i = 0; i < sceneMesh->mNumVertices; ++i) {
+      positions->push_back(sceneMesh->mVertices[i].x);
+      positions->push_back(sceneMesh->mVertices[i].y);
+      positions->push_back(sceneMesh->mVertices[i].z);
+      if (hasNormals) {
+        normals->push_back(sceneMesh->mNormals[i].x);
+        normals->push_back(sceneMesh->mNormals[i].y);
+        normals->push_back(sceneMesh->mNormals[i].z);
+      }
+    }
+    for (uint32_t i = 0; i < sceneMesh->mNumFaces; ++i) {
+      // points and lines survive aiProcess_Triangulate, they are not rendered
+      if (sceneMesh->mFaces[i].mNumIndices != 3) {
+        continue;
+      }
+      indices->push_back(baseVertex + sceneMesh->mFaces[i].mIndices[0]);
+      indices->push_back(baseVertex + sceneMesh->mFaces[i].mIndices[1]);
+      indices->push_back(baseVertex + sceneMesh->mFaces[i].mIndices[2]);
+    }
+    baseVertex += sceneMesh->mNumVertices;
+  }
+  // STL has no shared vertices, weld them and reorder for the vertex cache, overdraw and vertex fetch
+  optimizeMesh(positions, normals, indices, stats);
+  if (indices->empty()) {
+    throw std::runtime_error("mesh " + path + " contains no triangles");
+  }
+}
+
+uint32_t MeshLibrary::addMesh(const std::string &path, uint64_t hash, uint32_t vertexCount, uint32_t indexCount, bool index32,
+                              const float *positions, const void *indices, const float *boundsMin, const float *boundsMax) {
+  Mesh mesh;
+  mesh.path = path;
+  mesh.hash = hash;
+  mesh.vertexOffset = vertexCount_;
+  mesh.vertexCount = vertexCount;
+  mesh.firstIndex = index32 ? index32Count_ : index16Count_;
+  mesh.indexCount = indexCount;
+  mesh.index32 = index32;
+  std::copy(boundsMin, boundsMin + 3, mesh.boundsMin);
+  std::copy(boundsMax, boundsMax + 3, mesh.boundsMax);
+  mesh.positions = positions;
+  mesh.indices = indices;
+
+  vertexCount_ += vertexCount;
+  if (index32) {
+    index32Count_ += indexCount;
+  } else {
+    index16Count_ += indexCount;
+  }
+
+  const uint32_t id = meshes_.size();
+  meshes_.push_back(mesh);
+  meshByHash_[hash] = id;
+  meshByPath_[path] = id;
+  return id;
+}
+
+uint32_t MeshLibrary::load(const std::string &path) {
+  auto byPath = meshByPath_.find(path);
+  if (byPath != meshByPath_.end()) {
+    return byPath->second;
+  }
+  vks::trace::Scope traceScope("Load mesh", "assets", path);
+
+  // preprocessed meshes are mapped and referenced in place, their header carries the hash of the source file
+  if (path.size() > 6 && path.compare(path.size() - 6, 6, ".bmesh") == 0) {
+    std::unique_ptr<MeshBlob> blob(new MeshBlob(path));
+    const MeshBlobHeader &header = blob->header();
+    auto byHash = meshByHash_.find(header.sourceHash);
+    if (byHash != meshByHash_.end()) {
+      meshByPath_[path] = byHash->second;
+      return byHash->second;
+    }
+    const uint32_t id = addMesh(path, header.sourceHash, header.vertexCount, header.indexCount, blob->index32(),
+                                blob->positions(), blob->indices(), header.boundsMin, header.boundsMax);
+    blobs_.push_back(std::move(blob));
+    return id;
+  }
+
+  std::ifstream file(path, std::ios::binary | std::ios::in | std::ios::ate);
+  if (!file.is_open()) {
+    throw std::runtime_error("can not open mesh " + path);
+  }
+  std::vector<char> content((size_t)file.tellg());
+  file.seekg(0, std::ios::beg);
+  file.read(content.data(), content.size());
+  file.close();
+
+  // the same SKU is often exported under several names, identical files share one mesh
+  const uint64_t hash = hashBytes(content.data(), content.size());
+  auto byHash = meshByHash_.find(hash);
+  if (byHash != meshByHash_.end()) {
+    meshByPath_[path] = byHash->second;
+    return byHash->second;
+  }
+
+  std::unique_ptr<OwnedMesh> owned(new OwnedMesh());
+  std::vector<uint32_t> indices;
+  importMesh(path, content.data(), content.size(), &owned->positions, nullptr, &indices);
+
+  const uint32_t vertexCount = owned->positions.size() / 3;
+  float boundsMin[3] = {0.0f, 0.0f, 0.0f};
+  float boundsMax[3] = {0.0f, 0.0f, 0.0f};
+  for (uint32_t i = 0; i < vertexCount; ++i) {
+    for (int c = 0; c < 3; ++c) {
+      const float v = owned->positions[i * 3 + c];
+      boundsMin[c] = i == 0 ? v : std::min(boundsMin[c], v);
+      boundsMax[c] = i == 0 ? v : std::max(boundsMax[c], v);
+    }
+  }
+
+  // 16 bit indices halve the index memory of every mesh small enough for them
+  const bool index32 = vertexCount > 65536;
+  const void *indexData;
+  if (index32) {
+    owned->indices32.swap(indices);
+    indexData = owned->indices32.data();
+  } else {
+    owned->indices16.assign(indices.begin(), indices.end());
+    indexData = owned->indices16.data();
+  }
+  const uint32_t id = addMesh(path, hash, vertexCount, (uint32_t)(index32 ? owned->indices32.size() : owned->indices16.size()), index32,
+                              owned->positions.data(), indexData, boundsMin, boundsMax);
+  ownedMeshes_.push_back(std::move(owned));
+  return id;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "meshblob.h"
+
+struct MeshOptimizeStats;
+
+// host side library of every mesh used by the renderer
+// files with identical content are loaded once, every mesh gets a range in one shared position array and one of two
+// shared index arrays (uint16_t or uint32_t), so the renderer can keep them in a few device local buffers addressed by offset
+// .bmesh files are memory mapped and referenced in place, the renderer copies them straight into its staging buffer
+class MeshLibrary {
+ public:
+  struct Mesh {
+    std::string path;
+    uint64_t hash;
+    int32_t vertexOffset;
+    uint32_t vertexCount;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    bool index32;
+    float boundsMin[3];
+    float boundsMax[3];
+    // tightly packed xyz and indices, either owned by the library or pointing into a mapped .bmesh
+    const float *positions;
+    const void *indices;
+  };
+
+  // returns the id of the mesh stored in the file, the file is only imported if its content is new
+  // throws if the file can not be read or does not contain a triangle mesh
+  uint32_t load(const std::string &path);
+
+  const std::vector<Mesh> &meshes() const { return meshes_; }
+  uint32_t vertexCount() const { return vertexCount_; }
+  uint32_t indexCount(bool index32) const { return index32 ? index32Count_ : index16Count_; }
+
+  static uint64_t hashBytes(const void *data, size_t size);
+
+  // import all triangles of a mesh file with assimp, normals stay empty if the file has none
+  // normals can be null if only positions are needed, which lets vertices on hard edges be welded as well
+  // vertices are welded and the mesh is reordered with optimizeMesh()
+  static void importMesh(const std::string &path, const void *content, size_t size, std::vector<float> *positions,
+                         std::vector<float> *normals, std::vector<uint32_t> *indices, MeshOptimizeStats *stats = nullptr);
+
+ private:
+  struct OwnedMesh {
+    std::vector<float> positions;
+    std::vector<uint16_t> indices16;
+    std::vector<uint32_t> indices32;
+  };
+
+  uint32_t addMesh(const std::string &path, uint64_t hash, uint32_t vertexCount, uint32_t indexCount, bool index32,
+                   const float *positions, const void *indices, const float *boundsMin, const float *boundsMax);
+
+  std::vector<Mesh> meshes_;
+  std::vector<std::unique_ptr<OwnedMesh>> ownedMeshes_;
+  std::vector<std::unique_ptr<MeshBlob>> blobs_;
+  std::unordered_map<uint64_t, uint32_t> meshByHash_;
+  std::unordered_map<std::string, uint32_t> meshByPath_;
+  uint32_t vertexCount_ = 0;
+  uint32_t index16Count_ = 0;
+  uint32_t index32Count_ = 0;
+};
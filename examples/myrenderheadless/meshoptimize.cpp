@@ -0,0 +1,412 @@
+#include "meshoptimize.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <unordered_map>
+
+namespace {
+
+const uint32_t INVALID_INDEX = ~0u;
+
+// simulated post transform cache, matches the size of the caches Forsyth tuned the scores for
+const int VERTEX_CACHE_SIZE = 32;
+// FIFO size used to find cluster boundaries for the overdraw reordering
+const int FIFO_CACHE_SIZE = 16;
+// cosine of the largest angle between two normals that still count as the same, about 0.8 degrees
+const float NORMAL_WELD_COS = 0.9999f;
+
+uint64_t cellKey(int64_t x, int64_t y, int64_t z) {
+  // any mix works, colliding cells are told apart by the distance test
+  uint64_t key = (uint64_t)x * 73856093ull;
+  key ^= (uint64_t)y * 19349663ull;
+  key ^= (uint64_t)z * 83492791ull;
+  return key;
+}
+
+// normals of zero length only match each other, STL exporters write them for degenerate facets
+bool normalsMatch(const float *a, const float *b) {
+  const float lengthA = sqrtf(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+  const float lengthB = sqrtf(b[0] * b[0] + b[1] * b[1] + b[2] * b[2]);
+  if (lengthA == 0.0f || lengthB == 0.0f) {
+    return lengthA == lengthB;
+  }
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2] >= NORMAL_WELD_COS * lengthA * lengthB;
+}
+
+float vertexScore(int cachePosition, uint32_t remainingTriangles) {
+  if (remainingTriangles == 0) {
+    return -1.0f;
+  }
+  float score = 0.0f;
+  if (cachePosition >= 0) {
+    // the last triangle's vertices get a fixed score so the next triangle does not just reuse them
+    if (cachePosition < 3) {
+      score = 0.75f;
+    } else {
+      score = powf(1.0f - (cachePosition - 3) * (1.0f / (VERTEX_CACHE_SIZE - 3)), 1.5f);
+    }
+  }
+  // favour vertices with few triangles left so they leave the working set early
+  score += 2.0f * powf((float)remainingTriangles, -0.5f);
+  return score;
+}
+
+}  // namespace
+
+uint32_t weldVertices(std::vector<float> *positions, std::vector<float> *normals, std::vector<uint32_t> *indices, float epsilon) {
+  const uint32_t vertexCount = positions->size() / 3;
+  const bool hasNormals = !normals->empty();
+  const double cellSize = std::max(epsilon, FLT_MIN);
+
+  // vertices are bucketed in a grid with cells of epsilon, a match is always in one of the 27 surrounding cells
+  std::unordered_map<uint64_t, uint32_t> cellHead;
+  cellHead.reserve(vertexCount);
+  std::vector<uint32_t> cellNext;
+  std::vector<uint32_t> remap(vertexCount);
+  std::vector<float> welded;
+  std::vector<float> weldedNormals;
+  welded.reserve(positions->size());
+  for (uint32_t i = 0; i < vertexCount; ++i) {
+    const float *p = &(*positions)[i * 3];
+    const int64_t cx = (int64_t)floor(p[0] / cellSize);
+    const int64_t cy = (int64_t)floor(p[1] / cellSize);
+    const int64_t cz = (int64_t)floor(p[2] / cellSize);
+    uint32_t match = INVALID_INDEX;
+    for (int dz = -1; dz <= 1 && match == INVALID_INDEX; ++dz) {
+      for (int dy = -1; dy <= 1 && match == INVALID_INDEX; ++dy) {
+        for (int dx = -1; dx <= 1 && match == INVALID_INDEX; ++dx) {
+          auto head = cellHead.find(cellKey(cx + dx, cy + dy, cz + dz));
+          for (uint32_t v = head == cellHead.end() ? INVALID_INDEX : head->second; v != INVALID_INDEX; v = cellNext[v]) {
+            const float *q = &welded[v * 3];
+            if (fabsf(p[0] - q[0]) <= epsilon && fabsf(p[1] - q[1]) <= epsilon && fabsf(p[2] - q[2]) <= epsilon &&
+                (!hasNormals || normalsMatch(&(*normals)[i * 3], &weldedNormals[v * 3]))) {
+              match = v;
+              break;
+            }
+          }
+        }
+      }
+    }
+    if (match == INVALID_INDEX) {
+      match = welded.size() / 3;
+      welded.insert(welded.end(), p, p + 3);
+      if (hasNormals) {
+        weldedNormals.insert(weldedNormals.end(), normals->begin() + i * 3, normals->begin() + i * 3 + 3);
+      }
+      const uint64_t key = cellKey(cx, cy, cz);
+      auto head = cellHead.find(key);
+      cellNext.push_back(head == cellHead.end() ? INVALID_INDEX : head->second);
+      cellHead[key] = match;
+    }
+    remap[i] = match;
+  }
+
+  size_t out = 0;
+  for (size_t t = 0; t + 2 < indices->size(); t += 3) {
+    const uint32_t a = remap[(*indices)[t]];
+    const uint32_t b = remap[(*indices)[t + 1]];
+    const uint32_t c = remap[(*indices)[t + 2]];
+    if (a == b || b == c || a == c) {
+      continue;
+    }
+    (*indices)[out++] = a;
+    (*indices)[out++] = b;
+    (*indices)[out++] = c;
+  }
+  indices->resize(out);
+  positions->swap(welded);
+  normals->swap(weldedNormals);
+  return positions->size() / 3;
+}
+
+float vertexCacheMissRatio(const std::vector<uint32_t> &indices, uint32_t vertexCount, uint32_t cacheSize) {
+  const uint32_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0) {
+    return 0.0f;
+  }
+  // same FIFO simulation as optimizeOverdraw, a vertex is cached while fewer than cacheSize misses happened since it was loaded
+  std::vector<uint32_t> cacheTime(vertexCount, 0);
+  uint32_t time = cacheSize + 1;
+  uint32_t misses = 0;
+  for (uint32_t index : indices) {
+    if (time - cacheTime[index] > cacheSize) {
+      cacheTime[index] = time++;
+      misses++;
+    }
+  }
+  return (float)misses / triangleCount;
+}
+
+void optimizeVertexCache(std::vector<uint32_t> *indices, uint32_t vertexCount) {
+  const uint32_t triangleCount = indices->size() / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+  const std::vector<uint32_t> source(*indices);
+
+  // triangles of every vertex that are not emitted yet, the first remaining[v] entries of its adjacency range
+  std::vector<uint32_t> remaining(vertexCount, 0);
+  for (uint32_t index : source) {
+    remaining[index]++;
+  }
+  std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+  for (uint32_t v = 0; v < vertexCount; ++v) {
+    adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+  }
+  std::vector<uint32_t> adjacency(source.size());
+  {
+    std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+    for (uint32_t i = 0; i < source.size(); ++i) {
+      adjacency[fill[source[i]]++] = i / 3;
+    }
+  }
+
+  std::vector<int> cachePosition(vertexCount, -1);
+  std::vector<float> vertexScores(vertexCount);
+  for (uint32_t v = 0; v < vertexCount; ++v) {
+    vertexScores[v] = vertexScore(-1, remaining[v]);
+  }
+  std::vector<float> triangleScores(triangleCount);
+  std::vector<bool> emitted(triangleCount, false);
+  uint32_t best = 0;
+  for (uint32_t t = 0; t < triangleCount; ++t) {
+    triangleScores[t] = vertexScores[source[t * 3]] + vertexScores[source[t * 3 + 1]] + vertexScores[source[t * 3 + 2]];
+    if (triangleScores[t] > triangleScores[best]) {
+      best = t;
+    }
+  }
+
+  std::vector<uint32_t> cache;
+  std::vector<uint32_t> newCache;
+  uint32_t scanCursor = 0;
+  for (uint32_t out = 0; out < triangleCount; ++out) {
+    if (best == INVALID_INDEX) {
+      // nothing in the cache has triangles left, continue with the next triangle in input order
+      while (emitted[scanCursor]) {
+        scanCursor++;
+      }
+      best = scanCursor;
+    }
+    emitted[best] = true;
+    const uint32_t *triangle = &source[best * 3];
+    std::copy(triangle, triangle + 3, indices->begin() + out * 3);
+
+    // the triangle's vertices move to the front of the LRU cache
+    newCache.assign(triangle, triangle + 3);
+    for (uint32_t v : cache) {
+      if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+        newCache.push_back(v);
+      }
+    }
+    for (int k = 0; k < 3; ++k) {
+      const uint32_t v = triangle[k];
+      uint32_t *begin = &adjacency[adjacencyOffset[v]];
+      uint32_t *end = begin + remaining[v];
+      std::iter_swap(std::find(begin, end, best), end - 1);
+      remaining[v]--;
+    }
+
+    // only vertices that were or are in the cache change their score
+    for (uint32_t i = 0; i < newCache.size(); ++i) {
+      cachePosition[newCache[i]] = i < VERTEX_CACHE_SIZE ? (int)i : -1;
+    }
+    for (uint32_t v : newCache) {
+      const float score = vertexScore(cachePosition[v], remaining[v]);
+      const float delta = score - vertexScores[v];
+      vertexScores[v] = score;
+      for (uint32_t a = 0; a < remaining[v]; ++a) {
+        triangleScores[adjacency[adjacencyOffset[v] + a]] += delta;
+      }
+    }
+    best = INVALID_INDEX;
+    float bestScore = -FLT_MAX;
+    for (uint32_t v : newCache) {
+      for (uint32_t a = 0; a < remaining[v]; ++a) {
+        const uint32_t t = adjacency[adjacencyOffset[v] + a];
+        if (triangleScores[t] > bestScore) {
+          bestScore = triangleScores[t];
+          best = t;
+        }
+      }
+    }
+    if (newCache.size() > VERTEX_CACHE_SIZE) {
+      newCache.resize(VERTEX_CACHE_SIZE);
+    }
+    cache.swap(newCache);
+  }
+}
+
+void optimizeOverdraw(std::vector<uint32_t> *indices, const std::vector<float> &positions, float threshold) {
+  const uint32_t triangleCount = indices->size() / 3;
+  const uint32_t vertexCount = positions.size() / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+
+  // FIFO cache simulation, a vertex is cached while fewer than FIFO_CACHE_SIZE misses happened since it was loaded
+  std::vector<uint32_t> cacheTime(vertexCount, 0);
+  uint32_t time = FIFO_CACHE_SIZE + 1;
+  auto triangleMisses = [&](uint32_t t) {
+    uint32_t misses = 0;
+    for (int k = 0; k < 3; ++k) {
+      const uint32_t v = (*indices)[t * 3 + k];
+      if (time - cacheTime[v] > FIFO_CACHE_SIZE) {
+        cacheTime[v] = time++;
+        misses++;
+      }
+    }
+    return misses;
+  };
+
+  // hard boundaries: the cache optimizer restarted, every vertex of the triangle missed
+  std::vector<uint32_t> hardClusters;
+  for (uint32_t t = 0; t < triangleCount; ++t) {
+    if (triangleMisses(t) == 3) {
+      hardClusters.push_back(t);
+    }
+  }
+  if (hardClusters.empty() || hardClusters[0] != 0) {
+    hardClusters.insert(hardClusters.begin(), 0);
+  }
+
+  // soft boundaries: split a hard cluster wherever the miss ratio so far stays within threshold of the whole cluster
+  std::vector<uint32_t> clusters;
+  for (size_t c = 0; c < hardClusters.size(); ++c) {
+    const uint32_t begin = hardClusters[c];
+    const uint32_t end = c + 1 < hardClusters.size() ? hardClusters[c + 1] : triangleCount;
+    time += FIFO_CACHE_SIZE + 1;
+    uint32_t clusterMisses = 0;
+    for (uint32_t t = begin; t < end; ++t) {
+      clusterMisses += triangleMisses(t);
+    }
+    const float clusterRatio = (float)clusterMisses / (end - begin);
+
+    clusters.push_back(begin);
+    time += FIFO_CACHE_SIZE + 1;
+    uint32_t runningMisses = 0;
+    uint32_t runningStart = begin;
+    for (uint32_t t = begin; t < end; ++t) {
+      runningMisses += triangleMisses(t);
+      if (t + 1 < end && (float)runningMisses / (t + 1 - runningStart) <= threshold * clusterRatio) {
+        clusters.push_back(t + 1);
+        runningStart = t + 1;
+        runningMisses = 0;
+        time += FIFO_CACHE_SIZE + 1;
+      }
+    }
+  }
+
+  // clusters facing away from the mesh center are likely visible and occlude the rest, draw them first
+  float meshCenter[3] = {0.0f, 0.0f, 0.0f};
+  for (uint32_t v = 0; v < vertexCount; ++v) {
+    for (int k = 0; k < 3; ++k) {
+      meshCenter[k] += positions[v * 3 + k] / vertexCount;
+    }
+  }
+  std::vector<float> sortKey(clusters.size());
+  for (size_t c = 0; c < clusters.size(); ++c) {
+    const uint32_t begin = clusters[c];
+    const uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+    float center[3] = {0.0f, 0.0f, 0.0f};
+    float normal[3] = {0.0f, 0.0f, 0.0f};
+    float area = 0.0f;
+    for (uint32_t t = begin; t < end; ++t) {
+      const float *a = &positions[(*indices)[t * 3] * 3];
+      const float *b = &positions[(*indices)[t * 3 + 1] * 3];
+      const float *c2 = &positions[(*indices)[t * 3 + 2] * 3];
+      const float e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+      const float e2[3] = {c2[0] - a[0], c2[1] - a[1], c2[2] - a[2]};
+      const float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+      const float twiceArea = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      for (int k = 0; k < 3; ++k) {
+        center[k] += (a[k] + b[k] + c2[k]) / 3.0f * twiceArea;
+        normal[k] += n[k];
+      }
+      area += twiceArea;
+    }
+    float dot = 0.0f;
+    for (int k = 0; k < 3; ++k) {
+      const float centerK = area > 0.0f ? center[k] / area : 0.0f;
+      dot += (centerK - meshCenter[k]) * normal[k];
+    }
+    sortKey[c] = dot;
+  }
+
+  std::vector<uint32_t> order(clusters.size());
+  for (uint32_t c = 0; c < order.size(); ++c) {
+    order[c] = c;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKey[a] > sortKey[b]; });
+
+  const std::vector<uint32_t> source(*indices);
+  size_t out = 0;
+  for (uint32_t c : order) {
+    const uint32_t begin = clusters[c];
+    const uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+    std::copy(source.begin() + begin * 3, source.begin() + end * 3, indices->begin() + out);
+    out += (end - begin) * 3;
+  }
+}
+
+void optimizeVertexFetch(std::vector<float> *positions, std::vector<float> *normals, std::vector<uint32_t> *indices) {
+  const uint32_t vertexCount = positions->size() / 3;
+  const bool hasNormals = !normals->empty();
+  std::vector<uint32_t> remap(vertexCount, INVALID_INDEX);
+  std::vector<float> sortedPositions;
+  std::vector<float> sortedNormals;
+  sortedPositions.reserve(positions->size());
+  sortedNormals.reserve(normals->size());
+  // vertices no triangle uses are dropped
+  for (uint32_t &index : *indices) {
+    if (remap[index] == INVALID_INDEX) {
+      remap[index] = sortedPositions.size() / 3;
+      sortedPositions.insert(sortedPositions.end(), positions->begin() + index * 3, positions->begin() + index * 3 + 3);
+      if (hasNormals) {
+        sortedNormals.insert(sortedNormals.end(), normals->begin() + index * 3, normals->begin() + index * 3 + 3);
+      }
+    }
+    index = remap[index];
+  }
+  positions->swap(sortedPositions);
+  normals->swap(sortedNormals);
+}
+
+void optimizeMesh(std::vector<float> *positions, std::vector<float> *normals, std::vector<uint32_t> *indices,
+                  MeshOptimizeStats *stats) {
+  const uint32_t vertexCount = positions->size() / 3;
+  if (stats) {
+    *stats = MeshOptimizeStats{vertexCount, vertexCount, 0.0f, 0.0f};
+  }
+  if (vertexCount == 0) {
+    return;
+  }
+  float boundsMin[3];
+  float boundsMax[3];
+  for (int c = 0; c < 3; ++c) {
+    boundsMin[c] = boundsMax[c] = (*positions)[c];
+  }
+  for (uint32_t i = 1; i < vertexCount; ++i) {
+    for (int c = 0; c < 3; ++c) {
+      boundsMin[c] = std::min(boundsMin[c], (*positions)[i * 3 + c]);
+      boundsMax[c] = std::max(boundsMax[c], (*positions)[i * 3 + c]);
+    }
+  }
+  const float dx = boundsMax[0] - boundsMin[0];
+  const float dy = boundsMax[1] - boundsMin[1];
+  const float dz = boundsMax[2] - boundsMin[2];
+  // far below the precision of any scan or CAD export, only merges copies of the same corner
+  const float epsilon = sqrtf(dx * dx + dy * dy + dz * dz) * 1e-6f;
+
+  const uint32_t weldedCount = weldVertices(positions, normals, indices, epsilon);
+  if (stats) {
+    stats->weldedMissRatio = vertexCacheMissRatio(*indices, weldedCount, FIFO_CACHE_SIZE);
+  }
+  optimizeVertexCache(indices, weldedCount);
+  optimizeOverdraw(indices, *positions, 1.05f);
+  optimizeVertexFetch(positions, normals, indices);
+  if (stats) {
+    stats->outputVertexCount = positions->size() / 3;
+    stats->optimizedMissRatio = vertexCacheMissRatio(*indices, stats->outputVertexCount, FIFO_CACHE_SIZE);
+  }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// index and vertex order optimizations for triangle meshes given as packed xyz positions and uint32_t indices
+// normals are optional (empty vector), if present they follow every reordering of the positions
+
+// merge vertices closer than epsilon (per axis) into one, rewrite the indices and drop triangles that became degenerate
+// with normals only vertices whose normals also match are merged, so hard edges keep their per face normals
+// returns the new vertex count
+uint32_t weldVertices(std::vector<float> *positions, std::vector<float> *normals, std::vector<uint32_t> *indices, float epsilon);
+
+// average cache miss ratio (vertex shader invocations per triangle) of an index buffer on a FIFO cache of cacheSize entries
+float vertexCacheMissRatio(const std::vector<uint32_t> &indices, uint32_t vertexCount, uint32_t cacheSize);
+
+// reorder triangles for the post transform vertex cache (Forsyth, "Linear-Speed Vertex Cache Optimisation")
+void optimizeVertexCache(std::vector<uint32_t> *indices, uint32_t vertexCount);
+
+// reorder clusters of a cache optimized index buffer so outward facing clusters are drawn first (Sander et al.,
+// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"), threshold is the cache miss ratio the
+// reordering may lose compared to the input, e.g. 1.05
+void optimizeOverdraw(std::vector<uint32_t> *indices, const std::vector<float> &positions, float threshold);
+
+// renumber vertices in the order of their first use so vertex fetches walk the buffers linearly
+void optimizeVertexFetch(std::vector<float> *positions, std::vector<float> *normals, std::vector<uint32_t> *indices);
+
+struct MeshOptimizeStats {
+  uint32_t inputVertexCount;
+  uint32_t outputVertexCount;
+  // vertexCacheMissRatio on a 16 entry FIFO of the welded mesh in input order and after the reorderings
+  float weldedMissRatio;
+  float optimizedMissRatio;
+};
+
+// weld with an epsilon relative to the bounding box, then run the three reorderings above
+// stats can be null, measuring the miss ratios costs two extra passes over the indices
+void optimizeMesh(std::vector<float> *positions, std::vector<float> *normals, std::vector<uint32_t> *indices,
+                  MeshOptimizeStats *stats = nullptr);
@@ -7,6 +7,7 @@
 #include <chrono>
 #include <string>
 #include <algorithm>
+#include <functional>
 #include <vulkan/vulkan.h>
 
 #define GLM_FORCE_RADIANS
@@ -16,10 +17,13 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/string_cast.hpp>
 
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
+#include <VulkanPipelineCache.h>
 #include <VulkanTools.h>
+#include <trace.h>
+
+#include "imagewriter.h"
+#include "meshlibrary.h"
+#include "meshoptimize.h"
 
 #define CHECK_VK_SUCCESS(ret) \
   if ((ret) != VK_SUCCESS) {  \
@@ -51,40 +55,233 @@ VkPushConstantRange initializePushConstanceRange(uint32_t size, uint32_t offset,
   return constantRange;
 }
 
+// pinhole camera, (fx, fy, cx, cy) in pixels, near_z and far_z in scene units
+struct CameraIntrinsics {
+  float fx;
+  float fy;
+  float cx;
+  float cy;
+  // only used by PROJECTION_PERSPECTIVE_REVERSED_Z
+  float near_z;
+  float far_z;
+};
+
+enum ProjectionMode {
+  // triangle.vert: divides by view space z in the shader and writes w = 1, depth is z / far_z
+  PROJECTION_LINEAR_DEPTH,
+  // perspective.vert: full projection matrix from the intrinsics with w = z, so varyings are interpolated
+  // perspective correctly, depth is reversed (1 at near_z, 0 at far_z) on a D32_SFLOAT attachment
+  PROJECTION_PERSPECTIVE_REVERSED_Z,
+};
+
+// projection matrix for PROJECTION_PERSPECTIVE_REVERSED_Z, camera looks along +z with y pointing down
+glm::mat4 perspectiveFromIntrinsics(const CameraIntrinsics &intrinsics, uint32_t width, uint32_t height) {
+  const float n = intrinsics.near_z;
+  const float f = intrinsics.far_z;
+  glm::mat4 proj = glm::mat4(0);
+  proj[0][0] = 2.0f * intrinsics.fx / (float)width;
+  proj[2][0] = 2.0f * intrinsics.cx / (float)width - 1.0f;
+  proj[1][1] = 2.0f * intrinsics.fy / (float)height;
+  proj[2][1] = 2.0f * intrinsics.cy / (float)height - 1.0f;
+  // z_ndc = n * f / ((f - n) * z) - n / (f - n), 1 at the near plane and 0 at the far plane
+  proj[2][2] = -n / (f - n);
+  proj[3][2] = n * f / (f - n);
+  proj[2][3] = 1.0f;
+  return proj;
+}
+
+enum OutputFlagBits {
+  OUTPUT_COLOR_BIT = 0x1,
+  OUTPUT_DEPTH_BIT = 0x2,
+};
+typedef uint32_t OutputFlags;
+
+// one rendered image, the pointers are only valid during the callback
+struct RenderResult {
+  uint32_t index;
+  uint32_t width;
+  uint32_t height;
+  // tightly packed RGBA8, nullptr without OUTPUT_COLOR_BIT
+  const uint8_t *color;
+  // metric depth along the optical axis, 0 where no surface was hit, nullptr without OUTPUT_DEPTH_BIT
+  const float *depth;
+};
+
+// camera of one image in DRAW_RECORDED mode, std430 layout of recorded.vert's Cameras
+struct CameraData {
+  glm::mat4 view;
+  glm::mat4 proj;
+  float far_z;
+  float padding[3];
+};
+
+struct MeshPushConstants {
+  glm::mat4 model_view;
+  glm::mat4 proj;
+  float far_z;
+};
+
+enum DrawMode {
+  // one push constant update and vkCmdDrawIndexed per scene object
+  DRAW_PER_OBJECT,
+  // model matrices in a storage buffer, one instanced draw per mesh, issued through vkCmdDrawIndexedIndirect
+  DRAW_INSTANCED,
+  // DRAW_INSTANCED recorded once per slot and resubmitted, the camera of every image is read from a buffer
+  // instead of push constants, so only the camera buffer is written per frame
+  DRAW_RECORDED,
+};
+
+// one instance of a loaded mesh placed in the scene
+struct SceneObject {
+  uint32_t mesh;
+  glm::mat4 model;
+};
+
+struct RendererSettings {
+  uint32_t width = 2048;
+  uint32_t height = 1536;
+  // images recorded into one submission
+  uint32_t maxBatchSize = 8;
+  // submissions in flight
+  uint32_t ringSize = 3;
+  OutputFlags outputs = OUTPUT_COLOR_BIT;
+  ProjectionMode projection = PROJECTION_LINEAR_DEPTH;
+  DrawMode drawMode = DRAW_PER_OBJECT;
+  // the pipeline cache is loaded from and saved to this directory, empty for the working directory
+  std::string pipelineCacheDir;
+};
+
+// the vertex shader matching a draw mode and projection, --reversed-z, --instanced and --recorded each need their own
+std::string vertexShaderPath(DrawMode drawMode, ProjectionMode projection) {
+  const std::string dir = VK_EXAMPLE_DATA_DIR "shaders/glsl/myrenderheadless/";
+  if (drawMode == DRAW_RECORDED) {
+    return dir + "recorded.vert.spv";
+  } else if (drawMode == DRAW_INSTANCED) {
+    return dir + "instanced.vert.spv";
+  } else if (projection == PROJECTION_PERSPECTIVE_REVERSED_Z) {
+    return dir + "perspective.vert.spv";
+  }
+  return dir + "triangle.vert.spv";
+}
+
 class HeadlessRenderer {
  public:
+  // called once per rendered image
+  typedef std::function<void(const RenderResult &result)> ResultCallback;
+
   VkInstance instance_;
   VkPhysicalDevice physicalDevice_;
+  VkPhysicalDeviceProperties physicalDeviceProperties_;
   uint32_t queueFamilyIndex_ = -1;
   VkDevice device_;
   VkQueue queue_;
   VkCommandPool commandPool_;
 
-  VkBuffer vertexBuffer_;
-  VkDeviceMemory vertexMemory_;
+  // device local buffer that only grows, filled front to back
+  struct GrowableBuffer {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize capacity = 0;
+    VkDeviceSize size = 0;
+  };
+
+  // device local copy of the mesh library, all meshes are suballocated from one position buffer
+  // and the index buffer matching their index type
+  GrowableBuffer positions_;
+  GrowableBuffer indices16_;
+  GrowableBuffer indices32_;
+
+  // meshes carry no vertex colors, binding 1 reads this single white color with stride 0
+  VkBuffer colorBuffer_;
+  VkDeviceMemory colorMemory_;
 
-  VkBuffer indexBuffer_;
-  VkDeviceMemory indexMemory_;
+  struct MeshRange {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t vertexOffset;
+    bool index32;
+  };
+  std::vector<MeshRange> meshes_;
+
+  uint32_t width_;
+  uint32_t height_;
+  uint32_t maxBatchSize_;
+  OutputFlags outputs_;
+  ProjectionMode projection_;
+  DrawMode drawMode_;
+  bool multiDrawIndirect_ = false;
+  bool drawIndirectFirstInstance_ = false;
 
   VkFormat colorFormat_;
-  VkImage color_;
-  VkImageView colorView_;
-  VkDeviceMemory colorMemory_;
-
   VkFormat depthFormat_;
-  VkImage depth_;
-  VkImageView depthView_;
-  VkDeviceMemory depthMemory_;
+
+  // layout of one image inside a readback buffer: color texels followed by depth texels
+  VkDeviceSize colorOffset_ = 0;
+  VkDeviceSize depthOffset_ = 0;
+  VkDeviceSize imageStride_ = 0;
 
   VkRenderPass renderpass_;
-  VkFramebuffer framebuffer_;
 
   VkPipeline pipeline_;
   VkPipelineCache pipelineCache_;
+  std::string pipelineCacheFile_;
   VkPipelineLayout pipelineLayout_;
   VkShaderModule shaderVertex_;
   VkShaderModule shaderFragment_;
 
+  // instanced draw mode: model matrices of objects_ in a storage buffer and one indirect command per mesh
+  VkDescriptorSetLayout descriptorSetLayout_ = VK_NULL_HANDLE;
+  VkDescriptorPool descriptorPool_ = VK_NULL_HANDLE;
+  VkDescriptorSet descriptorSet_ = VK_NULL_HANDLE;
+  VkBuffer instanceBuffer_ = VK_NULL_HANDLE;
+  VkDeviceMemory instanceMemory_ = VK_NULL_HANDLE;
+  VkDeviceSize instanceCapacity_ = 0;
+  VkBuffer indirectBuffer_ = VK_NULL_HANDLE;
+  VkDeviceMemory indirectMemory_ = VK_NULL_HANDLE;
+  VkDeviceSize indirectCapacity_ = 0;
+  // commands of meshes with 16 bit indices come first
+  std::vector<VkDrawIndexedIndirectCommand> drawCommands_;
+  uint32_t drawCommandCount16_ = 0;
+  // bumped by setObjects(), recorded command buffers of an older scene are recorded again
+  uint32_t sceneVersion_ = 0;
+
+  // recorded draw mode: maxBatchSize_ cameras per slot, persistently mapped
+  VkBuffer cameraBuffer_ = VK_NULL_HANDLE;
+  VkDeviceMemory cameraMemory_ = VK_NULL_HANDLE;
+  CameraData *cameraData_ = nullptr;
+
+  // one submission in flight: each slot owns its attachments and a persistently mapped readback buffer
+  // for maxBatchSize_ images, so slot i+1 renders while slot i is copied and slot i-1 is consumed
+  struct FrameSlot {
+    VkImage color;
+    VkImageView colorView;
+    VkDeviceMemory colorMemory;
+    VkImage depth;
+    VkImageView depthView;
+    VkDeviceMemory depthMemory;
+    VkFramebuffer framebuffer;
+    VkBuffer readbackBuffer;
+    VkDeviceMemory readbackMemory;
+    uint8_t *readbackData = nullptr;
+    VkCommandBuffer cmdBuffer;
+    VkFence fence;
+    bool pending = false;
+    uint32_t firstImage = 0;
+    uint32_t imageCount = 0;
+    CameraIntrinsics intrinsics;
+    // recorded draw mode: what cmdBuffer currently holds, 0 images if it was never recorded
+    uint32_t recordedImageCount = 0;
+    uint32_t recordedSceneVersion = 0;
+  };
+  std::vector<FrameSlot> slots_;
+  uint32_t nextSlot_ = 0;
+
+  // scene objects sorted by mesh
+  std::vector<SceneObject> objects_;
+
+  // host side metric depth of the image currently handed to the callback
+  std::vector<float> metricDepth_;
+
   uint32_t getMemoryTypeIndex(uint32_t typeMask, VkMemoryPropertyFlags properties) {
     VkPhysicalDeviceMemoryProperties deviceMemProps;
     vkGetPhysicalDeviceMemoryProperties(physicalDevice_, &deviceMemProps);
@@ -100,9 +297,10 @@ class HeadlessRenderer {
   }
 
   VkFormat getSupportedDepthFormat() {
+    // prefer a pure float format, its depth aspect is copied out as float32 without unpacking
     std::vector<VkFormat> depthFormats = {
-        VK_FORMAT_D32_SFLOAT_S8_UINT,
         VK_FORMAT_D32_SFLOAT,
+        VK_FORMAT_D32_SFLOAT_S8_UINT,
         VK_FORMAT_D24_UNORM_S8_UINT,
         VK_FORMAT_D16_UNORM_S8_UINT,
         VK_FORMAT_D16_UNORM
@@ -138,7 +336,7 @@ class HeadlessRenderer {
       delete[] shaderCode;
       return shader;
     }
-    throw std::runtime_error("shader file dost not exist");
+    throw std::runtime_error("shader file " + filename + " does not exist");
   }
 
   // create buffer and associated memory, copy data to memory if data != nullptr
@@ -221,69 +419,8 @@ class HeadlessRenderer {
     CHECK_VK_SUCCESS(vkCreateImageView(device_, &imageViewInfo, nullptr, pImageView));
   }
 
-  HeadlessRenderer() {
-    // create instance
-    {
-      VkApplicationInfo appInfo{};
-      appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-      appInfo.apiVersion = VK_API_VERSION_1_0;
-      appInfo.pApplicationName = "HeadlessRenderer";
-      appInfo.pEngineName = "HeadlessRenderer";
-
-      VkInstanceCreateInfo instanceInfo{};
-      instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-      instanceInfo.pApplicationInfo = &appInfo;
-//      const char* validationLayerName = "VK_LAYER_KHRONOS_validation";
-//      instanceInfo.enabledLayerCount = 1;
-//      instanceInfo.ppEnabledLayerNames = &validationLayerName;
-      CHECK_VK_SUCCESS(vkCreateInstance(&instanceInfo, nullptr, &instance_));
-    }
-
-    // select physical device
-    {
-      uint32_t deviceCount;
-      vkEnumeratePhysicalDevices(instance_, &deviceCount, nullptr);
-      std::vector<VkPhysicalDevice> devices(deviceCount);
-      vkEnumeratePhysicalDevices(instance_, &deviceCount, devices.data());
-      physicalDevice_ = devices[0];
-      VkPhysicalDeviceProperties props;
-      vkGetPhysicalDeviceProperties(physicalDevice_, &props);
-      std::cout << "select " << props.deviceName << "\n";
-    }
-
-    // find a suitable queue family index
-    {
-      uint32_t familyCount;
-      vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice_, &familyCount, nullptr);
-      std::vector<VkQueueFamilyProperties> props(familyCount);
-      vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice_, &familyCount, props.data());
-      for (int i = 0; i < props.size(); ++i) {
-        if (props[i].queueFlags & VK_QUEUE_GRAPHICS_BIT && props[i].queueFlags & VK_QUEUE_TRANSFER_BIT) {
-          queueFamilyIndex_ = i;
-          break;
-        }
-      }
-      if (queueFamilyIndex_ == -1) {
-        throw std::runtime_error("can not find a suitable queue family");
-      }
-    }
-
-    // create logical device
-    {
-      float queuePriority = 1.0f;
-      VkDeviceQueueCreateInfo queueCreateInfo{};
-      queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-      queueCreateInfo.queueFamilyIndex = queueFamilyIndex_;
-      queueCreateInfo.queueCount = 1;
-      queueCreateInfo.pQueuePriorities = &queuePriority;
-      VkDeviceCreateInfo deviceCreateInfo{};
-      deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-      deviceCreateInfo.queueCreateInfoCount = 1;
-      deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
-      CHECK_VK_SUCCESS(vkCreateDevice(physicalDevice_, &deviceCreateInfo, nullptr, &device_));
-      vkGetDeviceQueue(device_, queueFamilyIndex_, 0, &queue_);
-    }
-
+  // print format features and image format properties of the selected device, useful when porting to a new GPU
+  void printFormatCapabilities() {
     // check image format capabilities
     {
       for (int i = 0; i < 185; ++i) {
@@ -352,6 +489,81 @@ class HeadlessRenderer {
         }
       }
     }
+  }
+
+  // instance, device, mesh, attachments and pipeline are created once and reused by every renderBatch() call
+  HeadlessRenderer(const MeshLibrary &library, const RendererSettings &settings = RendererSettings())
+      : width_(settings.width), height_(settings.height), maxBatchSize_(settings.maxBatchSize), outputs_(settings.outputs),
+        projection_(settings.projection), drawMode_(settings.drawMode), slots_(settings.ringSize) {
+    // create instance
+    {
+      VkApplicationInfo appInfo{};
+      appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+      appInfo.apiVersion = VK_API_VERSION_1_0;
+      appInfo.pApplicationName = "HeadlessRenderer";
+      appInfo.pEngineName = "HeadlessRenderer";
+
+      VkInstanceCreateInfo instanceInfo{};
+      instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+      instanceInfo.pApplicationInfo = &appInfo;
+//      const char* validationLayerName = "VK_LAYER_KHRONOS_validation";
+//      instanceInfo.enabledLayerCount = 1;
+//      instanceInfo.ppEnabledLayerNames = &validationLayerName;
+      CHECK_VK_SUCCESS(vkCreateInstance(&instanceInfo, nullptr, &instance_));
+    }
+
+    // select physical device
+    {
+      uint32_t deviceCount;
+      vkEnumeratePhysicalDevices(instance_, &deviceCount, nullptr);
+      std::vector<VkPhysicalDevice> devices(deviceCount);
+      vkEnumeratePhysicalDevices(instance_, &deviceCount, devices.data());
+      physicalDevice_ = devices[0];
+      vkGetPhysicalDeviceProperties(physicalDevice_, &physicalDeviceProperties_);
+      std::cout << "select " << physicalDeviceProperties_.deviceName << "\n";
+    }
+
+    // find a suitable queue family index
+    {
+      uint32_t familyCount;
+      vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice_, &familyCount, nullptr);
+      std::vector<VkQueueFamilyProperties> props(familyCount);
+      vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice_, &familyCount, props.data());
+      for (int i = 0; i < props.size(); ++i) {
+        if (props[i].queueFlags & VK_QUEUE_GRAPHICS_BIT && props[i].queueFlags & VK_QUEUE_TRANSFER_BIT) {
+          queueFamilyIndex_ = i;
+          break;
+        }
+      }
+      if (queueFamilyIndex_ == -1) {
+        throw std::runtime_error("can not find a suitable queue family");
+      }
+    }
+
+    // create logical device
+    {
+      float queuePriority = 1.0f;
+      VkDeviceQueueCreateInfo queueCreateInfo{};
+      queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+      queueCreateInfo.queueFamilyIndex = queueFamilyIndex_;
+      queueCreateInfo.queueCount = 1;
+      queueCreateInfo.pQueuePriorities = &queuePriority;
+      // instanced draws use one multi draw indirect call when available, firstInstance selects the model matrices
+      VkPhysicalDeviceFeatures supportedFeatures;
+      vkGetPhysicalDeviceFeatures(physicalDevice_, &supportedFeatures);
+      VkPhysicalDeviceFeatures enabledFeatures{};
+      enabledFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+      enabledFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+      multiDrawIndirect_ = supportedFeatures.multiDrawIndirect == VK_TRUE;
+      drawIndirectFirstInstance_ = supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
+      VkDeviceCreateInfo deviceCreateInfo{};
+      deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+      deviceCreateInfo.queueCreateInfoCount = 1;
+      deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
+      deviceCreateInfo.pEnabledFeatures = &enabledFeatures;
+      CHECK_VK_SUCCESS(vkCreateDevice(physicalDevice_, &deviceCreateInfo, nullptr, &device_));
+      vkGetDeviceQueue(device_, queueFamilyIndex_, 0, &queue_);
+    }
 
     // create command pool
     {
@@ -362,97 +574,45 @@ class HeadlessRenderer {
       CHECK_VK_SUCCESS(vkCreateCommandPool(device_, &poolCreateInfo, nullptr, &commandPool_));
     }
 
-    struct Vertex {
-      float position[3];
-      float color[3];
-    };
-    std::vector<Vertex> vertices = {
-        {{1.0f, -1.0f, 0.0f}, {1.0f, 0.0f, 0.0f}},
-        {{0.0f, 1.0f, 0.0f}, {0.0f, 1.0f, 0.0f}},
-        {{-1.0f, -1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}},
-    };
-    std::vector<uint32_t> indices = {0, 1, 2};
-    // load mesh
+    uploadMeshes(library);
     {
-      Assimp::Importer importer;
-      const aiScene* scene = importer.ReadFile("/home/shq/Data/DeepTote/20210915_169/00000003/model.stl", aiProcess_Triangulate);
-      if (scene) {
-        if (scene->mNumMeshes == 1) {
-          const aiMesh* mesh = scene->mMeshes[0];
-          if (mesh->mNumFaces > 0 && mesh->mNumVertices > 0) {
-            vertices.clear();
-            indices.clear();
-            for (int i = 0; i < mesh->mNumVertices; ++i) {
-              Vertex vertex;
-              vertex.position[0] = mesh->mVertices[i].x;
-              vertex.position[1] = mesh->mVertices[i].y;
-              vertex.position[2] = mesh->mVertices[i].z;
-              vertex.color[0] = 1.0f;
-              vertex.color[1] = 1.0f;
-              vertex.color[2] = 1.0f;
-              vertices.push_back(vertex);
-            }
-            for (int i = 0; i < mesh->mNumFaces; ++i) {
-              indices.push_back(mesh->mFaces[i].mIndices[0]);
-              indices.push_back(mesh->mFaces[i].mIndices[1]);
-              indices.push_back(mesh->mFaces[i].mIndices[2]);
-            }
-          }
-        }
-      }
-    }
-    printf("#vertices = %lu\n", vertices.size());
-    printf("#indices = %lu\n", indices.size());
-
-    // copy vertex data to device local buffer
-    {
-      auto t1 = std::chrono::high_resolution_clock::now();
-      const VkDeviceSize vertexBufferSize = vertices.size() * sizeof(Vertex);
-      const VkDeviceSize indexBufferSize = indices.size() * sizeof(uint32_t);
-
-      createBuffer(vertices.data(),
-                   vertexBufferSize,
-                   VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                   &vertexBuffer_,
-                   &vertexMemory_);
-
-      createBuffer(indices.data(),
-                   indexBufferSize,
-                   VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                   &indexBuffer_,
-                   &indexMemory_);
-      auto t2 = std::chrono::high_resolution_clock::now();
-      auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
-      std::cout << "copy vertex/index buffer to device cost " << duration << " us\n";
+      float white[3] = {1.0f, 1.0f, 1.0f};
+      createBuffer(white, sizeof(white), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &colorBuffer_, &colorMemory_);
     }
 
     // create image attachments
-    uint32_t width = 2048;
-    uint32_t height = 1536;
-    {
-      colorFormat_ = VK_FORMAT_R8G8B8A8_UNORM;
-      create2DImage(width,
-                    height,
+    colorFormat_ = VK_FORMAT_R8G8B8A8_UNORM;
+    depthFormat_ = getSupportedDepthFormat();
+    if (projection_ == PROJECTION_PERSPECTIVE_REVERSED_Z) {
+      // reversed z relies on the float exponent to spread precision over the whole range
+      depthFormat_ = VK_FORMAT_D32_SFLOAT;
+      VkFormatProperties formatProps;
+      vkGetPhysicalDeviceFormatProperties(physicalDevice_, depthFormat_, &formatProps);
+      if (!(formatProps.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)) {
+        throw std::runtime_error("reversed z requires a D32_SFLOAT depth attachment");
+      }
+    }
+    for (auto &slot : slots_) {
+      create2DImage(width_,
+                    height_,
                     colorFormat_,
                     VK_IMAGE_TILING_OPTIMAL,
                     VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                    &color_,
-                    &colorMemory_,
-                    &colorView_);
+                    &slot.color,
+                    &slot.colorMemory,
+                    &slot.colorView);
 
-      depthFormat_ = getSupportedDepthFormat();
-      create2DImage(width,
-                    height,
+      create2DImage(width_,
+                    height_,
                     depthFormat_,
                     VK_IMAGE_TILING_OPTIMAL,
                     VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                    &depth_,
-                    &depthMemory_,
-                    &depthView_);
+                    &slot.depth,
+                    &slot.depthMemory,
+                    &slot.depthView);
     }
 
     // create render pass
@@ -485,22 +645,23 @@ class HeadlessRenderer {
       subpassDescription.pColorAttachments = &colorRef;
       subpassDescription.pDepthStencilAttachment = &depthRef;
 
-      // ???
+      // the attachments are rendered several times per command buffer, so the render pass has to wait for
+      // the readback copy of the previous image and the copy has to wait for the attachment writes
       std::array<VkSubpassDependency, 2> subpassDependencys;
       subpassDependencys[0].srcSubpass = VK_SUBPASS_EXTERNAL;
       subpassDependencys[0].dstSubpass = 0;
-      subpassDependencys[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-      subpassDependencys[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-      subpassDependencys[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-      subpassDependencys[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
+      subpassDependencys[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+      subpassDependencys[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+      subpassDependencys[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+      subpassDependencys[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
       subpassDependencys[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
       subpassDependencys[1].srcSubpass = 0;
       subpassDependencys[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-      subpassDependencys[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-      subpassDependencys[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-      subpassDependencys[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
-      subpassDependencys[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+      subpassDependencys[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+      subpassDependencys[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+      subpassDependencys[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+      subpassDependencys[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
       subpassDependencys[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
       VkRenderPassCreateInfo renderPassInfo{};
@@ -514,33 +675,69 @@ class HeadlessRenderer {
       CHECK_VK_SUCCESS(vkCreateRenderPass(device_, &renderPassInfo, nullptr, &renderpass_));
     }
 
-    // create framebuffer
-    {
+    // create framebuffers
+    for (auto &slot : slots_) {
       std::array<VkImageView, 2> attachments;
-      attachments[0] = colorView_;
-      attachments[1] = depthView_;
+      attachments[0] = slot.colorView;
+      attachments[1] = slot.depthView;
 
       VkFramebufferCreateInfo bufferInfo{};
       bufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
       bufferInfo.renderPass = renderpass_;
       bufferInfo.attachmentCount = attachments.size();
       bufferInfo.pAttachments = attachments.data();
-      bufferInfo.width = width;
-      bufferInfo.height = height;
+      bufferInfo.width = width_;
+      bufferInfo.height = height_;
       bufferInfo.layers = 1;
-      CHECK_VK_SUCCESS(vkCreateFramebuffer(device_, &bufferInfo, nullptr, &framebuffer_));
+      CHECK_VK_SUCCESS(vkCreateFramebuffer(device_, &bufferInfo, nullptr, &slot.framebuffer));
+    }
+
+    // create descriptor set for the instance buffer, it is written by setObjects()
+    // the recorded mode adds the camera buffer as binding 1
+    if (drawMode_ != DRAW_PER_OBJECT) {
+      const uint32_t bindingCount = drawMode_ == DRAW_RECORDED ? 2 : 1;
+      std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+      for (uint32_t i = 0; i < bindingCount; ++i) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+      }
+      VkDescriptorSetLayoutCreateInfo setLayoutInfo{};
+      setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+      setLayoutInfo.bindingCount = bindingCount;
+      setLayoutInfo.pBindings = bindings.data();
+      CHECK_VK_SUCCESS(vkCreateDescriptorSetLayout(device_, &setLayoutInfo, nullptr, &descriptorSetLayout_));
+
+      VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, bindingCount};
+      VkDescriptorPoolCreateInfo poolInfo{};
+      poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+      poolInfo.maxSets = 1;
+      poolInfo.poolSizeCount = 1;
+      poolInfo.pPoolSizes = &poolSize;
+      CHECK_VK_SUCCESS(vkCreateDescriptorPool(device_, &poolInfo, nullptr, &descriptorPool_));
+
+      VkDescriptorSetAllocateInfo setAllocInfo{};
+      setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+      setAllocInfo.descriptorPool = descriptorPool_;
+      setAllocInfo.descriptorSetCount = 1;
+      setAllocInfo.pSetLayouts = &descriptorSetLayout_;
+      CHECK_VK_SUCCESS(vkAllocateDescriptorSets(device_, &setAllocInfo, &descriptorSet_));
+    }
+
+    if (drawMode_ == DRAW_RECORDED) {
+      const VkDeviceSize size = sizeof(CameraData) * maxBatchSize_ * slots_.size();
+      createBuffer(nullptr, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &cameraBuffer_, &cameraMemory_);
+      CHECK_VK_SUCCESS(vkMapMemory(device_, cameraMemory_, 0, size, 0, (void **)&cameraData_));
+      writeDescriptorSet();
     }
 
     // create graphics pipeline
-    struct MeshPushConstants {
-      glm::mat4 model_view;
-      glm::mat4 proj;
-      float far_z;
-    };
     {
-      VkPipelineCacheCreateInfo cacheInfo{};
-      cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-      CHECK_VK_SUCCESS(vkCreatePipelineCache(device_, &cacheInfo, nullptr, &pipelineCache_));
+      // a restarted worker finds the pipeline in the cache of its previous run
+      pipelineCacheFile_ = vks::pipelinecache::getFileName(physicalDeviceProperties_, settings.pipelineCacheDir, "myrenderheadless");
+      CHECK_VK_SUCCESS(vks::pipelinecache::create(device_, physicalDeviceProperties_, pipelineCacheFile_, &pipelineCache_));
 
       VkGraphicsPipelineCreateInfo pipeInfo{};
       pipeInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -557,17 +754,21 @@ class HeadlessRenderer {
       layoutInfo.pNext = nullptr;
       layoutInfo.pushConstantRangeCount = pushConstants.size();
       layoutInfo.pPushConstantRanges = pushConstants.data();
-      layoutInfo.setLayoutCount = 0;
-      layoutInfo.pSetLayouts = nullptr;
+      layoutInfo.setLayoutCount = drawMode_ != DRAW_PER_OBJECT ? 1 : 0;
+      layoutInfo.pSetLayouts = drawMode_ != DRAW_PER_OBJECT ? &descriptorSetLayout_ : nullptr;
       CHECK_VK_SUCCESS(vkCreatePipelineLayout(device_, &layoutInfo, nullptr, &pipelineLayout_));
       pipeInfo.layout = pipelineLayout_;
 
       std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
       shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
       shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-      shaderStages[0].module = loadShader(VK_EXAMPLE_DATA_DIR "shaders/glsl/myrenderheadless/triangle.vert.spv");
+      // the instanced shaders select the projection through a specialization constant
+      VkBool32 perspective = projection_ == PROJECTION_PERSPECTIVE_REVERSED_Z;
+      VkSpecializationMapEntry specializationEntry{0, 0, sizeof(VkBool32)};
+      VkSpecializationInfo specializationInfo{1, &specializationEntry, sizeof(VkBool32), &perspective};
+      shaderStages[0].module = loadShader(vertexShaderPath(drawMode_, projection_));
       shaderStages[0].pName = "main";
-      shaderStages[0].pSpecializationInfo = nullptr;
+      shaderStages[0].pSpecializationInfo = drawMode_ != DRAW_PER_OBJECT ? &specializationInfo : nullptr;
       shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
       shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
       shaderStages[1].module = loadShader(VK_EXAMPLE_DATA_DIR "shaders/glsl/myrenderheadless/triangle.frag.spv");
@@ -578,15 +779,19 @@ class HeadlessRenderer {
       pipeInfo.stageCount = shaderStages.size();
       pipeInfo.pStages = shaderStages.data();
 
-      VkVertexInputBindingDescription vertexBinding = initializeVertexInputBinding(0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX);
+      // tightly packed positions as stored in the mesh library, constant color from a stride 0 binding
+      std::array<VkVertexInputBindingDescription, 2> vertexBindings{
+          initializeVertexInputBinding(0, sizeof(float) * 3, VK_VERTEX_INPUT_RATE_VERTEX),
+          initializeVertexInputBinding(1, 0, VK_VERTEX_INPUT_RATE_VERTEX)
+      };
       std::array<VkVertexInputAttributeDescription, 2> vertexAttributes{
           initializeVertexInputAttribute(0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0),
-          initializeVertexInputAttribute(0, 1, VK_FORMAT_R32G32B32_SFLOAT, sizeof(float) * 3)
+          initializeVertexInputAttribute(1, 1, VK_FORMAT_R32G32B32_SFLOAT, 0)
       };
       VkPipelineVertexInputStateCreateInfo vertexInputState{};
       vertexInputState.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-      vertexInputState.vertexBindingDescriptionCount = 1;
-      vertexInputState.pVertexBindingDescriptions = &vertexBinding;
+      vertexInputState.vertexBindingDescriptionCount = vertexBindings.size();
+      vertexInputState.pVertexBindingDescriptions = vertexBindings.data();
       vertexInputState.vertexAttributeDescriptionCount = vertexAttributes.size();
       vertexInputState.pVertexAttributeDescriptions = vertexAttributes.data();
       pipeInfo.pVertexInputState = &vertexInputState;
@@ -623,7 +828,7 @@ class HeadlessRenderer {
       depthStencilState.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
       depthStencilState.depthTestEnable = VK_TRUE;
       depthStencilState.depthWriteEnable = VK_TRUE;
-      depthStencilState.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+      depthStencilState.depthCompareOp = projection_ == PROJECTION_PERSPECTIVE_REVERSED_Z ? VK_COMPARE_OP_GREATER_OR_EQUAL : VK_COMPARE_OP_LESS_OR_EQUAL;
       depthStencilState.back.compareOp = VK_COMPARE_OP_ALWAYS;
       pipeInfo.pDepthStencilState = &depthStencilState;
 
@@ -653,252 +858,586 @@ class HeadlessRenderer {
       CHECK_VK_SUCCESS(vkCreateGraphicsPipelines(device_, pipelineCache_, 1, &pipeInfo, nullptr, &pipeline_));
     }
 
-    // Create command buffer
+    // create readback buffers, they stay mapped for the lifetime of the renderer
     {
-      auto t1 = std::chrono::high_resolution_clock::now();
-      VkCommandBuffer cmdBuffer;
+      const VkDeviceSize texelCount = (VkDeviceSize)width_ * height_;
+      imageStride_ = 0;
+      if (outputs_ & OUTPUT_COLOR_BIT) {
+        colorOffset_ = imageStride_;
+        imageStride_ += texelCount * 4;
+      }
+      if (outputs_ & OUTPUT_DEPTH_BIT) {
+        depthOffset_ = imageStride_;
+        imageStride_ += texelCount * getDepthTexelSize();
+        metricDepth_.resize(texelCount);
+      }
+      // depth copies need 4 byte aligned buffer offsets
+      imageStride_ = (imageStride_ + 15) & ~(VkDeviceSize)15;
+    }
+    for (auto &slot : slots_) {
+      createBuffer(nullptr,
+                   imageStride_ * maxBatchSize_,
+                   VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                   &slot.readbackBuffer,
+                   &slot.readbackMemory);
+      CHECK_VK_SUCCESS(vkMapMemory(device_, slot.readbackMemory, 0, VK_WHOLE_SIZE, 0, (void **)&slot.readbackData));
+    }
+
+    // create per slot command buffers and fences, they are reused by every submission
+    {
+      std::vector<VkCommandBuffer> cmdBuffers(slots_.size());
       VkCommandBufferAllocateInfo cmdBufferAllocateInfo{};
       cmdBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-      cmdBufferAllocateInfo.commandBufferCount = 1;
+      cmdBufferAllocateInfo.commandBufferCount = cmdBuffers.size();
       cmdBufferAllocateInfo.commandPool = commandPool_;
       cmdBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-      CHECK_VK_SUCCESS(vkAllocateCommandBuffers(device_, &cmdBufferAllocateInfo, &cmdBuffer));
+      CHECK_VK_SUCCESS(vkAllocateCommandBuffers(device_, &cmdBufferAllocateInfo, cmdBuffers.data()));
+
+      VkFenceCreateInfo fenceInfo{};
+      fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+      for (size_t i = 0; i < slots_.size(); ++i) {
+        slots_[i].cmdBuffer = cmdBuffers[i];
+        CHECK_VK_SUCCESS(vkCreateFence(device_, &fenceInfo, nullptr, &slots_[i].fence));
+      }
+    }
+  }
 
-      VkCommandBufferBeginInfo cmdBufferBeginInfo{};
-      cmdBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-      CHECK_VK_SUCCESS(vkBeginCommandBuffer(cmdBuffer, &cmdBufferBeginInfo));
+  // record and submit a one time command buffer, blocks until the device executed it
+  template<typename F>
+  void submitAndWait(F record) {
+    VkCommandBuffer cmdBuffer;
+    VkCommandBufferAllocateInfo cmdBufferAllocateInfo{};
+    cmdBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmdBufferAllocateInfo.commandBufferCount = 1;
+    cmdBufferAllocateInfo.commandPool = commandPool_;
+    cmdBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    CHECK_VK_SUCCESS(vkAllocateCommandBuffers(device_, &cmdBufferAllocateInfo, &cmdBuffer));
+
+    VkCommandBufferBeginInfo cmdBufferBeginInfo{};
+    cmdBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmdBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    CHECK_VK_SUCCESS(vkBeginCommandBuffer(cmdBuffer, &cmdBufferBeginInfo));
+    record(cmdBuffer);
+    CHECK_VK_SUCCESS(vkEndCommandBuffer(cmdBuffer));
+
+    VkFence fence;
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    CHECK_VK_SUCCESS(vkCreateFence(device_, &fenceInfo, nullptr, &fence));
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &cmdBuffer;
+    CHECK_VK_SUCCESS(vkQueueSubmit(queue_, 1, &submitInfo, fence));
+    CHECK_VK_SUCCESS(vkWaitForFences(device_, 1, &fence, VK_TRUE, UINT64_MAX));
+    vkDestroyFence(device_, fence, nullptr);
+    vkFreeCommandBuffers(device_, commandPool_, 1, &cmdBuffer);
+  }
 
+  // a piece of host memory to upload
+  struct HostSpan {
+    const void *data;
+    VkDeviceSize size;
+  };
+
+  // append spans to a device local buffer through one staging buffer, the spans are copied straight from their
+  // source (e.g. a mapped .bmesh) into the staging memory, the buffer grows (keeping its content) when it is too small
+  void appendDeviceLocal(const std::vector<HostSpan> &spans, VkBufferUsageFlags usage, GrowableBuffer *pBuffer) {
+    VkDeviceSize size = 0;
+    for (const auto &span : spans) {
+      size += span.size;
+    }
+    if (size == 0) {
+      return;
+    }
+    usage |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    VkBuffer oldBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory oldMemory = VK_NULL_HANDLE;
+    if (pBuffer->size + size > pBuffer->capacity) {
+      oldBuffer = pBuffer->buffer;
+      oldMemory = pBuffer->memory;
+      pBuffer->capacity = std::max<VkDeviceSize>(pBuffer->size + size, pBuffer->capacity * 2);
+      createBuffer(nullptr, pBuffer->capacity, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &pBuffer->buffer, &pBuffer->memory);
+    }
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingMemory;
+    createBuffer(nullptr, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingMemory);
+    uint8_t *mapped;
+    CHECK_VK_SUCCESS(vkMapMemory(device_, stagingMemory, 0, size, 0, (void **)&mapped));
+    for (const auto &span : spans) {
+      memcpy(mapped, span.data, span.size);
+      mapped += span.size;
+    }
+    vkUnmapMemory(device_, stagingMemory);
+
+    const VkDeviceSize offset = pBuffer->size;
+    const VkBuffer dstBuffer = pBuffer->buffer;
+    submitAndWait([&](VkCommandBuffer cmdBuffer) {
+      if (oldBuffer != VK_NULL_HANDLE && offset > 0) {
+        VkBufferCopy keep{0, 0, offset};
+        vkCmdCopyBuffer(cmdBuffer, oldBuffer, dstBuffer, 1, &keep);
+      }
+      VkBufferCopy append{0, offset, size};
+      vkCmdCopyBuffer(cmdBuffer, stagingBuffer, dstBuffer, 1, &append);
+    });
+    pBuffer->size += size;
+
+    vkDestroyBuffer(device_, stagingBuffer, nullptr);
+    vkFreeMemory(device_, stagingMemory, nullptr);
+    if (oldBuffer != VK_NULL_HANDLE) {
+      vkDestroyBuffer(device_, oldBuffer, nullptr);
+      vkFreeMemory(device_, oldMemory, nullptr);
+    }
+  }
+
+  void destroyGrowableBuffer(GrowableBuffer *pBuffer) {
+    if (pBuffer->buffer != VK_NULL_HANDLE) {
+      vkDestroyBuffer(device_, pBuffer->buffer, nullptr);
+      vkFreeMemory(device_, pBuffer->memory, nullptr);
+    }
+    *pBuffer = GrowableBuffer();
+  }
+
+  // upload the meshes added to the library since the last call, existing meshes keep their offsets
+  // must not be called while renderBatch() is running
+  void uploadMeshes(const MeshLibrary &library) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    std::vector<HostSpan> positions;
+    std::vector<HostSpan> indices16;
+    std::vector<HostSpan> indices32;
+    for (size_t i = meshes_.size(); i < library.meshes().size(); ++i) {
+      const MeshLibrary::Mesh &mesh = library.meshes()[i];
+      positions.push_back({mesh.positions, (VkDeviceSize)mesh.vertexCount * 3 * sizeof(float)});
+      if (mesh.index32) {
+        indices32.push_back({mesh.indices, (VkDeviceSize)mesh.indexCount * sizeof(uint32_t)});
+      } else {
+        indices16.push_back({mesh.indices, (VkDeviceSize)mesh.indexCount * sizeof(uint16_t)});
+      }
+      meshes_.push_back({mesh.firstIndex, mesh.indexCount, mesh.vertexOffset, mesh.index32});
+    }
+    appendDeviceLocal(positions, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, &positions_);
+    appendDeviceLocal(indices16, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, &indices16_);
+    appendDeviceLocal(indices32, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, &indices32_);
+    auto t2 = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+    std::cout << "upload " << meshes_.size() << " meshes (" << positions_.size << " vertex bytes, " << indices16_.size + indices32_.size
+              << " index bytes) cost " << duration << " us\n";
+  }
+
+  // copy data into a host visible buffer, the buffer is recreated when it is too small
+  void updateHostBuffer(const void *pData, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer *pBuffer, VkDeviceMemory *pMemory, VkDeviceSize *pCapacity) {
+    if (size > *pCapacity) {
+      if (*pBuffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device_, *pBuffer, nullptr);
+        vkFreeMemory(device_, *pMemory, nullptr);
+      }
+      *pCapacity = std::max<VkDeviceSize>(size, *pCapacity * 2);
+      createBuffer(nullptr, *pCapacity, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, pBuffer, pMemory);
+    }
+    void *mapped;
+    CHECK_VK_SUCCESS(vkMapMemory(device_, *pMemory, 0, size, 0, &mapped));
+    memcpy(mapped, pData, size);
+    vkUnmapMemory(device_, *pMemory);
+  }
+
+  // objects are grouped by mesh, in the instanced modes each group becomes one indirect draw with firstInstance
+  // pointing at its model matrices, must not be called while renderBatch() is running
+  void setObjects(const std::vector<SceneObject> &objects) {
+    objects_ = objects;
+    for (const auto &object : objects_) {
+      if (object.mesh >= meshes_.size()) {
+        throw std::runtime_error("scene object references an unknown mesh");
+      }
+    }
+    // group by index type first, so each index buffer is bound once
+    std::stable_sort(objects_.begin(), objects_.end(), [this](const SceneObject &a, const SceneObject &b) {
+      const bool a32 = meshes_[a.mesh].index32;
+      const bool b32 = meshes_[b.mesh].index32;
+      return a32 != b32 ? b32 : a.mesh < b.mesh;
+    });
+    drawCommands_.clear();
+    drawCommandCount16_ = 0;
+    sceneVersion_++;
+    if (drawMode_ == DRAW_PER_OBJECT || objects_.empty()) {
+      return;
+    }
+
+    std::vector<glm::mat4> models(objects_.size());
+    for (uint32_t i = 0; i < objects_.size(); ++i) {
+      models[i] = objects_[i].model;
+      if (i == 0 || objects_[i].mesh != objects_[i - 1].mesh) {
+        const MeshRange &range = meshes_[objects_[i].mesh];
+        VkDrawIndexedIndirectCommand command{};
+        command.indexCount = range.indexCount;
+        command.firstIndex = range.firstIndex;
+        command.vertexOffset = range.vertexOffset;
+        command.firstInstance = i;
+        drawCommands_.push_back(command);
+        if (!range.index32) {
+          drawCommandCount16_++;
+        }
+      }
+      drawCommands_.back().instanceCount++;
+    }
+
+    updateHostBuffer(models.data(), models.size() * sizeof(glm::mat4), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                     &instanceBuffer_, &instanceMemory_, &instanceCapacity_);
+    updateHostBuffer(drawCommands_.data(), drawCommands_.size() * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                     &indirectBuffer_, &indirectMemory_, &indirectCapacity_);
+
+    // always written, a recreated buffer may get the handle of the destroyed one back so comparing handles is not enough
+    writeDescriptorSet();
+  }
+
+  // write every binding of descriptorSet_ whose buffer exists, this invalidates the recorded slots, which
+  // are recorded again because setObjects() bumped sceneVersion_
+  void writeDescriptorSet() {
+    std::array<VkDescriptorBufferInfo, 2> bufferInfos{};
+    std::array<VkWriteDescriptorSet, 2> writes{};
+    uint32_t writeCount = 0;
+    const VkBuffer buffers[2] = {instanceBuffer_, cameraBuffer_};
+    for (uint32_t binding = 0; binding < 2; ++binding) {
+      if (buffers[binding] == VK_NULL_HANDLE) {
+        continue;
+      }
+      bufferInfos[writeCount] = {buffers[binding], 0, VK_WHOLE_SIZE};
+      VkWriteDescriptorSet &write = writes[writeCount];
+      write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      write.dstSet = descriptorSet_;
+      write.dstBinding = binding;
+      write.descriptorCount = 1;
+      write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      write.pBufferInfo = &bufferInfos[writeCount];
+      writeCount++;
+    }
+    vkUpdateDescriptorSets(device_, writeCount, writes.data(), 0, nullptr);
+  }
+
+  void bindIndexBuffer(VkCommandBuffer cmdBuffer, bool index32) {
+    vkCmdBindIndexBuffer(cmdBuffer, index32 ? indices32_.buffer : indices16_.buffer, 0, index32 ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16);
+  }
+
+  // draw commandCount commands of drawCommands_ starting at firstCommand, they all use the same index type
+  void recordInstancedDraws(VkCommandBuffer cmdBuffer, uint32_t firstCommand, uint32_t commandCount) {
+    if (commandCount == 0) {
+      return;
+    }
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    if (!drawIndirectFirstInstance_) {
+      // indirect draws need drawIndirectFirstInstance to address the model matrices of each mesh
+      for (uint32_t j = firstCommand; j < firstCommand + commandCount; ++j) {
+        const VkDrawIndexedIndirectCommand &command = drawCommands_[j];
+        vkCmdDrawIndexed(cmdBuffer, command.indexCount, command.instanceCount, command.firstIndex, command.vertexOffset, command.firstInstance);
+      }
+    } else if (multiDrawIndirect_) {
+      vkCmdDrawIndexedIndirect(cmdBuffer, indirectBuffer_, firstCommand * stride, commandCount, stride);
+    } else {
+      for (uint32_t j = firstCommand; j < firstCommand + commandCount; ++j) {
+        vkCmdDrawIndexedIndirect(cmdBuffer, indirectBuffer_, j * stride, 1, stride);
+      }
+    }
+  }
+
+  // size of one texel of the depth aspect in a buffer copy
+  uint32_t getDepthTexelSize() {
+    return depthFormat_ == VK_FORMAT_D16_UNORM || depthFormat_ == VK_FORMAT_D16_UNORM_S8_UINT ? 2 : 4;
+  }
+
+  // unpack the copied depth aspect and undo the depth encoding of the projection mode
+  void convertDepth(const uint8_t *src, const CameraIntrinsics &intrinsics, float *dst) {
+    const size_t count = (size_t)width_ * height_;
+    if (projection_ == PROJECTION_PERSPECTIVE_REVERSED_Z) {
+      // invert z_ndc = b / z + a, the attachment is cleared to 0.0 (infinitely far)
+      const float n = intrinsics.near_z;
+      const float f = intrinsics.far_z;
+      const float a = -n / (f - n);
+      const float b = n * f / (f - n);
+      const float *depth = (const float *)src;
+      for (size_t i = 0; i < count; ++i) {
+        dst[i] = depth[i] > 0.0f ? b / (depth[i] - a) : 0.0f;
+      }
+      return;
+    }
+    // triangle.vert writes pView.z / far_z
+    const float farZ = intrinsics.far_z;
+    for (size_t i = 0; i < count; ++i) {
+      float d;
+      switch (depthFormat_) {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_D16_UNORM_S8_UINT:d = ((const uint16_t *)src)[i] / 65535.0f;
+          break;
+        case VK_FORMAT_D24_UNORM_S8_UINT:d = (((const uint32_t *)src)[i] & 0x00ffffff) / 16777215.0f;
+          break;
+        default:d = ((const float *)src)[i];
+      }
+      // the depth attachment is cleared to 1.0, so anything at the far plane is background
+      dst[i] = d < 1.0f ? d * farZ : 0.0f;
+    }
+  }
+
+  // wait for the submission of a slot and hand its images to the callback, the slot can be reused afterwards
+  void drainSlot(FrameSlot &slot, const ResultCallback &callback) {
+    if (!slot.pending) {
+      return;
+    }
+    {
+      // the wait time per slot goes to the trace (--trace) instead of stdout
+      vks::trace::Scope scope("Wait for slot", "sync", std::to_string(slot.imageCount) + " images");
+      CHECK_VK_SUCCESS(vkWaitForFences(device_, 1, &slot.fence, VK_TRUE, UINT64_MAX));
+    }
+    CHECK_VK_SUCCESS(vkResetFences(device_, 1, &slot.fence));
+
+    VKS_TRACE_SCOPE("Hand out images");
+    for (uint32_t i = 0; i < slot.imageCount; ++i) {
+      const uint8_t *image = slot.readbackData + imageStride_ * i;
+      RenderResult result{};
+      result.index = slot.firstImage + i;
+      result.width = width_;
+      result.height = height_;
+      if (outputs_ & OUTPUT_COLOR_BIT) {
+        result.color = image + colorOffset_;
+      }
+      if (outputs_ & OUTPUT_DEPTH_BIT) {
+        convertDepth(image + depthOffset_, slot.intrinsics, metricDepth_.data());
+        result.depth = metricDepth_.data();
+      }
+      callback(result);
+    }
+    slot.pending = false;
+  }
+
+  // record the draws and readback copies of count images into the command buffer of a slot
+  // views and constants are ignored in recorded mode, where the images use cameras cameraBase..cameraBase + count - 1
+  void recordSlot(FrameSlot &slot, uint32_t count, const glm::mat4 *views, MeshPushConstants constants, uint32_t cameraBase) {
+    VKS_TRACE_SCOPE("Record slot");
+    const float clearDepth = projection_ == PROJECTION_PERSPECTIVE_REVERSED_Z ? 0.0f : 1.0f;
+    VkCommandBuffer cmdBuffer = slot.cmdBuffer;
+    CHECK_VK_SUCCESS(vkResetCommandBuffer(cmdBuffer, 0));
+    VkCommandBufferBeginInfo cmdBufferBeginInfo{};
+    cmdBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmdBufferBeginInfo.flags = drawMode_ == DRAW_RECORDED ? 0 : VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    CHECK_VK_SUCCESS(vkBeginCommandBuffer(cmdBuffer, &cmdBufferBeginInfo));
+
+    for (uint32_t i = 0; i < count; ++i) {
       VkClearValue clearValues[2];
       clearValues[0].color = {{0.0f, 0.0f, 0.2f, 1.0f}};
-      clearValues[1].depthStencil = {1.0f, 0};
+      clearValues[1].depthStencil = {clearDepth, 0};
       VkRenderPassBeginInfo renderPassBegin{};
       renderPassBegin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
       renderPassBegin.renderPass = renderpass_;
-      renderPassBegin.framebuffer = framebuffer_;
-      renderPassBegin.renderArea.extent.width = width;
-      renderPassBegin.renderArea.extent.height = height;
+      renderPassBegin.framebuffer = slot.framebuffer;
+      renderPassBegin.renderArea.extent.width = width_;
+      renderPassBegin.renderArea.extent.height = height_;
       renderPassBegin.clearValueCount = 2;
       renderPassBegin.pClearValues = clearValues;
       vkCmdBeginRenderPass(cmdBuffer, &renderPassBegin, VK_SUBPASS_CONTENTS_INLINE);
 
-      VkViewport viewport;
-      viewport.width = (float)width;
-      viewport.height = (float)height;
+      VkViewport viewport{};
+      viewport.width = (float)width_;
+      viewport.height = (float)height_;
       viewport.minDepth = (float)0.0f;
       viewport.maxDepth = (float)1.0f;
       vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
 
       VkRect2D scissor{};
-      scissor.extent.width = width;
-      scissor.extent.height = height;
+      scissor.extent.width = width_;
+      scissor.extent.height = height_;
       vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
 
       vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_);
 
-      VkDeviceSize offsets[1] = {0};
-      vkCmdBindVertexBuffers(cmdBuffer, 0, 1, &vertexBuffer_, offsets);
-
-      vkCmdBindIndexBuffer(cmdBuffer, indexBuffer_, 0, VK_INDEX_TYPE_UINT32);
-
-      std::vector<glm::vec3> pos = {
-          glm::vec3(-0.6f, 0.0f, 0.0f),
-          glm::vec3(-0.3f, 0.0f, 0.0f),
-          glm::vec3(0.0f, 0.0f, 0.0f),
-          glm::vec3(0.3f, 0.0f, 0.0f),
-          glm::vec3(0.6f, 0.0f, 0.0f),
-          glm::vec3(-0.6f, 0.3f, 0.0f),
-          glm::vec3(-0.3f, 0.3f, 0.0f),
-          glm::vec3(0.0f, 0.3f, 0.0f),
-          glm::vec3(0.3f, 0.3f, 0.0f),
-          glm::vec3(0.6f, 0.3f, 0.0f),
-          glm::vec3(-0.6f, -0.3f, 0.0f),
-          glm::vec3(-0.3f, -0.3f, 0.0f),
-          glm::vec3(0.0f, -0.3f, 0.0f),
-          glm::vec3(0.3f, -0.3f, 0.0f),
-          glm::vec3(0.6f, -0.3f, 0.0f),
-      };
-
-      glm::mat4 view = glm::mat4(1);
-      view[1][1] = -1;
-      view[2][2] = -1;
-      view[3][2] = 2;
-
-      glm::mat4 K = glm::mat4(1);
-      K[0][0] = 2413;
-      K[1][1] = 2413;
-      K[3][0] = 2048 / 2;
-      K[3][1] = 1536 / 2;
-
-      glm::mat4 img2ndc = glm::mat4(1);
-      img2ndc[0][0] = 2.0f / 2048.0f;
-      img2ndc[1][1] = 2.0f / 1536.0f;
-      img2ndc[3][0] = -1.0f;
-      img2ndc[3][1] = -1.0f;
-
-      MeshPushConstants constants;
-      constants.proj = img2ndc * K;
-      constants.far_z = 4.0f;
-
-      for (auto v: pos) {
-        constants.model_view = glm::inverse(view) * glm::translate(glm::mat4(1.0f), v);
-        vkCmdPushConstants(cmdBuffer, pipelineLayout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants), &constants);
-        vkCmdDrawIndexed(cmdBuffer, indices.size(), 1, 0, 0, 0);
+      VkBuffer vertexBuffers[2] = {positions_.buffer, colorBuffer_};
+      VkDeviceSize offsets[2] = {0, 0};
+      vkCmdBindVertexBuffers(cmdBuffer, 0, 2, vertexBuffers, offsets);
+
+      if (drawMode_ != DRAW_PER_OBJECT) {
+        if (drawMode_ == DRAW_RECORDED) {
+          // recorded.vert reads view and projection from the camera buffer, only its index is baked in
+          const uint32_t camera = cameraBase + i;
+          vkCmdPushConstants(cmdBuffer, pipelineLayout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(camera), &camera);
+        } else {
+          // model_view only holds the view, instanced.vert applies the model matrix of gl_InstanceIndex
+          constants.model_view = views[i];
+          vkCmdPushConstants(cmdBuffer, pipelineLayout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants), &constants);
+        }
+        vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout_, 0, 1, &descriptorSet_, 0, nullptr);
+        if (drawCommandCount16_ > 0) {
+          bindIndexBuffer(cmdBuffer, false);
+          recordInstancedDraws(cmdBuffer, 0, drawCommandCount16_);
+        }
+        if (drawCommands_.size() > drawCommandCount16_) {
+          bindIndexBuffer(cmdBuffer, true);
+          recordInstancedDraws(cmdBuffer, drawCommandCount16_, drawCommands_.size() - drawCommandCount16_);
+        }
+      } else {
+        // objects are sorted by index type, so this rebinds at most twice
+        int boundIndex32 = -1;
+        for (const auto &object : objects_) {
+          const MeshRange &range = meshes_[object.mesh];
+          if (boundIndex32 != (int)range.index32) {
+            bindIndexBuffer(cmdBuffer, range.index32);
+            boundIndex32 = range.index32;
+          }
+          constants.model_view = views[i] * object.model;
+          vkCmdPushConstants(cmdBuffer, pipelineLayout_, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants), &constants);
+          vkCmdDrawIndexed(cmdBuffer, range.indexCount, 1, range.firstIndex, range.vertexOffset, 0);
+        }
       }
 
       vkCmdEndRenderPass(cmdBuffer);
 
-      CHECK_VK_SUCCESS(vkEndCommandBuffer(cmdBuffer));
-
-      VkSubmitInfo submitInfo{};
-      submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-      submitInfo.commandBufferCount = 1;
-      submitInfo.pCommandBuffers = &cmdBuffer;
-      vkQueueSubmit(queue_, 1, &submitInfo, VK_NULL_HANDLE);
-      vkDeviceWaitIdle(device_);
-
-      auto t2 = std::chrono::high_resolution_clock::now();
-      auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
-      std::cout << "render cost " << duration << " us\n";
+      // both attachments are already in TRANSFER_SRC_OPTIMAL, copy them tightly packed into their place in the readback buffer
+      VkBufferImageCopy copyRegion{};
+      copyRegion.imageSubresource.layerCount = 1;
+      copyRegion.imageExtent.width = width_;
+      copyRegion.imageExtent.height = height_;
+      copyRegion.imageExtent.depth = 1;
+      if (outputs_ & OUTPUT_COLOR_BIT) {
+        copyRegion.bufferOffset = imageStride_ * i + colorOffset_;
+        copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        vkCmdCopyImageToBuffer(cmdBuffer, slot.color, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.readbackBuffer, 1, &copyRegion);
+      }
+      if (outputs_ & OUTPUT_DEPTH_BIT) {
+        copyRegion.bufferOffset = imageStride_ * i + depthOffset_;
+        copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+        vkCmdCopyImageToBuffer(cmdBuffer, slot.depth, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.readbackBuffer, 1, &copyRegion);
+      }
     }
 
-    // copy image to host
-    VkImage dstImage;
-    VkDeviceMemory dstImageMemory;
-    VkImageView dstImageView;
-    {
-      create2DImage(width, height,
-                    colorFormat_,
-                    VK_IMAGE_TILING_LINEAR,
-                    VK_IMAGE_USAGE_TRANSFER_DST_BIT,
-                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                    &dstImage,
-                    &dstImageMemory,
-                    &dstImageView);
-
-      VkCommandBuffer cmdBuffer;
-      VkCommandBufferAllocateInfo cmdBufferAllocateInfo{};
-      cmdBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-      cmdBufferAllocateInfo.commandBufferCount = 1;
-      cmdBufferAllocateInfo.commandPool = commandPool_;
-      cmdBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-      CHECK_VK_SUCCESS(vkAllocateCommandBuffers(device_, &cmdBufferAllocateInfo, &cmdBuffer));
-
-      VkCommandBufferBeginInfo cmdBufferBeginInfo{};
-      cmdBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-      CHECK_VK_SUCCESS(vkBeginCommandBuffer(cmdBuffer, &cmdBufferBeginInfo));
-
-      // destination image layout to TRANSFER_DST_OPTIMAL
-      VkImageMemoryBarrier imageBarrier{};
-      imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-      imageBarrier.srcAccessMask = 0;
-      imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-      imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-      imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-      imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-      imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-      imageBarrier.image = dstImage;
-      imageBarrier.subresourceRange = VkImageSubresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
-      vkCmdPipelineBarrier(cmdBuffer,
-                           VK_PIPELINE_STAGE_TRANSFER_BIT,
-                           VK_PIPELINE_STAGE_TRANSFER_BIT,
-                           0,
-                           0, nullptr,
-                           0, nullptr,
-                           1, &imageBarrier);
-
-      // source image layout is already TRANSFER_SRC_OPTIMAL
-
-      VkImageCopy copyRegion{};
-      copyRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-      copyRegion.srcSubresource.layerCount = 1;
-      copyRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-      copyRegion.dstSubresource.layerCount = 1;
-      copyRegion.extent.width = width;
-      copyRegion.extent.height = height;
-      copyRegion.extent.depth = 1;
-      vkCmdCopyImage(cmdBuffer, color_, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                     dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                     1, &copyRegion);
-
-      // destination image to general layout
-      imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-      imageBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-      imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-      imageBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
-      imageBarrier.image = dstImage;
-      imageBarrier.subresourceRange = VkImageSubresourceRange{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
-      vkCmdPipelineBarrier(cmdBuffer,
-                           VK_PIPELINE_STAGE_TRANSFER_BIT,
-                           VK_PIPELINE_STAGE_TRANSFER_BIT,
-                           0,
-                           0, nullptr,
-                           0, nullptr,
-                           1, &imageBarrier);
-
-
-      CHECK_VK_SUCCESS(vkEndCommandBuffer(cmdBuffer));
-
-      auto t1 = std::chrono::high_resolution_clock::now();
+    // make the copies visible to the host
+    VkMemoryBarrier memoryBarrier{};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cmdBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT,
+                         0,
+                         1, &memoryBarrier,
+                         0, nullptr,
+                         0, nullptr);
+
+    CHECK_VK_SUCCESS(vkEndCommandBuffer(cmdBuffer));
+  }
+
+  // render one image per camera pose (camera to world), poses are split into submissions of at most maxBatchSize_ images
+  // which are spread over the slot ring, callbacks are issued in pose order and all of them before returning
+  // in recorded mode a slot is only recorded again when the scene or its image count changed
+  void renderBatch(const std::vector<glm::mat4> &poses, const CameraIntrinsics &intrinsics, const ResultCallback &callback) {
+    glm::mat4 K = glm::mat4(1);
+    K[0][0] = intrinsics.fx;
+    K[1][1] = intrinsics.fy;
+    K[3][0] = intrinsics.cx;
+    K[3][1] = intrinsics.cy;
+
+    glm::mat4 img2ndc = glm::mat4(1);
+    img2ndc[0][0] = 2.0f / (float)width_;
+    img2ndc[1][1] = 2.0f / (float)height_;
+    img2ndc[3][0] = -1.0f;
+    img2ndc[3][1] = -1.0f;
+
+    MeshPushConstants constants;
+    constants.proj = projection_ == PROJECTION_PERSPECTIVE_REVERSED_Z ? perspectiveFromIntrinsics(intrinsics, width_, height_) : img2ndc * K;
+    constants.far_z = intrinsics.far_z;
+
+    std::vector<glm::mat4> views(maxBatchSize_);
+    for (size_t first = 0; first < poses.size(); first += maxBatchSize_) {
+      const uint32_t count = (uint32_t)std::min<size_t>(maxBatchSize_, poses.size() - first);
+
+      // the oldest submission occupies the next slot, consume it before recording over it
+      const uint32_t slotIndex = nextSlot_;
+      FrameSlot &slot = slots_[slotIndex];
+      nextSlot_ = (nextSlot_ + 1) % slots_.size();
+      drainSlot(slot, callback);
+
+      for (uint32_t i = 0; i < count; ++i) {
+        views[i] = glm::inverse(poses[first + i]);
+      }
+      if (drawMode_ == DRAW_RECORDED) {
+        const uint32_t cameraBase = slotIndex * maxBatchSize_;
+        for (uint32_t i = 0; i < count; ++i) {
+          CameraData &camera = cameraData_[cameraBase + i];
+          camera.view = views[i];
+          camera.proj = constants.proj;
+          camera.far_z = constants.far_z;
+        }
+        if (slot.recordedImageCount != count || slot.recordedSceneVersion != sceneVersion_) {
+          recordSlot(slot, count, nullptr, constants, cameraBase);
+          slot.recordedImageCount = count;
+          slot.recordedSceneVersion = sceneVersion_;
+        }
+      } else {
+        recordSlot(slot, count, views.data(), constants, 0);
+      }
 
       VkSubmitInfo submitInfo{};
       submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
       submitInfo.commandBufferCount = 1;
-      submitInfo.pCommandBuffers = &cmdBuffer;
-      vkQueueSubmit(queue_, 1, &submitInfo, VK_NULL_HANDLE);
-      vkDeviceWaitIdle(device_);
-
-      auto t2 = std::chrono::high_resolution_clock::now();
-      auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
-      std::cout << "copy to host cost " << duration << " us\n";
-    }
-
-    // save image
-    const char * imageData;
-    {
-      VkImageSubresource subResource{};
-      subResource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-      VkSubresourceLayout subResourceLayout{};
-      vkGetImageSubresourceLayout(device_, dstImage, &subResource, &subResourceLayout);
-
-      vkMapMemory(device_, dstImageMemory, 0, VK_WHOLE_SIZE, 0, (void**)&imageData);
-      imageData += subResourceLayout.offset;
-
-      const char *filename = "myheadless.ppm";
-      std::ofstream file(filename, std::ios::out | std::ios::binary);
-
-      // ppm header
-      file << "P6\n" << width << "\n" << height << "\n" << 255 << "\n";
-      for (int32_t y = 0; y < height; y++) {
-        auto *row = (unsigned int *) imageData;
-        for (int32_t x = 0; x < width; x++) {
-          file.write((char *) row, 3);
-          row++;
-        }
-        imageData += subResourceLayout.rowPitch;
+      submitInfo.pCommandBuffers = &slot.cmdBuffer;
+      {
+        VKS_TRACE_SCOPE_CATEGORY("Submit slot", "queue");
+        CHECK_VK_SUCCESS(vkQueueSubmit(queue_, 1, &submitInfo, slot.fence));
       }
-      file.close();
+      slot.pending = true;
+      slot.firstImage = (uint32_t)first;
+      slot.imageCount = count;
+      slot.intrinsics = intrinsics;
+    }
 
+    // consume the remaining submissions, starting with the oldest one
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      drainSlot(slots_[(nextSlot_ + i) % slots_.size()], callback);
     }
   }
 
   ~HeadlessRenderer() {
+    vkDeviceWaitIdle(device_);
+    for (auto &slot : slots_) {
+      vkDestroyFence(device_, slot.fence, nullptr);
+      vkFreeCommandBuffers(device_, commandPool_, 1, &slot.cmdBuffer);
+      vkUnmapMemory(device_, slot.readbackMemory);
+      vkDestroyBuffer(device_, slot.readbackBuffer, nullptr);
+      vkFreeMemory(device_, slot.readbackMemory, nullptr);
+      vkDestroyFramebuffer(device_, slot.framebuffer, nullptr);
+      vkDestroyImageView(device_, slot.colorView, nullptr);
+      vkDestroyImageView(device_, slot.depthView, nullptr);
+      vkDestroyImage(device_, slot.color, nullptr);
+      vkDestroyImage(device_, slot.depth, nullptr);
+      vkFreeMemory(device_, slot.colorMemory, nullptr);
+      vkFreeMemory(device_, slot.depthMemory, nullptr);
+    }
     vkDestroyPipeline(device_, pipeline_, nullptr);
+    vks::pipelinecache::save(device_, physicalDeviceProperties_, pipelineCache_, pipelineCacheFile_);
     vkDestroyPipelineCache(device_, pipelineCache_, nullptr);
     vkDestroyShaderModule(device_, shaderVertex_, nullptr);
     vkDestroyShaderModule(device_, shaderFragment_, nullptr);
     vkDestroyPipelineLayout(device_, pipelineLayout_, nullptr);
-    vkDestroyFramebuffer(device_, framebuffer_, nullptr);
+    if (instanceBuffer_ != VK_NULL_HANDLE) {
+      vkDestroyBuffer(device_, instanceBuffer_, nullptr);
+      vkFreeMemory(device_, instanceMemory_, nullptr);
+    }
+    if (indirectBuffer_ != VK_NULL_HANDLE) {
+      vkDestroyBuffer(device_, indirectBuffer_, nullptr);
+      vkFreeMemory(device_, indirectMemory_, nullptr);
+    }
+    if (cameraBuffer_ != VK_NULL_HANDLE) {
+      vkUnmapMemory(device_, cameraMemory_);
+      vkDestroyBuffer(device_, cameraBuffer_, nullptr);
+      vkFreeMemory(device_, cameraMemory_, nullptr);
+    }
+    if (descriptorPool_ != VK_NULL_HANDLE) {
+      vkDestroyDescriptorPool(device_, descriptorPool_, nullptr);
+      vkDestroyDescriptorSetLayout(device_, descriptorSetLayout_, nullptr);
+    }
     vkDestroyRenderPass(device_, renderpass_, nullptr);
-    vkFreeMemory(device_, vertexMemory_, nullptr);
-    vkFreeMemory(device_, indexMemory_, nullptr);
+    destroyGrowableBuffer(&positions_);
+    destroyGrowableBuffer(&indices16_);
+    destroyGrowableBuffer(&indices32_);
+    vkDestroyBuffer(device_, colorBuffer_, nullptr);
     vkFreeMemory(device_, colorMemory_, nullptr);
-    vkFreeMemory(device_, depthMemory_, nullptr);
-    vkDestroyImageView(device_, colorView_, nullptr);
-    vkDestroyImageView(device_, depthView_, nullptr);
-    vkDestroyImage(device_, color_, nullptr);
-    vkDestroyImage(device_, depth_, nullptr);
-    vkDestroyBuffer(device_, vertexBuffer_, nullptr);
-    vkDestroyBuffer(device_, indexBuffer_, nullptr);
     vkDestroyCommandPool(device_, commandPool_, nullptr);
     vkDestroyDevice(device_, nullptr);
     vkDestroyInstance(instance_, nullptr);
@@ -906,6 +1445,170 @@ class HeadlessRenderer {
 };
 
 int main(int argc, char **argv) {
-  HeadlessRenderer renderer;
+  std::vector<std::string> meshPaths;
+  bool printFormats = false;
+  RendererSettings settings;
+  ImageFileFormat colorFormat = IMAGE_FILE_PPM;
+  std::string colorExtension = ".ppm";
+  ImageFileFormat depthFormat = IMAGE_FILE_PFM;
+  std::string depthExtension = ".pfm";
+  uint32_t repeatCount = 1;
+  // two images per submission over a ring of three slots, so the four poses below keep two submissions in flight
+  settings.maxBatchSize = 2;
+  settings.ringSize = 3;
+  // offline conversion: myrenderheadless --convert <mesh> <out.bmesh> [--normals]
+  if (argc >= 4 && std::string(argv[1]) == "--convert") {
+    const bool withNormals = argc >= 5 && std::string(argv[4]) == "--normals";
+    MeshOptimizeStats stats;
+    try {
+      convertToMeshBlob(argv[2], argv[3], withNormals, &stats);
+    } catch (const std::exception &e) {
+      std::cerr << e.what() << "\n";
+      return 1;
+    }
+    std::cout << "vertices: " << stats.inputVertexCount << " -> " << stats.outputVertexCount
+              << ", ACMR (FIFO 16): " << stats.weldedMissRatio << " -> " << stats.optimizedMissRatio << "\n";
+    return 0;
+  }
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--formats") {
+      printFormats = true;
+    } else if (arg == "--depth") {
+      settings.outputs |= OUTPUT_DEPTH_BIT;
+    } else if (arg == "--depth-only") {
+      settings.outputs = OUTPUT_DEPTH_BIT;
+    } else if (arg == "--reversed-z") {
+      settings.projection = PROJECTION_PERSPECTIVE_REVERSED_Z;
+    } else if (arg == "--instanced") {
+      settings.drawMode = DRAW_INSTANCED;
+    } else if (arg == "--recorded") {
+      settings.drawMode = DRAW_RECORDED;
+    } else if (arg == "--trace" && i + 1 < argc) {
+      vks::trace::setThreadName("Main thread");
+      vks::trace::start(argv[++i]);
+    } else if (arg == "--pipeline-cache-dir" && i + 1 < argc) {
+      settings.pipelineCacheDir = argv[++i];
+    } else if (arg == "--repeat" && i + 1 < argc) {
+      repeatCount = std::max(std::stoi(argv[++i]), 1);
+    } else if (arg == "--color-format" && i + 1 < argc) {
+      std::string format = argv[++i];
+      if (format == "raw") {
+        colorFormat = IMAGE_FILE_RAW_RGB;
+        colorExtension = ".rgb";
+      } else if (format != "ppm") {
+        std::cerr << "unknown color format " << format << "\n";
+        return 1;
+      }
+    } else if (arg == "--depth-format" && i + 1 < argc) {
+      std::string format = argv[++i];
+      depthExtension = "." + format;
+      if (format == "exr") {
+        depthFormat = IMAGE_FILE_EXR;
+      } else if (format == "npy") {
+        depthFormat = IMAGE_FILE_NPY;
+      } else if (format == "png16") {
+        depthFormat = IMAGE_FILE_PNG16;
+        depthExtension = ".png";
+      } else if (format != "pfm") {
+        std::cerr << "unknown depth format " << format << "\n";
+        return 1;
+      }
+    } else {
+      meshPaths.push_back(arg);
+    }
+  }
+
+  // fail before any device setup if the shader for the selected mode has not been compiled
+  const std::string vertexShader = vertexShaderPath(settings.drawMode, settings.projection);
+  if (!std::ifstream(vertexShader).good()) {
+    std::cerr << vertexShader << " not found, compile the shaders with data/shaders/glsl/compileshaders.py\n";
+    return 1;
+  }
+
+  if (meshPaths.empty()) {
+    meshPaths.push_back("/home/shq/Data/DeepTote/20210915_169/00000003/model.stl");
+  }
+  // identical files map to the same mesh id
+  MeshLibrary library;
+  std::vector<uint32_t> meshIds;
+  for (const auto &path : meshPaths) {
+    try {
+      meshIds.push_back(library.load(path));
+    } catch (const std::exception &e) {
+      std::cerr << e.what() << "\n";
+      return 1;
+    }
+  }
+  HeadlessRenderer renderer(library, settings);
+  if (printFormats) {
+    renderer.printFormatCapabilities();
+  }
+
+  std::vector<glm::vec3> pos = {
+      glm::vec3(-0.6f, 0.0f, 0.0f),
+      glm::vec3(-0.3f, 0.0f, 0.0f),
+      glm::vec3(0.0f, 0.0f, 0.0f),
+      glm::vec3(0.3f, 0.0f, 0.0f),
+      glm::vec3(0.6f, 0.0f, 0.0f),
+      glm::vec3(-0.6f, 0.3f, 0.0f),
+      glm::vec3(-0.3f, 0.3f, 0.0f),
+      glm::vec3(0.0f, 0.3f, 0.0f),
+      glm::vec3(0.3f, 0.3f, 0.0f),
+      glm::vec3(0.6f, 0.3f, 0.0f),
+      glm::vec3(-0.6f, -0.3f, 0.0f),
+      glm::vec3(-0.3f, -0.3f, 0.0f),
+      glm::vec3(0.0f, -0.3f, 0.0f),
+      glm::vec3(0.3f, -0.3f, 0.0f),
+      glm::vec3(0.6f, -0.3f, 0.0f),
+  };
+  // cycle through the given meshes
+  std::vector<SceneObject> objects;
+  for (size_t i = 0; i < pos.size(); ++i) {
+    objects.push_back({meshIds[i % meshIds.size()], glm::translate(glm::mat4(1.0f), pos[i])});
+  }
+  renderer.setObjects(objects);
+
+  // camera 2 units above the objects looking down, plus a few shifted views
+  std::vector<glm::mat4> poses;
+  for (int i = 0; i < 4; ++i) {
+    glm::mat4 view = glm::mat4(1);
+    view[1][1] = -1;
+    view[2][2] = -1;
+    view[3][0] = 0.1f * i;
+    view[3][2] = 2;
+    poses.push_back(view);
+  }
+
+  CameraIntrinsics intrinsics{2413.0f, 2413.0f, 2048 / 2, 1536 / 2, 0.1f, 4.0f};
+
+  // encoding runs next to rendering, the render thread only copies each image into the writer's queue
+  const uint32_t workerCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+  ImageWriter writer(workerCount, workerCount * 2);
+  // repeated batches only change the camera poses, the recorded mode replays its command buffers for them
+  for (uint32_t repeat = 0; repeat < repeatCount; ++repeat) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    const size_t firstIndex = repeat * poses.size();
+    VKS_TRACE_SCOPE("Render batch");
+    renderer.renderBatch(poses, intrinsics, [&](const RenderResult &result) {
+      if (result.color) {
+        writer.writeColor("myheadless_" + std::to_string(firstIndex + result.index) + colorExtension, colorFormat, result.color, result.width, result.height);
+      }
+      if (result.depth) {
+        writer.writeDepth("myheadless_depth_" + std::to_string(firstIndex + result.index) + depthExtension, depthFormat, result.depth, result.width,
+                          result.height);
+      }
+    });
+    auto t2 = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+    std::cout << "render " << poses.size() << " images cost " << duration << " us\n";
+  }
+  try {
+    writer.wait();
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+  vks::trace::stop();
   return 0;
 }
@@ -16,7 +16,8 @@ class VulkanExample: public VulkanExampleBase
 public:
 	vkglTF::Model scene;
 
-	vks::Buffer uniformBuffer;
+	// One uniform buffer per frame in flight, so the CPU doesn't overwrite data the GPU still reads
+	std::vector<vks::Buffer> uniformBuffers;
 
 	// Same uniform buffer layout as shader
 	struct UBOVS {
@@ -26,7 +27,7 @@ public:
 	} uboVS;
 
 	VkPipelineLayout pipelineLayout;
-	VkDescriptorSet descriptorSet;
+	std::vector<VkDescriptorSet> descriptorSets;
 	VkDescriptorSetLayout descriptorSetLayout;
 
 	struct {
@@ -43,6 +44,7 @@ public:
 		camera.setRotation(glm::vec3(-25.0f, 15.0f, 0.0f));
 		camera.setRotationSpeed(0.5f);
 		camera.setPerspective(60.0f, (float)(width / 3.0f) / (float)height, 0.1f, 256.0f);
+		maxFramesInFlight = 2;
 	}
 
 	~VulkanExample()
@@ -59,7 +61,9 @@ public:
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
-		uniformBuffer.destroy();
+		for (auto& uniformBuffer : uniformBuffers) {
+			uniformBuffer.destroy();
+		}
 	}
 
 	// Enable physical device features required for this example
@@ -75,7 +79,8 @@ public:
 		};
 	}
 
-	void buildCommandBuffers()
+	// Records the command buffer of a swap chain image, it binds the descriptor set of the current frame in flight
+	void buildCommandBuffer(uint32_t index)
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
@@ -91,76 +96,84 @@ public:
 		renderPassBeginInfo.renderArea.extent.height = height;
 		renderPassBeginInfo.clearValueCount = 2;
 		renderPassBeginInfo.pClearValues = clearValues;
+		// Set target frame buffer
+		renderPassBeginInfo.framebuffer = frameBuffers[index];
 
-		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
-		{
-			// Set target frame buffer
-			renderPassBeginInfo.framebuffer = frameBuffers[i];
+		VkCommandBuffer cmdBuffer = drawCmdBuffers[index];
 
-			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+		VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuffer, &cmdBufInfo));
 
-			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBeginRenderPass(cmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
 
-			VkRect2D scissor = vks::initializers::rect2D(width, height,	0, 0);
-			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+		VkRect2D scissor = vks::initializers::rect2D(width, height,	0, 0);
+		vkCmdSetScissor(cmdBuffer, 0, 1, &scissor);
 
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, NULL);
-			scene.bindBuffers(drawCmdBuffers[i]);
+		vkCmdBindDescriptorSets(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, NULL);
+		scene.bindBuffers(cmdBuffer);
 
-			// Left : Solid colored
-			viewport.width = (float)width / 3.0;
-			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.phong);
-			scene.draw(drawCmdBuffers[i]);
+		// Left : Solid colored
+		viewport.width = (float)width / 3.0;
+		vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
+		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.phong);
+		scene.draw(cmdBuffer);
 
-			// Center : Toon
-			viewport.x = (float)width / 3.0;
-			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-			vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.toon);
-			// Line width > 1.0f only if wide lines feature is supported
-			if (deviceFeatures.wideLines) {
-				vkCmdSetLineWidth(drawCmdBuffers[i], 2.0f);
-			}
-			scene.draw(drawCmdBuffers[i]);
+		// Center : Toon
+		viewport.x = (float)width / 3.0;
+		vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
+		vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.toon);
+		// Line width > 1.0f only if wide lines feature is supported
+		if (deviceFeatures.wideLines) {
+			vkCmdSetLineWidth(cmdBuffer, 2.0f);
+		}
+		scene.draw(cmdBuffer);
 
-			if (deviceFeatures.fillModeNonSolid)
-			{
-				// Right : Wireframe
-				viewport.x = (float)width / 3.0 + (float)width / 3.0;
-				vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.wireframe);
-				scene.draw(drawCmdBuffers[i]);
-			}
+		if (deviceFeatures.fillModeNonSolid)
+		{
+			// Right : Wireframe
+			viewport.x = (float)width / 3.0 + (float)width / 3.0;
+			vkCmdSetViewport(cmdBuffer, 0, 1, &viewport);
+			vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.wireframe);
+			scene.draw(cmdBuffer);
+		}
+
+		drawUI(cmdBuffer);
 
-			drawUI(drawCmdBuffers[i]);
+		vkCmdEndRenderPass(cmdBuffer);
 
-			vkCmdEndRenderPass(drawCmdBuffers[i]);
+		VK_CHECK_RESULT(vkEndCommandBuffer(cmdBuffer));
+	}
 
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+	void buildCommandBuffers()
+	{
+		for (uint32_t i = 0; i < drawCmdBuffers.size(); ++i) {
+			buildCommandBuffer(i);
 		}
 	}
 
 	void loadAssets()
 	{
-		const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::FlipY;
+		// Only the components used by the shaders are stored, in quantized formats the shaders read unchanged
+		scene.vertexComponents = { vkglTF::VertexComponent::Position, vkglTF::VertexComponent::Normal, vkglTF::VertexComponent::Color };
+		const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::FlipY | vkglTF::FileLoadingFlags::QuantizeVertices;
 		scene.loadFromFile(getAssetPath() + "models/treasure_smooth.gltf", vulkanDevice, queue, glTFLoadingFlags);
 	}
 
 	void setupDescriptorPool()
 	{
+		// One ubo per frame in flight
 		std::vector<VkDescriptorPoolSize> poolSizes =
 		{
-			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1)
+			vks::initializers::descriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, static_cast<uint32_t>(uniformBuffers.size()))
 		};
 
 		VkDescriptorPoolCreateInfo descriptorPoolInfo =
 			vks::initializers::descriptorPoolCreateInfo(
 				poolSizes.size(),
 				poolSizes.data(),
-				2);
+				static_cast<uint32_t>(uniformBuffers.size()));
 
 		VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr, &descriptorPool));
 	}
@@ -199,19 +212,23 @@ public:
 				&descriptorSetLayout,
 				1);
 
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
-
-		std::vector<VkWriteDescriptorSet> writeDescriptorSets =
-		{
-			// Binding 0 : Vertex shader uniform buffer
-			vks::initializers::writeDescriptorSet(
-				descriptorSet,
-				VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-				0,
-				&uniformBuffer.descriptor)
-		};
+		// One descriptor set per frame in flight, each referencing that frame's uniform buffer
+		descriptorSets.resize(uniformBuffers.size());
+		for (size_t i = 0; i < descriptorSets.size(); i++) {
+			VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets[i]));
 
-		vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+			std::vector<VkWriteDescriptorSet> writeDescriptorSets =
+			{
+				// Binding 0 : Vertex shader uniform buffer
+				vks::initializers::writeDescriptorSet(
+					descriptorSets[i],
+					VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+					0,
+					&uniformBuffers[i].descriptor)
+			};
+
+			vkUpdateDescriptorSets(device, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+		}
 	}
 
 	void preparePipelines()
@@ -237,7 +254,7 @@ public:
 		pipelineCI.pDynamicState = &dynamicState;
 		pipelineCI.stageCount = shaderStages.size();
 		pipelineCI.pStages = shaderStages.data();
-		pipelineCI.pVertexInputState  = vkglTF::Vertex::getPipelineVertexInputState({vkglTF::VertexComponent::Position, vkglTF::VertexComponent::Normal, vkglTF::VertexComponent::Color});
+		pipelineCI.pVertexInputState  = scene.getPipelineVertexInputState({vkglTF::VertexComponent::Position, vkglTF::VertexComponent::Normal, vkglTF::VertexComponent::Color});
 
 		// Create the graphics pipeline state objects
 
@@ -280,30 +297,27 @@ public:
 	// Prepare and initialize uniform buffer containing shader uniforms
 	void prepareUniformBuffers()
 	{
-		// Create the vertex shader uniform buffer block
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			&uniformBuffer,
-			sizeof(uboVS)));
-
-		// Map persistent
-		VK_CHECK_RESULT(uniformBuffer.map());
-
+		// Vertex shader uniform buffer block, one copy per frame in flight
 		updateUniformBuffers();
+		createFrameUniformBuffers(uniformBuffers, sizeof(uboVS), &uboVS);
 	}
 
 	void updateUniformBuffers()
 	{
 		uboVS.projection = camera.matrices.perspective;
 		uboVS.modelView = camera.matrices.view;
-		memcpy(uniformBuffer.mapped, &uboVS, sizeof(uboVS));
+		// Copied into the uniform buffer of the current frame in flight in draw()
 	}
 
 	void draw()
 	{
 		VulkanExampleBase::prepareFrame();
 
+		// The uniform buffer and descriptor set of this frame in flight are no longer in use once prepareFrame returned
+		memcpy(uniformBuffers[currentFrame].mapped, &uboVS, sizeof(uboVS));
+		// The command buffer of the acquired image is re-recorded to bind the descriptor set of this frame
+		buildCommandBuffer(currentBuffer);
+
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
@@ -15,6 +15,8 @@
 
 #include <vulkan/vulkan.h>
 #include "VulkanTools.h"
+#include "VulkanPipelineCache.h"
+#include "trace.h"
 
 #define LOG(...) printf(__VA_ARGS__)
 
@@ -22,6 +24,7 @@ class VulkanExample {
  public:
   VkInstance instance;
   VkPhysicalDevice physicalDevice;
+  VkPhysicalDeviceProperties deviceProperties;
   VkDevice device;
   uint32_t queueFamilyIndex;
   VkPipelineCache pipelineCache;
@@ -91,6 +94,7 @@ class VulkanExample {
       Submit command buffer to a queue and wait for fence until queue operations have been finished
   */
   void submitWork(VkCommandBuffer cmdBuffer, VkQueue targetQueue) const {
+    VKS_TRACE_SCOPE_CATEGORY("Submit and wait", "queue");
     VkSubmitInfo submitInfo = vks::initializers::submitInfo();
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &cmdBuffer;
@@ -132,7 +136,6 @@ class VulkanExample {
     else
       throw std::runtime_error("no physical device supported");
 
-    VkPhysicalDeviceProperties deviceProperties;
     vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
     LOG("GPU: %s\n", deviceProperties.deviceName);
 
@@ -423,9 +426,7 @@ class VulkanExample {
 
       VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout));
 
-      VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
-      pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-      VK_CHECK_RESULT(vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache));
+      VK_CHECK_RESULT(vks::pipelinecache::create(device, deviceProperties, vks::pipelinecache::getFileName(deviceProperties, "", "renderheadless"), &pipelineCache));
 
       // Create pipeline
       VkPipelineInputAssemblyStateCreateInfo inputAssemblyState =
@@ -576,7 +577,10 @@ class VulkanExample {
       auto t1 = std::chrono::high_resolution_clock::now();
       submitWork(cmdBuffer, queue);
 
-      vkDeviceWaitIdle(device);
+      {
+        VKS_TRACE_SCOPE_CATEGORY("vkDeviceWaitIdle", "sync");
+        vkDeviceWaitIdle(device);
+      }
       auto t2 = std::chrono::high_resolution_clock::now();
       auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1);
       std::cout << "render cost " << duration.count() << " us\n";
@@ -687,6 +691,7 @@ class VulkanExample {
       */
 
       const char *filename = "headless.ppm";
+      VKS_TRACE_SCOPE("Save image");
       std::ofstream file(filename, std::ios::out | std::ios::binary);
 
       // ppm header
@@ -741,6 +746,7 @@ class VulkanExample {
     vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
     vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
     vkDestroyPipeline(device, pipeline, nullptr);
+    vks::pipelinecache::save(device, deviceProperties, pipelineCache, vks::pipelinecache::getFileName(deviceProperties, "", "renderheadless"));
     vkDestroyPipelineCache(device, pipelineCache, nullptr);
     vkDestroyCommandPool(device, commandPool, nullptr);
     for (auto shadermodule: shaderModules) {
@@ -751,8 +757,16 @@ class VulkanExample {
   }
 };
 
-int main() {
+int main(int argc, char **argv) {
+  // renderheadless --trace <file> records a Chrome trace of the run
+  for (int i = 1; i + 1 < argc; ++i) {
+    if (std::string(argv[i]) == "--trace") {
+      vks::trace::setThreadName("Main thread");
+      vks::trace::start(argv[i + 1]);
+    }
+  }
   auto *vulkanExample = new VulkanExample();
   delete (vulkanExample);
+  vks::trace::stop();
   return 0;
 }
\ No newline at end of file
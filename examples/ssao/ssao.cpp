@@ -29,6 +29,12 @@ public:
 
 	vkglTF::Model scene;
 
+	// The G-Buffer can be filled with indirect draws that fetch per-draw data and materials from storage buffers (requires descriptor indexing)
+	bool gpuDrivenSupported = false;
+	bool gpuDriven = false;
+	// Indirect draws are culled against the view frustum and the depth of the previous frame on the GPU
+	bool gpuCulling = true;
+
 	struct UBOSceneParams {
 		glm::mat4 projection;
 		glm::mat4 model;
@@ -46,6 +52,7 @@ public:
 
 	struct {
 		VkPipeline offscreen;
+		VkPipeline offscreenIndirect;
 		VkPipeline composition;
 		VkPipeline ssao;
 		VkPipeline ssaoBlur;
@@ -53,6 +60,7 @@ public:
 
 	struct {
 		VkPipelineLayout gBuffer;
+		VkPipelineLayout gBufferIndirect;
 		VkPipelineLayout ssao;
 		VkPipelineLayout ssaoBlur;
 		VkPipelineLayout composition;
@@ -121,6 +129,8 @@ public:
 	// One sampler for the frame buffer color attachments
 	VkSampler colorSampler;
 
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT physicalDeviceDescriptorIndexingFeatures{};
+
 	VulkanExample() : VulkanExampleBase(ENABLE_VALIDATION)
 	{
 		title = "Screen space ambient occlusion";
@@ -131,6 +141,8 @@ public:
 		camera.position = { 1.0f, 0.75f, 0.0f };
 		camera.setRotation(glm::vec3(0.0f, 90.0f, 0.0f));
 		camera.setPerspective(60.0f, (float)width / (float)height, uboSceneParams.nearPlane, uboSceneParams.farPlane);
+		// Required by VK_EXT_descriptor_indexing, which is only enabled if the device supports it
+		enabledInstanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 	}
 
 	~VulkanExample()
@@ -151,6 +163,10 @@ public:
 		frameBuffers.ssaoBlur.destroy(device);
 
 		vkDestroyPipeline(device, pipelines.offscreen, nullptr);
+		if (gpuDrivenSupported) {
+			vkDestroyPipeline(device, pipelines.offscreenIndirect, nullptr);
+			vkDestroyPipelineLayout(device, pipelineLayouts.gBufferIndirect, nullptr);
+		}
 		vkDestroyPipeline(device, pipelines.composition, nullptr);
 		vkDestroyPipeline(device, pipelines.ssao, nullptr);
 		vkDestroyPipeline(device, pipelines.ssaoBlur, nullptr);
@@ -176,6 +192,38 @@ public:
 	void getEnabledFeatures()
 	{
 		enabledFeatures.samplerAnisotropy = deviceFeatures.samplerAnisotropy;
+		// Multiple draws per indirect command and the draw index passed as the first instance, the model falls back to single draws otherwise
+		enabledFeatures.multiDrawIndirect = deviceFeatures.multiDrawIndirect;
+		enabledFeatures.drawIndirectFirstInstance = deviceFeatures.drawIndirectFirstInstance;
+
+		// The GPU driven path indexes an unsized texture array with the material's texture index
+		uint32_t extensionCount = 0;
+		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+		std::vector<VkExtensionProperties> extensions(extensionCount);
+		vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+		auto extensionSupported = [&](const char* name) {
+			for (const VkExtensionProperties& extension : extensions) {
+				if (strcmp(extension.extensionName, name) == 0) {
+					return true;
+				}
+			}
+			return false;
+		};
+		gpuDrivenSupported = extensionSupported(VK_KHR_MAINTENANCE3_EXTENSION_NAME) && extensionSupported(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+		if (gpuDrivenSupported) {
+			enabledDeviceExtensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+			enabledDeviceExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+			// Culled draws are compacted if the draw count can be read from a buffer, they're drawn with zero instances otherwise
+			if (extensionSupported(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+				enabledDeviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+			}
+			physicalDeviceDescriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+			physicalDeviceDescriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+			physicalDeviceDescriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+			physicalDeviceDescriptorIndexingFeatures.descriptorBindingVariableDescriptorCount = VK_TRUE;
+			deviceCreatepNextChain = &physicalDeviceDescriptorIndexingFeatures;
+			gpuDriven = true;
+		}
 	}
 
 	// Create a frame buffer attachment
@@ -265,6 +313,11 @@ public:
 		createAttachment(VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &frameBuffers.offscreen.albedo, width, height);			// Albedo (color)
 		createAttachment(attDepthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, &frameBuffers.offscreen.depth, width, height);			// Depth
 
+		// The depth pyramid for occlusion culling is built from the G-Buffer depth
+		if (gpuDrivenSupported) {
+			scene.setCullingDepth(frameBuffers.offscreen.depth.image, attDepthFormat, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, width, height);
+		}
+
 		// SSAO
 		createAttachment(VK_FORMAT_R8_UNORM, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, &frameBuffers.ssao.color, ssaoWidth, ssaoHeight);				// Color
 
@@ -312,21 +365,22 @@ public:
 			// Use subpass dependencies for attachment layout transitions
 			std::array<VkSubpassDependency, 2> dependencies;
 
+			// The depth attachment is also read by the compute shader building the depth pyramid
 			dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
 			dependencies[0].dstSubpass = 0;
-			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+			dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
 			dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-			dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 			dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
 			dependencies[1].srcSubpass = 0;
 			dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+			dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+			dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 			dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-			dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+			dependencies[1].dependencyFlags = 0;
 
 			VkRenderPassCreateInfo renderPassInfo = {};
 			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -489,6 +543,14 @@ public:
 		vkglTF::descriptorBindingFlags  = vkglTF::DescriptorBindingFlags::ImageBaseColor;
 		const uint32_t gltfLoadingFlags = vkglTF::FileLoadingFlags::FlipY | vkglTF::FileLoadingFlags::PreTransformVertices;
 		scene.loadFromFile(getAssetPath() + "models/sponza/sponza.gltf", vulkanDevice, queue, gltfLoadingFlags);
+		if (gpuDrivenSupported) {
+			scene.prepareIndirectDraws(queue);
+			scene.prepareCulling(
+				loadShader(getShadersPath() + "base/culling.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT),
+				loadShader(getShadersPath() + "base/depthreduce.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT),
+				queue,
+				pipelineCache);
+		}
 	}
 
 	void buildCommandBuffers()
@@ -524,6 +586,14 @@ public:
 					First pass: Fill G-Buffer components (positions+depth, normals, albedo) using MRT
 				*/
 
+				const bool culled = gpuDriven && gpuCulling;
+
+				// Each pass is timed separately, the queries need to be written outside of the render passes
+				if (culled) {
+					vks::GpuProfiler::Scope cullingScope(gpuProfiler, drawCmdBuffers[i], "Culling", i);
+					scene.recordCulling(drawCmdBuffers[i]);
+				}
+				uint32_t gpuScope = gpuProfiler.begin(drawCmdBuffers[i], "G-Buffer", i);
 				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 				VkViewport viewport = vks::initializers::viewport((float)frameBuffers.offscreen.width, (float)frameBuffers.offscreen.height, 0.0f, 1.0f);
@@ -532,12 +602,25 @@ public:
 				VkRect2D scissor = vks::initializers::rect2D(frameBuffers.offscreen.width, frameBuffers.offscreen.height, 0, 0);
 				vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.offscreen);
-
-				vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.gBuffer, 0, 1, &descriptorSets.floor, 0, NULL);
-				scene.draw(drawCmdBuffers[i], vkglTF::RenderFlags::BindImages, pipelineLayouts.gBuffer);
+				if (gpuDriven) {
+					// All primitives are drawn with one indirect draw per alpha mode, materials are fetched in the shaders
+					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.offscreenIndirect);
+					vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.gBufferIndirect, 0, 1, &descriptorSets.floor, 0, NULL);
+					scene.drawIndirect(drawCmdBuffers[i], culled ? vkglTF::RenderFlags::CulledDraws : 0, pipelineLayouts.gBufferIndirect, 1);
+				} else {
+					vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.offscreen);
+					vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts.gBuffer, 0, 1, &descriptorSets.floor, 0, NULL);
+					scene.draw(drawCmdBuffers[i], vkglTF::RenderFlags::BindImages, pipelineLayouts.gBuffer);
+				}
 
 				vkCmdEndRenderPass(drawCmdBuffers[i]);
+				gpuProfiler.end(drawCmdBuffers[i], gpuScope);
+
+				// Occlusion culling in the next frame tests against the depth of this one
+				if (culled) {
+					vks::GpuProfiler::Scope pyramidScope(gpuProfiler, drawCmdBuffers[i], "Depth pyramid", i);
+					scene.recordDepthPyramid(drawCmdBuffers[i]);
+				}
 
 				/*
 					Second pass: SSAO generation
@@ -553,6 +636,7 @@ public:
 				renderPassBeginInfo.clearValueCount = 2;
 				renderPassBeginInfo.pClearValues = clearValues.data();
 
+				gpuScope = gpuProfiler.begin(drawCmdBuffers[i], "SSAO", i);
 				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 				viewport = vks::initializers::viewport((float)frameBuffers.ssao.width, (float)frameBuffers.ssao.height, 0.0f, 1.0f);
@@ -565,6 +649,7 @@ public:
 				vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
 
 				vkCmdEndRenderPass(drawCmdBuffers[i]);
+				gpuProfiler.end(drawCmdBuffers[i], gpuScope);
 
 				/*
 					Third pass: SSAO blur
@@ -575,6 +660,7 @@ public:
 				renderPassBeginInfo.renderArea.extent.width = frameBuffers.ssaoBlur.width;
 				renderPassBeginInfo.renderArea.extent.height = frameBuffers.ssaoBlur.height;
 
+				gpuScope = gpuProfiler.begin(drawCmdBuffers[i], "SSAO blur", i);
 				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 				viewport = vks::initializers::viewport((float)frameBuffers.ssaoBlur.width, (float)frameBuffers.ssaoBlur.height, 0.0f, 1.0f);
@@ -587,6 +673,7 @@ public:
 				vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
 
 				vkCmdEndRenderPass(drawCmdBuffers[i]);
+				gpuProfiler.end(drawCmdBuffers[i], gpuScope);
 			}
 
 			/*
@@ -609,6 +696,7 @@ public:
 				renderPassBeginInfo.clearValueCount = 2;
 				renderPassBeginInfo.pClearValues = clearValues.data();
 
+				vks::GpuProfiler::Scope gpuScope(gpuProfiler, drawCmdBuffers[i], "Composition", i);
 				vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 				VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
@@ -663,6 +751,12 @@ public:
 		pipelineLayoutCreateInfo.pSetLayouts = setLayouts.data();
 		pipelineLayoutCreateInfo.setLayoutCount = 2;
 		VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.gBuffer));
+		if (gpuDrivenSupported) {
+			// Set 1 holds the model's draw data, materials and texture array
+			const std::vector<VkDescriptorSetLayout> setLayoutsIndirect = { descriptorSetLayouts.gBuffer, scene.indirect.descriptorSetLayout };
+			pipelineLayoutCreateInfo.pSetLayouts = setLayoutsIndirect.data();
+			VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayouts.gBufferIndirect));
+		}
 		descriptorAllocInfo.pSetLayouts = &descriptorSetLayouts.gBuffer;
 		VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorAllocInfo, &descriptorSets.floor));
 		writeDescriptorSets = {
@@ -830,6 +924,12 @@ public:
 			shaderStages[0] = loadShader(getShadersPath() + "ssao/gbuffer.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
 			shaderStages[1] = loadShader(getShadersPath() + "ssao/gbuffer.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
 			VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.offscreen));
+			if (gpuDrivenSupported) {
+				pipelineCreateInfo.layout = pipelineLayouts.gBufferIndirect;
+				shaderStages[0] = loadShader(getShadersPath() + "ssao/gbufferindirect.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+				shaderStages[1] = loadShader(getShadersPath() + "ssao/gbufferindirect.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+				VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.offscreenIndirect));
+			}
 		}
 	}
 
@@ -940,6 +1040,7 @@ public:
 		if (!prepared) {
 			return;
 		}
+		scene.updateCulling(camera.matrices.perspective * camera.matrices.view * uboSceneParams.model);
 		draw();
 		if (camera.updated) {
 			updateUniformBufferMatrices();
@@ -959,6 +1060,17 @@ public:
 			if (overlay->checkBox("SSAO pass only", &uboSSAOParams.ssaoOnly)) {
 				updateUniformBufferSSAOParams();
 			}
+			if (gpuDrivenSupported) {
+				if (overlay->checkBox("GPU driven G-Buffer", &gpuDriven)) {
+					buildCommandBuffers();
+				}
+				if (gpuDriven && overlay->checkBox("GPU culling", &gpuCulling)) {
+					buildCommandBuffers();
+				}
+			}
+		}
+		if (gpuDriven && gpuCulling && overlay->header("Statistics")) {
+			overlay->text("Visible draws: %d / %d", scene.getVisibleDrawCount(), static_cast<uint32_t>(scene.indirect.drawCommands.size()));
 		}
 	}
 };